@@ -0,0 +1,114 @@
+#include "access_metrics.h"
+
+// --- Module Variables ---
+struct AccessHistogram {
+  uint32_t buckets[ACCESS_HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t max_us;
+};
+AccessHistogram access_histograms[ACCESS_STAGE_COUNT];
+
+// The reader task records on core 0 while loop() records and reads on core 1
+portMUX_TYPE access_metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+const char* const access_stage_names[ACCESS_STAGE_COUNT] = {
+  "read", "queue", "lookup", "2fa_roundtrip", "2fa_pickup", "gate", "total"
+};
+
+
+// --- Helpers ---
+int accessBucketIndex(uint32_t value_us) {
+  if (value_us < 4) return (int)value_us;
+  int msb = 31 - __builtin_clz(value_us);
+  int index = (msb - 1) * 4 + (int)((value_us >> (msb - 2)) & 3);
+  return index < ACCESS_HISTOGRAM_BUCKETS ? index : ACCESS_HISTOGRAM_BUCKETS - 1;
+}
+
+// Largest value that falls in a bucket
+uint32_t accessBucketUpperBound(int index) {
+  if (index < 4) return (uint32_t)index;
+  if (index == ACCESS_HISTOGRAM_BUCKETS - 1) return UINT32_MAX;
+  int msb = index / 4 + 1;
+  uint32_t next_lower = (uint32_t)(4 + index % 4 + 1) << (msb - 2);
+  return next_lower - 1;
+}
+
+
+// --- Function Implementations ---
+
+void accessMetricRecord(AccessStage stage, uint32_t duration_us) {
+  if (stage >= ACCESS_STAGE_COUNT) return;
+  int index = accessBucketIndex(duration_us);
+  AccessHistogram& histogram = access_histograms[stage];
+  portENTER_CRITICAL(&access_metrics_lock);
+  histogram.buckets[index]++;
+  histogram.count++;
+  if (duration_us > histogram.max_us) histogram.max_us = duration_us;
+  portEXIT_CRITICAL(&access_metrics_lock);
+}
+
+void accessMetricSince(AccessStage stage, uint32_t start_us) {
+  if (start_us != 0) accessMetricRecord(stage, micros() - start_us);
+}
+
+void getAccessStageStats(AccessStage stage, AccessStageStats& stats_out) {
+  memset(&stats_out, 0, sizeof(stats_out));
+  if (stage >= ACCESS_STAGE_COUNT) return;
+
+  AccessHistogram copy;
+  portENTER_CRITICAL(&access_metrics_lock);
+  copy = access_histograms[stage];
+  portEXIT_CRITICAL(&access_metrics_lock);
+
+  stats_out.count = copy.count;
+  stats_out.max_us = copy.max_us;
+  if (copy.count == 0) return;
+
+  // Rank of each percentile, rounded up so p99 of a small sample is its maximum
+  uint64_t rank50 = ((uint64_t)copy.count * 50 + 99) / 100;
+  uint64_t rank95 = ((uint64_t)copy.count * 95 + 99) / 100;
+  uint64_t rank99 = ((uint64_t)copy.count * 99 + 99) / 100;
+  uint64_t seen = 0;
+  bool have50 = false;
+  bool have95 = false;
+  for (int i = 0; i < ACCESS_HISTOGRAM_BUCKETS; i++) {
+    if (copy.buckets[i] == 0) continue;
+    seen += copy.buckets[i];
+    // The maximum is exact and tighter than the upper bound of its bucket
+    uint32_t bound = min(accessBucketUpperBound(i), copy.max_us);
+    if (!have50 && seen >= rank50) {
+      stats_out.p50_us = bound;
+      have50 = true;
+    }
+    if (!have95 && seen >= rank95) {
+      stats_out.p95_us = bound;
+      have95 = true;
+    }
+    if (seen >= rank99) {
+      stats_out.p99_us = bound;
+      break;
+    }
+  }
+}
+
+const char* getAccessStageName(AccessStage stage) {
+  return stage < ACCESS_STAGE_COUNT ? access_stage_names[stage] : "unknown";
+}
+
+void resetAccessMetrics() {
+  portENTER_CRITICAL(&access_metrics_lock);
+  memset(access_histograms, 0, sizeof(access_histograms));
+  portEXIT_CRITICAL(&access_metrics_lock);
+}
+
+void printAccessMetrics() {
+  Serial.println("--- Access Latency (us) ---");
+  Serial.println("stage              count        p50        p95        p99        max");
+  for (int i = 0; i < ACCESS_STAGE_COUNT; i++) {
+    AccessStageStats stats;
+    getAccessStageStats((AccessStage)i, stats);
+    Serial.printf("%-14s %9u %10u %10u %10u %10u\n", access_stage_names[i], stats.count,
+                  stats.p50_us, stats.p95_us, stats.p99_us, stats.max_us);
+  }
+  Serial.println("---------------------------");
+}
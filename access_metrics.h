@@ -0,0 +1,69 @@
+#ifndef ACCESS_METRICS_H
+#define ACCESS_METRICS_H
+
+#include <Arduino.h>
+
+// --- Constants ---
+// Log-linear buckets over microseconds: values below 4 us get a bucket each, then every
+// power of two is split in 4 sub-buckets (relative error <= 25%). The last bucket also
+// takes everything above ~67 s.
+#define ACCESS_HISTOGRAM_BUCKETS 100
+
+// Stages of one access, from the touch on the reader to the barrier moving
+enum AccessStage : uint8_t {
+  ACCESS_STAGE_READ,           // readIButton() search and CRC, on the reader task
+  ACCESS_STAGE_QUEUE,          // Touch read -> popped by loop()
+  ACCESS_STAGE_LOOKUP,         // getIButtonRecord() for the scanned ID
+  ACCESS_STAGE_2FA_ROUNDTRIP,  // publish2FARequest() -> auth/2fa_response handled
+  ACCESS_STAGE_2FA_PICKUP,     // 2FA response handled -> taken by the proactive check
+  ACCESS_STAGE_GATE,           // processEntry()/processExit(), gate command and registry commit
+  ACCESS_STAGE_TOTAL,          // Touch read -> gate commanded open
+  ACCESS_STAGE_COUNT
+};
+
+// Summary of one stage histogram. Percentiles are bucket upper bounds, in microseconds.
+struct AccessStageStats {
+  uint32_t count;
+  uint32_t p50_us;
+  uint32_t p95_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+};
+
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Adds one duration to the histogram of a stage.
+ * Constant time (one bucket increment under a spinlock) and safe from any task,
+ * so it stays enabled in production.
+ */
+void accessMetricRecord(AccessStage stage, uint32_t duration_us);
+
+/**
+ * @brief Adds the time elapsed since start_us (a micros() value) to a stage.
+ * Does nothing when start_us is 0, which marks an unknown start.
+ */
+void accessMetricSince(AccessStage stage, uint32_t start_us);
+
+/**
+ * @brief Computes the summary of a stage from a consistent copy of its histogram.
+ */
+void getAccessStageStats(AccessStage stage, AccessStageStats& stats_out);
+
+/**
+ * @brief Short stage name, used in serial dumps and as the metrics sub-topic.
+ */
+const char* getAccessStageName(AccessStage stage);
+
+/**
+ * @brief Clears every histogram.
+ */
+void resetAccessMetrics();
+
+/**
+ * @brief Prints count, p50/p95/p99 and max of every stage to the Serial monitor.
+ */
+void printAccessMetrics();
+
+#endif // ACCESS_METRICS_H
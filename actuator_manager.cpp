@@ -0,0 +1,140 @@
+#include "actuator_manager.h"
+#include <ESP32Servo.h>
+
+// --- Module Variables ---
+struct ActuatorLane {
+  Servo gate_servo;
+  ActuatorConfig config;
+
+  // Gate sequence: open -> hold -> close
+  bool gate_open;
+  unsigned long gate_opened_at_ms;
+  unsigned long gate_hold_ms;
+
+  // Buzzer sequence: beep_steps_left counts on and off phases still to play
+  uint8_t buzzer_owner;  // Lane whose sequence drives this lane's buzzer pin
+  uint8_t beep_steps_left;
+  bool beep_on;
+  unsigned long beep_phase_start_ms;
+  unsigned long beep_on_ms;
+  unsigned long beep_off_ms;
+};
+ActuatorLane actuator_lanes[ACTUATOR_MAX_LANES];
+uint8_t actuator_lane_count = 0;
+
+
+// --- Helpers ---
+void setBuzzer(ActuatorLane& lane, bool on) {
+  lane.beep_on = on;
+  digitalWrite(lane.config.buzzer_pin, on ? HIGH : LOW);
+}
+
+// Lane whose buzzer sequence plays on the pin of the given lane
+ActuatorLane& buzzerLane(uint8_t lane) {
+  return actuator_lanes[actuator_lanes[lane].buzzer_owner];
+}
+
+int attachLane(const ActuatorConfig& config) {
+  if (actuator_lane_count >= ACTUATOR_MAX_LANES) return -1;
+  uint8_t index = actuator_lane_count++;
+  ActuatorLane& lane = actuator_lanes[index];
+  lane.config = config;
+  lane.gate_servo.attach(config.servo_pin);
+  gateCloseNow(index);  // Ensure gate starts closed
+
+  lane.buzzer_owner = index;
+  for (uint8_t i = 0; i < index; i++) {
+    if (actuator_lanes[i].config.buzzer_pin == config.buzzer_pin) {
+      lane.buzzer_owner = actuator_lanes[i].buzzer_owner;
+      break;
+    }
+  }
+  if (lane.buzzer_owner == index) {
+    pinMode(config.buzzer_pin, OUTPUT);
+    lane.beep_steps_left = 0;
+    setBuzzer(lane, false);  // Ensure buzzer is off initially
+  }
+  return index;
+}
+
+
+// --- Function Implementations ---
+
+void setupActuatorManager(const ActuatorConfig& config) {
+  actuator_lane_count = 0;
+  attachLane(config);
+}
+
+int addActuatorLane(const ActuatorConfig& config) {
+  int lane = attachLane(config);
+  if (lane < 0) {
+    Serial.println("Error: No room for another actuator lane.");
+  }
+  return lane;
+}
+
+void loopActuatorManager() {
+  unsigned long now = millis();
+
+  for (uint8_t i = 0; i < actuator_lane_count; i++) {
+    ActuatorLane& lane = actuator_lanes[i];
+
+    // Gate: close once the hold time has elapsed
+    if (lane.gate_open && now - lane.gate_opened_at_ms >= lane.gate_hold_ms) {
+      gateCloseNow(i);
+    }
+
+    // Buzzer: move to the next phase when the current one has elapsed
+    if (lane.buzzer_owner == i && lane.beep_steps_left > 0) {
+      unsigned long phase_ms = lane.beep_on ? lane.beep_on_ms : lane.beep_off_ms;
+      if (now - lane.beep_phase_start_ms >= phase_ms) {
+        lane.beep_steps_left--;
+        lane.beep_phase_start_ms = now;
+        setBuzzer(lane, lane.beep_steps_left > 0 && !lane.beep_on);
+      }
+    }
+  }
+}
+
+void gateOpenFor(unsigned long hold_ms, uint8_t lane) {
+  if (lane >= actuator_lane_count) return;
+  ActuatorLane& l = actuator_lanes[lane];
+  if (!l.gate_open) {
+    Serial.printf("Gate %u: opening.\n", lane);
+    l.gate_servo.write(l.config.servo_open_angle);
+    l.gate_open = true;
+  }
+  l.gate_opened_at_ms = millis();
+  l.gate_hold_ms = hold_ms;
+}
+
+void gateCloseNow(uint8_t lane) {
+  if (lane >= actuator_lane_count) return;
+  ActuatorLane& l = actuator_lanes[lane];
+  Serial.printf("Gate %u: closing.\n", lane);
+  l.gate_servo.write(l.config.servo_close_angle);
+  l.gate_open = false;
+}
+
+bool isGateOpen(uint8_t lane) {
+  return lane < actuator_lane_count && actuator_lanes[lane].gate_open;
+}
+
+void buzzerPlay(uint8_t count, unsigned long on_ms, unsigned long off_ms, uint8_t lane) {
+  if (lane >= actuator_lane_count) return;
+  ActuatorLane& l = buzzerLane(lane);
+  if (count == 0) {
+    l.beep_steps_left = 0;
+    setBuzzer(l, false);
+    return;
+  }
+  l.beep_on_ms = on_ms;
+  l.beep_off_ms = off_ms;
+  l.beep_steps_left = count * 2 - 1;  // No pause after the last beep
+  l.beep_phase_start_ms = millis();
+  setBuzzer(l, true);
+}
+
+bool isBuzzerBusy(uint8_t lane) {
+  return lane < actuator_lane_count && buzzerLane(lane).beep_steps_left > 0;
+}
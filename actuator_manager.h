@@ -0,0 +1,70 @@
+#ifndef ACTUATOR_MANAGER_H
+#define ACTUATOR_MANAGER_H
+
+#include <Arduino.h>
+
+#define ACTUATOR_MAX_LANES 2  // Gates (servo and buzzer pairs) one controller can drive
+
+// Actuator configuration passed from main .ino
+struct ActuatorConfig {
+    uint8_t servo_pin;
+    int servo_open_angle;
+    int servo_close_angle;
+    uint8_t buzzer_pin;
+};
+
+// Public Function Declarations
+// Every lane has its own gate and buzzer sequence. Lanes whose buzzer_pin is the same
+// share one buzzer sequence, so a later pattern replaces the one in progress.
+
+/**
+ * @brief Attaches the gate servo and buzzer of lane 0 and leaves the gate closed and the buzzer off.
+ * Must be called in the main setup().
+ * @param config ActuatorConfig struct with pins and servo angles.
+ */
+void setupActuatorManager(const ActuatorConfig& config);
+
+/**
+ * @brief Attaches the gate and buzzer of one more lane, gate closed and buzzer off.
+ * Call after setupActuatorManager(), once per extra lane.
+ * @return The lane number, or -1 if ACTUATOR_MAX_LANES lanes are already set up.
+ */
+int addActuatorLane(const ActuatorConfig& config);
+
+/**
+ * @brief Advances the gate and buzzer sequences of every lane. Never blocks.
+ * Should be called on every pass of the main loop().
+ */
+void loopActuatorManager();
+
+/**
+ * @brief Opens the gate of a lane and schedules it to close after hold_ms.
+ * Calling it again while the gate is open extends the hold from now.
+ * @param hold_ms Time the gate stays open, in milliseconds.
+ */
+void gateOpenFor(unsigned long hold_ms, uint8_t lane = 0);
+
+/**
+ * @brief Closes the gate of a lane immediately and cancels any pending close.
+ */
+void gateCloseNow(uint8_t lane = 0);
+
+/**
+ * @brief Tells whether the gate of a lane is currently open (or holding open).
+ */
+bool isGateOpen(uint8_t lane = 0);
+
+/**
+ * @brief Starts a beep pattern on the buzzer of a lane, replacing the one in progress.
+ * @param count Number of beeps.
+ * @param on_ms Duration of each beep, in milliseconds.
+ * @param off_ms Pause between beeps, in milliseconds.
+ */
+void buzzerPlay(uint8_t count, unsigned long on_ms, unsigned long off_ms = 0, uint8_t lane = 0);
+
+/**
+ * @brief Tells whether a beep pattern is still playing on the buzzer of a lane.
+ */
+bool isBuzzerBusy(uint8_t lane = 0);
+
+#endif // ACTUATOR_MANAGER_H
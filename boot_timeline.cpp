@@ -0,0 +1,53 @@
+#include "boot_timeline.h"
+
+// --- Module Variables ---
+const char* boot_stage_names[BOOT_TIMELINE_MAX_STAGES];
+unsigned long boot_stage_ms[BOOT_TIMELINE_MAX_STAGES];
+int boot_stage_count = 0;
+unsigned long boot_scan_ready_ms = 0;
+
+
+// --- Function Implementations ---
+
+void bootMark(const char* stage) {
+  unsigned long now = millis();
+  if (boot_stage_count < BOOT_TIMELINE_MAX_STAGES) {
+    boot_stage_names[boot_stage_count] = stage;
+    boot_stage_ms[boot_stage_count] = now;
+    boot_stage_count++;
+  }
+  Serial.printf("Boot: %s done at %lu ms\n", stage, now);
+}
+
+void bootMarkScanReady() {
+  boot_scan_ready_ms = millis();
+  Serial.printf("Boot: ready to scan at %lu ms\n", boot_scan_ready_ms);
+}
+
+unsigned long getBootScanReadyMs() {
+  return boot_scan_ready_ms;
+}
+
+int getBootStageCount() {
+  return boot_stage_count;
+}
+
+const char* getBootStageName(int index) {
+  return boot_stage_names[index];
+}
+
+unsigned long getBootStageMs(int index) {
+  return boot_stage_ms[index];
+}
+
+void printBootTimeline() {
+  Serial.println("--- Boot Timeline ---");
+  unsigned long previous_ms = 0;
+  for (int i = 0; i < boot_stage_count; i++) {
+    Serial.printf("%-10s at %6lu ms (+%lu ms)\n", boot_stage_names[i], boot_stage_ms[i],
+                  boot_stage_ms[i] - previous_ms);
+    previous_ms = boot_stage_ms[i];
+  }
+  Serial.printf("Time to first scan: %lu ms\n", boot_scan_ready_ms);
+  Serial.println("---------------------");
+}
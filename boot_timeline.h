@@ -0,0 +1,37 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+
+// --- Constants ---
+#define BOOT_TIMELINE_MAX_STAGES 8
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Records the end of a boot stage at the current millis() (time since power-up).
+ * The stage name must be a string literal; it is stored by pointer and later used as
+ * a JSON key in the boot report.
+ */
+void bootMark(const char* stage);
+
+/**
+ * @brief Records the moment the reader task starts polling: the time-to-first-scan figure.
+ */
+void bootMarkScanReady();
+
+/**
+ * @brief Time-to-first-scan in milliseconds since power-up, 0 if not reached yet.
+ */
+unsigned long getBootScanReadyMs();
+
+int getBootStageCount();
+const char* getBootStageName(int index);
+unsigned long getBootStageMs(int index);
+
+/**
+ * @brief Prints every stage with its timestamp and duration to the Serial monitor.
+ */
+void printBootTimeline();
+
+#endif // BOOT_TIMELINE_H
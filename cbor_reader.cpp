@@ -0,0 +1,172 @@
+#include "cbor_reader.h"
+
+// --- Constants ---
+const int CBOR_MAX_KEY_LEN = 32;   // Longer keys cannot match any field and are skipped
+const int CBOR_MAX_DEPTH = 8;      // Nesting allowed inside skipped values
+
+enum CborMajor : uint8_t {
+  CBOR_MAJOR_UINT = 0,
+  CBOR_MAJOR_NEGINT = 1,
+  CBOR_MAJOR_BYTES = 2,
+  CBOR_MAJOR_TEXT = 3,
+  CBOR_MAJOR_ARRAY = 4,
+  CBOR_MAJOR_MAP = 5,
+  CBOR_MAJOR_TAG = 6,
+  CBOR_MAJOR_SIMPLE = 7  // false, true, null, undefined and floats
+};
+
+
+// --- Cursor Helpers ---
+struct CborCursor {
+  const byte* pos;
+  const byte* end;
+};
+
+/**
+ * Reads the initial byte and its argument. For major type 7 the argument of a float is
+ * its raw bits, which is enough to skip it. Indefinite lengths and reserved values fail.
+ */
+bool cborReadHead(CborCursor& c, uint8_t& major, uint64_t& value) {
+  if (c.pos >= c.end) return false;
+  byte initial = *c.pos++;
+  major = initial >> 5;
+  byte info = initial & 0x1F;
+  if (info < 24) {
+    value = info;
+    return true;
+  }
+  if (info > 27) return false;  // 28-30 reserved, 31 indefinite length
+  int bytes = 1 << (info - 24);
+  if (c.end - c.pos < bytes) return false;
+  value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value = (value << 8) | *c.pos++;
+  }
+  return true;
+}
+
+// Moves past length bytes of string data
+bool cborSkipData(CborCursor& c, uint64_t length) {
+  if ((uint64_t)(c.end - c.pos) < length) return false;
+  c.pos += length;
+  return true;
+}
+
+bool cborSkipItem(CborCursor& c, int depth) {
+  uint8_t major;
+  uint64_t value;
+  if (depth > CBOR_MAX_DEPTH || !cborReadHead(c, major, value)) return false;
+  switch (major) {
+    case CBOR_MAJOR_BYTES:
+    case CBOR_MAJOR_TEXT:
+      return cborSkipData(c, value);
+    case CBOR_MAJOR_ARRAY:
+    case CBOR_MAJOR_MAP: {
+      uint64_t items = major == CBOR_MAJOR_MAP ? value * 2 : value;
+      if (items > (uint64_t)(c.end - c.pos)) return false;  // Every item takes at least one byte
+      for (uint64_t i = 0; i < items; i++) {
+        if (!cborSkipItem(c, depth + 1)) return false;
+      }
+      return true;
+    }
+    case CBOR_MAJOR_TAG:
+      return cborSkipItem(c, depth + 1);
+    default:  // Integers and simple values have no content after the head
+      return true;
+  }
+}
+
+// Uppercase hex of a byte string, like ibuttonBytesToHex()
+bool cborBytesToHex(const byte* data, uint64_t length, char* out, size_t out_size) {
+  static const char hex_digits[] = "0123456789ABCDEF";
+  if (length * 2 + 1 > out_size) return false;
+  for (uint64_t i = 0; i < length; i++) {
+    out[i * 2] = hex_digits[data[i] >> 4];
+    out[i * 2 + 1] = hex_digits[data[i] & 0x0F];
+  }
+  out[length * 2] = '\0';
+  return true;
+}
+
+/**
+ * Reads the value at the cursor into field when it matches the field type,
+ * otherwise just skips it. field may be null.
+ */
+bool cborReadValue(CborCursor& c, JsonField* field) {
+  if (field == nullptr) return cborSkipItem(c, 0);
+
+  CborCursor start = c;
+  uint8_t major;
+  uint64_t value;
+  if (!cborReadHead(c, major, value)) return false;
+
+  switch (major) {
+    case CBOR_MAJOR_UINT:
+      if (field->type == JSON_FIELD_UINT && value <= UINT32_MAX) {
+        *(uint32_t*)field->out = (uint32_t)value;
+        field->found = true;
+      }
+      return true;
+
+    case CBOR_MAJOR_TEXT:
+    case CBOR_MAJOR_BYTES: {
+      const byte* data = c.pos;
+      if (!cborSkipData(c, value)) return false;
+      if (field->type != JSON_FIELD_STRING) return true;
+      char* out = (char*)field->out;
+      if (major == CBOR_MAJOR_BYTES) {
+        field->found = cborBytesToHex(data, value, out, field->out_size);
+      } else if (value < field->out_size && memchr(data, '\0', value) == nullptr) {
+        memcpy(out, data, value);
+        out[value] = '\0';
+        field->found = true;
+      }
+      return true;
+    }
+
+    case CBOR_MAJOR_SIMPLE:
+      if (field->type == JSON_FIELD_BOOL && (value == 20 || value == 21)) {  // false, true
+        *(bool*)field->out = value == 21;
+        field->found = true;
+      }
+      return true;
+
+    default:
+      c = start;
+      return cborSkipItem(c, 0);
+  }
+}
+
+
+// --- Function Implementations ---
+
+bool cborReadMap(const byte* data, unsigned int length, JsonField* fields, int field_count) {
+  for (int i = 0; i < field_count; i++) {
+    fields[i].found = false;
+  }
+  if (data == nullptr) return false;
+
+  CborCursor c = { data, data + length };
+  uint8_t major;
+  uint64_t members;
+  if (!cborReadHead(c, major, members) || major != CBOR_MAJOR_MAP) return false;
+  if (members > length) return false;
+
+  for (uint64_t m = 0; m < members; m++) {
+    uint64_t key_len;
+    if (!cborReadHead(c, major, key_len) || major != CBOR_MAJOR_TEXT) return false;
+    const byte* key = c.pos;
+    if (!cborSkipData(c, key_len)) return false;
+
+    JsonField* field = nullptr;
+    for (int i = 0; key_len <= CBOR_MAX_KEY_LEN && i < field_count && field == nullptr; i++) {
+      if (strlen(fields[i].key) == key_len && memcmp(fields[i].key, key, key_len) == 0) field = &fields[i];
+    }
+    if (!cborReadValue(c, field)) return false;
+  }
+  return c.pos == c.end;  // Nothing may follow the map
+}
+
+bool cborLooksLikeMap(const byte* data, unsigned int length) {
+  return data != nullptr && length > 0 && (data[0] >> 5) == CBOR_MAJOR_MAP;
+}
@@ -0,0 +1,32 @@
+#ifndef CBOR_READER_H
+#define CBOR_READER_H
+
+#include <Arduino.h>
+#include "json_reader.h"  // JsonField: the same field descriptions serve both formats
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Extracts typed top-level fields from a CBOR map (RFC 8949), the binary
+ * counterpart of jsonReadObject(). Works in place and never allocates. Keys must be
+ * text strings; unknown keys, nested items and tags are skipped. A JSON_FIELD_STRING
+ * field accepts a text string, or a byte string which is stored as uppercase hex (so a
+ * raw 8-byte iButton ID reads the same as its hex form in JSON). A field whose value has
+ * the wrong type, or that does not fit in its buffer, is left with found = false.
+ * Only definite-length items are accepted.
+ * @param data Payload bytes.
+ * @param length Payload length.
+ * @param fields Fields to extract.
+ * @param field_count Number of entries in fields.
+ * @return true if the payload is exactly one well-formed map, false otherwise
+ *         (fields found before the error keep their values).
+ */
+bool cborReadMap(const byte* data, unsigned int length, JsonField* fields, int field_count);
+
+/**
+ * @brief True if a payload starts like a CBOR map rather than a JSON object.
+ * JSON objects start with '{' or whitespace, which are never CBOR map headers.
+ */
+bool cborLooksLikeMap(const byte* data, unsigned int length);
+
+#endif // CBOR_READER_H
@@ -0,0 +1,121 @@
+#include "cbor_writer.h"
+
+// --- Constants ---
+const byte CBOR_MAJOR_UINT = 0;
+const byte CBOR_MAJOR_BYTES = 2;
+const byte CBOR_MAJOR_TEXT = 3;
+const byte CBOR_MAJOR_ARRAY = 4;
+const byte CBOR_MAJOR_MAP = 5;
+const byte CBOR_FALSE = 0xF4;
+const byte CBOR_TRUE = 0xF5;
+
+
+// --- Helpers ---
+void cborPutByte(CborWriter& w, byte value) {
+  if (!w.ok) return;
+  if (w.len >= w.size) {
+    w.ok = false;
+    return;
+  }
+  w.buf[w.len++] = value;
+}
+
+void cborPutData(CborWriter& w, const byte* data, size_t length) {
+  if (!w.ok) return;
+  if (w.size - w.len < length) {
+    w.ok = false;
+    return;
+  }
+  memcpy(w.buf + w.len, data, length);
+  w.len += length;
+}
+
+// Initial byte plus the argument in the shortest form (0, 1, 2 or 4 bytes, big-endian)
+void cborPutHead(CborWriter& w, byte major, uint32_t value) {
+  byte type = major << 5;
+  if (value < 24) {
+    cborPutByte(w, type | value);
+  } else if (value <= 0xFF) {
+    cborPutByte(w, type | 24);
+    cborPutByte(w, value);
+  } else if (value <= 0xFFFF) {
+    cborPutByte(w, type | 25);
+    cborPutByte(w, value >> 8);
+    cborPutByte(w, value);
+  } else {
+    cborPutByte(w, type | 26);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      cborPutByte(w, value >> shift);
+    }
+  }
+}
+
+void cborPutText(CborWriter& w, const char* text) {
+  size_t length = strlen(text);
+  cborPutHead(w, CBOR_MAJOR_TEXT, length);
+  cborPutData(w, (const byte*)text, length);
+}
+
+void cborPutKey(CborWriter& w, const char* key) {
+  if (w.in_element) w.element_count++;
+  else w.count++;
+  cborPutText(w, key);
+}
+
+
+// --- Function Implementations ---
+
+void cborBeginMap(CborWriter& w, byte* buf, size_t size) {
+  w.buf = buf;
+  w.size = size;
+  w.len = 0;
+  w.ok = true;
+  w.count = 0;
+  w.in_element = false;
+  cborPutByte(w, CBOR_MAJOR_MAP << 5);  // Member count filled in by cborEndMap()
+}
+
+void cborAddString(CborWriter& w, const char* key, const char* value) {
+  cborPutKey(w, key);
+  cborPutText(w, value);
+}
+
+void cborAddBytes(CborWriter& w, const char* key, const byte* data, size_t length) {
+  cborPutKey(w, key);
+  cborPutHead(w, CBOR_MAJOR_BYTES, length);
+  cborPutData(w, data, length);
+}
+
+void cborAddUInt(CborWriter& w, const char* key, uint32_t value) {
+  cborPutKey(w, key);
+  cborPutHead(w, CBOR_MAJOR_UINT, value);
+}
+
+void cborAddBool(CborWriter& w, const char* key, bool value) {
+  cborPutKey(w, key);
+  cborPutByte(w, value ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void cborBeginArray(CborWriter& w, const char* key, uint32_t items) {
+  cborPutKey(w, key);
+  cborPutHead(w, CBOR_MAJOR_ARRAY, items);
+}
+
+void cborBeginElement(CborWriter& w) {
+  w.in_element = true;
+  w.element_pos = w.len;
+  w.element_count = 0;
+  cborPutByte(w, CBOR_MAJOR_MAP << 5);  // Member count filled in by cborEndElement()
+}
+
+void cborEndElement(CborWriter& w) {
+  w.in_element = false;
+  if (w.element_count > CBOR_MAX_MAP_MEMBERS) w.ok = false;
+  if (w.ok) w.buf[w.element_pos] = (CBOR_MAJOR_MAP << 5) | w.element_count;
+}
+
+bool cborEndMap(CborWriter& w) {
+  if (w.count > CBOR_MAX_MAP_MEMBERS) w.ok = false;
+  if (w.ok) w.buf[0] = (CBOR_MAJOR_MAP << 5) | w.count;
+  return w.ok;
+}
@@ -0,0 +1,69 @@
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+#include <Arduino.h>
+
+// --- Constants ---
+#define CBOR_MAX_MAP_MEMBERS 23  // Map headers are a single byte, patched when the map is closed
+
+// Writes one CBOR map (RFC 8949) with text keys into a caller-provided buffer.
+// The binary counterpart of JsonWriter: same members, fewer bytes, and likewise flat
+// except for arrays of flat maps. Never allocates; if the buffer is too small the
+// writer stops and cborEndMap() returns false.
+struct CborWriter {
+  byte* buf;
+  size_t size;
+  size_t len;             // Encoded length so far
+  bool ok;
+  uint8_t count;          // Members written to the top-level map
+  bool in_element;        // Between cborBeginElement() and cborEndElement()
+  size_t element_pos;     // Header of the open element map
+  uint8_t element_count;  // Members written to it
+};
+
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Starts a map in buf.
+ * @param buf Destination buffer. The result is binary and not NUL-terminated; use len.
+ * @param size Size of buf in bytes.
+ */
+void cborBeginMap(CborWriter& w, byte* buf, size_t size);
+
+/**
+ * @brief Adds key: text string.
+ */
+void cborAddString(CborWriter& w, const char* key, const char* value);
+
+/**
+ * @brief Adds key: byte string (e.g. a raw iButton ID instead of its hex form).
+ */
+void cborAddBytes(CborWriter& w, const char* key, const byte* data, size_t length);
+
+/**
+ * @brief Adds key: unsigned integer, in the shortest encoding.
+ */
+void cborAddUInt(CborWriter& w, const char* key, uint32_t value);
+
+/**
+ * @brief Adds key: true or false.
+ */
+void cborAddBool(CborWriter& w, const char* key, bool value);
+
+/**
+ * @brief Starts key: array of items flat maps. CBOR arrays carry their length up front,
+ * so exactly items elements must follow, each between cborBeginElement() and
+ * cborEndElement().
+ */
+void cborBeginArray(CborWriter& w, const char* key, uint32_t items);
+void cborBeginElement(CborWriter& w);
+void cborEndElement(CborWriter& w);
+
+/**
+ * @brief Closes the map by writing the member count into its header.
+ * @return true if the whole map fit in the buffer and has at most CBOR_MAX_MAP_MEMBERS members.
+ */
+bool cborEndMap(CborWriter& w);
+
+#endif // CBOR_WRITER_H
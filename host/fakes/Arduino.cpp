@@ -0,0 +1,223 @@
+#include <Arduino.h>
+#include "host_fakes.h"
+#include <stdarg.h>
+#include <random>
+
+// --- Module Variables ---
+HardwareSerial Serial;
+EspClass ESP;
+
+std::string serial_input;
+bool serial_echo = true;
+
+const int HOST_PIN_COUNT = 64;
+uint8_t pin_levels[HOST_PIN_COUNT];
+uint32_t pin_rising_edges[HOST_PIN_COUNT];
+void (*pin_interrupts[HOST_PIN_COUNT])(void);
+
+std::mt19937 host_random(1);  // Fixed seed: same run, same backoff jitter and request IDs
+
+
+// --- String ---
+
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base) {
+  char text[40];
+  if (base == HEX) snprintf(text, sizeof(text), "%lx", (unsigned long)value);
+  else snprintf(text, sizeof(text), "%ld", value);
+  s_ = text;
+}
+
+String::String(unsigned long value, unsigned char base) {
+  char text[40];
+  snprintf(text, sizeof(text), base == HEX ? "%lx" : "%lu", value);
+  s_ = text;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > s_.size()) return String();
+  if (to > s_.size()) to = (unsigned int)s_.size();
+  return to > from ? String(s_.substr(from, to - from)) : String();
+}
+
+int String::indexOf(const char* text, unsigned int from) const {
+  size_t pos = s_.find(text, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String operator+(const String& a, const String& b) {
+  String result(a);
+  result += b;
+  return result;
+}
+
+String operator+(const String& a, const char* b) {
+  String result(a);
+  result += b;
+  return result;
+}
+
+String operator+(const char* a, const String& b) {
+  String result(a);
+  result += b;
+  return result;
+}
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return String(text);
+}
+
+
+// --- Print ---
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (size--) written += write(*buffer++);
+  return written;
+}
+
+size_t Print::print(long value, int base) {
+  if (base == DEC) {
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", value);
+    return write(text);
+  }
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char text[72];
+  char* p = &text[sizeof(text) - 1];
+  *p = '\0';
+  if (base < 2) base = DEC;
+  do {
+    int digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value > 0);
+  return write(p);
+}
+
+size_t Print::print(double value, int digits) {
+  char text[48];
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  return write(text);
+}
+
+size_t Print::printf(const char* format, ...) {
+  char text[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (length < 0) return 0;
+  if ((size_t)length < sizeof(text)) return write((const uint8_t*)text, length);
+
+  std::string long_text(length + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&long_text[0], long_text.size(), format, args);
+  va_end(args);
+  return write((const uint8_t*)long_text.data(), length);
+}
+
+
+// --- Serial ---
+
+int HardwareSerial::available() {
+  return (int)serial_input.size();
+}
+
+int HardwareSerial::read() {
+  if (serial_input.empty()) return -1;
+  int ch = (uint8_t)serial_input[0];
+  serial_input.erase(0, 1);
+  return ch;
+}
+
+size_t HardwareSerial::write(uint8_t ch) {
+  if (serial_echo) fputc(ch, stdout);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (serial_echo) fwrite(buffer, 1, size, stdout);
+  return size;
+}
+
+void hostSerialInput(const char* text) {
+  serial_input += text;
+}
+
+void hostSerialEcho(bool enabled) {
+  fflush(stdout);
+  serial_echo = enabled;
+}
+
+
+// --- ESP ---
+
+// Nothing on the host can reboot the process in place; a restart ends the run
+void EspClass::restart() {
+  fflush(stdout);
+  fprintf(stderr, "ESP.restart() called at %lu ms.\n", millis());
+  exit(3);
+}
+
+
+// --- GPIO ---
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= HOST_PIN_COUNT) return;
+  if (value == HIGH && pin_levels[pin] == LOW) pin_rising_edges[pin]++;
+  pin_levels[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < HOST_PIN_COUNT ? pin_levels[pin] : LOW;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+  if (pin < HOST_PIN_COUNT) pin_interrupts[pin] = handler;
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < HOST_PIN_COUNT) pin_interrupts[pin] = nullptr;
+}
+
+// Raises a pin's interrupt, as a falling edge would (called by the 1-Wire fake)
+void hostRaiseInterrupt(uint8_t pin) {
+  if (pin < HOST_PIN_COUNT && pin_interrupts[pin] != nullptr) pin_interrupts[pin]();
+}
+
+int hostPinLevel(uint8_t pin) {
+  return digitalRead(pin);
+}
+
+uint32_t hostPinRisingEdges(uint8_t pin) {
+  return pin < HOST_PIN_COUNT ? pin_rising_edges[pin] : 0;
+}
+
+
+// --- Randomness ---
+
+uint32_t esp_random() {
+  return (uint32_t)host_random();
+}
+
+long random(long max_value) {
+  return max_value > 0 ? (long)(esp_random() % (uint32_t)max_value) : 0;
+}
+
+long random(long min_value, long max_value) {
+  return max_value > min_value ? min_value + random(max_value - min_value) : min_value;
+}
+
+void randomSeed(unsigned long seed) {
+  host_random.seed((uint32_t)seed);
+}
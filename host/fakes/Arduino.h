@@ -0,0 +1,161 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host build only: the part of the ESP32 Arduino core the firmware uses, on top of the
+// C++ standard library. Time is virtual (see host_fakes.h); nothing here talks to hardware.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define DEC 10
+#define HEX 16
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToInterrupt(p) (p)
+
+// --- String ---
+class String {
+ public:
+  String() {}
+  String(const char* text) : s_(text ? text : "") {}
+  String(const std::string& text) : s_(text) {}
+  String(char ch) : s_(1, ch) {}
+  String(int value, unsigned char base = DEC);
+  String(unsigned int value, unsigned char base = DEC);
+  String(long value, unsigned char base = DEC);
+  String(unsigned long value, unsigned char base = DEC);
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  char charAt(unsigned int index) const { return index < s_.size() ? s_[index] : 0; }
+  String substring(unsigned int from, unsigned int to = 0xFFFFFFFF) const;
+  int indexOf(const char* text, unsigned int from = 0) const;
+  int indexOf(const String& text, unsigned int from = 0) const { return indexOf(text.c_str(), from); }
+  bool equals(const String& other) const { return s_ == other.s_; }
+  bool equalsIgnoreCase(const String& other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+
+  String& operator+=(const String& other) { s_ += other.s_; return *this; }
+  String& operator+=(const char* other) { s_ += other; return *this; }
+  String& operator+=(char other) { s_ += other; return *this; }
+  bool operator==(const String& other) const { return s_ == other.s_; }
+  bool operator!=(const String& other) const { return s_ != other.s_; }
+  bool operator==(const char* other) const { return s_ == other; }
+  bool operator!=(const char* other) const { return s_ != other; }
+
+ private:
+  std::string s_;
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const String& a, const char* b);
+String operator+(const char* a, const String& b);
+
+// --- IPAddress ---
+// Stored as on the ESP32: first octet in the low byte
+class IPAddress {
+ public:
+  IPAddress() : address_(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+    : address_(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  explicit IPAddress(uint32_t address) : address_(address) {}
+  operator uint32_t() const { return address_; }
+  uint8_t operator[](int index) const { return (uint8_t)(address_ >> (8 * index)); }
+  String toString() const;
+
+ private:
+  uint32_t address_;
+};
+
+// --- Print ---
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t ch) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+
+  size_t print(const char* text) { return write(text); }
+  size_t print(const String& text) { return write(text.c_str()); }
+  size_t print(char ch) { return write((uint8_t)ch); }
+  size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+  size_t print(const IPAddress& address) { return print(address.toString()); }
+
+  size_t println() { return write("\n"); }  // "\r\n" on the device
+  template <typename T> size_t println(const T& value) { return print(value) + println(); }
+  template <typename T> size_t println(const T& value, int format) { return print(value, format) + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Serial: output goes to stdout (see hostSerialEcho()), input comes from hostSerialInput()
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud) {}
+  int available();
+  int read();
+  size_t write(uint8_t ch) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  operator bool() const { return true; }
+};
+extern HardwareSerial Serial;
+
+// --- ESP ---
+class EspClass {
+ public:
+  void restart();
+  uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ULL; }
+  uint32_t getFreeHeap() { return 200 * 1024; }
+  uint32_t getMaxAllocHeap() { return 110 * 1024; }  // Largest free block with WiFi up
+};
+extern EspClass ESP;
+
+// --- Time, GPIO and randomness ---
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+long random(long max_value);
+long random(long min_value, long max_value);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+
+#endif // HOST_ARDUINO_H
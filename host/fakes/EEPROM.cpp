@@ -0,0 +1,44 @@
+#include <EEPROM.h>
+#include "host_fakes.h"
+
+// --- Module Variables ---
+EEPROMClass EEPROM;
+uint8_t eeprom_data[HOST_EEPROM_SIZE];
+bool eeprom_formatted = false;  // Erased flash reads back as 0xFF
+
+
+// --- Function Implementations ---
+
+uint8_t* EEPROMClass::data() {
+  return hostEepromData();
+}
+
+bool EEPROMClass::begin(size_t size) {
+  if (size == 0 || size > HOST_EEPROM_SIZE) return false;
+  size_ = size;
+  return true;
+}
+
+void EEPROMClass::end() {
+  size_ = 0;
+}
+
+bool EEPROMClass::commit() {
+  return size_ > 0;
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return address >= 0 && (size_t)address < size_ ? data()[address] : 0;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (address >= 0 && (size_t)address < size_) data()[address] = value;
+}
+
+uint8_t* hostEepromData() {
+  if (!eeprom_formatted) {
+    memset(eeprom_data, 0xFF, sizeof(eeprom_data));
+    eeprom_formatted = true;
+  }
+  return eeprom_data;
+}
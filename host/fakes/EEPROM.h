@@ -0,0 +1,35 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+// Host build only: emulated EEPROM in RAM, kept across begin()/end() like the flash copy
+// on the device (see hostEepromData())
+
+#include <Arduino.h>
+
+#define HOST_EEPROM_SIZE 4096
+
+class EEPROMClass {
+ public:
+  bool begin(size_t size);
+  void end();
+  bool commit();
+  size_t length() { return size_; }
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+
+  template <typename T> T& get(int address, T& value) {
+    if (address >= 0 && address + sizeof(T) <= size_) memcpy(&value, data() + address, sizeof(T));
+    return value;
+  }
+  template <typename T> const T& put(int address, const T& value) {
+    if (address >= 0 && address + sizeof(T) <= size_) memcpy(data() + address, &value, sizeof(T));
+    return value;
+  }
+
+ private:
+  uint8_t* data();
+  size_t size_ = 0;
+};
+extern EEPROMClass EEPROM;
+
+#endif // HOST_EEPROM_H
@@ -0,0 +1,40 @@
+#include <ESP32Servo.h>
+#include "host_fakes.h"
+
+// --- Module Variables ---
+const int HOST_SERVO_PINS = 64;
+int servo_angles[HOST_SERVO_PINS];
+uint32_t servo_writes[HOST_SERVO_PINS];
+bool servo_attached[HOST_SERVO_PINS];
+
+
+// --- Servo ---
+
+int Servo::attach(int pin) {
+  if (pin < 0 || pin >= HOST_SERVO_PINS) return 0;
+  pin_ = pin;
+  servo_attached[pin] = true;
+  return 1;
+}
+
+void Servo::detach() {
+  pin_ = -1;
+}
+
+void Servo::write(int angle) {
+  angle_ = constrain(angle, 0, 180);
+  if (pin_ < 0) return;
+  servo_angles[pin_] = angle_;
+  servo_writes[pin_]++;
+}
+
+
+// --- Host Controls ---
+
+int hostServoAngle(uint8_t pin) {
+  return pin < HOST_SERVO_PINS && servo_attached[pin] ? servo_angles[pin] : -1;
+}
+
+uint32_t hostServoWrites(uint8_t pin) {
+  return pin < HOST_SERVO_PINS ? servo_writes[pin] : 0;
+}
@@ -0,0 +1,22 @@
+#ifndef HOST_ESP32SERVO_H
+#define HOST_ESP32SERVO_H
+
+// Host build only: records the angle written to each servo pin (see hostServoAngle())
+
+#include <Arduino.h>
+
+class Servo {
+ public:
+  int attach(int pin);
+  int attach(int pin, int min_us, int max_us) { return attach(pin); }
+  void detach();
+  void write(int angle);
+  int read() const { return angle_; }
+  bool attached() const { return pin_ >= 0; }
+
+ private:
+  int pin_ = -1;
+  int angle_ = 0;
+};
+
+#endif // HOST_ESP32SERVO_H
@@ -0,0 +1,58 @@
+#include <LiquidCrystal_I2C.h>
+#include "host_fakes.h"
+
+// --- Module Variables ---
+TwoWire Wire;
+LiquidCrystal_I2C* host_lcd = nullptr;  // The display the firmware created
+
+
+// --- LiquidCrystal_I2C ---
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows)
+  : cols_(cols < HOST_LCD_MAX_COLS ? cols : HOST_LCD_MAX_COLS), rows_(rows < HOST_LCD_MAX_ROWS ? rows : HOST_LCD_MAX_ROWS) {
+  clear();
+  host_lcd = this;
+}
+
+void LiquidCrystal_I2C::clear() {
+  for (int r = 0; r < HOST_LCD_MAX_ROWS; r++) {
+    memset(cells_[r], ' ', cols_);
+    cells_[r][cols_] = '\0';
+  }
+  col_ = 0;
+  row_ = 0;
+  bus_us_ += HOST_LCD_CLEAR_US;
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row) {
+  col_ = col;
+  row_ = row;
+  bus_us_ += HOST_LCD_BYTE_US;
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t ch) {
+  cell_writes_++;
+  bus_us_ += HOST_LCD_BYTE_US;
+  if (row_ < rows_ && col_ < cols_) cells_[row_][col_] = (char)ch;
+  col_++;
+  return 1;
+}
+
+const char* LiquidCrystal_I2C::row(uint8_t index) {
+  return index < rows_ ? cells_[index] : "";
+}
+
+
+// --- Host Controls ---
+
+const char* hostLcdRow(uint8_t row) {
+  return host_lcd != nullptr ? host_lcd->row(row) : "";
+}
+
+uint32_t hostLcdCellWrites() {
+  return host_lcd != nullptr ? host_lcd->cellWrites() : 0;
+}
+
+uint64_t hostLcdBusMicros() {
+  return host_lcd != nullptr ? host_lcd->busMicros() : 0;
+}
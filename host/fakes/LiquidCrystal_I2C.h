@@ -0,0 +1,45 @@
+#ifndef HOST_LIQUIDCRYSTAL_I2C_H
+#define HOST_LIQUIDCRYSTAL_I2C_H
+
+// Host build only: an HD44780 behind a PCF8574 backpack, as a grid of characters
+// (see hostLcdRow())
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define HOST_LCD_MAX_COLS 20
+#define HOST_LCD_MAX_ROWS 4
+// I2C time per HD44780 byte (command or character): two nibbles, each three PCF8574
+// writes of ~200 us at 100 kHz. clear() also waits the library's 2 ms.
+#define HOST_LCD_BYTE_US 1200
+#define HOST_LCD_CLEAR_US (HOST_LCD_BYTE_US + 2000)
+
+class LiquidCrystal_I2C : public Print {
+ public:
+  LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows);
+  void init() { clear(); }
+  void begin() { clear(); }
+  void clear();
+  void home() { setCursor(0, 0); }
+  void backlight() { backlight_ = true; }
+  void noBacklight() { backlight_ = false; }
+  void setCursor(uint8_t col, uint8_t row);
+  size_t write(uint8_t ch) override;
+  using Print::write;
+
+  const char* row(uint8_t index);
+  uint32_t cellWrites() const { return cell_writes_; }
+  uint64_t busMicros() const { return bus_us_; }
+
+ private:
+  uint8_t cols_;
+  uint8_t rows_;
+  uint8_t col_ = 0;
+  uint8_t row_ = 0;
+  bool backlight_ = false;
+  uint32_t cell_writes_ = 0;
+  uint64_t bus_us_ = 0;
+  char cells_[HOST_LCD_MAX_ROWS][HOST_LCD_MAX_COLS + 1];
+};
+
+#endif // HOST_LIQUIDCRYSTAL_I2C_H
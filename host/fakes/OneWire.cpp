@@ -0,0 +1,108 @@
+#include <OneWire.h>
+#include "host_fakes.h"
+
+// --- Module Variables ---
+const int HOST_ONEWIRE_PINS = 64;
+const uint8_t ONEWIRE_READ_ROM = 0x33;
+
+const uint8_t ONEWIRE_SEARCH_ROM = 0xF0;
+
+struct HostIButtonPort {
+  bool present;
+  byte rom[8];
+  uint32_t resets;  // Reset/presence sequences
+  uint32_t slots;   // Read and write time slots, one per bit
+};
+HostIButtonPort ibutton_ports[HOST_ONEWIRE_PINS];
+
+void hostRaiseInterrupt(uint8_t pin);  // Arduino.cpp
+
+
+// --- OneWire ---
+
+uint8_t OneWire::reset() {
+  command_ = 0;
+  read_pos_ = 0;
+  if (pin_ < HOST_ONEWIRE_PINS) ibutton_ports[pin_].resets++;
+  return pin_ < HOST_ONEWIRE_PINS && ibutton_ports[pin_].present ? 1 : 0;
+}
+
+void OneWire::write(uint8_t value, uint8_t power) {
+  if (pin_ < HOST_ONEWIRE_PINS) ibutton_ports[pin_].slots += 8;
+  command_ = value;
+  read_pos_ = 0;
+}
+
+// A DS1990A answers Read ROM with its 8 ROM bytes; anything else reads as an idle bus
+uint8_t OneWire::read() {
+  if (pin_ < HOST_ONEWIRE_PINS) ibutton_ports[pin_].slots += 8;
+  if (pin_ >= HOST_ONEWIRE_PINS || !ibutton_ports[pin_].present || command_ != ONEWIRE_READ_ROM || read_pos_ >= 8) {
+    return 0xFF;
+  }
+  return ibutton_ports[pin_].rom[read_pos_++];
+}
+
+void OneWire::read_bytes(uint8_t* buffer, uint16_t count) {
+  for (uint16_t i = 0; i < count; i++) buffer[i] = read();
+}
+
+void OneWire::select(const uint8_t* rom) {
+  write(0x55);
+  if (pin_ < HOST_ONEWIRE_PINS) ibutton_ports[pin_].slots += 64;  // The ROM that follows
+}
+
+// Bus traffic as the library's search: a reset, the Search ROM command, then per ROM bit
+// two read slots (bit, complement) and one write slot (direction)
+uint8_t OneWire::search(uint8_t* rom_out, bool search_mode) {
+  if (search_done_ || pin_ >= HOST_ONEWIRE_PINS) return 0;
+  if (!reset()) return 0;
+  write(ONEWIRE_SEARCH_ROM);
+  ibutton_ports[pin_].slots += 64 * 3;
+  memcpy(rom_out, ibutton_ports[pin_].rom, 8);
+  search_done_ = true;
+  return 1;
+}
+
+// Dallas/Maxim CRC-8, as in the OneWire library
+uint8_t OneWire::crc8(const uint8_t* data, uint8_t length) {
+  uint8_t crc = 0;
+  while (length--) {
+    uint8_t in = *data++;
+    for (int i = 0; i < 8; i++) {
+      uint8_t mix = (crc ^ in) & 0x01;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      in >>= 1;
+    }
+  }
+  return crc;
+}
+
+
+// --- Host Controls ---
+
+void hostMakeIButtonRom(uint32_t serial, byte* rom_out) {
+  memset(rom_out, 0, 8);
+  rom_out[0] = 0x01;  // DS1990A family code
+  for (int i = 0; i < 4; i++) rom_out[1 + i] = (byte)(serial >> (8 * i));
+  rom_out[7] = OneWire::crc8(rom_out, 7);
+}
+
+void hostIButtonTouch(uint8_t pin, const byte* rom) {
+  if (pin >= HOST_ONEWIRE_PINS) return;
+  ibutton_ports[pin].present = true;
+  memcpy(ibutton_ports[pin].rom, rom, 8);
+  hostRaiseInterrupt(pin);  // Presence pulse
+}
+
+void hostIButtonRelease(uint8_t pin) {
+  if (pin < HOST_ONEWIRE_PINS) ibutton_ports[pin].present = false;
+}
+
+uint32_t hostOneWireResets(uint8_t pin) {
+  return pin < HOST_ONEWIRE_PINS ? ibutton_ports[pin].resets : 0;
+}
+
+uint32_t hostOneWireSlots(uint8_t pin) {
+  return pin < HOST_ONEWIRE_PINS ? ibutton_ports[pin].slots : 0;
+}
@@ -0,0 +1,29 @@
+#ifndef HOST_ONEWIRE_H
+#define HOST_ONEWIRE_H
+
+// Host build only: a 1-Wire bus with at most one iButton on it, placed and removed with
+// hostIButtonTouch()/hostIButtonRelease()
+
+#include <Arduino.h>
+
+class OneWire {
+ public:
+  explicit OneWire(uint8_t pin) : pin_(pin) {}
+  uint8_t reset();                 // 1 if a device answered with a presence pulse
+  void write(uint8_t value, uint8_t power = 0);
+  uint8_t read();
+  void read_bytes(uint8_t* buffer, uint16_t count);
+  void skip() { write(0xCC); }
+  void select(const uint8_t* rom);
+  void reset_search() { search_done_ = false; }
+  uint8_t search(uint8_t* rom_out, bool search_mode = true);
+  static uint8_t crc8(const uint8_t* data, uint8_t length);
+
+ private:
+  uint8_t pin_;
+  uint8_t command_ = 0;
+  uint8_t read_pos_ = 0;
+  bool search_done_ = false;
+};
+
+#endif // HOST_ONEWIRE_H
@@ -0,0 +1,211 @@
+#include <PubSubClient.h>
+#include "host_fakes.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+// --- Module Variables ---
+// One broker, one client session: the firmware has a single PubSubClient
+const size_t MQTT_MAX_HEADER_SIZE = 5;
+const size_t HOST_PUBLISHED_MAX = 4096;  // Messages kept until taken; the oldest go first
+
+struct HostBrokerMessage {
+  std::string topic;
+  std::vector<uint8_t> payload;
+};
+
+bool broker_available = true;
+bool session_open = false;
+uint32_t connect_attempts = 0;
+char connected_host[64] = "";
+std::string will_topic;
+std::string will_message;
+bool will_retain = false;
+std::vector<std::string> subscriptions;
+std::deque<HostBrokerMessage> to_device;
+// A fixed ring, so publishing never touches the heap (test_payload_alloc counts allocations)
+HostMqttMessage from_device[HOST_PUBLISHED_MAX];
+size_t from_device_head = 0;
+size_t from_device_count = 0;
+
+
+// --- Helpers ---
+// MQTT filter matching with + and #
+bool topicMatches(const char* filter, const char* topic) {
+  while (*filter != '\0') {
+    if (*filter == '#') return true;
+    if (*filter == '+') {
+      while (*topic != '\0' && *topic != '/') topic++;
+      filter++;
+      continue;
+    }
+    if (*filter != *topic) return false;
+    filter++;
+    topic++;
+  }
+  return *topic == '\0';
+}
+
+void storePublished(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+  if (from_device_count == HOST_PUBLISHED_MAX) {
+    from_device_head = (from_device_head + 1) % HOST_PUBLISHED_MAX;
+    from_device_count--;
+  }
+  HostMqttMessage& message = from_device[(from_device_head + from_device_count++) % HOST_PUBLISHED_MAX];
+  snprintf(message.topic, sizeof(message.topic), "%s", topic);
+  message.length = length < sizeof(message.payload) ? length : sizeof(message.payload);
+  memcpy(message.payload, payload, message.length);
+  message.retained = retained;
+}
+
+// The broker drops the session and publishes the will, as after a missed keepalive
+void loseSession() {
+  if (!session_open) return;
+  session_open = false;
+  if (!will_topic.empty()) {
+    storePublished(will_topic.c_str(), (const uint8_t*)will_message.data(), will_message.size(), will_retain);
+  }
+}
+
+
+// --- PubSubClient ---
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  domain_ = domain;
+  port_ = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t port) {
+  domain_ = nullptr;
+  ip_ = ip;
+  port_ = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  callback_ = callback;
+  return *this;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, 0, false, nullptr);
+}
+
+// Like the library: a name is resolved on every attempt, and an unreachable broker holds
+// the caller for the client's connect timeout
+bool PubSubClient::connect(const char* id, const char* will_topic_in, uint8_t will_qos, bool will_retain_in,
+                           const char* will_message_in) {
+  if (connected()) return true;
+  connect_attempts++;
+  if (WiFi.status() != WL_CONNECTED) {
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  IPAddress address = ip_;
+  if (domain_ != nullptr) {
+    snprintf(connected_host, sizeof(connected_host), "%s", domain_);
+    if (!WiFi.hostByName(domain_, address)) {
+      state_ = MQTT_CONNECT_FAILED;
+      return false;
+    }
+  } else {
+    snprintf(connected_host, sizeof(connected_host), "%s", ip_.toString().c_str());
+  }
+  if (!broker_available) {
+    WiFiClient* wifi_client = static_cast<WiFiClient*>(&client_);
+    delay(wifi_client->connectTimeoutMs());
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  session_open = true;
+  state_ = MQTT_CONNECTED;
+  subscriptions.clear();
+  will_topic = will_topic_in != nullptr ? will_topic_in : "";
+  will_message = will_message_in != nullptr ? will_message_in : "";
+  will_retain = will_retain_in;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  session_open = false;  // Clean disconnect: no will
+  state_ = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+  if (session_open && (!broker_available || WiFi.status() != WL_CONNECTED)) {
+    loseSession();
+    state_ = MQTT_CONNECTION_LOST;
+  }
+  return session_open;
+}
+
+// Hands at most one message to the callback per call, as the library reads one packet
+bool PubSubClient::loop() {
+  if (!connected()) return false;
+  while (!to_device.empty()) {
+    HostBrokerMessage message = to_device.front();
+    to_device.pop_front();
+    bool subscribed = false;
+    for (const std::string& filter : subscriptions) {
+      subscribed = subscribed || topicMatches(filter.c_str(), message.topic.c_str());
+    }
+    if (!subscribed) continue;
+    if (callback_ != nullptr) {
+      std::vector<char> topic(message.topic.begin(), message.topic.end());
+      topic.push_back('\0');
+      callback_(topic.data(), message.payload.data(), (unsigned int)message.payload.size());
+    }
+    break;
+  }
+  return true;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  return publish(topic, (const uint8_t*)payload, payload != nullptr ? strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  if (!connected()) return false;
+  if (buffer_size_ < MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + length) return false;  // Does not fit the packet buffer
+  storePublished(topic, payload, length, retained);
+  return true;
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+  if (!connected()) return false;
+  subscriptions.push_back(topic);
+  return true;
+}
+
+
+// --- Host Controls ---
+
+void hostMqttSetBrokerAvailable(bool available) {
+  broker_available = available;
+}
+
+uint32_t hostMqttConnectCount() {
+  return connect_attempts;
+}
+
+const char* hostMqttConnectedHost() {
+  return connected_host;
+}
+
+uint32_t hostMqttSubscriptionCount() {
+  return (uint32_t)subscriptions.size();
+}
+
+bool hostMqttTakePublished(HostMqttMessage& message_out) {
+  if (from_device_count == 0) return false;
+  message_out = from_device[from_device_head];
+  from_device_head = (from_device_head + 1) % HOST_PUBLISHED_MAX;
+  from_device_count--;
+  return true;
+}
+
+void hostMqttDeliver(const char* topic, const void* payload, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)payload;
+  to_device.push_back({ topic, std::vector<uint8_t>(bytes, bytes + length) });
+}
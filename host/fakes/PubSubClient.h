@@ -0,0 +1,56 @@
+#ifndef HOST_PUBSUBCLIENT_H
+#define HOST_PUBSUBCLIENT_H
+
+// Host build only: PubSubClient against an in-process broker. Published messages are
+// collected for hostMqttTakePublished(); hostMqttDeliver() feeds the callback.
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+class PubSubClient {
+ public:
+  explicit PubSubClient(Client& client) : client_(client) {}
+  PubSubClient& setServer(const char* domain, uint16_t port);
+  PubSubClient& setServer(IPAddress ip, uint16_t port);
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient& setKeepAlive(uint16_t seconds) { return *this; }
+  PubSubClient& setSocketTimeout(uint16_t seconds) { socket_timeout_s_ = seconds; return *this; }
+  bool setBufferSize(uint16_t size) { buffer_size_ = size; return true; }
+  uint16_t getBufferSize() { return buffer_size_; }
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* will_topic, uint8_t will_qos, bool will_retain, const char* will_message);
+  void disconnect();
+  bool connected();
+  int state() { return state_; }
+  bool loop();
+
+  bool publish(const char* topic, const char* payload) { return publish(topic, payload, false); }
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) {
+    return publish(topic, payload, length, false);
+  }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+  bool subscribe(const char* topic, uint8_t qos = 0);
+
+ private:
+  Client& client_;
+  const char* domain_ = nullptr;
+  IPAddress ip_;
+  uint16_t port_ = 1883;
+  void (*callback_)(char*, uint8_t*, unsigned int) = nullptr;
+  uint16_t buffer_size_ = MQTT_MAX_PACKET_SIZE;
+  uint16_t socket_timeout_s_ = 15;
+  int state_ = MQTT_DISCONNECTED;
+};
+
+#endif // HOST_PUBSUBCLIENT_H
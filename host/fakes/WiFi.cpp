@@ -0,0 +1,78 @@
+#include <WiFi.h>
+#include "host_fakes.h"
+
+// --- Module Variables ---
+WiFiClass WiFi;
+
+const IPAddress HOST_STATION_IP(192, 168, 1, 50);
+const IPAddress HOST_BROKER_IP(10, 0, 0, 2);  // What every broker name resolves to
+
+bool wifi_available = true;
+bool wifi_begun = false;
+bool wifi_link_lost = false;  // Dropped since the last begin()
+unsigned long wifi_begin_ms = 0;
+WiFiEventCb wifi_event_callback = nullptr;
+uint32_t dns_lookups = 0;
+
+
+// --- WiFiClass ---
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password) {
+  wifi_begun = true;
+  wifi_link_lost = false;
+  wifi_begin_ms = millis();
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifi_off) {
+  wifi_begun = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!wifi_begun) return WL_DISCONNECTED;
+  if (wifi_link_lost) return WL_CONNECTION_LOST;
+  if (!wifi_available) return WL_NO_SSID_AVAIL;
+  return millis() - wifi_begin_ms >= HOST_WIFI_CONNECT_MS ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+  return status() == WL_CONNECTED ? HOST_STATION_IP : IPAddress();
+}
+
+int WiFiClass::onEvent(WiFiEventCb callback, arduino_event_id_t event) {
+  wifi_event_callback = callback;
+  return 1;
+}
+
+// Dotted addresses need no lookup; names cost HOST_DNS_LOOKUP_MS of blocking, like a
+// round trip to the resolver
+int WiFiClass::hostByName(const char* host, IPAddress& address_out) {
+  unsigned a, b, c, d;
+  char extra;
+  if (sscanf(host, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) == 4 && a < 256 && b < 256 && c < 256 && d < 256) {
+    address_out = IPAddress(a, b, c, d);
+    return 1;
+  }
+  dns_lookups++;
+  delay(HOST_DNS_LOOKUP_MS);
+  if (status() != WL_CONNECTED) return 0;
+  address_out = HOST_BROKER_IP;
+  return 1;
+}
+
+
+// --- Host Controls ---
+
+void hostWiFiSetAvailable(bool available) {
+  bool was_connected = WiFi.status() == WL_CONNECTED;
+  wifi_available = available;
+  if (!available && was_connected) {
+    wifi_link_lost = true;
+    if (wifi_event_callback != nullptr) wifi_event_callback(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  }
+}
+
+uint32_t hostDnsLookupCount() {
+  return dns_lookups;
+}
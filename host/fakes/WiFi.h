@@ -0,0 +1,59 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+// Host build only: a station that gets an address shortly after begin() while the access
+// point is available (see hostWiFiSetAvailable()), and a resolver for the broker name
+
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_CONNECTED,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+  ARDUINO_EVENT_WIFI_STA_LOST_IP
+} arduino_event_id_t;
+
+typedef void (*WiFiEventCb)(arduino_event_id_t event);
+
+#define WIFI_STA 1
+#define HOST_WIFI_CONNECT_MS 500  // From begin() to an address
+#define HOST_DNS_LOOKUP_MS 200    // hostByName() of a name, not a dotted address
+
+class Client {
+ public:
+  virtual ~Client() {}
+};
+
+class WiFiClient : public Client {
+ public:
+  void setTimeout(uint32_t seconds) { timeout_ms_ = seconds * 1000; }
+  uint32_t connectTimeoutMs() const { return timeout_ms_; }
+
+ private:
+  uint32_t timeout_ms_ = 3000;  // WIFI_CLIENT_DEF_CONN_TIMEOUT_MS in the ESP32 core
+};
+
+class WiFiClass {
+ public:
+  bool mode(int mode) { return true; }
+  wl_status_t begin(const char* ssid, const char* password);
+  bool disconnect(bool wifi_off = false);
+  bool setAutoReconnect(bool enabled) { return true; }
+  wl_status_t status();
+  IPAddress localIP();
+  int8_t RSSI() { return -60; }
+  int onEvent(WiFiEventCb callback, arduino_event_id_t event = (arduino_event_id_t)-1);
+  int hostByName(const char* host, IPAddress& address_out);
+};
+extern WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
@@ -0,0 +1,22 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+// Host build only: an I2C bus where only the LCD backpack (0x27) answers
+
+#include <Arduino.h>
+
+#define HOST_I2C_LCD_ADDRESS 0x27
+
+class TwoWire {
+ public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+  void setClock(uint32_t frequency) {}
+  void beginTransmission(uint8_t address) { address_ = address; }
+  uint8_t endTransmission(bool send_stop = true) { return address_ == HOST_I2C_LCD_ADDRESS ? 0 : 2; }
+
+ private:
+  uint8_t address_ = 0;
+};
+extern TwoWire Wire;
+
+#endif // HOST_WIRE_H
@@ -0,0 +1,100 @@
+#include <esp_partition.h>
+#include "host_fakes.h"
+#include <vector>
+
+// --- Module Variables ---
+// "ibjournal" from partitions.csv
+const uint32_t HOST_FLASH_SECTOR = 4096;
+esp_partition_t journal_partition = { ESP_PARTITION_TYPE_DATA, 0x40, 0x290000, 0x160000, "ibjournal", false };
+std::vector<uint8_t> flash_data(0x160000, 0xFF);
+std::vector<uint32_t> sector_erases(0x160000 / HOST_FLASH_SECTOR, 0);
+HostFlashStats flash_stats;
+int writes_before_power_cut = -1;
+bool power_cut_tears_write = true;
+bool flash_powered_off = false;
+
+
+// --- Helpers ---
+bool inPartition(const esp_partition_t* partition, size_t offset, size_t size) {
+  return partition == &journal_partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+// NOR flash: programming can only clear bits
+void programBytes(size_t offset, const void* src, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)src;
+  for (size_t i = 0; i < size; i++) flash_data[offset + i] &= bytes[i];
+  flash_stats.bytes_written += size;
+}
+
+
+// --- esp_partition ---
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+  if (type != ESP_PARTITION_TYPE_DATA) return nullptr;
+  if (label != nullptr && strcmp(label, journal_partition.label) != 0) return nullptr;
+  return &journal_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) {
+  if (!inPartition(partition, src_offset, size)) return ESP_ERR_INVALID_SIZE;
+  memcpy(dst, &flash_data[src_offset], size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size) {
+  if (!inPartition(partition, dst_offset, size)) return ESP_ERR_INVALID_SIZE;
+  if (flash_powered_off) return ESP_FAIL;
+  if (writes_before_power_cut == 0) {  // Power fails halfway through this write
+    if (power_cut_tears_write) programBytes(dst_offset, src, size / 2);
+    flash_powered_off = true;
+    return ESP_FAIL;
+  }
+  if (writes_before_power_cut > 0) writes_before_power_cut--;
+  programBytes(dst_offset, src, size);
+  flash_stats.writes++;
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  if (!inPartition(partition, offset, size) || offset % HOST_FLASH_SECTOR != 0 || size % HOST_FLASH_SECTOR != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (flash_powered_off) return ESP_FAIL;
+  memset(&flash_data[offset], 0xFF, size);
+  for (size_t sector = offset / HOST_FLASH_SECTOR; sector < (offset + size) / HOST_FLASH_SECTOR; sector++) {
+    sector_erases[sector]++;
+    flash_stats.erases++;
+  }
+  return ESP_OK;
+}
+
+
+// --- Host Controls ---
+
+void hostFlashStats(HostFlashStats& stats_out) {
+  stats_out = flash_stats;
+  stats_out.min_sector_erases = UINT32_MAX;
+  stats_out.max_sector_erases = 0;
+  for (uint32_t erases : sector_erases) {
+    if (erases < stats_out.min_sector_erases) stats_out.min_sector_erases = erases;
+    if (erases > stats_out.max_sector_erases) stats_out.max_sector_erases = erases;
+  }
+}
+
+void hostFlashWipe() {
+  std::fill(flash_data.begin(), flash_data.end(), 0xFF);
+  std::fill(sector_erases.begin(), sector_erases.end(), 0);
+  memset(&flash_stats, 0, sizeof(flash_stats));
+  hostFlashPowerRestore();
+}
+
+void hostFlashFailAfterWrites(int writes, bool torn) {
+  writes_before_power_cut = writes;
+  power_cut_tears_write = torn;
+}
+
+void hostFlashPowerRestore() {
+  writes_before_power_cut = -1;
+  flash_powered_off = false;
+}
@@ -0,0 +1,285 @@
+#include <Arduino.h>
+#include "host_fakes.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --- Scheduler State ---
+// Each task is a host thread, but only the holder of the "CPU" runs: the loop thread (the
+// sketch, the tests) or one task. A task holds it until it blocks; the loop thread hands
+// it out from hostAdvanceMillis() and hostRunReadyTasks(). So runs are deterministic, and
+// the firmware's critical sections need no lock.
+
+const uint64_t NO_TIMEOUT = UINT64_MAX;
+
+enum HostTaskState : uint8_t {
+  HOST_TASK_READY,    // Waiting for the CPU
+  HOST_TASK_RUNNING,
+  HOST_TASK_BLOCKED   // Until wake_ms, a notification or a queue item
+};
+
+struct HostQueue {
+  UBaseType_t length;
+  UBaseType_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+struct HostTask {
+  int id;
+  const char* name;
+  TaskFunction_t function;
+  void* param;
+  HostTaskState state;
+  uint64_t wake_ms;
+  uint32_t notify_count;
+  bool waiting_notify;
+  HostQueue* waiting_queue;
+  std::condition_variable cv;
+};
+
+struct HostScheduler {
+  std::mutex mutex;
+  std::condition_variable loop_cv;
+  std::vector<HostTask*> tasks;
+  int running = 0;  // ID of the task holding the CPU, 0 for the loop thread
+  uint64_t now_ms = 0;
+};
+
+// Never destroyed: parked task threads still wait on it when the process exits
+HostScheduler& scheduler() {
+  static HostScheduler* instance = new HostScheduler();
+  return *instance;
+}
+
+thread_local HostTask* current_task = nullptr;
+bool fail_next_task_create = false;
+
+
+// --- Helpers ---
+// Gives the CPU back to the loop thread and waits until a wake-up hands it over again
+void blockCurrentTask(std::unique_lock<std::mutex>& lock, uint64_t wake_ms) {
+  HostScheduler& s = scheduler();
+  HostTask* task = current_task;
+  task->state = HOST_TASK_BLOCKED;
+  task->wake_ms = wake_ms;
+  s.running = 0;
+  s.loop_cv.notify_one();
+  task->cv.wait(lock, [&] { return s.running == task->id; });
+  task->state = HOST_TASK_RUNNING;
+  task->wake_ms = NO_TIMEOUT;
+}
+
+void readyTask(HostTask* task) {
+  if (task->state == HOST_TASK_BLOCKED) task->state = HOST_TASK_READY;
+}
+
+// Loop thread: runs ready tasks, lowest ID first, until none is left
+void runReadyTasks(std::unique_lock<std::mutex>& lock) {
+  HostScheduler& s = scheduler();
+  for (;;) {
+    HostTask* next = nullptr;
+    for (HostTask* task : s.tasks) {
+      if (task->state == HOST_TASK_READY) {
+        next = task;
+        break;
+      }
+    }
+    if (next == nullptr) return;
+    next->state = HOST_TASK_RUNNING;
+    s.running = next->id;
+    next->cv.notify_one();
+    s.loop_cv.wait(lock, [&] { return s.running == 0; });
+  }
+}
+
+uint64_t deadlineFor(TickType_t ticks) {
+  return ticks == portMAX_DELAY ? NO_TIMEOUT : scheduler().now_ms + ticks;
+}
+
+void hostTaskEntry(HostTask* task) {
+  HostScheduler& s = scheduler();
+  current_task = task;
+  {
+    std::unique_lock<std::mutex> lock(s.mutex);
+    task->cv.wait(lock, [&] { return s.running == task->id; });
+  }
+  task->function(task->param);
+
+  // FreeRTOS tasks must not return; park it for good
+  std::unique_lock<std::mutex> lock(s.mutex);
+  for (;;) blockCurrentTask(lock, NO_TIMEOUT);
+}
+
+
+// --- Clock ---
+
+unsigned long millis() {
+  return (unsigned long)scheduler().now_ms;
+}
+
+unsigned long micros() {
+  return (unsigned long)(scheduler().now_ms * 1000);
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)scheduler().now_ms;
+}
+
+void hostAdvanceMillis(uint32_t ms) {
+  if (current_task != nullptr) {  // delay() called from a task
+    vTaskDelay(ms);
+    return;
+  }
+  HostScheduler& s = scheduler();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  uint64_t target_ms = s.now_ms + ms;
+  runReadyTasks(lock);
+  for (;;) {
+    uint64_t next_ms = target_ms;
+    for (HostTask* task : s.tasks) {
+      if (task->state == HOST_TASK_BLOCKED && task->wake_ms < next_ms) next_ms = task->wake_ms;
+    }
+    if (next_ms > s.now_ms) s.now_ms = next_ms;
+    for (HostTask* task : s.tasks) {
+      if (task->state == HOST_TASK_BLOCKED && task->wake_ms <= s.now_ms) task->state = HOST_TASK_READY;
+    }
+    runReadyTasks(lock);
+    if (s.now_ms >= target_ms) return;
+  }
+}
+
+void hostRunReadyTasks() {
+  if (current_task != nullptr) return;
+  std::unique_lock<std::mutex> lock(scheduler().mutex);
+  runReadyTasks(lock);
+}
+
+void hostFailNextTaskCreate() {
+  fail_next_task_create = true;
+}
+
+void delay(unsigned long ms) {
+  hostAdvanceMillis(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+  // Below the clock's 1 ms resolution
+}
+
+void yield() {
+  hostRunReadyTasks();
+}
+
+
+// --- Tasks ---
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle_out, BaseType_t core_id) {
+  if (fail_next_task_create) {
+    fail_next_task_create = false;
+    return pdFAIL;
+  }
+  HostScheduler& s = scheduler();
+  HostTask* task = new HostTask();
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    task->id = (int)s.tasks.size() + 1;
+    task->name = name;
+    task->function = function;
+    task->param = param;
+    task->state = HOST_TASK_READY;  // First runs at the next delay()
+    task->wake_ms = NO_TIMEOUT;
+    task->notify_count = 0;
+    task->waiting_notify = false;
+    task->waiting_queue = nullptr;
+    s.tasks.push_back(task);
+  }
+  std::thread(hostTaskEntry, task).detach();
+  if (handle_out != nullptr) *handle_out = task;
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  if (current_task == nullptr) {
+    hostAdvanceMillis(ticks);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(scheduler().mutex);
+  blockCurrentTask(lock, scheduler().now_ms + ticks);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+  HostScheduler& s = scheduler();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  HostTask* task = current_task;
+  if (task == nullptr) return 0;
+  if (task->notify_count == 0 && ticks_to_wait > 0) {
+    task->waiting_notify = true;
+    blockCurrentTask(lock, deadlineFor(ticks_to_wait));
+    task->waiting_notify = false;
+  }
+  uint32_t value = task->notify_count;
+  if (value > 0) task->notify_count = clear_on_exit ? 0 : value - 1;
+  return value;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t* higher_priority_task_woken) {
+  if (handle == nullptr) return;
+  std::lock_guard<std::mutex> lock(scheduler().mutex);
+  HostTask* task = (HostTask*)handle;
+  task->notify_count++;
+  if (task->waiting_notify) readyTask(task);
+  if (higher_priority_task_woken != nullptr) *higher_priority_task_woken = pdFALSE;
+}
+
+
+// --- Queues ---
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  HostQueue* queue = new HostQueue();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+// Only deleted while no task waits on it
+void vQueueDelete(QueueHandle_t handle) {
+  delete (HostQueue*)handle;
+}
+
+// Never waits for room: the firmware only sends with a zero timeout
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t ticks_to_wait) {
+  HostScheduler& s = scheduler();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  HostQueue* queue = (HostQueue*)handle;
+  if (queue->items.size() >= queue->length) return pdFALSE;
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->item_size);
+  for (HostTask* task : s.tasks) {
+    if (task->waiting_queue == queue) readyTask(task);
+  }
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item_out, TickType_t ticks_to_wait) {
+  HostScheduler& s = scheduler();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  HostQueue* queue = (HostQueue*)handle;
+  uint64_t deadline_ms = deadlineFor(ticks_to_wait);
+  while (queue->items.empty()) {
+    if (ticks_to_wait == 0 || current_task == nullptr || s.now_ms >= deadline_ms) return pdFALSE;
+    current_task->waiting_queue = queue;
+    blockCurrentTask(lock, deadline_ms);
+    current_task->waiting_queue = nullptr;
+  }
+  memcpy(item_out, queue->items.front().data(), queue->item_size);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+  std::lock_guard<std::mutex> lock(scheduler().mutex);
+  return (UBaseType_t)((HostQueue*)handle)->items.size();
+}
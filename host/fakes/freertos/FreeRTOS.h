@@ -0,0 +1,49 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Host build only: the FreeRTOS calls the firmware makes, on host threads. Tasks run one
+// at a time, in lockstep with the virtual clock: a task runs until it blocks, and time
+// only moves on when the sketch calls delay() or the host calls hostAdvanceMillis().
+// Ticks are milliseconds (configTICK_RATE_HZ 1000, as on the ESP32 Arduino core).
+
+#include <stdint.h>
+
+typedef void* TaskHandle_t;
+typedef void* QueueHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+// Only one task runs at a time, so critical sections need no lock
+typedef struct {
+  uint32_t owner;
+  uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portYIELD_FROM_ISR() ((void)0)
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle_out, BaseType_t core_id);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item_out, TickType_t ticks_to_wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif // HOST_FREERTOS_H
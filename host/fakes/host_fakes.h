@@ -0,0 +1,118 @@
+#ifndef HOST_FAKES_H
+#define HOST_FAKES_H
+
+// Host build only: controls and probes for the in-process fakes, used by the host tests
+// and the load generator. The firmware itself never includes this header.
+
+#include <Arduino.h>
+
+// --- Virtual clock ---
+/**
+ * @brief Moves the virtual clock forward, running every task that wakes up on the way
+ * (in wake-up order) until each one blocks again. delay() in the sketch does the same.
+ */
+void hostAdvanceMillis(uint32_t ms);
+
+/**
+ * @brief Runs the tasks that are ready without moving the clock.
+ */
+void hostRunReadyTasks();
+
+// --- Tasks ---
+/**
+ * @brief Makes the next xTaskCreatePinnedToCore() fail, as it does when the heap cannot
+ * hold the task's stack.
+ */
+void hostFailNextTaskCreate();
+
+// --- Serial ---
+void hostSerialInput(const char* text);  // Queued for Serial.available()/read()
+void hostSerialEcho(bool enabled);       // Copy Serial output to stdout (default on)
+
+// --- GPIO ---
+int hostPinLevel(uint8_t pin);
+uint32_t hostPinRisingEdges(uint8_t pin);  // LOW to HIGH writes since start
+
+// --- 1-Wire iButton readers ---
+/**
+ * @brief Builds a DS1990A ROM (family 0x01, serial, CRC-8) for a serial number.
+ */
+void hostMakeIButtonRom(uint32_t serial, byte* rom_out);
+
+/**
+ * @brief Puts an iButton on (or takes it off) the reader on a 1-Wire pin. A touch
+ * raises the pin's interrupt, if one is attached.
+ */
+void hostIButtonTouch(uint8_t pin, const byte* rom);
+void hostIButtonRelease(uint8_t pin);
+
+/**
+ * @brief Bus traffic on a 1-Wire pin since start: reset/presence sequences (about 960 us
+ * each, HOST_ONEWIRE_RESET_US) and read/write time slots, one per bit (HOST_ONEWIRE_SLOT_US).
+ */
+const uint32_t HOST_ONEWIRE_RESET_US = 960;
+const uint32_t HOST_ONEWIRE_SLOT_US = 70;
+uint32_t hostOneWireResets(uint8_t pin);
+uint32_t hostOneWireSlots(uint8_t pin);
+
+// --- Servo ---
+int hostServoAngle(uint8_t pin);        // Last angle written, -1 if never attached
+uint32_t hostServoWrites(uint8_t pin);
+
+// --- LCD ---
+const char* hostLcdRow(uint8_t row);    // Text on the glass, padded to the column count
+uint32_t hostLcdCellWrites();           // Characters sent over I2C since start
+uint64_t hostLcdBusMicros();            // I2C time the display has taken since start (modelled, see HOST_LCD_BYTE_US)
+
+// --- WiFi and MQTT broker ---
+// Network calls take virtual time like on the device: a DNS lookup HOST_DNS_LOOKUP_MS, and
+// a connect to an unreachable broker the WiFiClient connect timeout.
+void hostWiFiSetAvailable(bool available);        // Access point in range (default yes)
+uint32_t hostDnsLookupCount();
+void hostMqttSetBrokerAvailable(bool available);  // Broker accepts connections (default yes)
+uint32_t hostMqttConnectCount();                  // Attempts, successful or not
+const char* hostMqttConnectedHost();              // Host (name or IP text) of the last attempt
+uint32_t hostMqttSubscriptionCount();             // SUBSCRIBE calls in the current session
+
+struct HostMqttMessage {
+  char topic[128];
+  uint8_t payload[1536];
+  size_t length;
+  bool retained;
+};
+
+/**
+ * @brief Takes the oldest message the device published, false if none is left.
+ */
+bool hostMqttTakePublished(HostMqttMessage& message_out);
+
+/**
+ * @brief Queues a message from the broker; the client hands it to the callback on its
+ * next loop() if the topic matches a subscription.
+ */
+void hostMqttDeliver(const char* topic, const void* payload, size_t length);
+
+// --- Flash (esp_partition) ---
+// NOR semantics: writes can only clear bits, erases set a whole 4 KB sector to 0xFF.
+struct HostFlashStats {
+  uint32_t writes;
+  uint32_t bytes_written;
+  uint32_t erases;             // Sectors erased
+  uint32_t min_sector_erases;  // Wear spread over the partition
+  uint32_t max_sector_erases;
+};
+
+void hostFlashStats(HostFlashStats& stats_out);
+void hostFlashWipe();        // Whole partition erased, counters cleared
+/**
+ * @brief Simulates a power cut: after this many more writes, the next write stores only
+ * its first half (nothing if torn is false) and every later write and erase fails.
+ * Negative disables it.
+ */
+void hostFlashFailAfterWrites(int writes, bool torn = true);
+void hostFlashPowerRestore();  // Writes and erases work again (the device "reboots")
+
+// --- EEPROM ---
+uint8_t* hostEepromData();   // Raw bytes of the emulated EEPROM (4 KB)
+
+#endif // HOST_FAKES_H
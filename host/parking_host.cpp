@@ -0,0 +1,413 @@
+// Host build of the sketch: smart-parking-esp32.ino on the in-process fakes, with a load
+// generator on the virtual clock. Vehicles arrive as in lot_sim_settings (Poisson
+// arrivals, exponential stays and 2FA answers), touch their iButton at the lane reader and
+// react to what the firmware does: the gate opening, the rejection beeps, or a 2FA request
+// that the generator answers through the fake broker. The run is printed in the format of
+// the lot_simulator model, followed by the model's own run of the same traffic.
+//
+// Usage: parking_host [hours] [arrivals_per_hour] [seed] [-v]
+//   -v  also print the sketch's Serial output
+
+#include "../smart-parking-esp32.ino"
+#include "host_fakes.h"
+#include "json_reader.h"
+#include "payload_codec.h"
+#include <algorithm>
+#include <ctime>
+#include <deque>
+#include <vector>
+
+// --- Module Variables ---
+const unsigned long LOAD_TOUCH_HOLD_MS = 400;         // iButton held against the reader
+const unsigned long LOAD_REACTION_TIMEOUT_MS = 2500;  // No reaction by then: the driver touches again
+const int LOAD_MAX_TOUCHES = 5;                       // Then gives up and drives off
+const unsigned long LOAD_2FA_GIVE_UP_MARGIN_MS = 2000;  // Past TWO_FA_TIMEOUT_DURATION_MS
+const unsigned long LOAD_BOOT_MS = 5000;              // Boot, WiFi and broker before traffic starts
+const size_t LOAD_TOPIC_MAX = 128;
+
+enum LoadVehicleState : uint8_t {
+  LOAD_VEHICLE_AWAY,    // Its iButton is free for the next arrival
+  LOAD_VEHICLE_QUEUED,
+  LOAD_VEHICLE_AT_READER,
+  LOAD_VEHICLE_PARKED
+};
+
+struct LoadVehicle {
+  byte rom[IBUTTON_ID_LEN];
+  LoadVehicleState state;
+  bool wants_exit;
+  bool inside;             // Went in through the gate and has not come out
+  unsigned long queued_ms;
+  unsigned long leave_ms;  // While parked
+};
+
+enum LoadLanePhase : uint8_t {
+  LOAD_LANE_IDLE,
+  LOAD_LANE_APPROACH,   // Driving up to the reader
+  LOAD_LANE_TOUCHING,   // Waiting for the firmware to react to the touch
+  LOAD_LANE_2FA,        // Waiting for the app (the generator) and then the gate
+  LOAD_LANE_GATE        // Gate open, vehicle going through
+};
+
+struct LoadLane {
+  std::deque<int> queue;
+  LoadLanePhase phase;
+  int vehicle;
+  unsigned long phase_start_ms;
+  bool touching;
+  int touches;
+  uint32_t buzzer_edges;    // Before the touch
+  uint32_t request_id;      // 2FA request for the vehicle at the reader
+  bool answer_due;
+  bool answer_allow;
+  unsigned long answer_ms;
+};
+
+std::vector<LoadVehicle> load_vehicles;
+LoadLane load_lanes[PARKING_LANES];
+uint32_t load_rng_state = 1;
+LotSimResult load_result;
+std::vector<uint32_t> load_waits_ms;
+uint32_t load_touches = 0;
+uint32_t load_retouches = 0;
+uint32_t load_gave_up = 0;
+uint32_t load_mqtt_messages = 0;
+uint32_t load_inside = 0;
+
+
+// --- Helpers ---
+uint32_t loadRandom() {
+  load_rng_state ^= load_rng_state << 13;
+  load_rng_state ^= load_rng_state >> 17;
+  load_rng_state ^= load_rng_state << 5;
+  return load_rng_state;
+}
+
+// Exponential with the given mean
+unsigned long loadExponential(double mean) {
+  double u = (loadRandom() + 1.0) / 4294967296.0;
+  return (unsigned long)(-mean * log(u));
+}
+
+bool loadChance(uint8_t percent) {
+  return loadRandom() % 100 < percent;
+}
+
+uint8_t loadLaneFor(bool wants_exit) {
+  return PARKING_LANES > 1 && wants_exit ? 1 : 0;
+}
+
+void loadVehicleAway(int index) {
+  LoadVehicle& vehicle = load_vehicles[index];
+  if (vehicle.inside) load_inside--;
+  vehicle.inside = false;
+  vehicle.state = LOAD_VEHICLE_AWAY;
+}
+
+void loadLaneDone(LoadLane& lane) {
+  if (lane.touching) hostIButtonRelease(lane_settings[&lane - load_lanes].reader_pin);
+  lane.touching = false;
+  lane.phase = LOAD_LANE_IDLE;
+  lane.vehicle = -1;
+  lane.answer_due = false;
+}
+
+// The app: answers a 2FA request after an exponential delay, or never (a timeout)
+void loadHandle2FARequest(const HostMqttMessage& message) {
+  char ibutton_hex[IBUTTON_HEX_LEN + 1];
+  uint32_t request_id = 0;
+  JsonField fields[] = {
+    { "request_id", JSON_FIELD_UINT, &request_id, 0, false },
+    { "ibutton_id", JSON_FIELD_STRING, ibutton_hex, sizeof(ibutton_hex), false },
+  };
+  if (!payloadReadObject(message.payload, message.length, fields, 2) || !fields[1].found) return;
+
+  for (LoadLane& lane : load_lanes) {
+    if (lane.vehicle < 0) continue;
+    char lane_hex[IBUTTON_HEX_LEN + 1];
+    ibuttonBytesToHex(load_vehicles[lane.vehicle].rom, lane_hex);
+    if (strcasecmp(lane_hex, ibutton_hex) != 0) continue;
+    load_result.two_fa_requests++;
+    unsigned long answer_after_ms = loadExponential(lot_sim_settings.mean_approval_ms);
+    lane.phase = LOAD_LANE_2FA;
+    lane.phase_start_ms = millis();
+    lane.request_id = request_id;
+    lane.answer_due = answer_after_ms < lot_sim_settings.two_fa_timeout_ms;
+    lane.answer_allow = loadChance(lot_sim_settings.approve_percent);
+    lane.answer_ms = millis() + answer_after_ms;
+  }
+}
+
+void loadDrainBroker() {
+  HostMqttMessage message;
+  char request_topic[LOAD_TOPIC_MAX];
+  char batch_topic[LOAD_TOPIC_MAX];
+  snprintf(request_topic, sizeof(request_topic), "%sauth/2fa_request", mqtt_settings.base_topic_prefix);
+  snprintf(batch_topic, sizeof(batch_topic), "%sibutton/scan_batch", mqtt_settings.base_topic_prefix);
+  while (hostMqttTakePublished(message)) {
+    load_mqtt_messages++;
+    if (strcmp(message.topic, request_topic) == 0) loadHandle2FARequest(message);
+    else if (strcmp(message.topic, batch_topic) == 0) load_result.scan_batches_per_hour++;  // Scaled at the end
+  }
+}
+
+void loadSend2FAAnswer(LoadLane& lane) {
+  char topic[LOAD_TOPIC_MAX];
+  char payload[128];
+  char ibutton_hex[IBUTTON_HEX_LEN + 1];
+  ibuttonBytesToHex(load_vehicles[lane.vehicle].rom, ibutton_hex);
+  snprintf(topic, sizeof(topic), "%scmd/auth/2fa_response", mqtt_settings.base_topic_prefix);
+  snprintf(payload, sizeof(payload), "{\"ibutton_id\":\"%s\",\"allow_entry\":%s,\"request_id\":%u}", ibutton_hex,
+           lane.answer_allow ? "true" : "false", lane.request_id);
+  hostMqttDeliver(topic, payload, strlen(payload));
+  lane.answer_due = false;
+}
+
+// Arrivals take a free iButton; with none left the arrival is not tracked (like the model's
+// LOT_SIM_MAX_VEHICLES)
+void loadArrival(unsigned long now) {
+  load_result.arrivals++;
+  for (size_t i = 0; i < load_vehicles.size(); i++) {
+    LoadVehicle& vehicle = load_vehicles[i];
+    if (vehicle.state != LOAD_VEHICLE_AWAY) continue;
+    IButtonRecord record;
+    if (getIButtonRecord(vehicle.rom, record) && record.is_inside) continue;  // Left without its exit being seen
+    setIButtonTwoFAPolicy(vehicle.rom,
+                          loadChance(lot_sim_settings.two_fa_percent) ? TWO_FA_POLICY_ALWAYS : TWO_FA_POLICY_NEVER, 0);
+    vehicle.state = LOAD_VEHICLE_QUEUED;
+    vehicle.wants_exit = false;
+    vehicle.queued_ms = now;
+    load_lanes[loadLaneFor(false)].queue.push_back((int)i);
+    return;
+  }
+  load_result.overflow_drops++;
+}
+
+void loadStepLane(uint8_t lane_index, unsigned long now) {
+  LoadLane& lane = load_lanes[lane_index];
+  const LaneConfig& config = lane_settings[lane_index];
+  if (lane.queue.size() > load_result.max_queue_length) load_result.max_queue_length = lane.queue.size();
+
+  switch (lane.phase) {
+    case LOAD_LANE_IDLE:
+      if (lane.queue.empty()) return;
+      lane.vehicle = lane.queue.front();
+      lane.queue.pop_front();
+      load_vehicles[lane.vehicle].state = LOAD_VEHICLE_AT_READER;
+      load_waits_ms.push_back(now - load_vehicles[lane.vehicle].queued_ms);
+      lane.phase = LOAD_LANE_APPROACH;
+      lane.phase_start_ms = now;
+      lane.touches = 0;
+      return;
+
+    case LOAD_LANE_APPROACH:
+      if (now - lane.phase_start_ms < lot_sim_settings.scan_ms) return;
+      lane.buzzer_edges = hostPinRisingEdges(config.actuators.buzzer_pin);
+      hostIButtonTouch(config.reader_pin, load_vehicles[lane.vehicle].rom);
+      lane.touching = true;
+      lane.touches++;
+      load_touches++;
+      lane.phase = LOAD_LANE_TOUCHING;
+      lane.phase_start_ms = now;
+      return;
+
+    case LOAD_LANE_TOUCHING:
+    case LOAD_LANE_2FA:
+      if (lane.touching && now - lane.phase_start_ms >= LOAD_TOUCH_HOLD_MS) {
+        hostIButtonRelease(config.reader_pin);
+        lane.touching = false;
+      }
+      if (hostServoAngle(config.actuators.servo_pin) == config.actuators.servo_open_angle) {
+        LoadVehicle& vehicle = load_vehicles[lane.vehicle];
+        if (vehicle.wants_exit) {
+          load_result.exits++;
+          loadVehicleAway(lane.vehicle);
+        } else {
+          load_result.entries++;
+          vehicle.state = LOAD_VEHICLE_PARKED;
+          vehicle.inside = true;
+          vehicle.leave_ms = now + loadExponential(lot_sim_settings.mean_stay_min * 60000.0);
+          load_inside++;
+          if (load_inside > load_result.max_occupancy) load_result.max_occupancy = load_inside;
+        }
+        lane.phase = LOAD_LANE_GATE;
+        return;
+      }
+      if (hostPinRisingEdges(config.actuators.buzzer_pin) != lane.buzzer_edges) {  // Rejected
+        if (!load_vehicles[lane.vehicle].wants_exit) load_result.full_rejections++;
+        loadVehicleAway(lane.vehicle);
+        loadLaneDone(lane);
+        return;
+      }
+      if (lane.phase == LOAD_LANE_2FA) {
+        if (lane.answer_due && (long)(now - lane.answer_ms) >= 0) {
+          loadSend2FAAnswer(lane);
+          if (!lane.answer_allow) {
+            load_result.two_fa_denied++;
+            loadVehicleAway(lane.vehicle);
+            loadLaneDone(lane);
+          }
+        } else if (!lane.answer_due && now - lane.phase_start_ms >= TWO_FA_TIMEOUT_DURATION_MS + LOAD_2FA_GIVE_UP_MARGIN_MS) {
+          // Never answered, or approved and the gate still did not open
+          if (lane.answer_ms - lane.phase_start_ms >= lot_sim_settings.two_fa_timeout_ms) load_result.two_fa_timeouts++;
+          else load_gave_up++;
+          loadVehicleAway(lane.vehicle);
+          loadLaneDone(lane);
+        }
+        return;
+      }
+      if (now - lane.phase_start_ms >= LOAD_REACTION_TIMEOUT_MS) {  // Touch ignored (hold-off or cooldown)
+        if (lane.touches >= LOAD_MAX_TOUCHES) {
+          load_gave_up++;
+          LoadVehicle& vehicle = load_vehicles[lane.vehicle];
+          if (vehicle.wants_exit) {
+            vehicle.state = LOAD_VEHICLE_PARKED;  // Tries again later
+            vehicle.leave_ms = now + 60000;
+          } else {
+            loadVehicleAway(lane.vehicle);
+          }
+          loadLaneDone(lane);
+          return;
+        }
+        load_retouches++;
+        lane.phase = LOAD_LANE_APPROACH;
+        lane.phase_start_ms = now - lot_sim_settings.scan_ms;  // Still at the reader
+      }
+      return;
+
+    case LOAD_LANE_GATE:
+      if (lane.touching) {
+        hostIButtonRelease(config.reader_pin);
+        lane.touching = false;
+      }
+      if (hostServoAngle(config.actuators.servo_pin) == config.actuators.servo_close_angle) loadLaneDone(lane);
+      return;
+  }
+}
+
+// Checks that the firmware's view of the lot matches the vehicles actually inside
+bool loadCheckConsistency() {
+  bool ok = true;
+  if (current_occupancy != load_inside || readOccupancyCount() != load_inside) {
+    printf("MISMATCH: occupancy RAM %u, stored %u, vehicles inside %u\n", current_occupancy, readOccupancyCount(),
+           load_inside);
+    ok = false;
+  }
+  for (const LoadVehicle& vehicle : load_vehicles) {
+    IButtonRecord record;
+    if (!getIButtonRecord(vehicle.rom, record)) {
+      printf("MISMATCH: iButton no longer registered\n");
+      ok = false;
+    } else if (record.is_inside != vehicle.inside) {
+      printf("MISMATCH: is_inside %d for a vehicle in state %d\n", record.is_inside, vehicle.state);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+
+// --- Main ---
+
+int main(int argc, char** argv) {
+  double hours = lot_sim_settings.duration_s / 3600.0;
+  bool verbose = false;
+  int position = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+      continue;
+    }
+    switch (position++) {
+      case 0: hours = atof(argv[i]); break;
+      case 1: lot_sim_settings.arrivals_per_hour = strtoul(argv[i], nullptr, 10); break;
+      case 2: lot_sim_settings.seed = strtoul(argv[i], nullptr, 10); break;
+    }
+  }
+  lot_sim_settings.duration_s = (uint32_t)(hours * 3600);
+  lot_sim_settings.lanes = PARKING_LANES;
+  load_rng_state = lot_sim_settings.seed ? lot_sim_settings.seed : 1;
+  hostSerialEcho(verbose);
+
+  // Boot until the broker is connected, then register one iButton per registry slot
+  setup();
+  while (millis() < LOAD_BOOT_MS) loop();
+  for (int i = 0; i < getIButtonCapacity(); i++) {
+    LoadVehicle vehicle = {};
+    hostMakeIButtonRom(1000 + i, vehicle.rom);
+    IButtonRecord record;
+    if (!getIButtonRecord(vehicle.rom, record) && !registerIButton(vehicle.rom)) break;
+    vehicle.state = LOAD_VEHICLE_AWAY;
+    load_vehicles.push_back(vehicle);
+  }
+  for (LoadLane& lane : load_lanes) {
+    lane.phase = LOAD_LANE_IDLE;
+    lane.vehicle = -1;
+  }
+  loadDrainBroker();
+  load_mqtt_messages = 0;
+  load_result.scan_batches_per_hour = 0;
+  if (!isMQTTConnected()) {
+    printf("FAIL: broker not connected after boot\n");
+    return 1;
+  }
+
+  unsigned long host_start_ms = (unsigned long)clock() * 1000 / CLOCKS_PER_SEC;
+  unsigned long start_ms = millis();
+  unsigned long end_ms = start_ms + lot_sim_settings.duration_s * 1000UL;
+  unsigned long next_arrival_ms = start_ms + loadExponential(3600000.0 / lot_sim_settings.arrivals_per_hour);
+  while (millis() < end_ms) {
+    unsigned long now = millis();
+    while ((long)(now - next_arrival_ms) >= 0) {
+      loadArrival(now);
+      next_arrival_ms += loadExponential(3600000.0 / lot_sim_settings.arrivals_per_hour);
+    }
+    for (size_t i = 0; i < load_vehicles.size(); i++) {
+      LoadVehicle& vehicle = load_vehicles[i];
+      if (vehicle.state == LOAD_VEHICLE_PARKED && (long)(now - vehicle.leave_ms) >= 0) {
+        vehicle.state = LOAD_VEHICLE_QUEUED;
+        vehicle.wants_exit = true;
+        vehicle.queued_ms = now;
+        load_lanes[loadLaneFor(true)].queue.push_back((int)i);
+      }
+    }
+    loadDrainBroker();
+    for (uint8_t lane = 0; lane < PARKING_LANES; lane++) loadStepLane(lane, now);
+    loop();  // Ends with delay(50): the reader and LCD tasks run meanwhile
+  }
+  // Let the gates close and the last batch go out
+  for (int i = 0; i < 200; i++) loop();
+  loadDrainBroker();
+  unsigned long host_elapsed_ms = (unsigned long)clock() * 1000 / CLOCKS_PER_SEC - host_start_ms;
+
+  // Same figures as the model
+  double run_hours = lot_sim_settings.duration_s / 3600.0;
+  load_result.entries_per_hour = (uint32_t)(load_result.entries / run_hours);
+  load_result.vehicles_per_hour = (uint32_t)((load_result.entries + load_result.exits) / run_hours);
+  load_result.scans_per_hour = (uint32_t)(load_touches / run_hours);
+  load_result.scan_batches_per_hour = (uint32_t)(load_result.scan_batches_per_hour / run_hours);
+  if (!load_waits_ms.empty()) {
+    uint64_t total = 0;
+    for (uint32_t wait : load_waits_ms) total += wait;
+    std::sort(load_waits_ms.begin(), load_waits_ms.end());
+    load_result.mean_wait_ms = (uint32_t)(total / load_waits_ms.size());
+    load_result.p95_wait_ms = load_waits_ms[(load_waits_ms.size() * 95) / 100];
+    load_result.max_wait_ms = load_waits_ms.back();
+  }
+
+  hostSerialEcho(true);
+  Serial.println("\n=== Firmware on the host (virtual clock) ===");
+  printLotSimulation(lot_sim_settings, load_result);
+  Serial.printf("Touches: %u (%u repeated after no reaction, %u vehicles gave up), MQTT messages: %u\n",
+                load_touches, load_retouches, load_gave_up, load_mqtt_messages);
+  Serial.printf("Host time: %lu ms for %.1f simulated hours\n", host_elapsed_ms, run_hours);
+
+  Serial.println("\n=== Model (lot_simulator) ===");
+  LotSimResult model_result;
+  runLotSimulation(lot_sim_settings, model_result);
+  printLotSimulation(lot_sim_settings, model_result);
+
+  bool consistent = loadCheckConsistency();
+  Serial.println(consistent ? "Registry and occupancy consistent with the traffic." : "FAIL: inconsistent state.");
+  return consistent ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+#include "host_test.h"
+
+int host_test_failures = 0;
+
+int hostTestResult() {
+  if (host_test_failures == 0) {
+    fprintf(stderr, "All checks passed.\n");
+    return 0;
+  }
+  fprintf(stderr, "%d check(s) failed.\n", host_test_failures);
+  return 1;
+}
@@ -0,0 +1,34 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+// Host build only: a minimal test harness. Each test file is one executable registered
+// with ctest; a failed CHECK prints its location and the run exits non-zero.
+
+#include <Arduino.h>
+#include "host_fakes.h"
+
+extern int host_test_failures;
+
+#define CHECK(cond)                                                              \
+  do {                                                                           \
+    if (!(cond)) {                                                               \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);   \
+      host_test_failures++;                                                      \
+    }                                                                            \
+  } while (0)
+
+#define RUN_TEST(test)                            \
+  do {                                            \
+    int failures_before = host_test_failures;     \
+    test();                                       \
+    fprintf(stderr, "%s %s\n",                    \
+            host_test_failures == failures_before \
+                ? "[ OK ]" : "[FAIL]", #test);    \
+  } while (0)
+
+/**
+ * @brief Prints the summary and returns the process exit code.
+ */
+int hostTestResult();
+
+#endif // HOST_TEST_H
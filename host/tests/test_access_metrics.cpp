@@ -0,0 +1,119 @@
+// Access latency histograms: bucket edges of the log-linear layout, the catch-all top
+// bucket, and p50/p95/p99/max computed from known samples.
+
+#include "host_test.h"
+#include "access_metrics.h"
+
+// Bucket layout, internal to access_metrics.cpp
+int accessBucketIndex(uint32_t value_us);
+uint32_t accessBucketUpperBound(int index);
+
+// --- Helpers ---
+const uint32_t TOP_BUCKET_START_US = 7UL << 23;  // 58.72 s: first value of the last natural bucket
+const uint32_t CLAMPED_START_US = 1UL << 26;     // 67.11 s: would open bucket 100
+
+
+// --- Tests ---
+
+void testSmallValuesHaveOwnBuckets() {
+  for (uint32_t v = 0; v < 8; v++) {
+    CHECK(accessBucketIndex(v) == (int)v);
+    CHECK(accessBucketUpperBound((int)v) == v);
+  }
+  // From 8 on every power of two is split in 4: 8-9, 10-11, 12-13, 14-15, 16-19...
+  CHECK(accessBucketIndex(8) == 8 && accessBucketIndex(9) == 8);
+  CHECK(accessBucketIndex(10) == 9);
+  CHECK(accessBucketIndex(16) == 12 && accessBucketIndex(19) == 12);
+  CHECK(accessBucketIndex(20) == 13);
+}
+
+void testUpperBoundsAreBucketEdges() {
+  // Each bound belongs to its bucket and the next value opens the following one
+  for (int i = 0; i < ACCESS_HISTOGRAM_BUCKETS - 1; i++) {
+    uint32_t bound = accessBucketUpperBound(i);
+    CHECK(accessBucketIndex(bound) == i);
+    CHECK(accessBucketIndex(bound + 1) == i + 1);
+  }
+  // Relative error of a bound stays within a quarter of the value
+  for (uint32_t v = 4; v < TOP_BUCKET_START_US; v += v / 7 + 1) {
+    uint32_t bound = accessBucketUpperBound(accessBucketIndex(v));
+    CHECK(bound >= v);
+    CHECK((uint64_t)(bound - v) * 4 <= v);
+  }
+}
+
+void testTopBucketTakesEverythingAbove() {
+  const int top = ACCESS_HISTOGRAM_BUCKETS - 1;
+  CHECK(accessBucketIndex(TOP_BUCKET_START_US - 1) == top - 1);
+  CHECK(accessBucketIndex(TOP_BUCKET_START_US) == top);
+  CHECK(accessBucketIndex(CLAMPED_START_US - 1) == top);
+  CHECK(accessBucketIndex(CLAMPED_START_US) == top);
+  CHECK(accessBucketIndex(UINT32_MAX) == top);
+  CHECK(accessBucketUpperBound(top) == UINT32_MAX);
+}
+
+void testPercentilesOfUniformSample() {
+  resetAccessMetrics();
+  for (uint32_t v = 1; v <= 100; v++) accessMetricRecord(ACCESS_STAGE_LOOKUP, v);
+
+  AccessStageStats stats;
+  getAccessStageStats(ACCESS_STAGE_LOOKUP, stats);
+  CHECK(stats.count == 100);
+  CHECK(stats.p50_us == 55);   // 50 lies in 48-55
+  CHECK(stats.p95_us == 95);   // 95 lies in 80-95
+  CHECK(stats.p99_us == 100);  // 99 lies in 96-111, capped by the exact maximum
+  CHECK(stats.max_us == 100);
+
+  // Other stages are untouched
+  getAccessStageStats(ACCESS_STAGE_GATE, stats);
+  CHECK(stats.count == 0 && stats.p50_us == 0 && stats.max_us == 0);
+}
+
+void testTailSamplesMoveOnlyHighPercentiles() {
+  resetAccessMetrics();
+  for (int i = 0; i < 97; i++) accessMetricRecord(ACCESS_STAGE_TOTAL, 1000);
+  for (int i = 0; i < 3; i++) accessMetricRecord(ACCESS_STAGE_TOTAL, 70000000);  // Stuck 2FA, > 67 s
+
+  AccessStageStats stats;
+  getAccessStageStats(ACCESS_STAGE_TOTAL, stats);
+  CHECK(stats.count == 100);
+  CHECK(stats.p50_us == 1023);  // 1000 lies in 896-1023
+  CHECK(stats.p95_us == 1023);
+  CHECK(stats.p99_us == 70000000);  // Top bucket, reported as the exact maximum
+  CHECK(stats.max_us == 70000000);
+}
+
+void testSmallSampleP99IsItsMaximum() {
+  resetAccessMetrics();
+  accessMetricRecord(ACCESS_STAGE_READ, 3);
+  accessMetricRecord(ACCESS_STAGE_READ, 2000);
+
+  AccessStageStats stats;
+  getAccessStageStats(ACCESS_STAGE_READ, stats);
+  CHECK(stats.p50_us == 3);
+  CHECK(stats.p95_us == 2000);
+  CHECK(stats.p99_us == 2000);
+}
+
+void testResetClearsEveryStage() {
+  for (int i = 0; i < ACCESS_STAGE_COUNT; i++) accessMetricRecord((AccessStage)i, 500);
+  resetAccessMetrics();
+  for (int i = 0; i < ACCESS_STAGE_COUNT; i++) {
+    AccessStageStats stats;
+    getAccessStageStats((AccessStage)i, stats);
+    CHECK(stats.count == 0 && stats.max_us == 0 && stats.p99_us == 0);
+  }
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testSmallValuesHaveOwnBuckets);
+  RUN_TEST(testUpperBoundsAreBucketEdges);
+  RUN_TEST(testTopBucketTakesEverythingAbove);
+  RUN_TEST(testPercentilesOfUniformSample);
+  RUN_TEST(testTailSamplesMoveOnlyHighPercentiles);
+  RUN_TEST(testSmallSampleP99IsItsMaximum);
+  RUN_TEST(testResetClearsEveryStage);
+  return hostTestResult();
+}
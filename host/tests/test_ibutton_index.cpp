@@ -0,0 +1,240 @@
+// RAM hash index of the iButton manager: lookups across deleted buckets (tombstones),
+// slot reuse, the rebuild once tombstones pile up, the index after a reboot, migration of
+// a legacy EEPROM registry, and lookup time as the registry grows.
+
+#include "host_test.h"
+#include "ibutton_manager.h"
+#include <chrono>
+#include <map>
+#include <random>
+
+// Index internals, read to check the tombstone bound
+extern uint32_t index_tombstones;
+extern uint32_t index_mask;
+
+// --- Helpers ---
+const uint8_t TEST_PIN = 33;
+const int TEST_RECORDS = 64;
+
+void makeID(uint32_t serial, byte* id_out) {
+  hostMakeIButtonRom(serial, id_out);
+}
+
+bool isRegistered(uint32_t serial, IButtonRecord* record_out = nullptr, int* slot_out = nullptr) {
+  byte id[IBUTTON_ID_LEN];
+  makeID(serial, id);
+  IButtonRecord record;
+  bool found = getIButtonRecord(id, record, slot_out);
+  if (found && record_out != nullptr) *record_out = record;
+  return found;
+}
+
+bool registerSerial(uint32_t serial) {
+  byte id[IBUTTON_ID_LEN];
+  makeID(serial, id);
+  return registerIButton(id);
+}
+
+bool deleteSerial(uint32_t serial) {
+  byte id[IBUTTON_ID_LEN];
+  makeID(serial, id);
+  return deleteIButton(id);
+}
+
+// Wall-clock nanoseconds per lookup (micros() is virtual here), half hits and half
+// misses, best of a few passes to filter out scheduler noise
+double lookupNanos(uint32_t registered) {
+  const int lookups = 20000;
+  double best = 1e30;
+  for (int pass = 0; pass < 5; pass++) {
+    int found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+      uint32_t serial = 1 + (uint32_t)(i * 7919) % (2 * registered);  // Above `registered`: miss
+      found += isRegistered(serial);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(found == lookups / 2);
+    best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / lookups);
+  }
+  return best;
+}
+
+void freshManager() {
+  hostFlashWipe();
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);
+  CHECK(getRegisteredIButtonCount() == 0);
+}
+
+
+// --- Tests ---
+
+void testInsertAndLookup() {
+  freshManager();
+  bool slot_used[TEST_RECORDS] = { false };
+  for (uint32_t serial = 1; serial <= 40; serial++) CHECK(registerSerial(serial));
+  for (uint32_t serial = 1; serial <= 40; serial++) {
+    int slot = -1;
+    CHECK(isRegistered(serial, nullptr, &slot));
+    CHECK(slot >= 0 && slot < TEST_RECORDS && !slot_used[slot]);
+    if (slot >= 0 && slot < TEST_RECORDS) slot_used[slot] = true;
+  }
+  CHECK(!isRegistered(41));
+  CHECK(!registerSerial(7));  // Duplicate
+  CHECK(getRegisteredIButtonCount() == 40);
+}
+
+void testDeleteLeavesTombstones() {
+  freshManager();
+  for (uint32_t serial = 1; serial <= 40; serial++) CHECK(registerSerial(serial));
+  for (uint32_t serial = 2; serial <= 40; serial += 4) CHECK(deleteSerial(serial));
+  CHECK(index_tombstones == 10);
+  // Probe chains that ran through a deleted bucket still reach the later entries
+  for (uint32_t serial = 1; serial <= 40; serial++) {
+    CHECK(isRegistered(serial) == ((serial - 2) % 4 != 0));
+  }
+  CHECK(!deleteSerial(2));  // Already gone
+  CHECK(getRegisteredIButtonCount() == 30);
+}
+
+void testReinsertReusesSlotAndBucket() {
+  freshManager();
+  for (uint32_t serial = 1; serial <= 10; serial++) CHECK(registerSerial(serial));
+  int slot = -1;
+  CHECK(isRegistered(4, nullptr, &slot));
+  IButtonRecord before;
+  CHECK(isRegistered(4, &before));
+  CHECK(deleteSerial(4));
+  CHECK(index_tombstones == 1);
+
+  CHECK(registerSerial(4));
+  int new_slot = -1;
+  IButtonRecord after;
+  CHECK(isRegistered(4, &after, &new_slot));
+  CHECK(new_slot == slot);                                // Lowest free slot
+  CHECK(index_tombstones == 0);                           // Its own tombstone is the first free bucket
+  CHECK(after.associated_id > before.associated_id);      // Associated IDs are never reused
+}
+
+// Random registrations and deletions against a reference map. Tombstones never exceed a
+// quarter of the buckets: the index is rebuilt before probes get long.
+void testChurnKeepsIndexConsistent() {
+  freshManager();
+  std::mt19937 rng(7);
+  std::map<uint32_t, bool> expected;
+  uint32_t bucket_count = index_mask + 1;
+  for (int step = 0; step < 5000; step++) {
+    uint32_t serial = 1 + rng() % 150;
+    bool registered = expected[serial];
+    if (registered) {
+      CHECK(deleteSerial(serial));
+      expected[serial] = false;
+    } else if (getRegisteredIButtonCount() < TEST_RECORDS) {
+      CHECK(registerSerial(serial));
+      expected[serial] = true;
+    } else {
+      CHECK(!registerSerial(serial));  // Full
+    }
+    CHECK(index_tombstones <= bucket_count / 4);
+  }
+  int count = 0;
+  for (const auto& entry : expected) {
+    CHECK(isRegistered(entry.first) == entry.second);
+    if (entry.second) count++;
+  }
+  CHECK(getRegisteredIButtonCount() == count);
+
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);  // Reboot: index rebuilt from the store
+  CHECK(index_tombstones == 0);
+  CHECK(getRegisteredIButtonCount() == count);
+  for (const auto& entry : expected) CHECK(isRegistered(entry.first) == entry.second);
+}
+
+void testFullRegistry() {
+  freshManager();
+  for (uint32_t serial = 1; serial <= TEST_RECORDS; serial++) CHECK(registerSerial(serial));
+  CHECK(!registerSerial(TEST_RECORDS + 1));
+  CHECK(deleteSerial(TEST_RECORDS / 2));
+  CHECK(registerSerial(TEST_RECORDS + 1));
+  CHECK(getRegisteredIButtonCount() == TEST_RECORDS);
+}
+
+// A legacy registry reaches flash in one snapshot, not one journal entry per record
+void testLegacyEEPROMMigration() {
+  hostFlashWipe();
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);
+  HostFlashStats stats;
+  hostFlashStats(stats);
+  uint32_t empty_store_writes = stats.writes;
+
+  uint8_t* eeprom = hostEepromData();
+  uint32_t value = EEPROM_INIT_SIGNATURE;
+  memcpy(eeprom + EEPROM_SIGNATURE_ADDR, &value, sizeof(value));
+  value = 3;
+  memcpy(eeprom + EEPROM_OCCUPANCY_COUNT_ADDR, &value, sizeof(value));
+  value = 900;
+  memcpy(eeprom + EEPROM_NEXT_ASSOCIATED_ID_ADDR, &value, sizeof(value));
+  for (int slot = 0; slot < TEST_RECORDS; slot++) {
+    IButtonRecord record;
+    memset(&record, 0, sizeof(record));
+    record.is_valid = true;
+    record.associated_id = 100 + slot;
+    makeID(slot + 1, record.ibutton_id);
+    memcpy(eeprom + EEPROM_CONFIG_OFFSET + slot * sizeof(IButtonRecord), &record, sizeof(record));
+  }
+
+  hostFlashWipe();
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);
+  hostFlashStats(stats);
+  memset(eeprom, 0xFF, EEPROM_CONFIG_OFFSET);  // Later tests start without a legacy registry
+
+  CHECK(getRegisteredIButtonCount() == TEST_RECORDS);
+  IButtonRecord record;
+  CHECK(isRegistered(TEST_RECORDS, &record) && record.associated_id == 100 + TEST_RECORDS - 1);
+  CHECK(readOccupancyCount() == 3);
+  CHECK(stats.writes <= 2 * empty_store_writes + 2);  // Creation, one compaction, two counters
+  CHECK(stats.writes < (uint32_t)TEST_RECORDS);
+
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);  // Reboot: the snapshot holds every record
+  CHECK(getRegisteredIButtonCount() == TEST_RECORDS);
+}
+
+void testCapacityIsCappedByRAM() {
+  hostFlashWipe();
+  setupIButtonManager(TEST_PIN, MAX_MANAGED_IBUTTONS + 1000);
+  CHECK(getIButtonCapacity() == MAX_MANAGED_IBUTTONS);
+  CHECK(MAX_MANAGED_IBUTTONS * sizeof(IButtonRecord) <= ESP.getMaxAllocHeap());
+  CHECK(MAX_MANAGED_IBUTTONS * IBUTTON_RAM_BYTES_PER_SLOT <= ESP.getFreeHeap());
+  CHECK(registerSerial(1) && isRegistered(1));
+}
+
+// Lookups hash into the RAM index, so their cost stays flat from a small registry to the
+// largest one; a scan over the slots would be 30 times slower at the top size.
+void testLookupTimeIsFlatAsRegistryGrows() {
+  hostFlashWipe();
+  setupIButtonManager(TEST_PIN, MAX_MANAGED_IBUTTONS);
+  const uint32_t sizes[] = { 100, 1000, (uint32_t)MAX_MANAGED_IBUTTONS };
+  double nanos[3];
+  uint32_t serial = 0;
+  for (int i = 0; i < 3; i++) {
+    while (serial < sizes[i]) CHECK(registerSerial(++serial));
+    nanos[i] = lookupNanos(sizes[i]);
+    fprintf(stderr, "  lookup with %4u registered: %6.0f ns\n", sizes[i], nanos[i]);
+  }
+  CHECK(nanos[2] < nanos[0] * 4);
+  CHECK(nanos[1] < nanos[0] * 4);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testInsertAndLookup);
+  RUN_TEST(testDeleteLeavesTombstones);
+  RUN_TEST(testReinsertReusesSlotAndBucket);
+  RUN_TEST(testChurnKeepsIndexConsistent);
+  RUN_TEST(testFullRegistry);
+  RUN_TEST(testLegacyEEPROMMigration);
+  RUN_TEST(testCapacityIsCappedByRAM);
+  RUN_TEST(testLookupTimeIsFlatAsRegistryGrows);
+  return hostTestResult();
+}
@@ -0,0 +1,118 @@
+// iButton reader task on the 1-Wire bus: an empty port costs one reset/presence sequence
+// per poll and no time slots, a held iButton one reset plus a Read ROM per poll, and a
+// touch becomes a single scan event however long the iButton is held.
+
+#include "host_test.h"
+#include "ibutton_manager.h"
+
+// --- Helpers ---
+const uint8_t TEST_PIN = 33;
+const uint8_t SPARE_PIN = 25;  // Its own bus, driven directly by the tests
+const int TEST_RECORDS = 16;
+const uint32_t READ_ROM_SLOTS = 8 + 8 * IBUTTON_ID_LEN;  // Command byte, then the ROM
+const uint32_t POLLS_PER_SECOND = 1000 / IBUTTON_READER_POLL_MS;
+
+struct BusRate {
+  uint32_t resets_per_s;
+  uint32_t slots_per_s;
+  uint32_t busy_permille;  // Share of the time the bus is in use
+};
+
+// Bus traffic on the test pin while the reader task runs for `seconds`
+BusRate measureBus(uint32_t seconds) {
+  uint32_t resets_before = hostOneWireResets(TEST_PIN);
+  uint32_t slots_before = hostOneWireSlots(TEST_PIN);
+  hostAdvanceMillis(seconds * 1000);
+  BusRate rate;
+  rate.resets_per_s = (hostOneWireResets(TEST_PIN) - resets_before) / seconds;
+  rate.slots_per_s = (hostOneWireSlots(TEST_PIN) - slots_before) / seconds;
+  rate.busy_permille = (rate.resets_per_s * HOST_ONEWIRE_RESET_US + rate.slots_per_s * HOST_ONEWIRE_SLOT_US) / 1000;
+  return rate;
+}
+
+bool withinPercent(uint32_t value, uint32_t expected, uint32_t percent) {
+  return value * 100 >= expected * (100 - percent) && value * 100 <= expected * (100 + percent);
+}
+
+uint32_t drainScans(byte* last_id) {
+  uint32_t scans = 0;
+  while (popScannedIButton(last_id)) scans++;
+  return scans;
+}
+
+BusRate idle_rate;
+BusRate active_rate;
+
+
+// --- Tests ---
+
+void testIdlePortCostsOnlyPresenceChecks() {
+  idle_rate = measureBus(10);
+  CHECK(withinPercent(idle_rate.resets_per_s, POLLS_PER_SECOND, 10));
+  CHECK(idle_rate.slots_per_s == 0);  // Nothing answered, nothing read
+  byte id[IBUTTON_ID_LEN];
+  CHECK(drainScans(id) == 0);
+}
+
+void testHeldIButtonIsReadWithReadROM() {
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(42, rom);
+  hostIButtonTouch(TEST_PIN, rom);
+  active_rate = measureBus(10);
+  CHECK(withinPercent(active_rate.resets_per_s, POLLS_PER_SECOND, 10));
+  CHECK(active_rate.slots_per_s == active_rate.resets_per_s * READ_ROM_SLOTS);
+
+  byte id[IBUTTON_ID_LEN];
+  CHECK(drainScans(id) == 1);  // Held for 10 s, still one touch
+  CHECK(memcmp(id, rom, IBUTTON_ID_LEN) == 0);
+
+  hostIButtonRelease(TEST_PIN);
+  hostAdvanceMillis(IBUTTON_RELEASE_MS * 2);
+  hostIButtonTouch(TEST_PIN, rom);  // A second touch is a new event
+  hostAdvanceMillis(IBUTTON_READER_POLL_MS * 2);
+  CHECK(drainScans(id) == 1);
+  hostIButtonRelease(TEST_PIN);
+  hostAdvanceMillis(IBUTTON_RELEASE_MS * 2);
+}
+
+// One read of a present iButton: Read ROM against the ROM search it replaced
+void testReadROMCostsLessThanASearch() {
+  OneWire bus(SPARE_PIN);
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(7, rom);
+  hostIButtonTouch(SPARE_PIN, rom);
+
+  uint32_t slots_before = hostOneWireSlots(SPARE_PIN);
+  byte found[IBUTTON_ID_LEN];
+  bus.reset_search();
+  CHECK(bus.search(found));
+  uint32_t search_slots = hostOneWireSlots(SPARE_PIN) - slots_before;
+
+  slots_before = hostOneWireSlots(SPARE_PIN);
+  CHECK(bus.reset());
+  bus.write(ONEWIRE_CMD_READ_ROM);
+  bus.read_bytes(found, IBUTTON_ID_LEN);
+  uint32_t read_rom_slots = hostOneWireSlots(SPARE_PIN) - slots_before;
+  CHECK(memcmp(found, rom, IBUTTON_ID_LEN) == 0);
+
+  CHECK(read_rom_slots == READ_ROM_SLOTS);
+  CHECK(read_rom_slots * 2 < search_slots);
+  fprintf(stderr, "  one read: Read ROM %u slots, ROM search %u slots\n", read_rom_slots, search_slots);
+  hostIButtonRelease(SPARE_PIN);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  hostFlashWipe();
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);
+  CHECK(startIButtonReaderTask());
+  RUN_TEST(testIdlePortCostsOnlyPresenceChecks);
+  RUN_TEST(testHeldIButtonIsReadWithReadROM);
+  RUN_TEST(testReadROMCostsLessThanASearch);
+  fprintf(stderr, "  bus idle: %u resets/s, %u slots/s (%u.%u%% busy); held: %u resets/s, %u slots/s (%u.%u%% busy)\n",
+          idle_rate.resets_per_s, idle_rate.slots_per_s, idle_rate.busy_permille / 10, idle_rate.busy_permille % 10,
+          active_rate.resets_per_s, active_rate.slots_per_s, active_rate.busy_permille / 10,
+          active_rate.busy_permille % 10);
+  return hostTestResult();
+}
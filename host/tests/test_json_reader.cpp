@@ -0,0 +1,192 @@
+// JSON reader of the MQTT commands: a corpus of valid and malformed command payloads
+// with the fields they must yield, then random mutations of that corpus checked for
+// writes outside the output buffers and for consistent answers.
+
+#include "host_test.h"
+#include "json_reader.h"
+#include <random>
+#include <string>
+#include <vector>
+
+// --- Helpers ---
+const int FUZZ_ITERATIONS = 200000;
+const uint32_t CANARY = 0xC0FFEE11;
+const uint32_t NOT_SET = 0xDEADBEEF;
+
+// Output buffers of a 2FA response, between canaries that must survive every read
+struct TwoFAOutput {
+  uint32_t canary_before;
+  char ibutton_id[17];
+  uint32_t canary_middle;
+  bool allow_entry;
+  uint32_t request_id;
+  uint32_t canary_after;
+};
+
+struct TwoFAResult {
+  bool ok;
+  bool has_id;
+  bool has_allow;
+  bool has_request;
+  TwoFAOutput out;
+};
+
+// Reads the fields handle2FAResponse() asks for, from an exact-size copy of the payload
+TwoFAResult read2FA(const std::string& payload) {
+  std::vector<byte> bytes(payload.begin(), payload.end());
+  TwoFAResult result;
+  memset(&result.out, 0x5A, sizeof(result.out));
+  result.out.canary_before = result.out.canary_middle = result.out.canary_after = CANARY;
+  result.out.request_id = NOT_SET;
+  JsonField fields[] = {
+    { "ibutton_id", JSON_FIELD_STRING, result.out.ibutton_id, sizeof(result.out.ibutton_id), false },
+    { "allow_entry", JSON_FIELD_BOOL, &result.out.allow_entry, 0, false },
+    { "request_id", JSON_FIELD_UINT, &result.out.request_id, 0, false },
+  };
+  result.ok = jsonReadObject(bytes.data(), bytes.size(), fields, 3);
+  result.has_id = fields[0].found;
+  result.has_allow = fields[1].found;
+  result.has_request = fields[2].found;
+  return result;
+}
+
+bool canariesIntact(const TwoFAResult& result) {
+  return result.out.canary_before == CANARY && result.out.canary_middle == CANARY
+         && result.out.canary_after == CANARY;
+}
+
+bool sameAnswer(const TwoFAResult& a, const TwoFAResult& b) {
+  if (a.ok != b.ok || a.has_id != b.has_id || a.has_allow != b.has_allow || a.has_request != b.has_request) {
+    return false;
+  }
+  if (a.has_id && strcmp(a.out.ibutton_id, b.out.ibutton_id) != 0) return false;
+  if (a.has_allow && a.out.allow_entry != b.out.allow_entry) return false;
+  return !a.has_request || a.out.request_id == b.out.request_id;
+}
+
+// One corpus entry: the payload and what the 2FA handler must get from it
+struct CorpusEntry {
+  const char* payload;
+  bool ok;
+  const char* ibutton_id;  // nullptr: not found
+  int allow_entry;         // -1: not found
+  int64_t request_id;      // -1: not found
+};
+
+const CorpusEntry corpus[] = {
+  // Valid, in the shapes apps actually send
+  { "{\"ibutton_id\":\"015A3C110000009E\",\"allow_entry\":true,\"request_id\":7}", true, "015A3C110000009E", 1, 7 },
+  { "{ \"ibutton_id\" : \"015A3C110000009E\" , \"allow_entry\" : false }", true, "015A3C110000009E", 0, -1 },
+  { "{\n\t\"request_id\": 4294967295,\r\n\t\"allow_entry\": true,\n\t\"ibutton_id\": \"01\"\n}\n", true, "01", 1, 4294967295LL },
+  { "{\"app\":{\"version\":\"2.1\",\"tags\":[\"a}\",\"b]\",{\"x\":[1,2]}]},\"allow_entry\":true}", true, nullptr, 1, -1 },
+  { "{\"note\":\"quote \\\" and \\\\ and \\u0041\",\"ibutton_id\":\"\\u0030\\u0031\"}", true, "01", -1, -1 },
+  { "{\"x\":null,\"y\":-3,\"z\":1.5e3,\"allow_entry\":false,\"request_id\":0}", true, nullptr, 0, 0 },
+  { "{}", true, nullptr, -1, -1 },
+  { "  {}  ", true, nullptr, -1, -1 },
+  // Valid, but a field has the wrong type or does not fit: the field is not found
+  { "{\"ibutton_id\":\"015A3C110000009E00\",\"allow_entry\":\"true\",\"request_id\":\"7\"}", true, nullptr, -1, -1 },
+  { "{\"ibutton_id\":16,\"allow_entry\":1,\"request_id\":-7}", true, nullptr, -1, -1 },
+  { "{\"request_id\":4294967296}", true, nullptr, -1, -1 },
+  { "{\"request_id\":7.0}", true, nullptr, -1, -1 },
+  { "{\"ibutton_id_long_key_that_cannot_match_any_field_at_all\":\"x\"}", true, nullptr, -1, -1 },
+  // Malformed
+  { "", false, nullptr, -1, -1 },
+  { "[]", false, nullptr, -1, -1 },
+  { "{", false, nullptr, -1, -1 },
+  { "{\"allow_entry\":true", false, nullptr, 1, -1 },
+  { "{\"allow_entry\" true}", false, nullptr, -1, -1 },
+  { "{\"allow_entry\":tru}", false, nullptr, -1, -1 },
+  { "{\"allow_entry\":true,}", false, nullptr, 1, -1 },
+  { "{\"allow_entry\":true \"request_id\":1}", false, nullptr, 1, -1 },
+  { "{allow_entry:true}", false, nullptr, -1, -1 },
+  { "{\"ibutton_id\":\"01\\x\"}", false, nullptr, -1, -1 },
+  { "{\"ibutton_id\":\"01\\u00G1\"}", false, nullptr, -1, -1 },
+  { "{\"ibutton_id\":\"01\n\"}", false, nullptr, -1, -1 },
+  { "{\"ibutton_id\":\"01", false, nullptr, -1, -1 },
+  { "{\"app\":{\"a\":[1,2}", false, nullptr, -1, -1 },
+  { "{\"allow_entry\":true}}", false, nullptr, 1, -1 },
+  { "{\"allow_entry\":true} x", false, nullptr, 1, -1 },
+};
+const int CORPUS_SIZE = sizeof(corpus) / sizeof(corpus[0]);
+
+// Bytes that steer a mutation towards the reader's decisions
+const char MUTATION_BYTES[] = "{}[]\":,\\ \t\nu0aZtfn-.e9";
+
+
+// --- Tests ---
+
+void testCorpusYieldsExpectedFields() {
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    const CorpusEntry& entry = corpus[i];
+    TwoFAResult result = read2FA(entry.payload);
+    bool match = result.ok == entry.ok && canariesIntact(result);
+    match = match && result.has_id == (entry.ibutton_id != nullptr);
+    if (match && result.has_id) match = strcmp(result.out.ibutton_id, entry.ibutton_id) == 0;
+    match = match && result.has_allow == (entry.allow_entry >= 0);
+    if (match && result.has_allow) match = result.out.allow_entry == (entry.allow_entry == 1);
+    match = match && result.has_request == (entry.request_id >= 0);
+    if (match && result.has_request) match = result.out.request_id == (uint32_t)entry.request_id;
+    if (!match) fprintf(stderr, "  corpus entry %d: %s\n", i, entry.payload);
+    CHECK(match);
+  }
+}
+
+// Random mutations of the corpus: never a write past an output buffer, always a
+// terminated string when one is found, the same answer twice, and whitespace around an
+// accepted object changes nothing
+void testMutatedCorpusIsReadSafely() {
+  std::mt19937 rng(2024);
+  int accepted = 0;
+  int failures = 0;
+  for (int iteration = 0; iteration < FUZZ_ITERATIONS && failures < 10; iteration++) {
+    std::string payload = corpus[rng() % CORPUS_SIZE].payload;
+    int mutations = 1 + rng() % 4;
+    for (int m = 0; m < mutations; m++) {
+      size_t pos = payload.empty() ? 0 : rng() % (payload.size() + 1);
+      char byte_value = rng() % 4 == 0 ? (char)(rng() % 256) : MUTATION_BYTES[rng() % (sizeof(MUTATION_BYTES) - 1)];
+      switch (rng() % 5) {
+        case 0:
+          if (pos < payload.size()) payload[pos] = byte_value;
+          break;
+        case 1:
+          payload.insert(pos, 1, byte_value);
+          break;
+        case 2:
+          if (pos < payload.size()) payload.erase(pos, 1 + rng() % 3);
+          break;
+        case 3:
+          payload.resize(pos);  // Truncated message
+          break;
+        case 4:
+          if (pos < payload.size()) payload.insert(pos, payload.substr(pos, 1 + rng() % 8));
+          break;
+      }
+    }
+
+    TwoFAResult result = read2FA(payload);
+    bool safe = canariesIntact(result);
+    if (result.has_id) safe = safe && memchr(result.out.ibutton_id, '\0', sizeof(result.out.ibutton_id)) != nullptr;
+    if (!result.has_request) safe = safe && result.out.request_id == NOT_SET;
+    safe = safe && sameAnswer(result, read2FA(payload));
+    if (result.ok) {
+      accepted++;
+      safe = safe && sameAnswer(result, read2FA(" \n" + payload + "\t "));
+    }
+    if (!safe) {
+      failures++;
+      fprintf(stderr, "  mutation %d: %s\n", iteration, payload.c_str());
+    }
+  }
+  CHECK(failures == 0);
+  // The mutations must still reach the accepting paths, not only the early rejections
+  CHECK(accepted > FUZZ_ITERATIONS / 20);
+  fprintf(stderr, "  %d mutated payloads, %d accepted\n", FUZZ_ITERATIONS, accepted);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testCorpusYieldsExpectedFields);
+  RUN_TEST(testMutatedCorpusIsReadSafely);
+  return hostTestResult();
+}
@@ -0,0 +1,127 @@
+// LCD manager: callers never wait on the I2C bus (the renderer task draws), the direct
+// drawing fallback when that task cannot start, and the renderer sends only the cells
+// that differ from what is already on the glass.
+
+#include "host_test.h"
+#include "lcd_manager.h"
+
+// --- Helpers ---
+const uint32_t FULL_REDRAW_CELLS = LCD_COLS * LCD_ROWS;  // clear() and both lines rewritten
+
+char glass_before[LCD_ROWS][LCD_COLS + 1];
+
+void snapshotGlass() {
+  for (uint8_t row = 0; row < LCD_ROWS; row++) {
+    strncpy(glass_before[row], hostLcdRow(row), LCD_COLS);
+    glass_before[row][LCD_COLS] = '\0';
+  }
+}
+
+// Cells whose character differs from the last snapshot
+uint32_t changedCells() {
+  uint32_t changed = 0;
+  for (uint8_t row = 0; row < LCD_ROWS; row++) {
+    const char* now = hostLcdRow(row);
+    for (int col = 0; col < LCD_COLS; col++) {
+      if (now[col] != glass_before[row][col]) changed++;
+    }
+  }
+  return changed;
+}
+
+// A burst of calls as the scan path makes them; returns the I2C time spent before they
+// returned (the clock does not move, so no task runs meanwhile)
+uint64_t callerBusMicros() {
+  uint64_t before = hostLcdBusMicros();
+  lcdPrintTemporary("Abriendo...", "Bienvenido!", 2000);
+  lcdDisplayOccupancy(1, 3);
+  lcdPrintTemporary("Acceso Concedido", "Bienvenido!", 2000);
+  return hostLcdBusMicros() - before;
+}
+
+uint64_t direct_caller_us = 0;
+
+// Shows an occupancy and returns the characters the renderer sent for it
+uint32_t renderOccupancy(uint32_t occupied, uint32_t total) {
+  snapshotGlass();
+  uint32_t writes_before = hostLcdCellWrites();
+  loopLCDManager(occupied, total);
+  hostAdvanceMillis(1);
+  return hostLcdCellWrites() - writes_before;
+}
+
+
+// --- Tests ---
+
+// Runs first, before any renderer task exists
+void testDirectDrawingWhenTheTaskCannotStart() {
+  hostFailNextTaskCreate();
+  CHECK(setupLCDManager());
+  direct_caller_us = callerBusMicros();
+  CHECK(direct_caller_us > 0);
+  CHECK(strncmp(hostLcdRow(0), "Acceso Concedido", LCD_COLS) == 0);  // Drawn before returning
+
+  hostAdvanceMillis(1000);
+  loopLCDManager(1, 3);
+  CHECK(strncmp(hostLcdRow(0), "Acceso Concedido", LCD_COLS) == 0);
+  hostAdvanceMillis(1000);
+  loopLCDManager(1, 3);  // Expires the temporary without a renderer
+  CHECK(strncmp(hostLcdRow(1), "  1/3 Libres:2  ", LCD_COLS) == 0);
+}
+
+void testCallsDoNotWaitForTheBus() {
+  uint64_t queued_caller_us = callerBusMicros();
+  CHECK(queued_caller_us == 0);
+  CHECK(strncmp(hostLcdRow(0), "Acceso Concedido", LCD_COLS) != 0);  // Not drawn yet
+
+  uint64_t before = hostLcdBusMicros();
+  hostAdvanceMillis(1);
+  CHECK(strncmp(hostLcdRow(0), "Acceso Concedido", LCD_COLS) == 0);  // The renderer drew it
+  CHECK(hostLcdBusMicros() > before);
+  fprintf(stderr, "  I2C time on the caller per burst: direct %llu us, queued %llu us\n",
+          (unsigned long long)direct_caller_us, (unsigned long long)queued_caller_us);
+  hostAdvanceMillis(2000);
+}
+
+void testFullQueueDropsAndCounts() {
+  uint32_t drops_before = getLCDDropCount();
+  for (int i = 0; i < LCD_RENDER_QUEUE_LENGTH + 3; i++) lcdPrintLines("Linea", "", true);
+  CHECK(getLCDDropCount() - drops_before == 3);
+  hostAdvanceMillis(1);
+}
+
+void testOccupancyChangeWritesOnlyChangedCells() {
+  renderOccupancy(2, 3);
+  CHECK(strncmp(hostLcdRow(1), "  2/3 Libres:1  ", LCD_COLS) == 0);
+
+  // One car in: "2/3 Libres:1" -> "3/3 Libres:0", two digits
+  uint32_t writes = renderOccupancy(3, 3);
+  CHECK(strncmp(hostLcdRow(0), "   Ocupacion:   ", LCD_COLS) == 0);
+  CHECK(strncmp(hostLcdRow(1), "  3/3 Libres:0  ", LCD_COLS) == 0);
+  CHECK(changedCells() == 2);
+  CHECK(writes == 2);
+  CHECK(writes < FULL_REDRAW_CELLS);
+
+  // The line grows by a digit and shifts: still only the cells that differ
+  renderOccupancy(9, 10);
+  writes = renderOccupancy(10, 10);
+  CHECK(writes == changedCells());
+  CHECK(writes < FULL_REDRAW_CELLS);
+}
+
+void testUnchangedOccupancyWritesNothing() {
+  renderOccupancy(1, 3);
+  CHECK(renderOccupancy(1, 3) == 0);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testDirectDrawingWhenTheTaskCannotStart);
+  CHECK(setupLCDManager());
+  RUN_TEST(testCallsDoNotWaitForTheBus);
+  RUN_TEST(testFullQueueDropsAndCounts);
+  RUN_TEST(testOccupancyChangeWritesOnlyChangedCells);
+  RUN_TEST(testUnchangedOccupancyWritesNothing);
+  return hostTestResult();
+}
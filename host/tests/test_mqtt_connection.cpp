@@ -0,0 +1,68 @@
+// Broker connection of the MQTT manager: the broker name is looked up once per WiFi
+// connection, and an unreachable broker holds the loop for a bounded time per attempt.
+
+#include "host_test.h"
+#include "mqtt_manager.h"
+
+// --- Helpers ---
+const MQTTConfig TEST_CONFIG = { "broker.test", 1883, "test-", "test/", false };
+const unsigned long TEST_STEP_MS = 10;
+const unsigned long MAX_CONNECT_STALL_MS = 1000;  // An unreachable broker never accepts the TCP connect
+
+unsigned long longest_pass_ms = 0;
+
+// Runs the loop as the sketch does, tracking the longest single pass
+void runFor(unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    unsigned long start = millis();
+    loopMQTTManager();
+    if (millis() - start > longest_pass_ms) longest_pass_ms = millis() - start;
+    hostAdvanceMillis(TEST_STEP_MS);
+    HostMqttMessage message;
+    while (hostMqttTakePublished(message)) {
+    }
+  }
+}
+
+
+// --- Tests ---
+
+void testBrokerNameResolvedOncePerWiFiConnection() {
+  setupMQTTManager(TEST_CONFIG, "ssid", "password");
+  runFor(5000);
+  CHECK(isMQTTConnected());
+  CHECK(hostDnsLookupCount() == 1);
+  CHECK(strcmp(hostMqttConnectedHost(), "10.0.0.2") == 0);  // Connected by address
+
+  // Broker down for ten minutes: many attempts, no new lookups, each pass bounded
+  uint32_t attempts_before = hostMqttConnectCount();
+  longest_pass_ms = 0;
+  hostMqttSetBrokerAvailable(false);
+  runFor(600000);
+  CHECK(!isMQTTConnected());
+  CHECK(hostMqttConnectCount() - attempts_before >= 10);
+  CHECK(hostDnsLookupCount() == 1);
+  CHECK(longest_pass_ms > 0 && longest_pass_ms <= MAX_CONNECT_STALL_MS);
+
+  hostMqttSetBrokerAvailable(true);
+  runFor(120000);
+  CHECK(isMQTTConnected());
+  CHECK(hostDnsLookupCount() == 1);
+
+  // A new WiFi connection may come with another DNS server: the name is looked up again
+  hostWiFiSetAvailable(false);
+  runFor(5000);
+  CHECK(!isMQTTConnected());
+  hostWiFiSetAvailable(true);
+  runFor(120000);
+  CHECK(isMQTTConnected());
+  CHECK(hostDnsLookupCount() == 2);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testBrokerNameResolvedOncePerWiFiConnection);
+  return hostTestResult();
+}
@@ -0,0 +1,124 @@
+// Command dispatch of the MQTT manager: one cmd/# subscription per session, the sorted
+// route table, and its cost per message against the if/else chain it replaced.
+
+#include "host_test.h"
+#include "mqtt_manager.h"
+#include <chrono>
+#include <string>
+
+// Dispatch table lookup, internal to mqtt_manager.cpp
+struct CommandRoute;
+const CommandRoute* findCommandRoute(const char* suffix);
+
+// --- Helpers ---
+const MQTTConfig TEST_CONFIG = { "broker.test", 1883, "test-", "test/", false };
+const int BENCH_ROUNDS = 200000;
+
+// Every command the app sends, as topic suffixes after "test/cmd/"
+const char* const command_suffixes[] = {
+  "initiate_pairing", "cancel_pairing", "auth/2fa_response", "ibutton/initiate_delete_mode",
+  "ibutton/cancel_delete_mode", "ibutton/set_2fa_policy", "registry/export", "registry/import",
+};
+const int COMMAND_COUNT = sizeof(command_suffixes) / sizeof(command_suffixes[0]);
+
+void runFor(unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    loopMQTTManager();
+    hostAdvanceMillis(10);
+  }
+}
+
+bool takePublished(const char* topic) {
+  bool seen = false;
+  HostMqttMessage message;
+  while (hostMqttTakePublished(message)) {
+    if (strcmp(message.topic, topic) == 0) seen = true;
+  }
+  return seen;
+}
+
+// The callback before the table: the full topic rebuilt and compared for each command
+// in turn, as cmd_topic_base + "..." did with String
+int chainDispatch(const std::string& topic) {
+  const std::string cmd_topic_base = std::string(TEST_CONFIG.base_topic_prefix) + "cmd/";
+  for (int i = 0; i < COMMAND_COUNT; i++) {
+    if (topic == cmd_topic_base + command_suffixes[i]) return i;
+  }
+  return -1;
+}
+
+// What mqttCallback() does with a topic: prefix check, then the table
+const char cmd_prefix[] = "test/cmd/";
+const void* tableDispatch(const char* topic) {
+  if (strncmp(topic, cmd_prefix, sizeof(cmd_prefix) - 1) != 0) return nullptr;
+  return findCommandRoute(topic + sizeof(cmd_prefix) - 1);
+}
+
+template <typename F>
+double nanosPerMessage(F dispatch) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < BENCH_ROUNDS; round++) dispatch(round % (COMMAND_COUNT + 1));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / BENCH_ROUNDS;
+}
+
+
+// --- Tests ---
+
+void testOneSubscriptionPerSession() {
+  CHECK(isMQTTConnected());
+  CHECK(hostMqttSubscriptionCount() == 1);
+
+  // A reconnect subscribes once again, not once per command
+  hostMqttSetBrokerAvailable(false);
+  runFor(3000);
+  CHECK(!isMQTTConnected());
+  hostMqttSetBrokerAvailable(true);
+  runFor(30000);
+  CHECK(isMQTTConnected());
+  CHECK(hostMqttSubscriptionCount() == 1);
+}
+
+void testEveryCommandHasARoute() {
+  for (int i = 0; i < COMMAND_COUNT; i++) CHECK(findCommandRoute(command_suffixes[i]) != nullptr);
+  const char* near_misses[] = { "", "auth", "auth/2fa_respons", "auth/2fa_responses", "Initiate_pairing",
+                                "registry/", "registry/export/x", "zzz" };
+  for (const char* suffix : near_misses) CHECK(findCommandRoute(suffix) == nullptr);
+}
+
+void testCommandReachesItsHandler() {
+  const char pairing[] = "{\"pairing_session_id\":\"s-1\"}";
+  hostMqttDeliver("test/cmd/initiate_pairing", pairing, strlen(pairing));
+  runFor(100);
+  CHECK(takePublished("test/pairing/ready_for_ibutton"));
+
+  hostMqttDeliver("test/cmd/initiate_pairingx", pairing, strlen(pairing));
+  runFor(100);
+  CHECK(!takePublished("test/pairing/ready_for_ibutton"));
+}
+
+// Cost per message over a mix of every command plus one unknown topic
+void testDispatchCostPerMessage() {
+  std::string topics[COMMAND_COUNT + 1];
+  for (int i = 0; i < COMMAND_COUNT; i++) topics[i] = std::string(cmd_prefix) + command_suffixes[i];
+  topics[COMMAND_COUNT] = std::string(cmd_prefix) + "unknown";
+
+  volatile uintptr_t sink = 0;
+  double table_ns = nanosPerMessage([&](int i) { sink = sink + (uintptr_t)tableDispatch(topics[i].c_str()); });
+  double chain_ns = nanosPerMessage([&](int i) { sink = sink + (uintptr_t)chainDispatch(topics[i]); });
+  fprintf(stderr, "  dispatch per message: table %.0f ns, String chain %.0f ns\n", table_ns, chain_ns);
+  CHECK(table_ns < chain_ns);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  setupMQTTManager(TEST_CONFIG, "ssid", "password");
+  runFor(5000);
+  RUN_TEST(testOneSubscriptionPerSession);
+  RUN_TEST(testEveryCommandHasARoute);
+  RUN_TEST(testCommandReachesItsHandler);
+  RUN_TEST(testDispatchCostPerMessage);
+  return hostTestResult();
+}
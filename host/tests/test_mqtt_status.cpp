@@ -0,0 +1,128 @@
+// Retained status of the MQTT manager: published when occupancy or capacity change and
+// on every new broker connection, re-sent as a heartbeat when nothing changes, and
+// replaced by the broker's Last Will {"online":false} when the device drops off.
+
+#include "host_test.h"
+#include "mqtt_manager.h"
+#include <string>
+
+// --- Helpers ---
+const MQTTConfig TEST_CONFIG = { "broker.test", 1883, "test-", "test/", false };
+const char STATUS_TOPIC[] = "test/status";
+
+struct StatusLog {
+  uint32_t count;
+  bool all_retained;
+  std::string last;  // Payload of the last one
+};
+
+// Runs the manager and collects the status messages the broker got meanwhile
+StatusLog runFor(unsigned long ms) {
+  StatusLog log = { 0, true, "" };
+  unsigned long end = millis() + ms;
+  while (true) {
+    HostMqttMessage message;
+    while (hostMqttTakePublished(message)) {
+      if (strcmp(message.topic, STATUS_TOPIC) != 0) continue;
+      log.count++;
+      log.all_retained = log.all_retained && message.retained;
+      log.last.assign((const char*)message.payload, message.length);
+    }
+    if ((long)(millis() - end) >= 0) break;
+    loopMQTTManager();
+    hostAdvanceMillis(10);
+  }
+  return log;
+}
+
+bool has(const std::string& payload, const char* member) {
+  return payload.find(member) != std::string::npos;
+}
+
+
+// --- Tests ---
+
+void testPublishedOnlyWhenSomethingChanges() {
+  reportStatus(1, 3);
+  StatusLog log = runFor(1000);
+  CHECK(log.count == 1);
+  CHECK(log.all_retained);
+  CHECK(has(log.last, "\"online\":true"));
+  CHECK(has(log.last, "\"occupancy\":1"));
+  CHECK(has(log.last, "\"total_spaces\":3"));
+
+  // The sketch reports on every loop() pass; the same values publish nothing
+  uint32_t repeats = 0;
+  for (int i = 0; i < 600; i++) {
+    reportStatus(1, 3);
+    repeats += runFor(100).count;
+  }
+  CHECK(repeats == 0);
+
+  reportStatus(2, 3);  // A car in
+  log = runFor(1000);
+  CHECK(log.count == 1);
+  CHECK(has(log.last, "\"occupancy\":2"));
+
+  reportStatus(2, 4);  // Capacity changed
+  log = runFor(1000);
+  CHECK(log.count == 1);
+  CHECK(has(log.last, "\"total_spaces\":4"));
+}
+
+void testHeartbeatWhenNothingChanges() {
+  reportStatus(3, 4);
+  CHECK(runFor(1000).count == 1);
+  CHECK(runFor(STATUS_HEARTBEAT_MS - 10000).count == 0);
+  StatusLog log = runFor(20000);
+  CHECK(log.count == 1);
+  CHECK(log.all_retained);
+  CHECK(has(log.last, "\"occupancy\":3"));
+
+  // Then one per period
+  CHECK(runFor(3 * STATUS_HEARTBEAT_MS).count == 3);
+}
+
+void testLastWillReplacesStatusWhenTheDeviceDropsOff() {
+  hostMqttSetBrokerAvailable(false);
+  StatusLog log = runFor(3000);
+  CHECK(!isMQTTConnected());
+  CHECK(log.count == 1);
+  CHECK(log.all_retained);
+  CHECK(has(log.last, "\"online\":false"));
+  CHECK(!has(log.last, "occupancy"));
+
+  // Changes while offline are not queued: the next connection publishes the latest
+  reportStatus(1, 4);
+  reportStatus(0, 4);
+  hostMqttSetBrokerAvailable(true);
+  log = runFor(30000);
+  CHECK(isMQTTConnected());
+  CHECK(log.count == 1);
+  CHECK(has(log.last, "\"online\":true"));
+  CHECK(has(log.last, "\"occupancy\":0"));
+}
+
+// A reconnect replaces the will on the topic even when nothing else changed
+void testReconnectRepublishesUnchangedStatus() {
+  hostMqttSetBrokerAvailable(false);
+  CHECK(has(runFor(3000).last, "\"online\":false"));
+  hostMqttSetBrokerAvailable(true);
+  StatusLog log = runFor(30000);
+  CHECK(isMQTTConnected());
+  CHECK(log.count == 1);
+  CHECK(has(log.last, "\"online\":true"));
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  setupMQTTManager(TEST_CONFIG, "ssid", "password");
+  runFor(5000);
+  CHECK(isMQTTConnected());
+  RUN_TEST(testPublishedOnlyWhenSomethingChanges);
+  RUN_TEST(testHeartbeatWhenNothingChanges);
+  RUN_TEST(testLastWillReplacesStatusWhenTheDeviceDropsOff);
+  RUN_TEST(testReconnectRepublishesUnchangedStatus);
+  return hostTestResult();
+}
@@ -0,0 +1,149 @@
+// Outbound queue: FIFO delivery, coalescing, priority eviction when full, and the RTC copy
+// surviving a software reset only while its CRC matches.
+
+#include "host_test.h"
+#include "outbound_queue.h"
+
+// The RTC block of the queue, corrupted byte by byte below
+struct OutboundQueueState;
+extern OutboundQueueState outbound_state;
+
+// --- Helpers ---
+bool push(const char* topic, const char* payload, OutboundPriority priority = OUTBOUND_PRIORITY_NORMAL,
+          bool coalesce = false) {
+  return outboundQueuePush(topic, (const byte*)payload, strlen(payload), false, priority, coalesce);
+}
+
+bool popExpect(const char* topic, const char* payload) {
+  const OutboundMessage* message = outboundQueuePeek();
+  bool match = message != nullptr && strcmp(message->sub_topic, topic) == 0
+               && message->payload_len == strlen(payload) && memcmp(message->payload, payload, strlen(payload)) == 0;
+  outboundQueuePop();
+  return match;
+}
+
+void freshQueue() {
+  memset(&outbound_state, 0, 64);  // Break the magic: cold boot
+  setupOutboundQueue();
+  CHECK(getOutboundQueueDepth() == 0);
+}
+
+
+// --- Tests ---
+
+void testFifoOrder() {
+  freshQueue();
+  CHECK(push("a", "1"));
+  CHECK(push("b", "2"));
+  CHECK(push("c", "3"));
+  CHECK(popExpect("a", "1"));
+  CHECK(popExpect("b", "2"));
+  CHECK(popExpect("c", "3"));
+  CHECK(outboundQueuePeek() == nullptr);
+}
+
+void testCoalescingReplacesInPlace() {
+  freshQueue();
+  CHECK(push("status", "old", OUTBOUND_PRIORITY_NORMAL, true));
+  CHECK(push("event", "e"));
+  CHECK(push("status", "new", OUTBOUND_PRIORITY_NORMAL, true));
+  CHECK(getOutboundQueueDepth() == 2);
+  CHECK(popExpect("status", "new"));  // Keeps the position of the first one
+  CHECK(popExpect("event", "e"));
+  OutboundQueueStats stats;
+  getOutboundQueueStats(stats);
+  CHECK(stats.coalesced == 1);
+}
+
+void testFullQueueEvictsOldestNormal() {
+  freshQueue();
+  CHECK(push("high/0", "h", OUTBOUND_PRIORITY_HIGH));
+  char topic[16];
+  for (int i = 1; i < OUTBOUND_QUEUE_CAPACITY; i++) {
+    snprintf(topic, sizeof(topic), "normal/%d", i);
+    CHECK(push(topic, "n"));
+  }
+  CHECK(getOutboundQueueDepth() == OUTBOUND_QUEUE_CAPACITY);
+
+  CHECK(push("normal/new", "n"));  // Evicts normal/1, not the older high/0
+  CHECK(push("high/new", "h", OUTBOUND_PRIORITY_HIGH));  // Evicts normal/2, still not high/0
+  CHECK(getOutboundQueueDepth() == OUTBOUND_QUEUE_CAPACITY);
+  CHECK(popExpect("high/0", "h"));
+  CHECK(popExpect("normal/3", "n"));
+  OutboundQueueStats stats;
+  getOutboundQueueStats(stats);
+  CHECK(stats.evicted == 2 && stats.dropped == 0);
+}
+
+void testAllHighDropsNewNormal() {
+  freshQueue();
+  char topic[16];
+  for (int i = 0; i < OUTBOUND_QUEUE_CAPACITY; i++) {
+    snprintf(topic, sizeof(topic), "high/%d", i);
+    CHECK(push(topic, "h", OUTBOUND_PRIORITY_HIGH));
+  }
+  CHECK(!push("normal", "n"));  // Everything queued outranks it
+  CHECK(push("high/new", "h", OUTBOUND_PRIORITY_HIGH));  // Same priority: the oldest goes
+  CHECK(popExpect("high/1", "h"));
+  OutboundQueueStats stats;
+  getOutboundQueueStats(stats);
+  CHECK(stats.dropped == 1 && stats.evicted == 1);
+}
+
+void testOversizedMessageIsRejected() {
+  freshQueue();
+  char payload[OUTBOUND_PAYLOAD_MAX_LEN + 2];
+  memset(payload, 'x', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = '\0';
+  CHECK(!push("big", payload));
+  CHECK(!push("a/sub/topic/that/is/far/too/long/for/the/slot", "1"));
+  CHECK(getOutboundQueueDepth() == 0);
+}
+
+void testBinaryPayloadKeepsLength() {
+  freshQueue();
+  const byte cbor[] = { 0xA1, 0x61, 0x6E, 0x00, 0x00 };  // Embedded NULs
+  CHECK(outboundQueuePush("bin", cbor, sizeof(cbor), false, OUTBOUND_PRIORITY_NORMAL, false));
+  const OutboundMessage* message = outboundQueuePeek();
+  CHECK(message != nullptr && message->payload_len == sizeof(cbor));
+  CHECK(message != nullptr && memcmp(message->payload, cbor, sizeof(cbor)) == 0);
+}
+
+void testRestoredAfterReset() {
+  freshQueue();
+  CHECK(push("a", "1"));
+  CHECK(push("b", "2"));
+  outboundQueuePop();
+  setupOutboundQueue();  // Software reset: RTC memory kept
+  CHECK(getOutboundQueueDepth() == 1);
+  CHECK(popExpect("b", "2"));
+}
+
+// Any corrupted byte of the RTC block (brownout, stray write) means a fresh, empty queue
+void testCorruptedCopyIsDiscarded() {
+  const size_t offsets[] = { 0, 4, 8, 40, 300 };
+  for (size_t offset : offsets) {
+    freshQueue();
+    CHECK(push("a", "1"));
+    CHECK(push("b", "2"));
+    ((byte*)&outbound_state)[offset] ^= 0x01;
+    setupOutboundQueue();
+    CHECK(getOutboundQueueDepth() == 0);
+    CHECK(push("c", "3"));  // Usable again
+    CHECK(popExpect("c", "3"));
+  }
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testFifoOrder);
+  RUN_TEST(testCoalescingReplacesInPlace);
+  RUN_TEST(testFullQueueEvictsOldestNormal);
+  RUN_TEST(testAllHighDropsNewNormal);
+  RUN_TEST(testOversizedMessageIsRejected);
+  RUN_TEST(testBinaryPayloadKeepsLength);
+  RUN_TEST(testRestoredAfterReset);
+  RUN_TEST(testCorruptedCopyIsDiscarded);
+  return hostTestResult();
+}
@@ -0,0 +1,120 @@
+// Outbound MQTT encoding never touches the heap: every publish path is run with malloc
+// counted, online and while the broker is down (messages go to the outbound queue).
+
+#include "host_test.h"
+#include "mqtt_manager.h"
+#include "scan_telemetry.h"
+
+void publishStatusIfDue();  // Internal to mqtt_manager.cpp, run from loopMQTTManager()
+
+// --- Allocation counter ---
+// glibc: the executable's malloc() takes precedence over the library's, so operator new,
+// std::string and the fakes' String all come through here
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+size_t heap_allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+  heap_allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  heap_allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+  heap_allocations++;
+  return __libc_realloc(ptr, size);
+}
+
+// --- Helpers ---
+const MQTTConfig TEST_CONFIG = { "broker.test", 1883, "test-", "test/", false };
+const byte TEST_ID[IBUTTON_ID_LEN] = { 0x01, 0x5A, 0x3C, 0x11, 0x00, 0x00, 0x00, 0x9E };
+
+void runFor(unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    loopMQTTManager();
+    hostAdvanceMillis(10);
+  }
+}
+
+// Drains what the broker got and tells whether topic was among it
+bool takePublished(const char* topic) {
+  bool seen = false;
+  HostMqttMessage message;
+  while (hostMqttTakePublished(message)) {
+    if (strcmp(message.topic, topic) == 0) seen = true;
+  }
+  return seen;
+}
+
+// Runs every publish path once and returns the allocations they made
+size_t allocationsOfEveryPublish() {
+  uint32_t touch_us = micros();
+  size_t before = heap_allocations;
+  publish2FARequest(TEST_ID, 1042, "test-device", touch_us, 0);
+  scanTelemetryRecord(TEST_ID, true, 1042, 0, SCAN_OUTCOME_ENTRY);
+  scanTelemetryRecord(TEST_ID, false, INVALID_ASSOCIATED_ID, 0, SCAN_OUTCOME_UNREGISTERED);
+  publishScanBatch();
+  publishPairingReady("a1f0c2d4-7e55-4b1a-9c3e-2f6d8b0e4a17");
+  publishPairingSuccess("a1f0c2d4-7e55-4b1a-9c3e-2f6d8b0e4a17", TEST_ID, 1042);
+  publishPairingFailure("a1f0c2d4-7e55-4b1a-9c3e-2f6d8b0e4a17", "timeout");
+  publishDeleteReady();
+  publishDeleteSuccess(TEST_ID);
+  publishDeleteFailure("not_found", TEST_ID);
+  reportStatus(2, 3);
+  publishStatusIfDue();
+  reportStatus(1, 3);
+  publishStatusIfDue();
+  return heap_allocations - before;
+}
+
+
+// --- Tests ---
+
+void testOnlinePublishesDoNotAllocate() {
+  allocationsOfEveryPublish();  // Warm-up: first-use initialisation of the fakes
+  takePublished("");
+  runFor(TWO_FA_TIMEOUT_DURATION_MS + 1000);  // Frees the 2FA session of the warm-up
+  takePublished("");
+
+  size_t allocations = allocationsOfEveryPublish();
+  CHECK(allocations == 0);
+  if (allocations != 0) fprintf(stderr, "  %zu allocations online\n", allocations);
+  CHECK(takePublished("test/auth/2fa_request"));
+}
+
+void testQueuedPublishesDoNotAllocate() {
+  hostMqttSetBrokerAvailable(false);
+  runFor(3000);
+  CHECK(!isMQTTConnected());
+  takePublished("");  // The Last Will
+
+  size_t allocations = allocationsOfEveryPublish();
+  CHECK(allocations == 0);
+  if (allocations != 0) fprintf(stderr, "  %zu allocations offline\n", allocations);
+
+  // What was queued goes out on reconnect
+  hostMqttSetBrokerAvailable(true);
+  runFor(30000);
+  CHECK(isMQTTConnected());
+  CHECK(takePublished("test/pairing/success"));
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  setupMQTTManager(TEST_CONFIG, "ssid", "password");
+  ScanTelemetryConfig telemetry = { 2, 60000 };
+  setupScanTelemetry(telemetry);
+  runFor(5000);
+  CHECK(isMQTTConnected());
+  RUN_TEST(testOnlinePublishesDoNotAllocate);
+  RUN_TEST(testQueuedPublishesDoNotAllocate);
+  return hostTestResult();
+}
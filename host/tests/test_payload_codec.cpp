@@ -0,0 +1,162 @@
+// JSON and CBOR payloads: whatever PayloadWriter writes, payloadReadObject() reads back
+// the same way in both formats.
+
+#include "host_test.h"
+#include "payload_codec.h"
+#include "cbor_reader.h"
+
+// --- Helpers ---
+const PayloadFormat TEST_FORMATS[] = { PAYLOAD_FORMAT_JSON, PAYLOAD_FORMAT_CBOR };
+const byte TEST_ID[8] = { 0x01, 0xA2, 0xB3, 0xC4, 0x00, 0x00, 0x00, 0x5F };
+
+struct DecodedStatus {
+  char device[24];
+  char note[48];
+  char id_hex[17];
+  uint32_t occupancy;
+  uint32_t big;
+  bool online;
+  bool offline;
+};
+
+void readStatus(const char* buf, size_t length, DecodedStatus& out, JsonField* fields, bool& ok) {
+  memset(&out, 0, sizeof(out));
+  JsonField template_fields[] = {
+    { "device", JSON_FIELD_STRING, out.device, sizeof(out.device), false },
+    { "note", JSON_FIELD_STRING, out.note, sizeof(out.note), false },
+    { "id", JSON_FIELD_STRING, out.id_hex, sizeof(out.id_hex), false },
+    { "occupancy", JSON_FIELD_UINT, &out.occupancy, 0, false },
+    { "big", JSON_FIELD_UINT, &out.big, 0, false },
+    { "online", JSON_FIELD_BOOL, &out.online, 0, false },
+    { "offline", JSON_FIELD_BOOL, &out.offline, 0, false },
+  };
+  memcpy(fields, template_fields, sizeof(template_fields));
+  ok = payloadReadObject((const byte*)buf, length, fields, 7);
+}
+
+size_t writeStatus(PayloadFormat format, char* buf, size_t size, bool& fit) {
+  PayloadWriter w;
+  payloadBegin(w, format, buf, size);
+  payloadAddString(w, "device", "esp32-A1B2");
+  payloadAddString(w, "note", "quote \" slash \\ tab \t end");
+  payloadAddID(w, "id", TEST_ID, sizeof(TEST_ID));
+  payloadAddUInt(w, "occupancy", 3);
+  payloadAddUInt(w, "big", 4000000000UL);
+  payloadAddBool(w, "online", true);
+  payloadAddBool(w, "offline", false);
+  fit = payloadEnd(w);
+  return payloadLength(w);
+}
+
+
+// --- Tests ---
+
+void testRoundTripBothFormats() {
+  for (PayloadFormat format : TEST_FORMATS) {
+    char buf[256];
+    bool fit = false;
+    size_t length = writeStatus(format, buf, sizeof(buf), fit);
+    CHECK(fit);
+    CHECK(payloadDetectFormat((const byte*)buf, length) == format);
+
+    DecodedStatus status;
+    JsonField fields[7];
+    bool ok = false;
+    readStatus(buf, length, status, fields, ok);
+    CHECK(ok);
+    for (const JsonField& field : fields) CHECK(field.found);
+    CHECK(strcmp(status.device, "esp32-A1B2") == 0);
+    CHECK(strcmp(status.note, "quote \" slash \\ tab \t end") == 0);
+    CHECK(strcmp(status.id_hex, "01A2B3C40000005F") == 0);  // Hex text in JSON, byte string in CBOR
+    CHECK(status.occupancy == 3);
+    CHECK(status.big == 4000000000UL);
+    CHECK(status.online);
+    CHECK(!status.offline);
+  }
+}
+
+void testCborIsSmaller() {
+  char json[256];
+  char cbor[256];
+  bool fit = false;
+  size_t json_len = writeStatus(PAYLOAD_FORMAT_JSON, json, sizeof(json), fit);
+  size_t cbor_len = writeStatus(PAYLOAD_FORMAT_CBOR, cbor, sizeof(cbor), fit);
+  CHECK(cbor_len < json_len);
+  CHECK(cborLooksLikeMap((const byte*)cbor, cbor_len));
+  CHECK(!cborLooksLikeMap((const byte*)json, json_len));
+}
+
+void testArraysAreSkippedByTheReader() {
+  for (PayloadFormat format : TEST_FORMATS) {
+    char buf[256];
+    PayloadWriter w;
+    payloadBegin(w, format, buf, sizeof(buf));
+    payloadAddUInt(w, "count", 2);
+    payloadBeginArray(w, "events", 2);
+    for (uint32_t i = 0; i < 2; i++) {
+      payloadBeginElement(w);
+      payloadAddUInt(w, "lane", i);
+      payloadAddString(w, "outcome", "entry");
+      payloadEndElement(w);
+    }
+    payloadEndArray(w);
+    payloadAddBool(w, "last", true);
+    CHECK(payloadEnd(w));
+
+    uint32_t count = 0;
+    bool last = false;
+    JsonField fields[] = {
+      { "count", JSON_FIELD_UINT, &count, 0, false },
+      { "last", JSON_FIELD_BOOL, &last, 0, false },
+    };
+    CHECK(payloadReadObject((const byte*)buf, payloadLength(w), fields, 2));
+    CHECK(fields[0].found && count == 2);
+    CHECK(fields[1].found && last);  // Read past the nested array
+  }
+}
+
+void testBufferTooSmall() {
+  for (PayloadFormat format : TEST_FORMATS) {
+    char buf[24];
+    bool fit = true;
+    writeStatus(format, buf, sizeof(buf), fit);
+    CHECK(!fit);
+  }
+}
+
+void testTruncatedPayloadIsRejected() {
+  for (PayloadFormat format : TEST_FORMATS) {
+    char buf[256];
+    bool fit = false;
+    size_t length = writeStatus(format, buf, sizeof(buf), fit);
+    DecodedStatus status;
+    JsonField fields[7];
+    bool ok = true;
+    readStatus(buf, length - 3, status, fields, ok);
+    CHECK(!ok);
+  }
+}
+
+void testWrongTypesAndOversizedStrings() {
+  const char* json = "{\"occupancy\":\"3\",\"online\":1,\"device\":\"a-device-name-much-too-long-for-the-buffer\"}";
+  DecodedStatus status;
+  JsonField fields[7];
+  bool ok = false;
+  readStatus(json, strlen(json), status, fields, ok);
+  CHECK(ok);              // Well-formed object
+  CHECK(!fields[0].found);  // device does not fit
+  CHECK(!fields[3].found);  // occupancy is a string
+  CHECK(!fields[5].found);  // online is a number
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testRoundTripBothFormats);
+  RUN_TEST(testCborIsSmaller);
+  RUN_TEST(testArraysAreSkippedByTheReader);
+  RUN_TEST(testBufferTooSmall);
+  RUN_TEST(testTruncatedPayloadIsRejected);
+  RUN_TEST(testWrongTypesAndOversizedStrings);
+  return hostTestResult();
+}
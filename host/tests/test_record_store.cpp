@@ -0,0 +1,209 @@
+// Record store on the fake NOR partition: journal replay across reboots and compactions,
+// and recovery from power cuts in the middle of a batch or a compaction.
+
+#include "host_test.h"
+#include "record_store.h"
+
+// --- Helpers ---
+const int TEST_RECORDS = 64;
+
+IButtonRecord makeRecord(uint32_t serial) {
+  IButtonRecord record;
+  memset(&record, 0, sizeof(record));
+  record.is_valid = true;
+  record.associated_id = 1000 + serial;
+  record.ibutton_id[0] = 0x01;
+  memcpy(&record.ibutton_id[1], &serial, sizeof(serial));
+  return record;
+}
+
+bool slotHolds(int slot, uint32_t serial) {
+  IButtonRecord record;
+  storeGetRecord(slot, record);
+  IButtonRecord expected = makeRecord(serial);
+  return record.is_valid && record.associated_id == expected.associated_id
+         && memcmp(record.ibutton_id, expected.ibutton_id, IBUTTON_ID_LEN) == 0;
+}
+
+bool slotEmpty(int slot) {
+  IButtonRecord record;
+  storeGetRecord(slot, record);
+  return !record.is_valid;
+}
+
+void freshStore() {
+  hostFlashWipe();
+  CHECK(beginRecordStore(TEST_RECORDS));
+  CHECK(recordStoreWasCreated());
+}
+
+
+// --- Tests ---
+
+void testJournalReplaysAfterReboot() {
+  freshStore();
+  CHECK(storePutRecord(0, makeRecord(1)));
+  CHECK(storePutRecord(5, makeRecord(2)));
+  CHECK(storePutCounter(STORE_COUNTER_OCCUPANCY, 2));
+  IButtonRecord deleted;
+  memset(&deleted, 0, sizeof(deleted));
+  CHECK(storePutRecord(0, deleted));
+
+  CHECK(beginRecordStore(TEST_RECORDS));  // Reboot
+  CHECK(!recordStoreWasCreated());
+  CHECK(slotEmpty(0));
+  CHECK(slotHolds(5, 2));
+  CHECK(storeGetCounter(STORE_COUNTER_OCCUPANCY) == 2);
+}
+
+void testReplayAcrossCompactions() {
+  freshStore();
+  // Enough single-entry batches to fill a journal and compact into the other bank more than once
+  const uint32_t updates = 50000;
+  for (uint32_t i = 0; i < updates; i++) {
+    if (!storePutRecord(i % TEST_RECORDS, makeRecord(i))) {
+      CHECK(false);
+      return;
+    }
+  }
+  CHECK(storePutCounter(STORE_COUNTER_OCCUPANCY, 7));
+
+  CHECK(beginRecordStore(TEST_RECORDS));
+  for (int slot = 0; slot < TEST_RECORDS; slot++) {
+    uint32_t last = (updates - 1) - ((updates - 1 - slot) % TEST_RECORDS);  // Last update of this slot
+    CHECK(slotHolds(slot, last));
+  }
+  CHECK(storeGetCounter(STORE_COUNTER_OCCUPANCY) == 7);
+}
+
+void testBatchAppliesTogether() {
+  freshStore();
+  storeBeginBatch();
+  CHECK(storeBatchActive());
+  CHECK(storePutRecord(1, makeRecord(10)));
+  CHECK(storePutRecord(2, makeRecord(11)));
+  CHECK(storePutCounter(STORE_COUNTER_OCCUPANCY, 2));
+  CHECK(slotHolds(1, 10));  // Visible in RAM before the commit
+  CHECK(storeCommitBatch());
+
+  CHECK(beginRecordStore(TEST_RECORDS));
+  CHECK(slotHolds(1, 10));
+  CHECK(slotHolds(2, 11));
+  CHECK(storeGetCounter(STORE_COUNTER_OCCUPANCY) == 2);
+}
+
+void testAbortedBatchRollsBack() {
+  freshStore();
+  CHECK(storePutRecord(1, makeRecord(10)));
+  storeBeginBatch();
+  CHECK(storePutRecord(1, makeRecord(20)));
+  CHECK(storePutCounter(STORE_COUNTER_OCCUPANCY, 9));
+  storeAbortBatch();
+  CHECK(slotHolds(1, 10));
+  CHECK(storeGetCounter(STORE_COUNTER_OCCUPANCY) == 0);
+}
+
+// Power fails after some entries of a batch, during the next write or just before it: the
+// batch is rolled back in RAM and discarded on replay, and the journal keeps working after
+// the reboot
+void testTornBatchIsDiscarded() {
+  for (int run = 0; run < 8; run++) {
+    int entries_written = run / 2;
+    bool torn = run % 2 == 0;
+    freshStore();
+    CHECK(storePutRecord(0, makeRecord(1)));
+
+    storeBeginBatch();
+    CHECK(storePutRecord(1, makeRecord(2)));
+    CHECK(storePutRecord(2, makeRecord(3)));
+    CHECK(storePutRecord(3, makeRecord(4)));
+    CHECK(storePutCounter(STORE_COUNTER_OCCUPANCY, 3));
+    hostFlashFailAfterWrites(entries_written, torn);  // The last of the 4 entries carries the commit flag
+    CHECK(!storeCommitBatch());
+    CHECK(slotEmpty(1));  // Rolled back in RAM
+    CHECK(storeGetCounter(STORE_COUNTER_OCCUPANCY) == 0);
+
+    hostFlashPowerRestore();
+    CHECK(beginRecordStore(TEST_RECORDS));
+    CHECK(slotHolds(0, 1));
+    CHECK(slotEmpty(1));
+    CHECK(slotEmpty(2));
+    CHECK(slotEmpty(3));
+    CHECK(storeGetCounter(STORE_COUNTER_OCCUPANCY) == 0);
+
+    // Appends after the torn entry survive the next reboot
+    CHECK(storePutRecord(4, makeRecord(5)));
+    CHECK(beginRecordStore(TEST_RECORDS));
+    CHECK(slotHolds(4, 5));
+    CHECK(slotEmpty(1));
+  }
+}
+
+// Power fails while writing the snapshot or the header of a compaction: the previous bank
+// stays in charge with its journal
+void testTornCompactionKeepsPreviousBank() {
+  for (int writes = 0; writes < 2; writes++) {
+    freshStore();
+    CHECK(storePutRecord(0, makeRecord(1)));
+    CHECK(storePutCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID, 42));
+
+    hostFlashFailAfterWrites(writes);  // 0: snapshot torn, 1: header torn
+    CHECK(!compactRecordStore());
+    hostFlashPowerRestore();
+
+    CHECK(beginRecordStore(TEST_RECORDS));
+    CHECK(!recordStoreWasCreated());
+    CHECK(slotHolds(0, 1));
+    CHECK(storeGetCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID) == 42);
+  }
+}
+
+void testUnloggedChangeNeedsCompaction() {
+  freshStore();
+  storePutRecordUnlogged(3, makeRecord(30));
+  CHECK(beginRecordStore(TEST_RECORDS));
+  CHECK(slotEmpty(3));  // Forgotten by a reboot before the compaction
+
+  storePutRecordUnlogged(3, makeRecord(30));
+  CHECK(compactRecordStore());
+  CHECK(beginRecordStore(TEST_RECORDS));
+  CHECK(slotHolds(3, 30));
+}
+
+// One hot record rewritten over and over: the journal walks both banks, so every sector of
+// the partition wears at the same rate and an update costs 1/128 of a sector erase
+void testWearIsSpreadOverThePartition() {
+  freshStore();
+  const uint32_t entries_per_sector = RECORD_STORE_SECTOR_SIZE / 32;
+  const uint32_t updates = 150000;  // About three cycles through each bank
+  for (uint32_t i = 0; i < updates; i++) {
+    IButtonRecord record = makeRecord(1);
+    record.is_inside = (i % 2) != 0;
+    CHECK(storePutRecord(0, record));
+  }
+
+  HostFlashStats stats;
+  hostFlashStats(stats);
+  CHECK(stats.min_sector_erases >= 2);
+  CHECK(stats.max_sector_erases - stats.min_sector_erases <= 1);
+  CHECK(stats.erases <= updates / entries_per_sector + 2 * stats.max_sector_erases);  // Journal plus snapshots
+
+  CHECK(beginRecordStore(TEST_RECORDS));  // Reboot
+  IButtonRecord record;
+  storeGetRecord(0, record);
+  CHECK(record.is_inside == ((updates - 1) % 2 != 0));
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testJournalReplaysAfterReboot);
+  RUN_TEST(testReplayAcrossCompactions);
+  RUN_TEST(testBatchAppliesTogether);
+  RUN_TEST(testAbortedBatchRollsBack);
+  RUN_TEST(testTornBatchIsDiscarded);
+  RUN_TEST(testTornCompactionKeepsPreviousBank);
+  RUN_TEST(testUnloggedChangeNeedsCompaction);
+  RUN_TEST(testWearIsSpreadOverThePartition);
+  return hostTestResult();
+}
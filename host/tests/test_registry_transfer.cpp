@@ -0,0 +1,316 @@
+// Bulk registry export and import: chunks through the JSON and CBOR wire formats, CRC and
+// sequence checks, the idle timeout, and all-or-nothing commits.
+
+#include "host_test.h"
+#include "registry_transfer.h"
+#include <string>
+#include <vector>
+
+// --- Helpers ---
+const uint8_t TEST_PIN = 33;
+const int TEST_RECORDS = 300;
+const PayloadFormat TEST_FORMATS[] = { PAYLOAD_FORMAT_JSON, PAYLOAD_FORMAT_CBOR };
+
+// Serial n, with its own associated ID except for every 7th record, which gets a new one
+IButtonRecord makeRecord(uint32_t serial) {
+  IButtonRecord record;
+  memset(&record, 0, sizeof(record));
+  record.is_valid = true;
+  hostMakeIButtonRom(serial, record.ibutton_id);
+  record.associated_id = serial % 7 == 0 ? INVALID_ASSOCIATED_ID : 5000 + serial;
+  record.two_fa_policy = serial % 3;
+  if (record.two_fa_policy == TWO_FA_POLICY_GRANT_WINDOW) record.two_fa_grant_minutes = 1 + serial % 600;
+  return record;
+}
+
+bool isRegistered(uint32_t serial, IButtonRecord* record_out = nullptr) {
+  IButtonRecord wanted = makeRecord(serial);
+  IButtonRecord record;
+  bool found = getIButtonRecord(wanted.ibutton_id, record);
+  if (found && record_out != nullptr) *record_out = record;
+  return found;
+}
+
+// Chunk seq of an import of the records first_serial .. first_serial + total - 1
+RegistryChunk makeImportChunk(uint32_t transfer_id, uint32_t seq, uint32_t first_serial, uint32_t total) {
+  RegistryChunk chunk;
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.transfer_id = transfer_id;
+  chunk.seq = seq;
+  uint32_t first = seq * REGISTRY_CHUNK_RECORDS;
+  chunk.count = (uint8_t)min<uint32_t>(REGISTRY_CHUNK_RECORDS, total - first);
+  chunk.last = first + chunk.count >= total;
+  for (int i = 0; i < chunk.count; i++) {
+    packRegistryRecord(makeRecord(first_serial + first + i), &chunk.data[i * REGISTRY_RECORD_WIRE_LEN]);
+  }
+  return chunk;
+}
+
+std::string encodeChunk(const RegistryChunk& chunk, PayloadFormat format) {
+  char buf[REGISTRY_CHUNK_PAYLOAD_MAX];
+  PayloadWriter w;
+  payloadBegin(w, format, buf, sizeof(buf));
+  encodeRegistryChunk(w, chunk);
+  CHECK(payloadEnd(w));
+  return std::string(buf, payloadLength(w));
+}
+
+RegistryImportStatus applyWire(const std::string& wire) {
+  RegistryChunk chunk;
+  if (decodeRegistryChunk((const byte*)wire.data(), wire.size(), chunk) != REGISTRY_CHUNK_OK) {
+    return REGISTRY_IMPORT_MALFORMED;
+  }
+  return applyRegistryImportChunk(chunk);
+}
+
+// Sends a whole import; returns the status of the last chunk
+RegistryImportStatus importRange(uint32_t transfer_id, uint32_t first_serial, uint32_t total, PayloadFormat format) {
+  RegistryImportStatus status = REGISTRY_IMPORT_FAILED;
+  for (uint32_t seq = 0; seq * REGISTRY_CHUNK_RECORDS < total; seq++) {
+    status = applyWire(encodeChunk(makeImportChunk(transfer_id, seq, first_serial, total), format));
+    if (status != REGISTRY_IMPORT_ACCEPTED) break;
+  }
+  return status;
+}
+
+std::vector<std::string> exportAll(uint32_t transfer_id, uint32_t from_seq, uint32_t from_slot, PayloadFormat format) {
+  std::vector<std::string> chunks;
+  beginRegistryExport(transfer_id, from_seq, from_slot);
+  RegistryChunk chunk;
+  while (peekRegistryExportChunk(chunk)) {
+    chunks.push_back(encodeChunk(chunk, format));
+    consumeRegistryExportChunk();
+  }
+  return chunks;
+}
+
+void freshManager() {
+  hostFlashWipe();
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);
+}
+
+
+// --- Tests ---
+
+void testRecordWireRoundTrip() {
+  for (uint32_t serial = 1; serial < 20; serial++) {
+    IButtonRecord record = makeRecord(serial);
+    byte wire[REGISTRY_RECORD_WIRE_LEN];
+    packRegistryRecord(record, wire);
+    IButtonRecord back;
+    unpackRegistryRecord(wire, back);
+    CHECK(memcmp(back.ibutton_id, record.ibutton_id, IBUTTON_ID_LEN) == 0);
+    CHECK(back.associated_id == record.associated_id);
+    CHECK(back.two_fa_policy == record.two_fa_policy);
+    CHECK(back.two_fa_grant_minutes == record.two_fa_grant_minutes);
+    CHECK(back.is_valid && !back.is_inside);
+  }
+}
+
+void testImportThenExportBothFormats() {
+  for (PayloadFormat format : TEST_FORMATS) {
+    freshManager();
+    CHECK(importRange(1, 1, 95, format) == REGISTRY_IMPORT_COMMITTED);
+    RegistryImportStats stats;
+    getRegistryImportStats(stats);
+    CHECK(stats.staged == 95 && stats.skipped == 0);
+    CHECK(getRegisteredIButtonCount() == 95);
+
+    IButtonRecord record;
+    CHECK(isRegistered(8, &record) && record.associated_id == 5008);
+    CHECK(isRegistered(14, &record) && record.associated_id > 5095);  // Numbered after the imported IDs
+
+    std::vector<std::string> chunks = exportAll(2, 0, 0, format);
+    CHECK(chunks.size() == 10);
+    uint32_t exported = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+      RegistryChunk chunk;
+      CHECK(decodeRegistryChunk((const byte*)chunks[i].data(), chunks[i].size(), chunk) == REGISTRY_CHUNK_OK);
+      CHECK(chunk.transfer_id == 2 && chunk.seq == i);
+      CHECK(chunk.last == (i == chunks.size() - 1));
+      exported += chunk.count;
+    }
+    CHECK(exported == 95);
+    CHECK(!isRegistryExportActive());
+
+    // The export imports unchanged on a blank device
+    freshManager();
+    for (const std::string& wire : chunks) applyWire(wire);
+    CHECK(getRegisteredIButtonCount() == 95);
+    for (uint32_t serial = 1; serial <= 95; serial++) {
+      IButtonRecord expected = makeRecord(serial);
+      CHECK(isRegistered(serial, &record));
+      CHECK(record.two_fa_policy == expected.two_fa_policy);
+      if (expected.associated_id != INVALID_ASSOCIATED_ID) CHECK(record.associated_id == expected.associated_id);
+    }
+  }
+}
+
+void testEmptyRegistryExportsOneLastChunk() {
+  freshManager();
+  std::vector<std::string> chunks = exportAll(3, 0, 0, PAYLOAD_FORMAT_JSON);
+  CHECK(chunks.size() == 1);
+  RegistryChunk chunk;
+  CHECK(decodeRegistryChunk((const byte*)chunks[0].data(), chunks[0].size(), chunk) == REGISTRY_CHUNK_OK);
+  CHECK(chunk.count == 0 && chunk.last);
+}
+
+void testCorruptedChunkIsDetected() {
+  freshManager();
+  std::string json = encodeChunk(makeImportChunk(4, 0, 1, 30), PAYLOAD_FORMAT_JSON);
+  size_t records = json.find("\"records\":\"") + 11;
+  std::string flipped = json;
+  flipped[records] = flipped[records] == '0' ? '1' : '0';
+  RegistryChunk chunk;
+  CHECK(decodeRegistryChunk((const byte*)flipped.data(), flipped.size(), chunk) == REGISTRY_CHUNK_BAD_CRC);
+
+  std::string bad_hex = json;
+  bad_hex[records] = 'G';
+  CHECK(decodeRegistryChunk((const byte*)bad_hex.data(), bad_hex.size(), chunk) == REGISTRY_CHUNK_MALFORMED);
+
+  std::string short_records = json;
+  short_records.erase(records, 2);
+  CHECK(decodeRegistryChunk((const byte*)short_records.data(), short_records.size(), chunk) == REGISTRY_CHUNK_MALFORMED);
+
+  std::string cbor = encodeChunk(makeImportChunk(4, 0, 1, 30), PAYLOAD_FORMAT_CBOR);
+  cbor[cbor.size() - 1] ^= 0x01;  // Last record byte
+  CHECK(decodeRegistryChunk((const byte*)cbor.data(), cbor.size(), chunk) == REGISTRY_CHUNK_BAD_CRC);
+
+  const char* missing = "{\"transfer_id\":4,\"seq\":0,\"last\":true,\"count\":0}";
+  CHECK(decodeRegistryChunk((const byte*)missing, strlen(missing), chunk) == REGISTRY_CHUNK_MALFORMED);
+}
+
+void testSequenceHandling() {
+  freshManager();
+  const uint32_t total = 30;
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 1, 1, total)) == REGISTRY_IMPORT_NO_SESSION);  // Not opened
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 0, 1, total)) == REGISTRY_IMPORT_ACCEPTED);
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 0, 1, total)) == REGISTRY_IMPORT_ACCEPTED);   // Seq 0 restarts
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 2, 1, total)) == REGISTRY_IMPORT_OUT_OF_ORDER);  // 1 lost
+  CHECK(applyRegistryImportChunk(makeImportChunk(6, 1, 1, total)) == REGISTRY_IMPORT_NO_SESSION);  // Other transfer
+  RegistryImportStats stats;
+  getRegistryImportStats(stats);
+  CHECK(stats.next_seq == 1 && stats.staged == 10);
+
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 1, 1, total)) == REGISTRY_IMPORT_ACCEPTED);
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 1, 1, total)) == REGISTRY_IMPORT_OUT_OF_ORDER);  // Repeated
+  CHECK(getRegisteredIButtonCount() == 0);  // Nothing live before the last chunk
+  CHECK(!isRegistered(1));
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 2, 1, total)) == REGISTRY_IMPORT_COMMITTED);
+  CHECK(getRegisteredIButtonCount() == (int)total);
+  CHECK(applyRegistryImportChunk(makeImportChunk(5, 3, 1, total)) == REGISTRY_IMPORT_NO_SESSION);  // Closed
+
+  setupIButtonManager(TEST_PIN, TEST_RECORDS);  // Reboot: the commit is durable
+  CHECK(getRegisteredIButtonCount() == (int)total);
+}
+
+void testDuplicatesAreSkipped() {
+  freshManager();
+  IButtonRecord existing = makeRecord(3);
+  CHECK(registerIButton(existing.ibutton_id));
+  CHECK(applyRegistryImportChunk(makeImportChunk(7, 0, 1, 20)) == REGISTRY_IMPORT_ACCEPTED);
+  IButtonRecord raced = makeRecord(15);
+  CHECK(registerIButton(raced.ibutton_id));  // Registered while staged
+  CHECK(applyRegistryImportChunk(makeImportChunk(7, 1, 1, 20)) == REGISTRY_IMPORT_COMMITTED);
+  RegistryImportStats stats;
+  getRegistryImportStats(stats);
+  CHECK(stats.staged == 18 && stats.skipped == 2);
+  CHECK(getRegisteredIButtonCount() == 20);
+}
+
+void testAssociatedIDConflictsAreSkipped() {
+  freshManager();
+  IButtonRecord existing;
+  CHECK(registerIButton(makeRecord(3).ibutton_id));
+  CHECK(isRegistered(3, &existing));
+
+  const uint32_t wanted_ids[] = { existing.associated_id, 9000, 9000, 9500, INVALID_ASSOCIATED_ID };
+  RegistryChunk chunk;
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.transfer_id = 12;
+  chunk.last = true;
+  chunk.count = 5;
+  for (int i = 0; i < chunk.count; i++) {
+    IButtonRecord record = makeRecord(101 + i);
+    record.associated_id = wanted_ids[i];
+    packRegistryRecord(record, &chunk.data[i * REGISTRY_RECORD_WIRE_LEN]);
+  }
+  CHECK(applyRegistryImportChunk(chunk) == REGISTRY_IMPORT_COMMITTED);
+  RegistryImportStats stats;
+  getRegistryImportStats(stats);
+  CHECK(stats.staged == 3 && stats.skipped == 2);
+  CHECK(getRegisteredIButtonCount() == 4);
+
+  IButtonRecord record;
+  CHECK(isRegistered(3, &record) && record.associated_id == existing.associated_id);
+  CHECK(!isRegistered(101));                                           // ID held by a registered iButton
+  CHECK(isRegistered(102, &record) && record.associated_id == 9000);
+  CHECK(!isRegistered(103));                                           // ID taken by the record before it
+  CHECK(isRegistered(104, &record) && record.associated_id == 9500);
+  CHECK(isRegistered(105, &record) && record.associated_id == 9501);  // Numbered past the accepted IDs
+
+  CHECK(registerIButton(makeRecord(200).ibutton_id));
+  CHECK(isRegistered(200, &record) && record.associated_id == 9502);
+}
+
+void testIdleImportTimesOut() {
+  freshManager();
+  CHECK(applyRegistryImportChunk(makeImportChunk(8, 0, 1, 30)) == REGISTRY_IMPORT_ACCEPTED);
+  hostAdvanceMillis(REGISTRY_IMPORT_IDLE_TIMEOUT_MS - 1);
+  CHECK(!checkRegistryImportTimeout(millis()));
+  hostAdvanceMillis(1);
+  CHECK(checkRegistryImportTimeout(millis()));
+  CHECK(!isIButtonImportActive());
+  CHECK(applyRegistryImportChunk(makeImportChunk(8, 1, 1, 30)) == REGISTRY_IMPORT_NO_SESSION);
+  CHECK(getRegisteredIButtonCount() == 0);
+  CHECK(registerIButton(makeRecord(1).ibutton_id));  // Staged slots were freed
+}
+
+void testFullRegistryDiscardsImport() {
+  freshManager();
+  for (uint32_t serial = 10000; serial < 10000 + TEST_RECORDS - 15; serial++) {
+    CHECK(registerIButton(makeRecord(serial).ibutton_id));
+  }
+  CHECK(importRange(9, 1, 30, PAYLOAD_FORMAT_CBOR) == REGISTRY_IMPORT_FULL);
+  CHECK(!isIButtonImportActive());
+  CHECK(getRegisteredIButtonCount() == TEST_RECORDS - 15);
+  CHECK(!isRegistered(1));
+}
+
+// Chunks 7.. were lost; records deleted from the chunks already delivered must not shift
+// the resumed ones
+void testExportResume() {
+  freshManager();
+  CHECK(importRange(10, 1, 95, PAYLOAD_FORMAT_JSON) == REGISTRY_IMPORT_COMMITTED);
+  std::vector<std::string> all = exportAll(11, 0, 0, PAYLOAD_FORMAT_JSON);
+  CHECK(all.size() == 10);
+  RegistryChunk received;
+  CHECK(decodeRegistryChunk((const byte*)all[6].data(), all[6].size(), received) == REGISTRY_CHUNK_OK);
+  CHECK(received.next_slot > 0 && !received.last);
+
+  CHECK(deleteIButton(makeRecord(2).ibutton_id));
+  CHECK(deleteIButton(makeRecord(40).ibutton_id));
+  std::vector<std::string> resumed = exportAll(11, 7, received.next_slot, PAYLOAD_FORMAT_JSON);
+  CHECK(resumed.size() == 3);
+  for (size_t i = 0; i < resumed.size() && i + 7 < all.size(); i++) CHECK(resumed[i] == all[i + 7]);
+
+  RegistryChunk last;
+  CHECK(decodeRegistryChunk((const byte*)resumed.back().data(), resumed.back().size(), last) == REGISTRY_CHUNK_OK);
+  CHECK(last.last && last.next_slot == (uint32_t)getIButtonCapacity());
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testRecordWireRoundTrip);
+  RUN_TEST(testImportThenExportBothFormats);
+  RUN_TEST(testEmptyRegistryExportsOneLastChunk);
+  RUN_TEST(testCorruptedChunkIsDetected);
+  RUN_TEST(testSequenceHandling);
+  RUN_TEST(testDuplicatesAreSkipped);
+  RUN_TEST(testAssociatedIDConflictsAreSkipped);
+  RUN_TEST(testIdleImportTimesOut);
+  RUN_TEST(testFullRegistryDiscardsImport);
+  RUN_TEST(testExportResume);
+  return hostTestResult();
+}
@@ -0,0 +1,129 @@
+// Scan cooldown table: expiry on the virtual clock, independent cooldowns per iButton,
+// and least-recently-started eviction when every slot is taken.
+
+#include "host_test.h"
+#include "scan_cooldown.h"
+
+// --- Helpers ---
+byte test_ids[SCAN_COOLDOWN_SLOTS + 2][IBUTTON_ID_LEN];
+
+const byte* id(int n) {
+  return test_ids[n];
+}
+
+uint32_t associatedID(int n) {
+  return 500 + n;
+}
+
+void start(int n, unsigned long duration_ms) {
+  scanCooldownStart(id(n), duration_ms, associatedID(n));
+}
+
+
+// --- Tests ---
+
+void testExpiresAfterDuration() {
+  scanCooldownClear();
+  start(0, 1000);
+  CHECK(scanCooldownActive(id(0)));
+  CHECK(!scanCooldownActive(id(1)));
+  hostAdvanceMillis(999);
+  CHECK(scanCooldownActive(id(0)));
+  hostAdvanceMillis(1);
+  CHECK(!scanCooldownActive(id(0)));
+}
+
+void testRestartExtends() {
+  scanCooldownClear();
+  start(0, 1000);
+  hostAdvanceMillis(800);
+  start(0, 1000);
+  hostAdvanceMillis(800);
+  CHECK(scanCooldownActive(id(0)));
+  hostAdvanceMillis(200);
+  CHECK(!scanCooldownActive(id(0)));
+}
+
+void testZeroDurationIsIgnored() {
+  scanCooldownClear();
+  start(0, 0);
+  CHECK(!scanCooldownActive(id(0)));
+}
+
+void testEachIButtonHasItsOwnCooldown() {
+  scanCooldownClear();
+  for (int i = 0; i < SCAN_COOLDOWN_SLOTS; i++) {
+    start(i, 1000 + 100 * i);
+    hostAdvanceMillis(10);
+  }
+  for (int i = 0; i < SCAN_COOLDOWN_SLOTS; i++) CHECK(scanCooldownActive(id(i)));
+  hostAdvanceMillis(1000);
+  CHECK(!scanCooldownActive(id(0)));
+  CHECK(scanCooldownActive(id(SCAN_COOLDOWN_SLOTS - 1)));
+}
+
+void testFullTableEvictsLeastRecentlyStarted() {
+  scanCooldownClear();
+  for (int i = 0; i < SCAN_COOLDOWN_SLOTS; i++) {
+    start(i, 60000);
+    hostAdvanceMillis(10);
+  }
+  start(0, 60000);  // Restarted: now the most recent
+  hostAdvanceMillis(10);
+
+  start(SCAN_COOLDOWN_SLOTS, 60000);
+  CHECK(scanCooldownActive(id(SCAN_COOLDOWN_SLOTS)));
+  CHECK(scanCooldownActive(id(0)));
+  CHECK(!scanCooldownActive(id(1)));  // Oldest start
+  for (int i = 2; i < SCAN_COOLDOWN_SLOTS; i++) CHECK(scanCooldownActive(id(i)));
+
+  start(SCAN_COOLDOWN_SLOTS + 1, 60000);
+  CHECK(!scanCooldownActive(id(2)));
+}
+
+void testExpiredSlotIsReusedBeforeEviction() {
+  scanCooldownClear();
+  start(0, 100);
+  for (int i = 1; i < SCAN_COOLDOWN_SLOTS; i++) start(i, 60000);
+  hostAdvanceMillis(200);
+  start(SCAN_COOLDOWN_SLOTS, 60000);  // Takes the expired slot
+  for (int i = 1; i <= SCAN_COOLDOWN_SLOTS; i++) CHECK(scanCooldownActive(id(i)));
+}
+
+void testHandsBackAssociatedID() {
+  scanCooldownClear();
+  start(0, 1000);
+  start(1, 1000);
+  uint32_t associated_id = 0;
+  CHECK(scanCooldownActive(id(1), &associated_id));
+  CHECK(associated_id == associatedID(1));
+  CHECK(scanCooldownActive(id(0), &associated_id));
+  CHECK(associated_id == associatedID(0));
+  scanCooldownStart(id(0), 1000, 77);  // Restart with a newer record
+  CHECK(scanCooldownActive(id(0), &associated_id));
+  CHECK(associated_id == 77);
+  associated_id = 0;
+  CHECK(!scanCooldownActive(id(2), &associated_id));
+  CHECK(associated_id == 0);  // Untouched on a miss
+}
+
+void testClear() {
+  start(0, 60000);
+  scanCooldownClear();
+  CHECK(!scanCooldownActive(id(0)));
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  for (int i = 0; i < SCAN_COOLDOWN_SLOTS + 2; i++) hostMakeIButtonRom(100 + i, test_ids[i]);
+  RUN_TEST(testExpiresAfterDuration);
+  RUN_TEST(testRestartExtends);
+  RUN_TEST(testZeroDurationIsIgnored);
+  RUN_TEST(testEachIButtonHasItsOwnCooldown);
+  RUN_TEST(testFullTableEvictsLeastRecentlyStarted);
+  RUN_TEST(testExpiredSlotIsReusedBeforeEviction);
+  RUN_TEST(testHandsBackAssociatedID);
+  RUN_TEST(testClear);
+  return hostTestResult();
+}
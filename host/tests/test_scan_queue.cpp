@@ -0,0 +1,91 @@
+// Scan queue: single-producer/single-consumer ring between the reader task and loop().
+// The concurrent test runs a real thread on each side, as the two ESP32 cores do.
+
+#include "host_test.h"
+#include "scan_queue.h"
+#include <thread>
+
+// --- Helpers ---
+const uint32_t SEQUENCE_LENGTH = 200000;
+
+ScanEvent numberedEvent(uint32_t n) {
+  ScanEvent event = {};
+  memcpy(event.ibutton_id, &n, sizeof(n));  // Also in the payload, to catch torn copies
+  event.timestamp_ms = n;
+  event.timestamp_us = ~n;
+  event.lane = (uint8_t)n;
+  return event;
+}
+
+bool isNumberedEvent(const ScanEvent& event, uint32_t n) {
+  uint32_t id_n;
+  memcpy(&id_n, event.ibutton_id, sizeof(id_n));
+  return id_n == n && event.timestamp_ms == n && event.timestamp_us == ~n && event.lane == (uint8_t)n;
+}
+
+void drain() {
+  ScanEvent event;
+  while (scanQueuePop(event)) {
+  }
+}
+
+
+// --- Tests ---
+
+void testFullQueueDropsAndCounts() {
+  drain();
+  uint32_t drops_before = getScanQueueDropCount();
+  for (uint32_t n = 0; n < SCAN_QUEUE_CAPACITY; n++) CHECK(scanQueuePush(numberedEvent(n)));
+  CHECK(!scanQueuePush(numberedEvent(SCAN_QUEUE_CAPACITY)));
+  CHECK(getScanQueueDropCount() == drops_before + 1);
+
+  // The dropped event is the new one; the queued ones come out in order
+  ScanEvent event;
+  for (uint32_t n = 0; n < SCAN_QUEUE_CAPACITY; n++) {
+    CHECK(scanQueuePop(event));
+    CHECK(isNumberedEvent(event, n));
+  }
+  CHECK(!scanQueuePop(event));
+}
+
+void testConcurrentSequenceArrivesOnceInOrder() {
+  drain();
+  uint32_t drops_before = getScanQueueDropCount();
+  uint32_t producer_retries = 0;
+
+  // The reader task: pushes 0..N-1, retrying while the consumer is behind
+  std::thread producer([&producer_retries]() {
+    for (uint32_t n = 0; n < SEQUENCE_LENGTH; n++) {
+      while (!scanQueuePush(numberedEvent(n))) {
+        producer_retries++;
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  // loop(): every value exactly once, in order, with an intact payload
+  uint32_t expected = 0;
+  uint32_t out_of_order = 0;
+  ScanEvent event;
+  while (expected < SEQUENCE_LENGTH) {
+    if (!scanQueuePop(event)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (!isNumberedEvent(event, expected)) out_of_order++;
+    expected++;
+  }
+  producer.join();
+
+  CHECK(out_of_order == 0);
+  CHECK(!scanQueuePop(event));  // Nothing duplicated past the end
+  CHECK(getScanQueueDropCount() - drops_before == producer_retries);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  RUN_TEST(testFullQueueDropsAndCounts);
+  RUN_TEST(testConcurrentSequenceArrivesOnceInOrder);
+  return hostTestResult();
+}
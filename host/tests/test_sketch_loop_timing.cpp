@@ -0,0 +1,103 @@
+// Worst-case loop() pass while the sketch opens, holds and closes the gate and plays the
+// buzzer patterns: the sequencer advances them between passes instead of delaying inside one.
+
+#include "../../smart-parking-esp32.ino"
+#include "host_test.h"
+
+// --- Helpers ---
+// The pass ends with the loop's own delay(50); the gate hold alone is GATE_OPEN_DELAY_MS
+const unsigned long MAX_LOOP_PASS_MS = 100;
+
+unsigned long longest_pass_ms = 0;
+bool gate_seen_open = false;
+
+void runFor(unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    unsigned long start = millis();
+    loop();
+    if (millis() - start > longest_pass_ms) longest_pass_ms = millis() - start;
+    if (hostServoAngle(SERVO_PIN) == SERVO_OPEN_ANGLE) gate_seen_open = true;
+    HostMqttMessage message;
+    while (hostMqttTakePublished(message)) {
+    }
+  }
+}
+
+void touch(uint32_t serial) {
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(serial, rom);
+  hostIButtonTouch(IBUTTON_DATA_PIN, rom);
+  runFor(400);
+  hostIButtonRelease(IBUTTON_DATA_PIN);
+}
+
+void registerDirect(uint32_t serial) {
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(serial, rom);
+  CHECK(registerIButton(rom));
+  CHECK(setIButtonTwoFAPolicy(rom, TWO_FA_POLICY_NEVER, 0));
+}
+
+// Touches an iButton, checks the gate opened and closed again, and returns the longest pass
+unsigned long passThroughGate(uint32_t serial) {
+  longest_pass_ms = 0;
+  gate_seen_open = false;
+  touch(serial);
+  CHECK(gate_seen_open);
+  runFor(GATE_OPEN_DELAY_MS + SCAN_HOLDOFF_MS);
+  CHECK(hostServoAngle(SERVO_PIN) == SERVO_CLOSE_ANGLE);
+  return longest_pass_ms;
+}
+
+
+// --- Tests ---
+
+void testEntryAndExitNeverStallTheLoop() {
+  registerDirect(1);
+  uint32_t beeps_before = hostPinRisingEdges(BUZZER_PIN);
+  CHECK(passThroughGate(1) <= MAX_LOOP_PASS_MS);  // Entry
+  CHECK(current_occupancy == 1);
+  runFor(IBUTTON_COOLDOWN_MS);
+  CHECK(passThroughGate(1) <= MAX_LOOP_PASS_MS);  // Exit
+  CHECK(current_occupancy == 0);
+  CHECK(hostPinRisingEdges(BUZZER_PIN) - beeps_before == 2);  // One success beep each
+}
+
+void testRejectionBeepsNeverStallTheLoop() {
+  longest_pass_ms = 0;
+  uint32_t beeps_before = hostPinRisingEdges(BUZZER_PIN);
+  touch(99);  // Not registered
+  runFor(SCAN_HOLDOFF_MS);
+  CHECK(hostPinRisingEdges(BUZZER_PIN) - beeps_before == REJECT_BEEP_COUNT);
+  CHECK(hostServoAngle(SERVO_PIN) == SERVO_CLOSE_ANGLE);
+  CHECK(longest_pass_ms <= MAX_LOOP_PASS_MS);
+}
+
+// A second car is read while the first one's gate is still holding open
+void testBackToBackCarsAreReadDuringTheHold() {
+  registerDirect(2);
+  registerDirect(3);
+  longest_pass_ms = 0;
+  touch(2);
+  runFor(SCAN_HOLDOFF_MS);
+  CHECK(isGateOpen());
+  touch(3);
+  CHECK(current_occupancy == 2);
+  runFor(GATE_OPEN_DELAY_MS + SCAN_HOLDOFF_MS);
+  CHECK(!isGateOpen());
+  CHECK(longest_pass_ms <= MAX_LOOP_PASS_MS);
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  setup();
+  runFor(5000);  // WiFi, broker and LCD
+  CHECK(isMQTTConnected());
+  RUN_TEST(testEntryAndExitNeverStallTheLoop);
+  RUN_TEST(testRejectionBeepsNeverStallTheLoop);
+  RUN_TEST(testBackToBackCarsAreReadDuringTheHold);
+  fprintf(stderr, "  longest loop() pass: %lu ms (gate hold %d ms)\n", longest_pass_ms, GATE_OPEN_DELAY_MS);
+  return hostTestResult();
+}
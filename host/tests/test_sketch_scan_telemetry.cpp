@@ -0,0 +1,162 @@
+// The sketch's scan pipeline end to end: touches at the reader and 2FA answers from the
+// fake broker, checked against the ibutton/scan_batch events the firmware publishes.
+
+#include "../../smart-parking-esp32.ino"
+#include "host_test.h"
+#include "payload_codec.h"
+#include <string>
+
+// --- Helpers ---
+const uint8_t TEST_LANE_PIN = IBUTTON_DATA_PIN;
+std::string published_events;  // Every scan_batch payload so far
+uint32_t last_2fa_request_id = 0;
+
+void drainBroker() {
+  char batch_topic[128];
+  char request_topic[128];
+  snprintf(batch_topic, sizeof(batch_topic), "%sibutton/scan_batch", mqtt_settings.base_topic_prefix);
+  snprintf(request_topic, sizeof(request_topic), "%sauth/2fa_request", mqtt_settings.base_topic_prefix);
+  HostMqttMessage message;
+  while (hostMqttTakePublished(message)) {
+    if (strcmp(message.topic, batch_topic) == 0) {
+      published_events.append((const char*)message.payload, message.length);
+    } else if (strcmp(message.topic, request_topic) == 0) {
+      JsonField fields[] = { { "request_id", JSON_FIELD_UINT, &last_2fa_request_id, 0, false } };
+      payloadReadObject(message.payload, message.length, fields, 1);
+    }
+  }
+}
+
+void runFor(unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    loop();
+    drainBroker();
+  }
+}
+
+void touch(uint32_t serial) {
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(serial, rom);
+  hostIButtonTouch(TEST_LANE_PIN, rom);
+  runFor(400);
+  hostIButtonRelease(TEST_LANE_PIN);
+  runFor(1600);  // Past SCAN_HOLDOFF_MS
+}
+
+uint32_t associatedID(uint32_t serial) {
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(serial, rom);
+  IButtonRecord record;
+  return getIButtonRecord(rom, record) ? record.associated_id : INVALID_ASSOCIATED_ID;
+}
+
+void registerWithPolicy(uint32_t serial, TwoFAPolicy policy) {
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(serial, rom);
+  CHECK(registerIButton(rom));
+  CHECK(setIButtonTwoFAPolicy(rom, policy, 0));
+}
+
+void answer2FA(uint32_t serial, bool allow) {
+  byte rom[IBUTTON_ID_LEN];
+  char hex[IBUTTON_HEX_LEN + 1];
+  char topic[128];
+  char payload[128];
+  hostMakeIButtonRom(serial, rom);
+  ibuttonBytesToHex(rom, hex);
+  snprintf(topic, sizeof(topic), "%scmd/auth/2fa_response", mqtt_settings.base_topic_prefix);
+  snprintf(payload, sizeof(payload), "{\"ibutton_id\":\"%s\",\"allow_entry\":%s,\"request_id\":%u}", hex,
+           allow ? "true" : "false", last_2fa_request_id);
+  hostMqttDeliver(topic, payload, strlen(payload));
+}
+
+// Publishes whatever is buffered (the batch age limit) and looks for one event
+bool published(uint32_t serial, bool is_registered, uint32_t associated_id, const char* outcome) {
+  runFor(SCAN_BATCH_MAX_AGE_MS + 1000);
+  byte rom[IBUTTON_ID_LEN];
+  char hex[IBUTTON_HEX_LEN + 1];
+  hostMakeIButtonRom(serial, rom);
+  ibuttonBytesToHex(rom, hex);
+  char event[160];
+  if (is_registered) {
+    snprintf(event, sizeof(event), "{\"ibutton_id\":\"%s\",\"is_registered\":true,\"associated_id\":%u,\"lane\":0,"
+             "\"outcome\":\"%s\"", hex, associated_id, outcome);
+  } else {
+    snprintf(event, sizeof(event), "{\"ibutton_id\":\"%s\",\"is_registered\":false,\"lane\":0,\"outcome\":\"%s\"",
+             hex, outcome);
+  }
+  bool found = published_events.find(event) != std::string::npos;
+  if (!found) fprintf(stderr, "  missing %s\n  in %s\n", event, published_events.c_str());
+  return found;
+}
+
+
+// --- Tests ---
+
+void testDirectEntryThenCooldown() {
+  registerWithPolicy(1, TWO_FA_POLICY_NEVER);
+  touch(1);
+  touch(1);  // Within IBUTTON_COOLDOWN_MS
+  CHECK(published(1, true, associatedID(1), "entry"));
+  CHECK(published(1, true, associatedID(1), "cooldown"));
+}
+
+void testTwoFADenied() {
+  registerWithPolicy(2, TWO_FA_POLICY_ALWAYS);
+  touch(2);
+  answer2FA(2, false);
+  runFor(500);
+  CHECK(published(2, true, associatedID(2), "2fa_requested"));
+  CHECK(published(2, true, associatedID(2), "2fa_denied"));
+}
+
+void testTwoFATimeout() {
+  registerWithPolicy(3, TWO_FA_POLICY_ALWAYS);
+  touch(3);
+  runFor(TWO_FA_TIMEOUT_DURATION_MS + 1000);
+  CHECK(published(3, true, associatedID(3), "2fa_timeout"));
+}
+
+void testTwoFAApprovedEntry() {
+  registerWithPolicy(4, TWO_FA_POLICY_ALWAYS);
+  touch(4);
+  answer2FA(4, true);
+  runFor(500);
+  CHECK(published(4, true, associatedID(4), "2fa_entry"));
+  byte rom[IBUTTON_ID_LEN];
+  hostMakeIButtonRom(4, rom);
+  IButtonRecord record;
+  CHECK(getIButtonRecord(rom, record) && record.is_inside);
+}
+
+// Register and delete from the serial console report the record as it is after the action
+void testConsoleRegisterAndDelete() {
+  hostSerialInput("r");
+  runFor(200);
+  touch(5);
+  uint32_t associated_id = associatedID(5);
+  CHECK(associated_id != INVALID_ASSOCIATED_ID);
+  CHECK(published(5, true, associated_id, "registered"));
+
+  runFor(IBUTTON_COOLDOWN_MS);
+  hostSerialInput("d");
+  runFor(200);
+  touch(5);
+  CHECK(associatedID(5) == INVALID_ASSOCIATED_ID);
+  CHECK(published(5, false, 0, "deleted"));
+}
+
+
+int main() {
+  hostSerialEcho(false);
+  setup();
+  runFor(5000);  // WiFi, broker and LCD
+  CHECK(isMQTTConnected());
+  RUN_TEST(testDirectEntryThenCooldown);
+  RUN_TEST(testTwoFADenied);
+  RUN_TEST(testTwoFATimeout);
+  RUN_TEST(testTwoFAApprovedEntry);
+  RUN_TEST(testConsoleRegisterAndDelete);
+  return hostTestResult();
+}
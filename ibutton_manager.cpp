@@ -1,53 +1,285 @@
 #include "ibutton_manager.h"
+#include "record_store.h"
+#include "scan_queue.h"
+#include "access_metrics.h"
 #include <limits.h>  // Required for UINT32_MAX
 
 
 // --- Module Variables ---
-OneWire* ds = nullptr;
+OneWire* readers[IBUTTON_MAX_READERS] = { nullptr };  // One 1-Wire bus per lane
+uint8_t reader_pins[IBUTTON_MAX_READERS];
+uint8_t reader_count = 0;
 int max_managed_ibuttons = 0;    // Maximum number of records
-int calculated_eeprom_size = 0;  // Total EEPROM size needed
+int calculated_eeprom_size = 0;  // Size of the legacy EEPROM layout (migration only)
+
+// RAM index: open-addressing hash table keyed on the 64-bit ROM ID.
+// Each bucket stores (slot + 1); 0 marks an empty bucket and INDEX_TOMBSTONE a deleted one.
+const uint16_t INDEX_EMPTY = 0;
+const uint16_t INDEX_TOMBSTONE = 0xFFFF;
+uint16_t* index_buckets = nullptr;
+uint32_t index_mask = 0;              // Bucket count - 1 (bucket count is a power of two)
+uint32_t index_tombstones = 0;        // Deleted buckets; the index is rebuilt when they pile up
+uint16_t* free_slots = nullptr;       // Stack of free slots, lowest slot on top
+int free_slot_count = 0;
+
+// Open bulk import: staged slots are neither free nor indexed until the commit
+uint32_t* import_claimed = nullptr;   // Bitmap of staged slots; nullptr when no import is open
+int import_claimed_count = 0;
+
+TaskHandle_t reader_task_handle = nullptr;
+
+// Approvals granted by the app for TWO_FA_POLICY_GRANT_WINDOW credentials. RAM only:
+// a reboot simply asks again. When full, the entry closest to expiry is replaced.
+struct TwoFAGrant {
+  byte ibutton_id[IBUTTON_ID_LEN];
+  unsigned long granted_at_ms;
+  unsigned long valid_ms;  // 0 marks a free entry
+};
+TwoFAGrant two_fa_grants[TWO_FA_GRANT_CACHE_SIZE];
 
 
 // --- Helpers ---
-// Helper function to calculate EEPROM address for a given index
+// Helper function to calculate the legacy EEPROM address for a given index
 int getRecordAddress(int index) {
   return EEPROM_CONFIG_OFFSET + (index * sizeof(IButtonRecord));
 }
 
-// Helper function to generate the next associated ID
-uint32_t generateNextAssociatedID() {
-  uint32_t max_id = INVALID_ASSOCIATED_ID;  // Start assuming 0 is the max (or no valid IDs exist yet)
+// Mixes the 64-bit ROM ID into a bucket hash (MurmurHash3 finalizer)
+uint32_t hashIButtonID(const byte* ibutton_id) {
+  uint64_t key = 0;
+  memcpy(&key, ibutton_id, IBUTTON_ID_LEN);
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ULL;
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+// Returns the bucket holding ibutton_id, or -1. Optionally copies the matching record.
+int findIndexBucket(const byte* ibutton_id, IButtonRecord* record_out = nullptr) {
+  if (index_buckets == nullptr) return -1;
   IButtonRecord record;
+  for (uint32_t b = hashIButtonID(ibutton_id) & index_mask;; b = (b + 1) & index_mask) {
+    uint16_t entry = index_buckets[b];
+    if (entry == INDEX_EMPTY) return -1;  // End of probe chain
+    if (entry == INDEX_TOMBSTONE) continue;
+    storeGetRecord(entry - 1, record);
+    if (record.is_valid && memcmp(record.ibutton_id, ibutton_id, IBUTTON_ID_LEN) == 0) {
+      if (record_out != nullptr) *record_out = record;
+      return (int)b;
+    }
+  }
+}
 
-  if (max_managed_ibuttons <= 0) {
-    Serial.println("Error: Cannot generate ID, manager not initialized.");
-    return INVALID_ASSOCIATED_ID;  // Return invalid ID
+void indexInsert(const byte* ibutton_id, int slot) {
+  uint32_t b = hashIButtonID(ibutton_id) & index_mask;
+  // Load factor stays <= 0.5, so a free or deleted bucket is always reached
+  while (index_buckets[b] != INDEX_EMPTY && index_buckets[b] != INDEX_TOMBSTONE) {
+    b = (b + 1) & index_mask;
   }
+  if (index_buckets[b] == INDEX_TOMBSTONE) index_tombstones--;
+  index_buckets[b] = (uint16_t)(slot + 1);
+}
 
-  // Scan all records to find the highest current associated_id
-  for (int i = 0; i < max_managed_ibuttons; ++i) {
-    EEPROM.get(getRecordAddress(i), record);
-    if (record.is_valid && record.associated_id > max_id) {
-      max_id = record.associated_id;
+// Drops a specific slot from the free stack (only needed when a slot is revalidated directly)
+void removeFreeSlot(int slot) {
+  for (int i = 0; i < free_slot_count; ++i) {
+    if (free_slots[i] == slot) {
+      memmove(&free_slots[i], &free_slots[i + 1], (free_slot_count - i - 1) * sizeof(uint16_t));
+      free_slot_count--;
+      return;
     }
   }
+}
 
-  // Check for potential overflow (highly unlikely, but good practice)
-  if (max_id == UINT32_MAX) {
-    Serial.println("Error: Cannot generate new Associated ID, maximum value reached.");
-    return INVALID_ASSOCIATED_ID;  // Return invalid ID to indicate failure
+bool isImportClaimed(int slot) {
+  return import_claimed != nullptr && (import_claimed[slot / 32] & (1UL << (slot % 32))) != 0;
+}
+
+void indexRemoveBucket(int bucket) {
+  if (bucket >= 0) {
+    index_buckets[bucket] = INDEX_TOMBSTONE;
+    index_tombstones++;
   }
+}
 
-  // The next ID is the highest found + 1
-  uint32_t next_id = max_id + 1;
+// Builds the index and the free-slot stack with a single pass over the record store.
+// Returns the highest associated ID found, used to validate the persisted counter.
+uint32_t buildIndex() {
+  uint32_t bucket_count = 1;
+  while (bucket_count < (uint32_t)max_managed_ibuttons * 2) bucket_count <<= 1;
+
+  free(index_buckets);
+  free(free_slots);
+  index_buckets = (uint16_t*)calloc(bucket_count, sizeof(uint16_t));
+  free_slots = (uint16_t*)malloc(max_managed_ibuttons * sizeof(uint16_t));
+  if (index_buckets == nullptr || free_slots == nullptr) {
+    Serial.println("FATAL: Not enough RAM for the iButton index!");
+    delay(5000);
+    ESP.restart();
+  }
+  index_mask = bucket_count - 1;
+  index_tombstones = 0;
+  free_slot_count = 0;
 
-  // Ensure the generated ID is not the reserved invalid ID (shouldn't happen if max_id starts at 0)
-  if (next_id == INVALID_ASSOCIATED_ID) {
-    next_id++;  // Skip 0 if it somehow resulted from max_id + 1
+  uint32_t max_id = INVALID_ASSOCIATED_ID;
+  IButtonRecord record;
+  // Walk backwards so the lowest free slot ends on top of the stack
+  for (int i = max_managed_ibuttons - 1; i >= 0; --i) {
+    if (isImportClaimed(i)) continue;  // Staged by the open import
+    storeGetRecord(i, record);
+    if (record.is_valid) {
+      indexInsert(record.ibutton_id, i);
+      if (record.associated_id > max_id) max_id = record.associated_id;
+    } else {
+      free_slots[free_slot_count++] = (uint16_t)i;
+    }
   }
+  Serial.printf("iButton index built: %d registered, %d free, %u buckets.\n",
+                max_managed_ibuttons - free_slot_count, free_slot_count, bucket_count);
+  return max_id;
+}
 
-  Serial.printf("Generated next Associated ID: %u\n", next_id);
-  return next_id;
+// Rebuilds the index once deleted buckets would make miss lookups probe too far.
+// Call only after the record store holds the final state of the slot that was changed.
+void compactIndexIfNeeded() {
+  if (index_tombstones > (index_mask + 1) / 4) {
+    buildIndex();
+  }
+}
+
+// Holder of an associated ID, for finding staged IDs that are already taken
+struct AssociatedIDOwner {
+  uint32_t associated_id;
+  int slot;  // Staged slot, or -1 for a registered record (sorts first, so it keeps its ID)
+};
+
+int compareAssociatedIDOwners(const void* a, const void* b) {
+  const AssociatedIDOwner* x = (const AssociatedIDOwner*)a;
+  const AssociatedIDOwner* y = (const AssociatedIDOwner*)b;
+  if (x->associated_id != y->associated_id) return x->associated_id < y->associated_id ? -1 : 1;
+  return x->slot < y->slot ? -1 : (x->slot > y->slot ? 1 : 0);
+}
+
+// Takes a staged record out of the open import and returns its slot to the free list
+void dropStagedImport(int slot) {
+  IButtonRecord empty;
+  memset(&empty, 0, sizeof(empty));
+  storePutRecordUnlogged(slot, empty);
+  import_claimed[slot / 32] &= ~(1UL << (slot % 32));
+  import_claimed_count--;
+  free_slots[free_slot_count++] = (uint16_t)slot;
+}
+
+// Drops staged records whose associated ID belongs to a registered iButton or to a staged
+// record in a lower slot. Staged iButtons that are already registered are left for the
+// duplicate check. One sort over registered and staged IDs.
+// Returns the number dropped, or -1 if there is not enough RAM.
+int dropConflictingImportIDs() {
+  int owner_capacity = max_managed_ibuttons - free_slot_count;  // Registered plus staged
+  AssociatedIDOwner* owners = (AssociatedIDOwner*)malloc(max(owner_capacity, 1) * sizeof(AssociatedIDOwner));
+  if (owners == nullptr) return -1;
+  int owner_count = 0;
+  IButtonRecord record;
+  for (int slot = 0; slot < max_managed_ibuttons && owner_count < owner_capacity; slot++) {
+    storeGetRecord(slot, record);
+    if (isImportClaimed(slot)) {
+      if (record.associated_id == INVALID_ASSOCIATED_ID || findIndexBucket(record.ibutton_id) >= 0) continue;
+      owners[owner_count++] = { record.associated_id, slot };
+    } else if (record.is_valid) {
+      owners[owner_count++] = { record.associated_id, -1 };
+    }
+  }
+  qsort(owners, owner_count, sizeof(AssociatedIDOwner), compareAssociatedIDOwners);
+
+  int dropped = 0;
+  for (int i = 1; i < owner_count; i++) {
+    if (owners[i].associated_id == owners[i - 1].associated_id && owners[i].slot >= 0) {
+      dropStagedImport(owners[i].slot);
+      dropped++;
+    }
+  }
+  free(owners);
+  return dropped;
+}
+
+// Imports a registry written by firmware that kept it in emulated EEPROM
+void migrateLegacyEEPROM() {
+  calculated_eeprom_size = EEPROM_CONFIG_OFFSET + (sizeof(IButtonRecord) * max_managed_ibuttons);
+  if (!EEPROM.begin(calculated_eeprom_size)) {
+    Serial.println("Warning: Could not open legacy EEPROM, starting with an empty registry.");
+    return;
+  }
+
+  uint32_t current_signature = 0;
+  EEPROM.get(EEPROM_SIGNATURE_ADDR, current_signature);
+  if (current_signature == EEPROM_INIT_SIGNATURE) {
+    Serial.println("Legacy EEPROM registry found. Migrating to record store...");
+    // Records are staged in RAM only and reach flash together in one snapshot, instead of
+    // one journal entry (and flash write) each
+    IButtonRecord record;
+    int migrated = 0;
+    for (int i = 0; i < max_managed_ibuttons; ++i) {
+      EEPROM.get(getRecordAddress(i), record);
+      upgradeIButtonRecord(record, 0);  // The EEPROM layout predates the 2FA fields
+      if (record.is_valid) {
+        storePutRecordUnlogged(i, record);
+        migrated++;
+      }
+    }
+    uint32_t value = 0;
+    EEPROM.get(EEPROM_OCCUPANCY_COUNT_ADDR, value);
+    if (value != UINT32_MAX) storePutCounter(STORE_COUNTER_OCCUPANCY, value);
+    EEPROM.get(EEPROM_NEXT_ASSOCIATED_ID_ADDR, value);
+    storePutCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID, value);  // Validated after the index is built
+    if (compactRecordStore()) {
+      Serial.printf("Migrated %d iButton records from EEPROM.\n", migrated);
+    } else {
+      Serial.println("Error: Could not write the migrated registry to flash.");
+    }
+  } else {
+    Serial.println("No legacy EEPROM registry found. Starting with an empty registry.");
+  }
+  EEPROM.end();
+}
+
+// Returns the grant cache entry of ibutton_id, or nullptr. Expired entries are freed on the way.
+TwoFAGrant* findTwoFAGrant(const byte* ibutton_id) {
+  unsigned long now = millis();
+  for (int i = 0; i < TWO_FA_GRANT_CACHE_SIZE; i++) {
+    TwoFAGrant& grant = two_fa_grants[i];
+    if (grant.valid_ms == 0) continue;
+    if (now - grant.granted_at_ms >= grant.valid_ms) {
+      grant.valid_ms = 0;
+      continue;
+    }
+    if (memcmp(grant.ibutton_id, ibutton_id, IBUTTON_ID_LEN) == 0) return &grant;
+  }
+  return nullptr;
+}
+
+void forgetTwoFAGrant(const byte* ibutton_id) {
+  TwoFAGrant* grant = findTwoFAGrant(ibutton_id);
+  if (grant != nullptr) grant->valid_ms = 0;
+}
+
+// Helper function to generate the next associated ID
+uint32_t generateNextAssociatedID() {
+  if (max_managed_ibuttons <= 0) {
+    Serial.println("Error: Cannot generate ID, manager not initialized.");
+    return INVALID_ASSOCIATED_ID;  // Return invalid ID
+  }
+
+  // The counter only moves forward, so IDs of deleted iButtons are never reused
+  uint32_t next_associated_id = storeGetCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID);
+  if (next_associated_id == INVALID_ASSOCIATED_ID) {
+    Serial.println("Error: Cannot generate new Associated ID, maximum value reached.");
+    return INVALID_ASSOCIATED_ID;  // Counter wrapped around
+  }
+
+  Serial.printf("Generated next Associated ID: %u\n", next_associated_id);
+  return next_associated_id;
 }
 
 
@@ -55,87 +287,94 @@ uint32_t generateNextAssociatedID() {
 
 void setupIButtonManager(uint8_t pin, int max_records) {
   // Store configuration parameters
+  if (max_records > MAX_MANAGED_IBUTTONS) {
+    Serial.printf("Warning: max_records %d exceeds the RAM limit, clamping to %d.\n", max_records, MAX_MANAGED_IBUTTONS);
+    max_records = MAX_MANAGED_IBUTTONS;
+  }
   max_managed_ibuttons = max_records;
 
-  // Initialize OneWire object
-  if (ds == nullptr) {
-    ds = new OneWire(pin);  // Allocate OneWire object dynamically
+  // Fail here, with the numbers, rather than on whichever allocation comes up short
+  size_t image_bytes = max_records * sizeof(IButtonRecord);
+  size_t slot_bytes = max_records * IBUTTON_RAM_BYTES_PER_SLOT;
+  if (image_bytes > ESP.getMaxAllocHeap() || slot_bytes > ESP.getFreeHeap()) {
+    Serial.printf("FATAL: %d iButton slots need %u bytes of RAM (%u in one block); %u free, largest block %u.\n",
+                  max_records, (unsigned)slot_bytes, (unsigned)image_bytes, ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+    delay(5000);
+    ESP.restart();
+  }
+
+  // Initialize the OneWire object of lane 0
+  if (readers[0] == nullptr) {
+    readers[0] = new OneWire(pin);  // Allocate OneWire object dynamically
+    reader_pins[0] = pin;
+    reader_count = 1;
     Serial.printf("OneWire initialized on pin %d.\n", pin);
   } else {
     // This case should ideally not happen if setup is called only once,
-    // but it's good practice to avoid re-allocating if ds already exists.
+    // but it's good practice to avoid re-allocating if the reader already exists.
     // Note: OneWire library doesn't have a simple 'change pin' method.
-    // Re-initialization would require deleting the old 'ds' and creating a new one.
+    // Re-initialization would require deleting the old object and creating a new one.
     Serial.println("Warning: OneWire object already exists. Re-using existing instance.");
   }
 
 
-  // Calculate required EEPROM size including the offset
-  calculated_eeprom_size = EEPROM_CONFIG_OFFSET + (sizeof(IButtonRecord) * max_managed_ibuttons);
-
-  // Initialize EEPROM
-  if (!EEPROM.begin(calculated_eeprom_size)) {
-    Serial.println("FATAL: Failed to initialize EEPROM!");
-    // Consider halting or restarting
+  // Mount the journal-backed record store (replays pending changes into RAM)
+  if (!beginRecordStore(max_managed_ibuttons)) {
+    Serial.println("FATAL: Failed to initialize record store!");
     delay(5000);
     ESP.restart();
   }
-  Serial.printf("EEPROM initialized. Total Size: %d bytes. Config Offset: %d bytes. Record Capacity: %d\n",
-                calculated_eeprom_size, EEPROM_CONFIG_OFFSET, max_managed_ibuttons);
-
-  // --- Check if EEPROM needs formatting ---
-  uint32_t current_signature = 0;
-  EEPROM.get(EEPROM_SIGNATURE_ADDR, current_signature);  // Read signature from address 0
-
-  if (current_signature != EEPROM_INIT_SIGNATURE) {
-    Serial.println("EEPROM signature not found or invalid. Formatting iButton storage area...");
-
-    IButtonRecord emptyRecord;
-    emptyRecord.is_valid = false;
-    emptyRecord.associated_id = INVALID_ASSOCIATED_ID;  // Or 0
-    emptyRecord.is_inside = false;                      // Initialize is_inside flag
-    memset(emptyRecord.ibutton_id, 0, IBUTTON_ID_LEN);  // Clear the ID field too
-
-    // Write empty records to all slots
-    for (int i = 0; i < max_managed_ibuttons; ++i) {
-      EEPROM.put(getRecordAddress(i), emptyRecord);
-      if (i % 10 == 0) {  // Print progress dot occasionally
-        Serial.print(".");
-      }
-    }
-    Serial.println();  // Newline after dots
-
-    // Write the signature to mark initialization as complete
-    EEPROM.put(EEPROM_SIGNATURE_ADDR, EEPROM_INIT_SIGNATURE);
-    EEPROM.put(EEPROM_OCCUPANCY_COUNT_ADDR, (uint32_t)0);  // Initialize count
-
-    // Commit all changes (formatting + signature)
-    if (EEPROM.commit()) {
-      Serial.println("EEPROM formatting, signature, and initial count write successful.");
-    } else {
-      Serial.println("Error: EEPROM commit failed after formatting!");
-      // Handle this critical error - maybe halt?
-    }
+  if (recordStoreWasCreated()) {
+    migrateLegacyEEPROM();
   } else {
-    Serial.println("Valid EEPROM signature found. Skipping format.");
-    // Optional: Verify/Recalculate occupancy count here for robustness
     uint32_t stored_count = readOccupancyCount();
     Serial.printf("Stored occupancy count found: %u\n", stored_count);
   }
+  printRecordStoreStats();
+
+  // --- Build RAM index and restore the associated ID counter ---
+  uint32_t max_id = buildIndex();
+  uint32_t next_associated_id = storeGetCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID);
+  // Registries migrated from before the counter existed hold 0 or 0xFFFFFFFF here
+  if (next_associated_id == UINT32_MAX || next_associated_id <= max_id) {
+    next_associated_id = (max_id == UINT32_MAX) ? INVALID_ASSOCIATED_ID : max_id + 1;
+    if (!storePutCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID, next_associated_id)) {
+      Serial.println("Error: Failed to persist associated ID counter.");
+    }
+    Serial.printf("Associated ID counter initialized to %u.\n", next_associated_id);
+  }
+}
+
+
+int addIButtonReader(uint8_t pin) {
+  if (reader_task_handle != nullptr || reader_count == 0 || reader_count >= IBUTTON_MAX_READERS) {
+    Serial.println("Error: Cannot add another iButton reader lane.");
+    return -1;
+  }
+  readers[reader_count] = new OneWire(pin);
+  reader_pins[reader_count] = pin;
+  Serial.printf("OneWire reader for lane %u initialized on pin %d.\n", reader_count, pin);
+  return reader_count++;
 }
 
 
-bool readIButton(byte* id_buffer) {
+int getIButtonReaderCount() {
+  return reader_count;
+}
+
+
+bool readIButton(byte* id_buffer, uint8_t lane) {
+  OneWire* ds = lane < reader_count ? readers[lane] : nullptr;
   if (ds == nullptr) {
     Serial.println("Error: OneWire not initialized. Call setupIButtonManager first.");
     return false;
   }
 
-  if (!ds->search(id_buffer)) {  // Use -> for pointer access
-    ds->reset_search();
-    delay(50);  // Small delay to prevent rapid ghost reads
-    return false;
+  if (!ds->reset()) {
+    return false;  // No presence pulse: the port is empty
   }
+  ds->write(ONEWIRE_CMD_READ_ROM);
+  ds->read_bytes(id_buffer, IBUTTON_ID_LEN);
 
   // Verify CRC
   if (OneWire::crc8(id_buffer, 7) != id_buffer[7]) {
@@ -155,23 +394,119 @@ bool readIButton(byte* id_buffer) {
 }
 
 
+#if IBUTTON_PRESENCE_IRQ
+// Falling edge on the data line: a presence pulse, or our own bus traffic
+void IRAM_ATTR onIButtonLineFall() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(reader_task_handle, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+#endif
+
+// Polls every lane's reader and turns each new touch into a scan event tagged with its
+// lane (producer side of the queue)
+void iButtonReaderTask(void* param) {
+  struct ReaderState {
+    byte last_id[IBUTTON_ID_LEN];
+    unsigned long last_read_ms;
+    bool present;
+  };
+  ReaderState states[IBUTTON_MAX_READERS] = {};
+  ScanEvent event;
+
+  for (;;) {
+    bool any_present = false;
+    for (uint8_t lane = 0; lane < reader_count; lane++) {
+      ReaderState& state = states[lane];
+      uint32_t read_start_us = micros();
+      if (readIButton(event.ibutton_id, lane)) {
+        unsigned long now = millis();
+        // A held iButton is read over and over; only a new touch becomes an event
+        bool new_touch = !state.present || memcmp(event.ibutton_id, state.last_id, IBUTTON_ID_LEN) != 0;
+        state.present = true;
+        state.last_read_ms = now;
+        memcpy(state.last_id, event.ibutton_id, IBUTTON_ID_LEN);
+        if (new_touch) {
+          event.timestamp_ms = now;
+          event.timestamp_us = micros();
+          event.lane = lane;
+          accessMetricRecord(ACCESS_STAGE_READ, event.timestamp_us - read_start_us);
+          if (!scanQueuePush(event)) {
+            Serial.println("Warning: Scan queue full, iButton touch dropped.");
+          }
+        }
+      } else if (state.present && millis() - state.last_read_ms > IBUTTON_RELEASE_MS) {
+        state.present = false;
+      }
+      any_present = any_present || state.present;
+    }
+#if IBUTTON_PRESENCE_IRQ
+    if (!any_present) {
+      ulTaskNotifyTake(pdTRUE, 0);  // Drop the edges our own reset and reads produced
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IBUTTON_IDLE_POLL_MS));  // Sleep until a touch
+      continue;
+    }
+#endif
+    vTaskDelay(pdMS_TO_TICKS(IBUTTON_READER_POLL_MS));
+  }
+}
+
+
+bool startIButtonReaderTask() {
+  if (reader_count == 0) {
+    Serial.println("Error: OneWire not initialized. Call setupIButtonManager first.");
+    return false;
+  }
+  if (reader_task_handle != nullptr) {
+    return true;  // Already running
+  }
+  if (xTaskCreatePinnedToCore(iButtonReaderTask, "ibutton_reader", IBUTTON_READER_STACK_SIZE, nullptr,
+                              IBUTTON_READER_PRIORITY, &reader_task_handle, IBUTTON_READER_CORE) != pdPASS) {
+    Serial.println("Error: Failed to start iButton reader task.");
+    reader_task_handle = nullptr;
+    return false;
+  }
+#if IBUTTON_PRESENCE_IRQ
+  for (uint8_t lane = 0; lane < reader_count; lane++) {
+    attachInterrupt(digitalPinToInterrupt(reader_pins[lane]), onIButtonLineFall, FALLING);
+  }
+#endif
+  Serial.printf("iButton reader task started on core %d, %u lane(s).\n", IBUTTON_READER_CORE, reader_count);
+  return true;
+}
+
+
+bool popScannedIButton(byte* id_buffer, unsigned long* timestamp_ms, uint32_t* timestamp_us, uint8_t* lane) {
+  ScanEvent event;
+  if (!scanQueuePop(event)) {
+    return false;
+  }
+  memcpy(id_buffer, event.ibutton_id, IBUTTON_ID_LEN);
+  if (timestamp_ms != nullptr) {
+    *timestamp_ms = event.timestamp_ms;
+  }
+  if (timestamp_us != nullptr) {
+    *timestamp_us = event.timestamp_us;
+  }
+  if (lane != nullptr) {
+    *lane = event.lane;
+  }
+  return true;
+}
+
+
 bool getIButtonRecord(const byte* ibutton_id, IButtonRecord &record_out, int* record_index) {
    if (max_managed_ibuttons <= 0) return false; // Not initialized
 
-   for (int i = 0; i < max_managed_ibuttons; ++i) {
-       IButtonRecord temp_record; // Use a temporary to avoid modifying record_out if not found
-       EEPROM.get(getRecordAddress(i), temp_record);
-       // Check if the slot is valid and if the IDs match
-       if (temp_record.is_valid && memcmp(temp_record.ibutton_id, ibutton_id, IBUTTON_ID_LEN) == 0) {
-           record_out = temp_record; // Copy the found record
-           if (record_index != nullptr) {
-               *record_index = i; // Store the index if requested
-           }
-           return true; // Found and valid
+   IButtonRecord temp_record; // Use a temporary to avoid modifying record_out if not found
+   int bucket = findIndexBucket(ibutton_id, &temp_record);
+   if (bucket >= 0) {
+       record_out = temp_record; // Copy the found record
+       if (record_index != nullptr) {
+           *record_index = index_buckets[bucket] - 1; // Store the index if requested
        }
+       return true; // Found and valid
    }
-   // Optional: Clear record_out if not found? Depends on usage.
-   // record_out.is_valid = false;
    if (record_index != nullptr) {
         *record_index = -1; // Indicate not found
    }
@@ -185,30 +520,21 @@ bool registerIButton(const byte* ibutton_id) {
     return false;
   }
 
-  int first_free_slot = -1;
   IButtonRecord record;
+  memset(&record, 0, sizeof(record));  // Padding and 2FA fields start zeroed (TWO_FA_POLICY_ALWAYS)
 
-  // 1. Check for duplicates and find the first free slot
-  for (int i = 0; i < max_managed_ibuttons; ++i) {
-    EEPROM.get(getRecordAddress(i), record);  // Read from calculated address
-
-    if (record.is_valid) {
-      // Check if the ID is already registered
-      if (memcmp(record.ibutton_id, ibutton_id, IBUTTON_ID_LEN) == 0) {
-        Serial.println("Error: iButton is already registered.");
-        return false;  // Already exists
-      }
-    } else if (first_free_slot == -1) {
-      // Found the first free slot
-      first_free_slot = i;
-    }
+  // 1. Check for duplicates
+  if (findIndexBucket(ibutton_id) >= 0) {
+    Serial.println("Error: iButton is already registered.");
+    return false;  // Already exists
   }
 
-  // 2. Check if EEPROM is full
-  if (first_free_slot == -1) {
-    Serial.println("Error: No free space in EEPROM to register.");
+  // 2. Check if the registry is full
+  if (free_slot_count == 0) {
+    Serial.println("Error: No free space in the registry to register.");
     return false;
   }
+  int first_free_slot = free_slots[free_slot_count - 1];
 
   // 3. Generate the next associated ID
   uint32_t new_associated_id = generateNextAssociatedID();
@@ -223,21 +549,26 @@ bool registerIButton(const byte* ibutton_id) {
   record.is_inside = false; // Initialize as 'outside'
   memcpy(record.ibutton_id, ibutton_id, IBUTTON_ID_LEN);
 
-  EEPROM.put(getRecordAddress(first_free_slot), record);  // Write to calculated address
-
-  // 5. Commit changes to EEPROM
-  if (EEPROM.commit()) {
-    Serial.print("iButton registered in slot ");
-    Serial.print(first_free_slot);
-    Serial.print(" (Address: ");
-    Serial.print(getRecordAddress(first_free_slot));
-    Serial.print(") with automatically generated Associated ID: ");  // Updated message
-    Serial.println(new_associated_id);                               // Use the generated ID
-    return true;
-  } else {
-    Serial.println("Error: EEPROM commit failed during registration.");
+  // 5. Write the record and the advanced counter in one journal commit
+  bool own_transaction = !storeBatchActive();
+  if (own_transaction) beginRegistryTransaction();
+  if (!storePutRecord(first_free_slot, record)
+      || !storePutCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID, new_associated_id + 1)) {
+    Serial.println("Error: Record store write failed during registration.");
+    if (own_transaction) abortRegistryTransaction();
     return false;
   }
+  free_slot_count--;
+  indexInsert(ibutton_id, first_free_slot);
+  if (own_transaction && !commitRegistryTransaction()) {
+    Serial.println("Error: Record store commit failed during registration.");
+    return false;
+  }
+  Serial.print("iButton registered in slot ");
+  Serial.print(first_free_slot);
+  Serial.print(" with automatically generated Associated ID: ");  // Updated message
+  Serial.println(new_associated_id);                               // Use the generated ID
+  return true;
 }
 
 
@@ -246,14 +577,31 @@ bool updateIButtonRecord(int index, const IButtonRecord& record) {
         Serial.println("Error: Invalid index for updateIButtonRecord.");
         return false;
     }
-    EEPROM.put(getRecordAddress(index), record);
-    // Note: We might commit later, after updating the occupancy count too,
-    // but committing here ensures the record is saved immediately.
-    // Consider the trade-off. Let's commit here for simplicity for now.
-    if (!EEPROM.commit()) {
-         Serial.println("Error: EEPROM commit failed during record update.");
+    IButtonRecord old_record;
+    storeGetRecord(index, old_record);
+    bool owner_changed = old_record.is_valid != record.is_valid
+                         || memcmp(old_record.ibutton_id, record.ibutton_id, IBUTTON_ID_LEN) != 0;
+    // Locate the old bucket while the store still holds the old record
+    int old_bucket = (owner_changed && old_record.is_valid) ? findIndexBucket(old_record.ibutton_id) : -1;
+
+    // A single journal append; no full-sector rewrite for an is_inside flip
+    if (!storePutRecord(index, record)) {
+         Serial.println("Error: Record store write failed during record update.");
          return false;
     }
+
+    // Keep the RAM index and free list in sync if the slot changed owner or validity
+    if (owner_changed) {
+        indexRemoveBucket(old_bucket);
+        if (old_record.is_valid && !record.is_valid) {
+            free_slots[free_slot_count++] = (uint16_t)index;
+            compactIndexIfNeeded();
+        }
+        if (record.is_valid) {
+            if (!old_record.is_valid) removeFreeSlot(index);
+            indexInsert(record.ibutton_id, index);
+        }
+    }
     return true;
 }
 
@@ -279,44 +627,116 @@ bool deleteIButton(const byte* ibutton_id) {
     // record.associated_id = 0;
     // memset(record.ibutton_id, 0, IBUTTON_ID_LEN);
 
-    EEPROM.put(getRecordAddress(slot_to_delete), record);
+    // Record and occupancy changes are committed together
+    bool own_transaction = !storeBatchActive();
+    if (own_transaction) beginRegistryTransaction();
+    if (!updateIButtonRecord(slot_to_delete, record)) { // Also releases the slot in the index
+        Serial.println("Error: Record store write failed during deletion.");
+        if (own_transaction) abortRegistryTransaction();
+        return false;
+    }
 
     // 3. Adjust occupancy count if necessary
-    bool count_updated = false;
     if (was_inside) {
         Serial.println("Deleted iButton was marked as 'inside'. Decrementing occupancy.");
         uint32_t current_count = readOccupancyCount();
         if (current_count > 0) {
-            current_count--;
-            if (writeOccupancyCount(current_count)) { // writeOccupancyCount handles its own commit
-               count_updated = true; // Count was successfully updated
-            } else {
-               Serial.println("Error: Failed to update occupancy count during deletion.");
-               // Proceed with deletion commit anyway? Or return error? Let's proceed.
-            }
+            writeOccupancyCount(current_count - 1);
         } else {
             Serial.println("Warning: Occupancy count already 0, cannot decrement further during deletion.");
         }
     }
 
-    // 4. Commit the record deletion (if count wasn't updated, or if count update failed)
-    // If writeOccupancyCount succeeded, it already committed.
-    if (!count_updated) {
-       if (!EEPROM.commit()) {
-          Serial.println("Error: EEPROM commit failed during deletion.");
-          return false; // Commit failed
-       }
+    // 4. Commit record deletion and count in a single journal commit
+    if (own_transaction && !commitRegistryTransaction()) {
+        Serial.println("Error: Record store commit failed during deletion.");
+        return false;
     }
 
+    forgetTwoFAGrant(ibutton_id);
     Serial.print("iButton deleted from slot ");
-    Serial.print(slot_to_delete);
-    Serial.print(" (Address: ");
-    Serial.print(getRecordAddress(slot_to_delete));
-    Serial.println(")");
+    Serial.println(slot_to_delete);
     return true; // Deletion successful (even if count update had issues)
 }
 
 
+void upgradeIButtonRecord(IButtonRecord& record, uint16_t from_version) {
+  if (from_version < 1) {
+    // The 2FA fields used to be padding and may hold anything
+    record.two_fa_policy = TWO_FA_POLICY_ALWAYS;
+    record.two_fa_grant_minutes = 0;
+  }
+}
+
+
+bool setIButtonTwoFAPolicy(const byte* ibutton_id, TwoFAPolicy policy, uint16_t grant_minutes) {
+  if (policy > TWO_FA_POLICY_GRANT_WINDOW) {
+    Serial.println("Error: Unknown 2FA policy.");
+    return false;
+  }
+  if (policy == TWO_FA_POLICY_GRANT_WINDOW) {
+    if (grant_minutes == 0 || grant_minutes > TWO_FA_MAX_GRANT_MINUTES) {
+      Serial.printf("Error: 2FA grant window must be 1-%d minutes.\n", TWO_FA_MAX_GRANT_MINUTES);
+      return false;
+    }
+  } else {
+    grant_minutes = 0;
+  }
+
+  IButtonRecord record;
+  int slot = -1;
+  if (!getIButtonRecord(ibutton_id, record, &slot)) {
+    Serial.println("Error: iButton for 2FA policy change was not found.");
+    return false;
+  }
+  record.two_fa_policy = policy;
+  record.two_fa_grant_minutes = grant_minutes;
+  if (!updateIButtonRecord(slot, record)) {
+    Serial.println("Error: Record store write failed while changing 2FA policy.");
+    return false;
+  }
+  forgetTwoFAGrant(ibutton_id);  // A stricter policy must take effect immediately
+  Serial.printf("2FA policy of slot %d set to %u (%u min).\n", slot, policy, grant_minutes);
+  return true;
+}
+
+
+bool isTwoFARequired(const IButtonRecord& record) {
+  switch (record.two_fa_policy) {
+    case TWO_FA_POLICY_NEVER:
+      return false;
+    case TWO_FA_POLICY_GRANT_WINDOW:
+      return findTwoFAGrant(record.ibutton_id) == nullptr;
+    default:
+      return true;  // TWO_FA_POLICY_ALWAYS and anything unknown fail safe
+  }
+}
+
+
+void cacheTwoFAGrant(const IButtonRecord& record) {
+  if (record.two_fa_policy != TWO_FA_POLICY_GRANT_WINDOW || record.two_fa_grant_minutes == 0) return;
+
+  unsigned long now = millis();
+  TwoFAGrant* grant = findTwoFAGrant(record.ibutton_id);
+  for (int i = 0; grant == nullptr && i < TWO_FA_GRANT_CACHE_SIZE; i++) {
+    if (two_fa_grants[i].valid_ms == 0) grant = &two_fa_grants[i];
+  }
+  if (grant == nullptr) {
+    // Full: replace the grant that would expire first
+    grant = &two_fa_grants[0];
+    for (int i = 1; i < TWO_FA_GRANT_CACHE_SIZE; i++) {
+      TwoFAGrant& candidate = two_fa_grants[i];
+      if (candidate.valid_ms - (now - candidate.granted_at_ms) < grant->valid_ms - (now - grant->granted_at_ms)) {
+        grant = &candidate;
+      }
+    }
+  }
+  memcpy(grant->ibutton_id, record.ibutton_id, IBUTTON_ID_LEN);
+  grant->granted_at_ms = now;
+  grant->valid_ms = (unsigned long)record.two_fa_grant_minutes * 60000UL;
+}
+
+
 void printIButtonID(const byte* id) {
   for (int i = 0; i < IBUTTON_ID_LEN; i++) {
     if (id[i] < 16) Serial.print("0");  // Add leading zero for values < 0x10
@@ -328,7 +748,7 @@ void printIButtonID(const byte* id) {
 
 
 void printAllRegisteredIButtons() {
-  Serial.println("\n--- Registered iButtons in EEPROM ---");
+  Serial.println("\n--- Registered iButtons in record store ---");
   if (max_managed_ibuttons <= 0) {
     Serial.println("iButton manager not initialized.");
     return;
@@ -336,30 +756,180 @@ void printAllRegisteredIButtons() {
   IButtonRecord record;
   bool any_registered = false;
   for (int i = 0; i < max_managed_ibuttons; ++i) {
-    EEPROM.get(getRecordAddress(i), record);  // Read from calculated address
+    storeGetRecord(i, record);
     if (record.is_valid) {
       any_registered = true;
-      Serial.printf("Slot %d (Addr %d): Valid=YES, AssocID=%u, iButtonID=",
-                    i, getRecordAddress(i), record.associated_id);
+      Serial.printf("Slot %d: Valid=YES, AssocID=%u, 2FA=%u/%umin, iButtonID=",
+                    i, record.associated_id, record.two_fa_policy, record.two_fa_grant_minutes);
       printIButtonID(record.ibutton_id);  // Re-use the print ID function
       Serial.println();                   // Add newline after printing the ID
     }
     // Optional: Print empty slots for more detail
     // else {
-    //   Serial.printf("Slot %d (Addr %d): Valid=NO\n", i, getRecordAddress(i));
+    //   Serial.printf("Slot %d: Valid=NO\n", i);
     // }
   }
   if (!any_registered) {
     Serial.println("No iButtons are currently registered.");
   }
+  printRecordStoreStats();
   Serial.println("-------------------------------------");
 }
 
 
+int getIButtonCapacity() {
+  return max_managed_ibuttons;
+}
+
+
+int getRegisteredIButtonCount() {
+  return max_managed_ibuttons - free_slot_count - import_claimed_count;
+}
+
+
+bool getIButtonRecordBySlot(int slot, IButtonRecord& record_out) {
+  if (slot < 0 || slot >= max_managed_ibuttons) return false;
+  storeGetRecord(slot, record_out);
+  return record_out.is_valid;
+}
+
+
+bool beginIButtonImport() {
+  if (max_managed_ibuttons <= 0 || import_claimed != nullptr) return false;
+  import_claimed = (uint32_t*)calloc((max_managed_ibuttons + 31) / 32, sizeof(uint32_t));
+  if (import_claimed == nullptr) {
+    Serial.println("Error: Not enough RAM to open an iButton import.");
+    return false;
+  }
+  import_claimed_count = 0;
+  Serial.println("iButton import opened.");
+  return true;
+}
+
+
+IButtonImportStage stageIButtonImport(const IButtonRecord& record) {
+  if (import_claimed == nullptr) return IBUTTON_IMPORT_INVALID;
+  if (record.associated_id == UINT32_MAX || record.two_fa_policy > TWO_FA_POLICY_GRANT_WINDOW
+      || (record.two_fa_policy == TWO_FA_POLICY_GRANT_WINDOW
+          && (record.two_fa_grant_minutes == 0 || record.two_fa_grant_minutes > TWO_FA_MAX_GRANT_MINUTES))) {
+    return IBUTTON_IMPORT_INVALID;
+  }
+  if (findIndexBucket(record.ibutton_id) >= 0) return IBUTTON_IMPORT_DUPLICATE;
+  if (free_slot_count == 0) return IBUTTON_IMPORT_FULL;
+
+  int slot = free_slots[--free_slot_count];
+  IButtonRecord staged;
+  memset(&staged, 0, sizeof(staged));
+  // Stays invalid until the commit, so a compaction in between stores the slot as free
+  staged.two_fa_policy = record.two_fa_policy;
+  staged.two_fa_grant_minutes = record.two_fa_policy == TWO_FA_POLICY_GRANT_WINDOW ? record.two_fa_grant_minutes : 0;
+  staged.associated_id = record.associated_id;
+  memcpy(staged.ibutton_id, record.ibutton_id, IBUTTON_ID_LEN);
+  storePutRecordUnlogged(slot, staged);
+  import_claimed[slot / 32] |= 1UL << (slot % 32);
+  import_claimed_count++;
+  return IBUTTON_IMPORT_STAGED;
+}
+
+
+bool commitIButtonImport(int& imported_out, int& duplicates_out, int& conflicts_out) {
+  imported_out = 0;
+  duplicates_out = 0;
+  conflicts_out = 0;
+  if (import_claimed == nullptr) return false;
+  if (import_claimed_count == 0) {  // Nothing staged, nothing to write
+    free(import_claimed);
+    import_claimed = nullptr;
+    Serial.println("iButton import committed: nothing to register.");
+    return true;
+  }
+  if (storeBatchActive()) {  // The snapshot would carry the uncommitted batch along
+    Serial.println("Error: iButton import cannot commit inside a registry transaction.");
+    abortIButtonImport();
+    return false;
+  }
+
+  // Associated IDs stay unique: an imported ID already in use is not imported
+  conflicts_out = dropConflictingImportIDs();
+  if (conflicts_out < 0) {
+    Serial.println("Error: Not enough RAM to check imported associated IDs.");
+    abortIButtonImport();
+    conflicts_out = 0;
+    return false;
+  }
+
+  // Imported IDs are kept; the counter moves past the highest one actually registered
+  IButtonRecord record;
+  uint32_t next_associated_id = storeGetCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID);
+  for (int slot = 0; slot < max_managed_ibuttons; slot++) {
+    if (!isImportClaimed(slot)) continue;
+    storeGetRecord(slot, record);
+    if (findIndexBucket(record.ibutton_id) >= 0) {  // Registered meanwhile, or staged twice
+      dropStagedImport(slot);
+      duplicates_out++;
+      continue;
+    }
+    if (record.associated_id >= next_associated_id) next_associated_id = record.associated_id + 1;
+    record.is_valid = true;
+    storePutRecordUnlogged(slot, record);
+    indexInsert(record.ibutton_id, slot);
+    imported_out++;
+  }
+
+  // Records imported without an ID are numbered after all of them
+  for (int slot = 0; slot < max_managed_ibuttons; slot++) {
+    if (!isImportClaimed(slot)) continue;
+    storeGetRecord(slot, record);
+    if (record.associated_id != INVALID_ASSOCIATED_ID) continue;
+    record.associated_id = next_associated_id++;
+    storePutRecordUnlogged(slot, record);
+  }
+
+  // One snapshot write makes the whole import durable; the old bank stays in charge until it is done
+  bool ok = true;
+  if (next_associated_id > storeGetCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID)) {
+    ok = storePutCounter(STORE_COUNTER_NEXT_ASSOCIATED_ID, next_associated_id);
+  }
+  ok = ok && compactRecordStore();
+  if (!ok) {
+    Serial.println("Error: Record store compaction failed during iButton import.");
+    abortIButtonImport();
+    imported_out = 0;
+    return false;
+  }
+
+  free(import_claimed);
+  import_claimed = nullptr;
+  import_claimed_count = 0;
+  Serial.printf("iButton import committed: %d registered, %d duplicates and %d associated ID conflicts dropped.\n",
+                imported_out, duplicates_out, conflicts_out);
+  return true;
+}
+
+
+void abortIButtonImport() {
+  if (import_claimed == nullptr) return;
+  IButtonRecord empty;
+  memset(&empty, 0, sizeof(empty));
+  for (int slot = 0; slot < max_managed_ibuttons; slot++) {
+    if (isImportClaimed(slot)) storePutRecordUnlogged(slot, empty);
+  }
+  free(import_claimed);
+  import_claimed = nullptr;
+  import_claimed_count = 0;
+  buildIndex();  // Returns the staged slots to the free list
+  Serial.println("iButton import discarded.");
+}
+
+
+bool isIButtonImportActive() {
+  return import_claimed != nullptr;
+}
+
+
 uint32_t readOccupancyCount() {
-    uint32_t count = 0;
-    EEPROM.get(EEPROM_OCCUPANCY_COUNT_ADDR, count);
-    // Basic validation: EEPROM returns FFFFFFFF if never written or corrupted in a specific way.
+    uint32_t count = storeGetCounter(STORE_COUNTER_OCCUPANCY);
+    // Basic validation: erased flash reads as FFFFFFFF if never written or corrupted in a specific way.
     // While technically a valid uint32_t, it's unlikely as an occupancy count.
     if (count == UINT32_MAX) {
         Serial.println("Warning: Read occupancy count looks invalid (0xFFFFFFFF), returning 0.");
@@ -369,10 +939,31 @@ uint32_t readOccupancyCount() {
 }
 
 
+void beginRegistryTransaction() {
+    storeBeginBatch();
+}
+
+
+bool commitRegistryTransaction() {
+    if (storeCommitBatch()) {
+        return true;
+    }
+    // The store rolled the batch back; resync the index and free list with it
+    buildIndex();
+    return false;
+}
+
+
+void abortRegistryTransaction() {
+    if (!storeBatchActive()) return; // Nothing open; a failed commit already rolled back
+    storeAbortBatch();
+    buildIndex();
+}
+
+
 bool writeOccupancyCount(uint32_t count) {
-    EEPROM.put(EEPROM_OCCUPANCY_COUNT_ADDR, count);
-    if (!EEPROM.commit()) {
-        Serial.println("Error: EEPROM commit failed while writing occupancy count.");
+    if (!storePutCounter(STORE_COUNTER_OCCUPANCY, count)) {
+        Serial.println("Error: Record store write failed while writing occupancy count.");
         return false;
     }
     Serial.printf("Occupancy count updated to: %u\n", count);
@@ -8,43 +8,137 @@
 // --- Constants ---
 #define IBUTTON_ID_LEN 8       // Length of the iButton ID in bytes
 #define INVALID_ASSOCIATED_ID 0 // Value indicating an invalid or not-found associated ID
+// Legacy EEPROM layout, read once to migrate old registries into the record store
 const int EEPROM_CONFIG_OFFSET = 16; // Bytes reserved at the beginning of EEPROM for configuration
 const uint32_t EEPROM_INIT_SIGNATURE = 0xCAFEFE0D; // 
 const int EEPROM_SIGNATURE_ADDR = 0;             // Store signature at address 0
 const int EEPROM_OCCUPANCY_COUNT_ADDR = 4;  // Use next 4 bytes after signature for the counter
+const int EEPROM_NEXT_ASSOCIATED_ID_ADDR = 8; // Next 4 bytes: monotonic counter for associated IDs
+// Registry size limit. The hash index was meant for registries of 5k-20k iButtons, but
+// every slot lives in RAM: its record in the record store image (one block), 2 to 4 hash
+// index buckets and a free-slot stack entry, up to IBUTTON_RAM_BYTES_PER_SLOT. Once WiFi and
+// MQTT run, an ESP32 without PSRAM has about 110 KB in its largest free block, and 3000
+// slots already take ~90 KB, plus 24 KB while an import commits. The cap is deliberate:
+// lookups stay in RAM instead of reading flash on every touch. Larger registries need a
+// board with PSRAM and a higher cap.
+const int MAX_MANAGED_IBUTTONS = 3000;
+
+// Reader task (see startIButtonReaderTask)
+#define IBUTTON_MAX_READERS 2          // Lanes, each with its own 1-Wire reader port
+#define IBUTTON_READER_CORE 0          // Arduino loop() runs on core 1; keep the 1-Wire polling off it
+#define IBUTTON_READER_PRIORITY 1
+#define IBUTTON_READER_STACK_SIZE 4096
+#define IBUTTON_READER_POLL_MS 10      // Pause between reader polls
+#define IBUTTON_RELEASE_MS 250         // No read for this long means the iButton was removed
+// 1: an iButton touching the idle port sends a presence pulse; its falling edge wakes the
+// reader task, which then only polls while an iButton is present (plus a slow fallback poll).
+// 0: poll every IBUTTON_READER_POLL_MS.
+#define IBUTTON_PRESENCE_IRQ 0
+#define IBUTTON_IDLE_POLL_MS 200       // Fallback poll with IBUTTON_PRESENCE_IRQ, in case an edge is missed
+#define ONEWIRE_CMD_READ_ROM 0x33      // Valid with a single device on the bus, as on a reader port
+
+
+// Per-credential 2FA policy
+#define TWO_FA_GRANT_CACHE_SIZE 16            // Approvals remembered in RAM for TWO_FA_POLICY_GRANT_WINDOW
+#define TWO_FA_MAX_GRANT_MINUTES (24 * 60)
+const uint16_t IBUTTON_RECORD_LAYOUT_VERSION = 1;  // 1: 2FA policy fields in the former padding
+
+enum TwoFAPolicy : uint8_t {
+  TWO_FA_POLICY_ALWAYS = 0,        // Every entry needs app approval (default; also for unknown values)
+  TWO_FA_POLICY_NEVER = 1,         // The iButton alone opens the gate
+  TWO_FA_POLICY_GRANT_WINDOW = 2   // An approval is valid for two_fa_grant_minutes
+};
+
+// What stageIButtonImport() did with a record
+enum IButtonImportStage : uint8_t {
+  IBUTTON_IMPORT_STAGED,
+  IBUTTON_IMPORT_DUPLICATE,  // Already registered; the registered record is kept
+  IBUTTON_IMPORT_INVALID,    // Bad associated ID, 2FA policy or grant window, or no import open
+  IBUTTON_IMPORT_FULL        // No free slot left
+};
 
 
 // --- Data Structure ---
-// Structure to store one record in EEPROM
+// Structure to store one record in the record store.
+// The 2FA fields occupy what used to be padding after is_valid, so the size and the
+// offsets of the older fields are unchanged (see IBUTTON_RECORD_LAYOUT_VERSION).
 struct IButtonRecord {
   bool is_valid;
+  uint8_t two_fa_policy;          // TwoFAPolicy
+  uint16_t two_fa_grant_minutes;  // Only for TWO_FA_POLICY_GRANT_WINDOW
   uint32_t associated_id;
   byte ibutton_id[IBUTTON_ID_LEN]; // The physical ID of the iButton
   bool is_inside; // Flag to track if the iButton holder is inside
 };
+static_assert(sizeof(IButtonRecord) == 20, "IButtonRecord layout must stay compatible with stored records");
+const size_t IBUTTON_RAM_BYTES_PER_SLOT = sizeof(IButtonRecord) + 5 * sizeof(uint16_t);  // Image, index, free stack
 
 
 // --- Public Function Declarations ---
 
 /**
  * @brief Initializes the iButton manager.
- * Configures OneWire, initializes EEPROM with offset, and stores parameters.
- * Must be called in the main setup().
+ * Configures OneWire, mounts the journal-backed record store (migrating a legacy
+ * EEPROM registry on first boot), and stores parameters.
+ * Also builds the in-RAM hash index of registered iButtons (one pass over the record
+ * store's RAM image), so later lookups do not scan every slot.
+ * Must be called in the main setup(). Restarts the ESP32 if the slots do not fit in RAM.
  * @param pin The GPIO pin connected to the OneWire data line.
- * @param max_records The maximum number of iButton records to manage.
+ * @param max_records The maximum number of iButton records to manage, clamped to
+ * MAX_MANAGED_IBUTTONS.
  */
 void setupIButtonManager(uint8_t pin, int max_records);
 
+/**
+ * @brief Adds the reader of one more lane. Lane 0 is the pin given to setupIButtonManager().
+ * Call after setupIButtonManager() and before startIButtonReaderTask(), once per extra lane.
+ * @param pin The GPIO pin connected to the OneWire data line of the lane's reader.
+ * @return The lane number, or -1 if IBUTTON_MAX_READERS readers exist or the task is running.
+ */
+int addIButtonReader(uint8_t pin);
+
+/**
+ * @brief Number of reader lanes set up.
+ */
+int getIButtonReaderCount();
+
 /**
  * @brief Reads an iButton present on the reader.
+ * Issues a reset first; an empty port (no presence pulse) returns false after about 1 ms
+ * of bus time. Only when a device answers is its ROM read directly with Read ROM, since
+ * a reader port never holds more than one iButton.
+ * Once startIButtonReaderTask() has run, only the reader task may call this.
  * @param id_buffer Buffer where the read ID will be stored (must be IBUTTON_ID_LEN bytes).
+ * @param lane Reader to read.
  * @return true if a valid DS1990A iButton was read successfully, false otherwise.
  */
-bool readIButton(byte* id_buffer);
+bool readIButton(byte* id_buffer, uint8_t lane = 0);
+
+/**
+ * @brief Starts the FreeRTOS task that polls every lane's reader on IBUTTON_READER_CORE.
+ * Each new touch (a held iButton is reported once) is pushed into the lock-free scan
+ * queue, so broker round-trips or I2C traffic in loop() never delay card detection.
+ * Call after setupIButtonManager().
+ * @return true if the task is running.
+ */
+bool startIButtonReaderTask();
+
+/**
+ * @brief Takes the next iButton touch reported by the reader task.
+ * Must only be called from the main loop (single consumer).
+ * @param id_buffer Buffer where the ID will be stored (must be IBUTTON_ID_LEN bytes).
+ * @param[out] timestamp_ms Optional pointer for the millis() of the read. Can be nullptr.
+ * @param[out] timestamp_us Optional pointer for the micros() of the read. Can be nullptr.
+ * @param[out] lane Optional pointer for the lane whose reader was touched. Can be nullptr.
+ * @return true if a touch was pending.
+ */
+bool popScannedIButton(byte* id_buffer, unsigned long* timestamp_ms = nullptr, uint32_t* timestamp_us = nullptr,
+                       uint8_t* lane = nullptr);
 
 /**
  * @brief Gets the full record for a given iButton ID.
- * Searches EEPROM after the offset.
+ * Looks the ID up in the RAM index and copies the matching slot from the record store's
+ * RAM image; no flash access, and the cost does not grow with the registry size.
  * @param ibutton_id The physical ID of the iButton to search for (IBUTTON_ID_LEN bytes).
  * @param[out] record_out Reference to an IButtonRecord struct where the found record will be copied.
  * @param[out] record_index Optional pointer to store the index (slot) where the record was found. Can be nullptr.
@@ -53,31 +147,61 @@ bool readIButton(byte* id_buffer);
 bool getIButtonRecord(const byte* ibutton_id, IButtonRecord &record_out, int* record_index = nullptr);
 
 /**
- * @brief Registers a new iButton in EEPROM after the offset.
- * Searches for a free slot, automatically generates the next available associated ID,
- * and stores the information. Prevents duplicate registrations.
+ * @brief Registers a new iButton in the record store.
+ * Takes a free slot from the RAM free list, generates the next associated ID from the
+ * persisted monotonic counter, and stores the information. Prevents duplicate registrations.
  * @param ibutton_id The physical ID of the iButton to register (IBUTTON_ID_LEN bytes).
  * @return true if registration was successful, false if no space is available, the iButton already exists, or an ID could not be generated.
  */
 bool registerIButton(const byte* ibutton_id);
 
 /**
- * @brief Updates an existing iButton record in EEPROM.
- * Used internally to update the is_inside flag.
+ * @brief Updates an existing iButton record in the record store.
+ * Used internally to update the is_inside flag. Costs one journal append.
  * @param index The index (slot) of the record to update.
  * @param record The IButtonRecord data to write.
- * @return true if the update and commit were successful, false otherwise.
+ * @return true if the journal write was successful, false otherwise.
  */
 bool updateIButtonRecord(int index, const IButtonRecord& record);
 
 /**
- * @brief Deletes the registration of an iButton from EEPROM.
- * Searches for the iButton by its physical ID (after the offset) and marks its slot as invalid.
+ * @brief Deletes the registration of an iButton from the record store.
+ * Finds the iButton through the RAM index and marks its slot as invalid.
  * @param ibutton_id The physical ID of the iButton to delete (IBUTTON_ID_LEN bytes).
  * @return true if deletion was successful, false if the iButton was not found.
  */
 bool deleteIButton(const byte* ibutton_id);
 
+/**
+ * @brief Brings a record written under an older layout up to IBUTTON_RECORD_LAYOUT_VERSION.
+ * Called by the record store for every slot of a bank written with an older layout, and
+ * on EEPROM migration, so bytes that used to be padding never leak into the new fields.
+ */
+void upgradeIButtonRecord(IButtonRecord& record, uint16_t from_version);
+
+/**
+ * @brief Sets the 2FA policy of a registered iButton and persists it.
+ * Drops any cached approval for the iButton.
+ * @param ibutton_id The physical ID of the iButton (IBUTTON_ID_LEN bytes).
+ * @param policy New policy.
+ * @param grant_minutes Approval validity for TWO_FA_POLICY_GRANT_WINDOW (1 to TWO_FA_MAX_GRANT_MINUTES).
+ * @return true if the iButton was found, the values are valid and the change was stored.
+ */
+bool setIButtonTwoFAPolicy(const byte* ibutton_id, TwoFAPolicy policy, uint16_t grant_minutes);
+
+/**
+ * @brief Tells whether an entry with this record needs a 2FA round-trip right now.
+ * False for TWO_FA_POLICY_NEVER, and for TWO_FA_POLICY_GRANT_WINDOW while a cached
+ * approval is still valid. RAM only, no flash access.
+ */
+bool isTwoFARequired(const IButtonRecord& record);
+
+/**
+ * @brief Remembers an app approval for an iButton whose policy is TWO_FA_POLICY_GRANT_WINDOW,
+ * until its grant window expires. Does nothing for other policies.
+ */
+void cacheTwoFAGrant(const IButtonRecord& record);
+
 /**
  * @brief Prints an iButton ID in hexadecimal format to the Serial monitor.
  * @param id The buffer containing the iButton ID (IBUTTON_ID_LEN bytes).
@@ -85,21 +209,94 @@ bool deleteIButton(const byte* ibutton_id);
 void printIButtonID(const byte* id);
 
 /**
- * @brief Prints all currently registered iButtons stored in EEPROM (after the offset) to the Serial monitor.
+ * @brief Prints all currently registered iButtons in the record store to the Serial monitor.
  * Useful for debugging.
  */
 void printAllRegisteredIButtons();
 
 /**
- * @brief Reads the current occupancy count from EEPROM.
+ * @brief Number of record slots managed (max_records given to setupIButtonManager()).
+ */
+int getIButtonCapacity();
+
+/**
+ * @brief Number of registered iButtons, from the RAM free list (no store scan).
+ * Records staged by an open import are not counted.
+ */
+int getRegisteredIButtonCount();
+
+/**
+ * @brief Copies the record in a slot, for walking the registry slot by slot.
+ * @return true if the slot holds a registered iButton.
+ */
+bool getIButtonRecordBySlot(int slot, IButtonRecord& record_out);
+
+/**
+ * @brief Opens a bulk import. Records staged with stageIButtonImport() take free slots
+ * in the RAM image but are neither indexed nor journaled, so they stay invisible until
+ * commitIButtonImport() makes all of them live with a single record store compaction.
+ * Entries, exits and other registry changes keep working meanwhile.
+ * @return false if an import is already open or the manager is not initialized.
+ */
+bool beginIButtonImport();
+
+/**
+ * @brief Stages one record of the open import. Only ibutton_id, associated_id and the
+ * 2FA fields are used: imported iButtons start outside, and an associated_id of
+ * INVALID_ASSOCIATED_ID gets a new one from the counter on commit.
+ */
+IButtonImportStage stageIButtonImport(const IButtonRecord& record);
+
+/**
+ * @brief Registers every staged record at once. After a crash either all of them are
+ * registered or none. Staged iButtons that were registered in the meantime, or staged
+ * twice, are dropped, and so are staged records whose associated ID is already held by a
+ * registered iButton or by an earlier staged record. The associated ID counter only moves
+ * past the IDs that were registered.
+ * @param[out] imported_out Records registered.
+ * @param[out] duplicates_out Staged records dropped as duplicates.
+ * @param[out] conflicts_out Staged records dropped for an associated ID in use.
+ * @return true if the import was committed. On failure it is discarded.
+ */
+bool commitIButtonImport(int& imported_out, int& duplicates_out, int& conflicts_out);
+
+/**
+ * @brief Discards the open import and frees its staged slots.
+ */
+void abortIButtonImport();
+
+bool isIButtonImportActive();
+
+/**
+ * @brief Reads the current occupancy count from the record store.
  * @return The stored occupancy count, or 0 if read fails or looks invalid (e.g., negative interpreted value).
  */
 uint32_t readOccupancyCount();
 
 /**
- * @brief Writes the current occupancy count to EEPROM.
+ * @brief Starts a registry transaction.
+ * Record and occupancy writes made until commitRegistryTransaction() are visible at once
+ * but reach flash together in a single journal commit, so after a crash either all of
+ * them apply or none does. Used for entry/exit so the is_inside flag and the counter
+ * always agree.
+ */
+void beginRegistryTransaction();
+
+/**
+ * @brief Commits the changes staged since beginRegistryTransaction().
+ * @return true if the commit succeeded. On failure all staged changes are rolled back.
+ */
+bool commitRegistryTransaction();
+
+/**
+ * @brief Discards the changes staged since beginRegistryTransaction().
+ */
+void abortRegistryTransaction();
+
+/**
+ * @brief Writes the current occupancy count to the record store.
  * @param count The occupancy count to write.
- * @return true if write and commit were successful, false otherwise.
+ * @return true if the journal write was successful, false otherwise.
  */
 bool writeOccupancyCount(uint32_t count);
 
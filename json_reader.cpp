@@ -0,0 +1,236 @@
+#include "json_reader.h"
+
+// --- Constants ---
+const int JSON_MAX_KEY_LEN = 32;  // Longer keys cannot match any field and are skipped
+
+
+// --- Cursor Helpers ---
+struct JsonCursor {
+  const byte* pos;
+  const byte* end;
+};
+
+void jsonSkipWhitespace(JsonCursor& c) {
+  while (c.pos < c.end && (*c.pos == ' ' || *c.pos == '\t' || *c.pos == '\n' || *c.pos == '\r')) {
+    c.pos++;
+  }
+}
+
+bool jsonConsume(JsonCursor& c, char expected) {
+  jsonSkipWhitespace(c);
+  if (c.pos >= c.end || *c.pos != expected) return false;
+  c.pos++;
+  return true;
+}
+
+bool jsonConsumeLiteral(JsonCursor& c, const char* literal) {
+  size_t len = strlen(literal);
+  if ((size_t)(c.end - c.pos) < len || memcmp(c.pos, literal, len) != 0) return false;
+  c.pos += len;
+  return true;
+}
+
+int jsonHexDigit(byte ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+/**
+ * Reads a string whose opening quote is at the cursor. The unescaped text is copied
+ * into out when it is not null; fits is cleared if it did not fit in out_size.
+ * \uXXXX escapes outside ASCII are replaced by '?', which is enough for IDs and reasons.
+ */
+bool jsonReadString(JsonCursor& c, char* out, size_t out_size, bool& fits) {
+  size_t written = 0;
+  fits = true;
+  if (c.pos >= c.end || *c.pos != '"') return false;
+  c.pos++;
+
+  while (c.pos < c.end) {
+    byte ch = *c.pos++;
+    if (ch == '"') {
+      if (out != nullptr) {
+        if (written < out_size) out[written] = '\0';
+        else fits = false;
+      }
+      return true;
+    }
+    if (ch < 0x20) return false;  // Control characters must be escaped
+
+    if (ch == '\\') {
+      if (c.pos >= c.end) return false;
+      byte esc = *c.pos++;
+      switch (esc) {
+        case '"': case '\\': case '/': ch = esc; break;
+        case 'b': ch = '\b'; break;
+        case 'f': ch = '\f'; break;
+        case 'n': ch = '\n'; break;
+        case 'r': ch = '\r'; break;
+        case 't': ch = '\t'; break;
+        case 'u': {
+          if (c.end - c.pos < 4) return false;
+          uint16_t code = 0;
+          for (int i = 0; i < 4; i++) {
+            int digit = jsonHexDigit(c.pos[i]);
+            if (digit < 0) return false;
+            code = (code << 4) | digit;
+          }
+          c.pos += 4;
+          ch = code < 0x80 ? (byte)code : '?';
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+
+    if (out != nullptr) {
+      if (written + 1 < out_size) out[written++] = (char)ch;
+      else fits = false;
+    }
+  }
+  return false;  // Unterminated string
+}
+
+/**
+ * Reads a non-negative integer. Fractions, exponents and signs are consumed so the
+ * value can be skipped, but then ok is cleared.
+ */
+bool jsonReadNumber(JsonCursor& c, uint32_t& value, bool& ok) {
+  const byte* start = c.pos;
+  uint64_t acc = 0;
+  ok = true;
+  if (c.pos < c.end && *c.pos == '-') {
+    ok = false;
+    c.pos++;
+  }
+  const byte* digits = c.pos;
+  while (c.pos < c.end && *c.pos >= '0' && *c.pos <= '9') {
+    if (acc <= UINT32_MAX) acc = acc * 10 + (*c.pos - '0');  // Stops growing once out of range
+    c.pos++;
+  }
+  if (acc > UINT32_MAX) ok = false;
+  if (c.pos == digits) {
+    c.pos = start;
+    return false;
+  }
+  while (c.pos < c.end && (*c.pos == '.' || *c.pos == 'e' || *c.pos == 'E' || *c.pos == '+' || *c.pos == '-'
+                           || (*c.pos >= '0' && *c.pos <= '9'))) {
+    ok = false;
+    c.pos++;
+  }
+  value = (uint32_t)acc;
+  return true;
+}
+
+/**
+ * Skips a nested object or array whose opening bracket is at the cursor.
+ * Only bracket balance and string boundaries are checked.
+ */
+bool jsonSkipContainer(JsonCursor& c) {
+  int depth = 0;
+  while (c.pos < c.end) {
+    byte ch = *c.pos;
+    if (ch == '"') {
+      bool fits;
+      if (!jsonReadString(c, nullptr, 0, fits)) return false;
+      continue;
+    }
+    c.pos++;
+    if (ch == '{' || ch == '[') {
+      depth++;
+    } else if (ch == '}' || ch == ']') {
+      if (--depth == 0) return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Reads the value at the cursor into field when it matches the field type,
+ * otherwise just skips it. field may be null.
+ */
+bool jsonReadValue(JsonCursor& c, JsonField* field) {
+  jsonSkipWhitespace(c);
+  if (c.pos >= c.end) return false;
+
+  switch (*c.pos) {
+    case '"': {
+      bool want = field != nullptr && field->type == JSON_FIELD_STRING;
+      bool fits;
+      if (!jsonReadString(c, want ? (char*)field->out : nullptr, want ? field->out_size : 0, fits)) return false;
+      if (want) field->found = fits;
+      return true;
+    }
+    case 't':
+    case 'f': {
+      bool value = *c.pos == 't';
+      if (!jsonConsumeLiteral(c, value ? "true" : "false")) return false;
+      if (field != nullptr && field->type == JSON_FIELD_BOOL) {
+        *(bool*)field->out = value;
+        field->found = true;
+      }
+      return true;
+    }
+    case 'n':
+      return jsonConsumeLiteral(c, "null");
+    case '{':
+    case '[':
+      return jsonSkipContainer(c);
+    default: {
+      uint32_t value;
+      bool ok;
+      if (!jsonReadNumber(c, value, ok)) return false;
+      if (ok && field != nullptr && field->type == JSON_FIELD_UINT) {
+        *(uint32_t*)field->out = value;
+        field->found = true;
+      }
+      return true;
+    }
+  }
+}
+
+
+// --- Function Implementations ---
+
+bool jsonReadObject(const byte* json, unsigned int length, JsonField* fields, int field_count) {
+  for (int i = 0; i < field_count; i++) {
+    fields[i].found = false;
+  }
+  if (json == nullptr) return false;
+
+  JsonCursor c = { json, json + length };
+  if (!jsonConsume(c, '{')) return false;
+
+  jsonSkipWhitespace(c);
+  if (c.pos < c.end && *c.pos == '}') {
+    c.pos++;
+  } else {
+    while (true) {
+      char key[JSON_MAX_KEY_LEN + 1];
+      bool key_fits;
+      jsonSkipWhitespace(c);
+      if (!jsonReadString(c, key, sizeof(key), key_fits)) return false;
+      if (!jsonConsume(c, ':')) return false;
+
+      JsonField* field = nullptr;
+      for (int i = 0; key_fits && i < field_count && field == nullptr; i++) {
+        if (strcmp(fields[i].key, key) == 0) field = &fields[i];
+      }
+      if (!jsonReadValue(c, field)) return false;
+
+      jsonSkipWhitespace(c);
+      if (c.pos < c.end && *c.pos == ',') {
+        c.pos++;
+        continue;
+      }
+      if (!jsonConsume(c, '}')) return false;
+      break;
+    }
+  }
+
+  jsonSkipWhitespace(c);
+  return c.pos == c.end;  // Nothing but whitespace may follow the object
+}
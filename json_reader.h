@@ -0,0 +1,41 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <Arduino.h>
+
+// --- Types ---
+enum JsonFieldType : uint8_t {
+  JSON_FIELD_STRING,  // Copied, unescaped and NUL-terminated into a char buffer
+  JSON_FIELD_BOOL,    // bool
+  JSON_FIELD_UINT     // uint32_t, non-negative integers only
+};
+
+// One top-level key to extract. Fill key/type/out (and out_size for strings);
+// jsonReadObject() sets found.
+struct JsonField {
+  const char* key;
+  JsonFieldType type;
+  void* out;
+  size_t out_size;  // Only for JSON_FIELD_STRING, including the NUL terminator
+  bool found;
+};
+
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Extracts typed top-level fields from a JSON object in a single pass.
+ * Works in place on the payload buffer (which need not be NUL-terminated) and never
+ * allocates. Whitespace and key order are free; unknown keys and nested values are
+ * skipped. A field whose value has the wrong type, or a string that does not fit in
+ * its buffer, is left with found = false.
+ * @param json Payload bytes.
+ * @param length Payload length.
+ * @param fields Fields to extract.
+ * @param field_count Number of entries in fields.
+ * @return true if the payload is a well-formed JSON object, false otherwise
+ *         (fields found before the error keep their values).
+ */
+bool jsonReadObject(const byte* json, unsigned int length, JsonField* fields, int field_count);
+
+#endif // JSON_READER_H
@@ -0,0 +1,117 @@
+#include "json_writer.h"
+
+// --- Helpers ---
+void jsonPutChar(JsonWriter& w, char ch) {
+  if (!w.ok) return;
+  if (w.len + 1 >= w.size) {  // Keep room for the NUL terminator
+    w.ok = false;
+    return;
+  }
+  w.buf[w.len++] = ch;
+  w.buf[w.len] = '\0';
+}
+
+void jsonPutRaw(JsonWriter& w, const char* text) {
+  while (*text != '\0' && w.ok) {
+    jsonPutChar(w, *text++);
+  }
+}
+
+void jsonPutQuoted(JsonWriter& w, const char* text) {
+  static const char hex_digits[] = "0123456789abcdef";
+  jsonPutChar(w, '"');
+  for (; *text != '\0' && w.ok; text++) {
+    byte ch = (byte)*text;
+    if (ch == '"' || ch == '\\') {
+      jsonPutChar(w, '\\');
+      jsonPutChar(w, (char)ch);
+    } else if (ch < 0x20) {
+      jsonPutRaw(w, "\\u00");
+      jsonPutChar(w, hex_digits[ch >> 4]);
+      jsonPutChar(w, hex_digits[ch & 0x0F]);
+    } else {
+      jsonPutChar(w, (char)ch);
+    }
+  }
+  jsonPutChar(w, '"');
+}
+
+void jsonPutKey(JsonWriter& w, const char* key) {
+  if (!w.first) jsonPutChar(w, ',');
+  w.first = false;
+  jsonPutQuoted(w, key);
+  jsonPutChar(w, ':');
+}
+
+
+// --- Function Implementations ---
+
+void jsonBeginObject(JsonWriter& w, char* buf, size_t size) {
+  w.buf = buf;
+  w.size = size;
+  w.len = 0;
+  w.ok = size > 0;
+  w.first = true;
+  if (w.ok) w.buf[0] = '\0';
+  jsonPutChar(w, '{');
+}
+
+void jsonAddString(JsonWriter& w, const char* key, const char* value) {
+  jsonPutKey(w, key);
+  jsonPutQuoted(w, value);
+}
+
+void jsonAddUInt(JsonWriter& w, const char* key, uint32_t value) {
+  char digits[11];  // Up to 4294967295
+  int pos = sizeof(digits);
+  digits[--pos] = '\0';
+  do {
+    digits[--pos] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  jsonPutKey(w, key);
+  jsonPutRaw(w, &digits[pos]);
+}
+
+void jsonAddBool(JsonWriter& w, const char* key, bool value) {
+  jsonPutKey(w, key);
+  jsonPutRaw(w, value ? "true" : "false");
+}
+
+void jsonAddHex(JsonWriter& w, const char* key, const byte* data, size_t length) {
+  static const char hex_digits[] = "0123456789ABCDEF";
+  jsonPutKey(w, key);
+  jsonPutChar(w, '"');
+  for (size_t i = 0; i < length && w.ok; i++) {
+    jsonPutChar(w, hex_digits[data[i] >> 4]);
+    jsonPutChar(w, hex_digits[data[i] & 0x0F]);
+  }
+  jsonPutChar(w, '"');
+}
+
+void jsonBeginArray(JsonWriter& w, const char* key) {
+  jsonPutKey(w, key);
+  jsonPutChar(w, '[');
+  w.first = true;
+}
+
+void jsonBeginElement(JsonWriter& w) {
+  if (!w.first) jsonPutChar(w, ',');
+  jsonPutChar(w, '{');
+  w.first = true;
+}
+
+void jsonEndElement(JsonWriter& w) {
+  jsonPutChar(w, '}');
+  w.first = false;  // Next element needs a comma
+}
+
+void jsonEndArray(JsonWriter& w) {
+  jsonPutChar(w, ']');
+  w.first = false;  // Next member needs a comma
+}
+
+bool jsonEndObject(JsonWriter& w) {
+  jsonPutChar(w, '}');
+  return w.ok;
+}
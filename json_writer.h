@@ -0,0 +1,62 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+
+// Writes one JSON object into a caller-provided buffer. Members are flat, except for
+// arrays of flat objects (see jsonBeginArray()). Never allocates; if the buffer is too
+// small the writer stops and jsonEndObject() returns false.
+struct JsonWriter {
+  char* buf;
+  size_t size;
+  size_t len;
+  bool ok;
+  bool first;  // No comma before the first member
+};
+
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Starts an object ("{") in buf.
+ * @param buf Destination buffer; always NUL-terminated afterwards.
+ * @param size Size of buf in bytes.
+ */
+void jsonBeginObject(JsonWriter& w, char* buf, size_t size);
+
+/**
+ * @brief Adds "key":"value", escaping quotes, backslashes and control characters.
+ */
+void jsonAddString(JsonWriter& w, const char* key, const char* value);
+
+/**
+ * @brief Adds "key":value for an unsigned integer.
+ */
+void jsonAddUInt(JsonWriter& w, const char* key, uint32_t value);
+
+/**
+ * @brief Adds "key":true or "key":false.
+ */
+void jsonAddBool(JsonWriter& w, const char* key, bool value);
+
+/**
+ * @brief Adds "key":"HEX" for binary data, as uppercase hex written straight into the buffer.
+ */
+void jsonAddHex(JsonWriter& w, const char* key, const byte* data, size_t length);
+
+/**
+ * @brief Starts "key":[ for an array of flat objects. Add each one between
+ * jsonBeginElement() and jsonEndElement(), then close with jsonEndArray().
+ */
+void jsonBeginArray(JsonWriter& w, const char* key);
+void jsonBeginElement(JsonWriter& w);
+void jsonEndElement(JsonWriter& w);
+void jsonEndArray(JsonWriter& w);
+
+/**
+ * @brief Closes the object ("}").
+ * @return true if the whole object fit in the buffer.
+ */
+bool jsonEndObject(JsonWriter& w);
+
+#endif // JSON_WRITER_H
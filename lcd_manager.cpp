@@ -2,18 +2,208 @@
 
 // --- Objeto LCD (privado a este módulo) ---
 // El constructor toma (dirección_i2c, columnas, filas)
+// Solo la tarea del renderer toca `lcd` después de setupLCDManager().
 LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
 bool lcd_initialized = false;
-
-// Variables para lcdPrintTemporary
-String prev_line1 = "";
-String prev_line2 = "";
+bool lcd_direct = false;  // Sin tarea (no se pudo crear): se dibuja en el hilo que llama
+
+// --- Peticiones al renderer ---
+enum LcdRequestType : uint8_t {
+  LCD_REQ_SHOW,       // Nueva pantalla base (lcdPrint)
+  LCD_REQ_PRINT_AT,   // Escritura parcial sobre la pantalla base
+  LCD_REQ_TEMPORARY,  // Mensaje temporal
+  LCD_REQ_BACKLIGHT
+};
+
+struct LcdRequest {
+  uint8_t type;
+  uint8_t priority;     // LcdPriority, solo para LCD_REQ_TEMPORARY
+  uint8_t col;          // LCD_REQ_PRINT_AT
+  uint8_t row;
+  bool flag;            // SHOW: limpiar antes; TEMPORARY: trae pantalla a restaurar; BACKLIGHT: encender
+  uint32_t duration_ms;
+  char line1[LCD_COLS + 1];
+  char line2[LCD_COLS + 1];
+  char restore_line1[LCD_COLS + 1];
+  char restore_line2[LCD_COLS + 1];
+};
+
+QueueHandle_t lcd_queue = nullptr;
+TaskHandle_t lcd_task_handle = nullptr;
+uint32_t lcd_drop_count = 0;  // Solo lo modifica el lado que encola (tarea del loop)
+
+// --- Estado del renderer (propiedad de la tarea) ---
+char lcd_base[LCD_ROWS][LCD_COLS];  // Pantalla a la que se vuelve tras los temporales
 bool temporary_message_active = false;
 unsigned long temporary_message_end_time = 0;
+LcdRequest temporary_current;
+LcdRequest temporary_pending[LCD_PENDING_TEMPORARY_MAX];  // En orden de llegada
+int temporary_pending_count = 0;
+
+// Framebuffer: lcd_shadow es lo que hay en el cristal, lcd_target lo que queremos mostrar.
+// lcdFlush() solo envía por I2C las celdas que difieren.
+char lcd_shadow[LCD_ROWS][LCD_COLS];
+char lcd_target[LCD_ROWS][LCD_COLS];
+int lcd_cursor_row = -1;  // Posición del cursor del HD44780 (-1 = desconocida)
+int lcd_cursor_col = -1;
+
+
+// --- Framebuffer ---
+
+// Copia texto en una pantalla desde (col,row), truncando al ancho. Con pad_to_end rellena con espacios.
+void lcdSetCells(char screen[LCD_ROWS][LCD_COLS], uint8_t col, uint8_t row, const char* text, bool pad_to_end) {
+  if (row >= LCD_ROWS) return;
+  while (col < LCD_COLS && *text != '\0') {
+    screen[row][col++] = *text++;
+  }
+  while (pad_to_end && col < LCD_COLS) {
+    screen[row][col++] = ' ';
+  }
+}
+
+// Envía solo las celdas cambiadas; mueve el cursor solo cuando no es contiguo
+void lcdFlush() {
+  for (int row = 0; row < LCD_ROWS; row++) {
+    for (int col = 0; col < LCD_COLS; col++) {
+      char ch = lcd_target[row][col];
+      if (ch == lcd_shadow[row][col]) continue;
+      if (row != lcd_cursor_row || col != lcd_cursor_col) {
+        lcd.setCursor(col, row);
+      }
+      lcd.write((uint8_t)ch);
+      lcd_shadow[row][col] = ch;
+      lcd_cursor_row = row;
+      lcd_cursor_col = col + 1;  // El HD44780 avanza solo
+    }
+  }
+}
+
+// Escribe texto centrado en buf (LCD_COLS + 1 bytes), sin usar String
+void lcdCenter(char* buf, const char* text) {
+  int len = strlen(text);
+  if (len > LCD_COLS) len = LCD_COLS;
+  int padding = (LCD_COLS - len) / 2;
+  memset(buf, ' ', padding);
+  memcpy(buf + padding, text, len);
+  buf[padding + len] = '\0';
+}
+
+// Copia texto a un campo de la petición, truncando al ancho de la LCD
+void lcdCopyLine(char* dest, const char* text) {
+  size_t len = strnlen(text, LCD_COLS);
+  memcpy(dest, text, len);
+  dest[len] = '\0';
+}
+
+
+// --- Renderer ---
 
-// Para saber qué restaurar si no se especifica
-extern uint32_t current_occupancy; // Asume que current_occupancy es global en tu .ino
-extern uint32_t TOTAL_PARKING_SPACES; // Asume que TOTAL_PARKING_SPACES es global en tu .ino
+void lcdApplyRestore(const LcdRequest& temporary) {
+  if (!temporary.flag) return;
+  memset(lcd_base, ' ', sizeof(lcd_base));
+  lcdSetCells(lcd_base, 0, 0, temporary.restore_line1, false);
+  lcdSetCells(lcd_base, 0, 1, temporary.restore_line2, false);
+}
+
+void lcdStartTemporary(const LcdRequest& request) {
+  temporary_current = request;
+  temporary_message_active = true;
+  temporary_message_end_time = millis() + request.duration_ms;
+}
+
+void lcdHandleTemporary(const LcdRequest& request) {
+  if (!temporary_message_active || request.priority >= temporary_current.priority) {
+    if (temporary_message_active) lcdApplyRestore(temporary_current);  // Reemplazado, pero su restauración vale
+    lcdStartTemporary(request);
+    return;
+  }
+  // Hay uno de mayor prioridad visible: esperar turno (si no cabe, se descarta el más antiguo)
+  if (temporary_pending_count == LCD_PENDING_TEMPORARY_MAX) {
+    memmove(&temporary_pending[0], &temporary_pending[1], sizeof(LcdRequest) * (LCD_PENDING_TEMPORARY_MAX - 1));
+    temporary_pending_count--;
+  }
+  temporary_pending[temporary_pending_count++] = request;
+}
+
+void lcdApplyRequest(const LcdRequest& request) {
+  switch (request.type) {
+    case LCD_REQ_SHOW:
+      if (request.flag) memset(lcd_base, ' ', sizeof(lcd_base));
+      lcdSetCells(lcd_base, 0, 0, request.line1, false);
+      if (request.line2[0] != '\0') lcdSetCells(lcd_base, 0, 1, request.line2, false);
+      break;
+    case LCD_REQ_PRINT_AT:
+      lcdSetCells(lcd_base, request.col, request.row, request.line1, false);
+      break;
+    case LCD_REQ_TEMPORARY:
+      lcdHandleTemporary(request);
+      break;
+    case LCD_REQ_BACKLIGHT:
+      if (request.flag) lcd.backlight();
+      else lcd.noBacklight();
+      break;
+  }
+}
+
+void lcdExpireTemporary() {
+  if (!temporary_message_active || (long)(millis() - temporary_message_end_time) < 0) return;
+  lcdApplyRestore(temporary_current);
+  if (temporary_pending_count > 0) {
+    LcdRequest next = temporary_pending[0];
+    memmove(&temporary_pending[0], &temporary_pending[1], sizeof(LcdRequest) * (temporary_pending_count - 1));
+    temporary_pending_count--;
+    lcdStartTemporary(next);
+  } else {
+    temporary_message_active = false;
+  }
+}
+
+// Compone lo que debe verse (temporal o pantalla base) y envía las diferencias
+void lcdRender() {
+  if (temporary_message_active) {
+    memset(lcd_target, ' ', sizeof(lcd_target));
+    lcdSetCells(lcd_target, 0, 0, temporary_current.line1, false);
+    lcdSetCells(lcd_target, 0, 1, temporary_current.line2, false);
+  } else {
+    memcpy(lcd_target, lcd_base, sizeof(lcd_target));
+  }
+  lcdFlush();
+}
+
+void lcdRendererTask(void* param) {
+  LcdRequest request;
+  for (;;) {
+    // Dormir hasta la próxima petición o hasta que caduque el temporal visible
+    TickType_t wait = portMAX_DELAY;
+    if (temporary_message_active) {
+      long remaining = (long)(temporary_message_end_time - millis());
+      wait = remaining > 0 ? pdMS_TO_TICKS(remaining) + 1 : 0;
+    }
+    if (xQueueReceive(lcd_queue, &request, wait) == pdTRUE) {
+      lcdApplyRequest(request);
+      while (xQueueReceive(lcd_queue, &request, 0) == pdTRUE) {  // Agrupar lo acumulado en un solo dibujado
+        lcdApplyRequest(request);
+      }
+    }
+    lcdExpireTemporary();
+    lcdRender();
+  }
+}
+
+// Encola sin esperar nunca; si la cola está llena la petición se descarta.
+// Sin tarea, la aplica y dibuja aquí mismo.
+void lcdEnqueue(const LcdRequest& request) {
+  if (!lcd_initialized) return;
+  if (lcd_direct) {
+    lcdApplyRequest(request);
+    lcdExpireTemporary();
+    lcdRender();
+    return;
+  }
+  if (xQueueSend(lcd_queue, &request, 0) != pdTRUE) {
+    lcd_drop_count++;
+  }
+}
 
 
 // --- Implementación de Funciones ---
@@ -34,28 +224,9 @@ bool setupLCDManager(int sda_pin, int scl_pin) {
   }
 
 
-  // Escaneo I2C para verificar la dirección (opcional pero bueno para debug)
-  bool device_found = false;
-  Serial.println("Scanning I2C bus for LCD...");
-  byte error, address;
-  for(address = 1; address < 127; address++ ) {
-    Wire.beginTransmission(address);
-    error = Wire.endTransmission();
-    if (error == 0) {
-      Serial.print("I2C device found at address 0x");
-      if (address < 16) Serial.print("0");
-      Serial.print(address,HEX);
-      Serial.println(" !");
-      if (address == LCD_ADDRESS) {
-          device_found = true;
-      }
-    } else if (error == 4) {
-      // Serial.print("Unknown error at address 0x");
-      // if (address<16) Serial.print("0");
-      // Serial.println(address,HEX);
-    }
-  }
-  if (!device_found) {
+  // Solo se sondea LCD_ADDRESS; un escaneo completo del bus retrasaba el arranque
+  Wire.beginTransmission(LCD_ADDRESS);
+  if (Wire.endTransmission() != 0) {
       Serial.printf("LCD not found at address 0x%02X. Please check wiring and LCD_ADDRESS.\n", LCD_ADDRESS);
       lcd_initialized = false;
       return false;
@@ -66,134 +237,137 @@ bool setupLCDManager(int sda_pin, int scl_pin) {
   // Inicializar la LCD
   lcd.init(); // Inicializa la LCD (algunas bibliotecas usan lcd.begin())
   lcd.backlight(); // Encender la luz de fondo
-  lcdClear();
-  lcdPrint("LCD Initialized", "Smart Parking");
-  delay(1000); // Mostrar mensaje de inicialización
+  lcd.clear();     // Único clear: a partir de aquí se actualizan solo las celdas que cambian
+  memset(lcd_shadow, ' ', sizeof(lcd_shadow));
+  memset(lcd_target, ' ', sizeof(lcd_target));
+  memset(lcd_base, ' ', sizeof(lcd_base));
+  lcd_cursor_row = 0;
+  lcd_cursor_col = 0;
+
+  // Desde aquí la LCD es de la tarea del renderer
+  lcd_direct = false;
+  lcd_queue = xQueueCreate(LCD_RENDER_QUEUE_LENGTH, sizeof(LcdRequest));
+  if (lcd_queue != nullptr
+      && xTaskCreatePinnedToCore(lcdRendererTask, "lcd_renderer", LCD_RENDERER_STACK_SIZE, nullptr,
+                                 LCD_RENDERER_PRIORITY, &lcd_task_handle, LCD_RENDERER_CORE) != pdPASS) {
+      vQueueDelete(lcd_queue);
+      lcd_queue = nullptr;
+  }
+  if (lcd_queue == nullptr) {
+      // La pantalla funciona igual, pero cada llamada espera al bus I2C
+      Serial.println("Warning: LCD renderer task could not be started. Drawing directly.");
+      lcd_direct = true;
+  }
   lcd_initialized = true;
   return true;
 }
 
-void lcdPrint(const String& line1, const String& line2, bool clear_display) {
-  if (!lcd_initialized) return;
-  if (temporary_message_active && millis() < temporary_message_end_time) return; // No sobreescribir mensaje temporal
+void lcdPrintLines(const char* line1, const char* line2, bool clear_display) {
+  LcdRequest request = {};
+  request.type = LCD_REQ_SHOW;
+  request.flag = clear_display;
+  lcdCopyLine(request.line1, line1); // Truncar si es más largo
+  lcdCopyLine(request.line2, line2);
+  lcdEnqueue(request);
+}
 
-  if (clear_display) {
-    lcd.clear();
-  }
-  lcd.setCursor(0, 0);
-  lcd.print(line1.substring(0, LCD_COLS)); // Truncar si es más largo
-  if (line2 != "") {
-    lcd.setCursor(0, 1);
-    lcd.print(line2.substring(0, LCD_COLS)); // Truncar si es más largo
-  }
-  prev_line1 = line1; // Guardar para restauración
-  prev_line2 = line2;
-  temporary_message_active = false; // Cualquier print normal cancela el temporal
+void lcdPrint(const String& line1, const String& line2, bool clear_display) {
+  lcdPrintLines(line1.c_str(), line2.c_str(), clear_display);
 }
 
 void lcdPrintAt(uint8_t col, uint8_t row, const String& message) {
-  if (!lcd_initialized) return;
-  if (temporary_message_active && millis() < temporary_message_end_time) return;
-
-  if (row < LCD_ROWS && col < LCD_COLS) {
-    lcd.setCursor(col, row);
-    lcd.print(message.substring(0, LCD_COLS - col)); // Truncar si excede
-  }
-  // No actualizamos prev_line1/2 aquí porque es una escritura parcial
-  temporary_message_active = false;
+  if (row >= LCD_ROWS || col >= LCD_COLS) return;
+  LcdRequest request = {};
+  request.type = LCD_REQ_PRINT_AT;
+  request.col = col;
+  request.row = row;
+  lcdCopyLine(request.line1, message.c_str()); // El renderer trunca si excede
+  lcdEnqueue(request);
 }
 
 void lcdClear() {
-  if (!lcd_initialized) return;
-  lcd.clear();
-  prev_line1 = "";
-  prev_line2 = "";
-  temporary_message_active = false;
+  lcdPrintLines("", "", true);
 }
 
 void lcdBacklightOn() {
-  if (!lcd_initialized) return;
-  lcd.backlight();
+  LcdRequest request = {};
+  request.type = LCD_REQ_BACKLIGHT;
+  request.flag = true;
+  lcdEnqueue(request);
 }
 
 void lcdBacklightOff() {
-  if (!lcd_initialized) return;
-  lcd.noBacklight();
+  LcdRequest request = {};
+  request.type = LCD_REQ_BACKLIGHT;
+  request.flag = false;
+  lcdEnqueue(request);
 }
 
 void lcdDisplayWelcome() {
-  if (!lcd_initialized) return;
-  lcdPrint(" Smart Parking ", "  Bienvenido!  ");
+  lcdPrintLines(" Smart Parking ", "  Bienvenido!  ");
 }
 
 void lcdDisplayOccupancy(uint32_t current_occupied, uint32_t total_spaces) {
   if (!lcd_initialized) return;
-  if (temporary_message_active && millis() < temporary_message_end_time) return; // No sobreescribir mensaje temporal
 
-  String line1 = "Ocupacion:";
-  String line2 = String(current_occupied) + "/" + String(total_spaces) + " Libres:" + String(total_spaces - current_occupied);
+  char text[24];
+  char padded_line1[LCD_COLS + 1];
+  char padded_line2[LCD_COLS + 1];
 
-  // Centrar línea 1 si es corta
-  int padding1 = (LCD_COLS - line1.length()) / 2;
-  String padded_line1 = "";
-  for(int i=0; i<padding1; ++i) padded_line1 += " ";
-  padded_line1 += line1;
+  lcdCenter(padded_line1, "Ocupacion:");
 
   // Ajustar línea 2 para que quepa
-  if (line2.length() > LCD_COLS) {
-      line2 = String(current_occupied) + "/" + String(total_spaces) + " L:" + String(total_spaces - current_occupied);
-      if (line2.length() > LCD_COLS) { // Aun así es larga
-          line2 = String(current_occupied) + "/" + String(total_spaces); // La más básica
+  uint32_t free_spaces = total_spaces - current_occupied;
+  int len = snprintf(text, sizeof(text), "%u/%u Libres:%u", current_occupied, total_spaces, free_spaces);
+  if (len > LCD_COLS) {
+      len = snprintf(text, sizeof(text), "%u/%u L:%u", current_occupied, total_spaces, free_spaces);
+      if (len > LCD_COLS) { // Aun así es larga
+          snprintf(text, sizeof(text), "%u/%u", current_occupied, total_spaces); // La más básica
       }
   }
-  int padding2 = (LCD_COLS - line2.length()) / 2;
-  String padded_line2 = "";
-  for(int i=0; i<padding2; ++i) padded_line2 += " ";
-  padded_line2 += line2;
+  lcdCenter(padded_line2, text);
 
-
-  lcdPrint(padded_line1, padded_line2, true); // Limpiar y mostrar
+  lcdPrintLines(padded_line1, padded_line2, true); // Limpiar y mostrar; solo cambian los dígitos
 }
 
 
-void lcdPrintTemporary(const String& temp_line1, const String& temp_line2, unsigned long duration_ms,
-                       const String& restore_line1_custom, const String& restore_line2_custom) {
-    if (!lcd_initialized) return;
-
-    // Guardar el estado actual si no hay ya un mensaje temporal activo
-    if (!temporary_message_active) {
-        // prev_line1 y prev_line2 ya deberían tener el mensaje actual visible
-        // si se usó lcdPrint(). Si se usó lcdPrintAt() o lcdClear(), pueden estar vacíos.
-        // Para ser más robustos, podríamos leer de la LCD si la librería lo permitiera,
-        // pero la mayoría no lo hace. Asumimos que prev_line1/2 son representativos o
-        // el usuario quiere restaurar ocupación.
-    }
-
-    lcd.clear();
-    lcd.setCursor(0,0);
-    lcd.print(temp_line1.substring(0, LCD_COLS));
-    if (temp_line2 != "") {
-        lcd.setCursor(0,1);
-        lcd.print(temp_line2.substring(0, LCD_COLS));
-    }
-
-    temporary_message_active = true;
-    temporary_message_end_time = millis() + duration_ms;
-
-    // Guardar qué restaurar
-    // Si no se proveen líneas de restauración custom, usaremos las previas.
-    // Si las previas están vacías (ej. después de un clear), por defecto mostramos ocupación.
-    // Esta parte de la restauración se manejará en un loopLCDManager()
+void lcdPrintTemporary(const char* temp_line1, const char* temp_line2, unsigned long duration_ms,
+                       const char* restore_line1_custom, const char* restore_line2_custom,
+                       LcdPriority priority) {
+    LcdRequest request = {};
+    request.type = LCD_REQ_TEMPORARY;
+    request.priority = priority;
+    request.duration_ms = duration_ms;
+    lcdCopyLine(request.line1, temp_line1);
+    lcdCopyLine(request.line2, temp_line2);
+
+    // Si se proveen líneas de restauración, pasan a ser la pantalla base al terminar.
+    // Si no, se vuelve a la base actual (normalmente la ocupación, ver loopLCDManager()).
+    request.flag = restore_line1_custom[0] != '\0' || restore_line2_custom[0] != '\0';
+    lcdCopyLine(request.restore_line1, restore_line1_custom);
+    lcdCopyLine(request.restore_line2, restore_line2_custom);
+    lcdEnqueue(request);
 }
 
-// NUEVO: Función para manejar el loop de la LCD (restaurar mensajes temporales)
+// La caducidad de los temporales la gestiona el renderer (o esta función, sin él); aquí
+// se mantiene al día la pantalla de ocupación, encolando únicamente cuando cambia.
 void loopLCDManager(uint32_t current_occupied_val, uint32_t total_spaces_val) {
+    static uint32_t shown_occupied = UINT32_MAX;
+    static uint32_t shown_total = UINT32_MAX;
     if (!lcd_initialized) return;
 
-    if (temporary_message_active && millis() >= temporary_message_end_time) {
-        temporary_message_active = false;
-        // Ahora usa los parámetros pasados a esta función
+    if (lcd_direct && temporary_message_active) {  // Sin renderer, los temporales caducan aquí
+        lcdExpireTemporary();
+        lcdRender();  // Solo envía algo si cambió lo visible
+    }
+
+    if (current_occupied_val != shown_occupied || total_spaces_val != shown_total) {
+        shown_occupied = current_occupied_val;
+        shown_total = total_spaces_val;
         lcdDisplayOccupancy(current_occupied_val, total_spaces_val);
     }
 }
 
+uint32_t getLCDDropCount() {
+    return lcd_drop_count;
+}
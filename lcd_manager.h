@@ -9,11 +9,29 @@
 #define LCD_COLS 16      // Columnas de tu LCD
 #define LCD_ROWS 2       // Filas de tu LCD
 
+// --- Renderer ---
+// Las funciones lcd* solo encolan peticiones; una tarea propia las dibuja por I2C.
+#define LCD_RENDER_QUEUE_LENGTH 8   // Peticiones pendientes antes de descartar
+#define LCD_PENDING_TEMPORARY_MAX 4 // Mensajes temporales en espera detrás de uno de mayor prioridad
+#define LCD_RENDERER_CORE 0         // Igual que el lector; loop() corre en el core 1
+#define LCD_RENDERER_PRIORITY 1
+#define LCD_RENDERER_STACK_SIZE 3072
+
+// Prioridad de un mensaje temporal. Uno nuevo reemplaza al visible si su prioridad es
+// mayor o igual; si es menor, espera a que el visible termine.
+enum LcdPriority : uint8_t {
+  LCD_PRIORITY_LOW = 0,     // Informativo (bienvenida); cualquier otro lo reemplaza
+  LCD_PRIORITY_NORMAL = 1,
+  LCD_PRIORITY_HIGH = 2     // Errores que el usuario debe llegar a ver
+};
+
 // --- Declaraciones de Funciones Públicas ---
 
 /**
- * @brief Inicializa la pantalla LCD I2C.
- * Debe llamarse en el setup() principal.
+ * @brief Inicializa la pantalla LCD I2C y arranca la tarea que la dibuja.
+ * Debe llamarse en el setup() principal. Mientras no se llame (o si falla), las demás
+ * funciones lcd* no hacen nada. Si la tarea no se puede crear, la LCD funciona igual pero
+ * las funciones lcd* dibujan directamente, esperando al bus I2C.
  * @param sda_pin El pin GPIO para SDA (por defecto Wire usa los pines estándar del ESP32).
  * @param scl_pin El pin GPIO para SCL (por defecto Wire usa los pines estándar del ESP32).
  * @return true si la LCD fue detectada e inicializada, false en caso contrario.
@@ -22,11 +40,14 @@ bool setupLCDManager(int sda_pin = 21, int scl_pin = 22); // Valores por defecto
 
 /**
  * @brief Muestra un mensaje en la LCD. Limpia la pantalla antes.
+ * Pasa a ser la pantalla base, la que se restaura tras los mensajes temporales.
+ * No espera al bus I2C: la petición se encola y el renderer solo envía las celdas que cambian.
  * @param line1 Mensaje para la primera línea (máx LCD_COLS caracteres).
  * @param line2 Mensaje para la segunda línea (máx LCD_COLS caracteres, opcional).
  * @param clear_display Si es true (por defecto), limpia la pantalla antes de escribir.
  */
 void lcdPrint(const String& line1, const String& line2 = "", bool clear_display = true);
+void lcdPrintLines(const char* line1, const char* line2, bool clear_display = true); // Igual, sin String
 
 /**
  * @brief Muestra un mensaje en una posición específica sin limpiar la pantalla.
@@ -64,16 +85,29 @@ void lcdDisplayWelcome();
 void lcdDisplayOccupancy(uint32_t current_occupied, uint32_t total_spaces);
 
 /**
- * @brief Muestra un mensaje temporalmente y luego restaura el mensaje anterior (o uno por defecto).
+ * @brief Muestra un mensaje temporalmente y luego restaura la pantalla base.
+ * Los mensajes que llegan mientras otro de mayor prioridad está visible esperan su turno,
+ * en orden de llegada.
  * @param temp_line1 Mensaje temporal para la línea 1.
  * @param temp_line2 Mensaje temporal para la línea 2 (opcional).
  * @param duration_ms Duración en milisegundos para mostrar el mensaje temporal.
- * @param restore_line1 Mensaje a restaurar en línea 1 después del temporal (opcional, si no se provee, muestra ocupación).
- * @param restore_line2 Mensaje a restaurar en línea 2 después del temporal (opcional).
+ * @param restore_line1 Nueva pantalla base (línea 1) tras el temporal (opcional; si no se provee, se restaura la base actual, normalmente la ocupación).
+ * @param restore_line2 Nueva pantalla base (línea 2) tras el temporal (opcional).
+ * @param priority Prioridad frente a otros mensajes temporales.
  */
-void lcdPrintTemporary(const String& temp_line1, const String& temp_line2, unsigned long duration_ms,
-                       const String& restore_line1 = "", const String& restore_line2 = "");
+void lcdPrintTemporary(const char* temp_line1, const char* temp_line2, unsigned long duration_ms,
+                       const char* restore_line1 = "", const char* restore_line2 = "",
+                       LcdPriority priority = LCD_PRIORITY_NORMAL);
 
+/**
+ * @brief Mantiene la pantalla de ocupación al día: encola una actualización solo cuando los valores cambian.
+ * Debe llamarse en cada pasada del loop() principal.
+ */
 void loopLCDManager(uint32_t current_occupied_val, uint32_t total_spaces_val);
 
+/**
+ * @brief Número de peticiones descartadas porque la cola del renderer estaba llena.
+ */
+uint32_t getLCDDropCount();
+
 #endif // LCD_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include "lot_simulator.h"
+#include "scan_telemetry.h"
+#include <math.h>
+
+// --- Module Variables ---
+enum SimEventType : uint8_t {
+  SIM_EVENT_ARRIVAL,     // Next vehicle reaches the gate queue
+  SIM_EVENT_LEAVE_SPOT,  // A parked vehicle drives to the gate to exit
+  SIM_EVENT_GATE_DONE    // The vehicle at the reader releases the lane
+};
+
+enum SimOutcome : uint8_t {
+  SIM_OUTCOME_ADMITTED,
+  SIM_OUTCOME_REJECTED,
+  SIM_OUTCOME_EXITED
+};
+
+struct SimEvent {
+  uint64_t at_ms;
+  uint16_t vehicle;
+  SimEventType type;
+};
+
+struct SimVehicle {
+  bool in_use;
+  bool wants_exit;
+  uint8_t lane;        // Lane it is queued at or passing through
+  SimOutcome outcome;  // Of the current pass through the lane
+  uint64_t queued_at_ms;
+};
+
+// Every vehicle has at most one pending event, plus the arrival generator
+const int SIM_HEAP_CAPACITY = LOT_SIM_MAX_VEHICLES + 1;
+SimEvent sim_heap[SIM_HEAP_CAPACITY];
+int sim_heap_count = 0;
+const int SIM_MAX_LANES = 2;
+SimVehicle sim_vehicles[LOT_SIM_MAX_VEHICLES];
+uint16_t sim_gate_queue[SIM_MAX_LANES][LOT_SIM_MAX_VEHICLES];  // FIFO ring of vehicle indices per lane
+int sim_queue_head[SIM_MAX_LANES];
+int sim_queue_count[SIM_MAX_LANES];
+bool sim_gate_busy[SIM_MAX_LANES];
+uint32_t sim_wait_buckets[LOT_SIM_WAIT_BUCKETS];
+uint32_t sim_rng_state = 1;
+uint32_t sim_scans = 0;
+uint32_t sim_scan_batches = 0;
+uint32_t sim_batch_pending = 0;  // Scans waiting for the next batch
+uint64_t sim_batch_oldest_ms = 0;
+
+
+// --- Helpers ---
+uint32_t simRandom() {
+  // xorshift32: small, fast and reproducible for a given seed
+  sim_rng_state ^= sim_rng_state << 13;
+  sim_rng_state ^= sim_rng_state >> 17;
+  sim_rng_state ^= sim_rng_state << 5;
+  return sim_rng_state;
+}
+
+// Uniform in (0, 1]
+float simUniform() {
+  return ((simRandom() >> 8) + 1) / 16777216.0f;
+}
+
+uint32_t simExponential(uint32_t mean_ms) {
+  return (uint32_t)(-(float)mean_ms * logf(simUniform()));
+}
+
+bool simPercent(uint8_t percent) {
+  return simRandom() % 100 < percent;
+}
+
+void simPushEvent(uint64_t at_ms, uint16_t vehicle, SimEventType type) {
+  if (sim_heap_count >= SIM_HEAP_CAPACITY) return;  // Cannot happen: one event per vehicle
+  int i = sim_heap_count++;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (sim_heap[parent].at_ms <= at_ms) break;
+    sim_heap[i] = sim_heap[parent];
+    i = parent;
+  }
+  sim_heap[i] = { at_ms, vehicle, type };
+}
+
+SimEvent simPopEvent() {
+  SimEvent top = sim_heap[0];
+  SimEvent last = sim_heap[--sim_heap_count];
+  int i = 0;
+  while (true) {
+    int child = 2 * i + 1;
+    if (child >= sim_heap_count) break;
+    if (child + 1 < sim_heap_count && sim_heap[child + 1].at_ms < sim_heap[child].at_ms) child++;
+    if (last.at_ms <= sim_heap[child].at_ms) break;
+    sim_heap[i] = sim_heap[child];
+    i = child;
+  }
+  sim_heap[i] = last;
+  return top;
+}
+
+// Same flush rules as scanTelemetryBatchDue(): a batch goes out when it is full, or when
+// its oldest scan is too old (checked here at the next scan, counted the same)
+void simRecordScan(const LotSimConfig& config, uint64_t now_ms) {
+  uint32_t batch_events = constrain(config.scan_batch_events, 1, SCAN_TELEMETRY_BATCH_MAX);
+  if (sim_batch_pending > 0 && now_ms - sim_batch_oldest_ms >= config.scan_batch_max_age_ms) {
+    sim_scan_batches++;
+    sim_batch_pending = 0;
+  }
+  if (sim_batch_pending == 0) sim_batch_oldest_ms = now_ms;
+  sim_scans++;
+  if (++sim_batch_pending >= batch_events) {
+    sim_scan_batches++;
+    sim_batch_pending = 0;
+  }
+}
+
+void simEnqueue(uint16_t vehicle, uint8_t lane, uint64_t now_ms, LotSimResult& result) {
+  sim_vehicles[vehicle].queued_at_ms = now_ms;
+  sim_vehicles[vehicle].lane = lane;
+  sim_gate_queue[lane][(sim_queue_head[lane] + sim_queue_count[lane]) % LOT_SIM_MAX_VEHICLES] = vehicle;
+  sim_queue_count[lane]++;
+  if ((uint32_t)sim_queue_count[lane] > result.max_queue_length) result.max_queue_length = sim_queue_count[lane];
+}
+
+// Puts the next vehicle queued at a lane on its reader and schedules when it frees the lane
+void simStartService(const LotSimConfig& config, uint8_t lane, uint64_t now_ms, uint32_t& occupancy,
+                     LotSimResult& result, uint64_t& total_wait_ms, uint32_t& waits) {
+  uint16_t vehicle = sim_gate_queue[lane][sim_queue_head[lane]];
+  sim_queue_head[lane] = (sim_queue_head[lane] + 1) % LOT_SIM_MAX_VEHICLES;
+  sim_queue_count[lane]--;
+  sim_gate_busy[lane] = true;
+  simRecordScan(config, now_ms + config.scan_ms);
+
+  SimVehicle& v = sim_vehicles[vehicle];
+  uint32_t wait_ms = (uint32_t)(now_ms - v.queued_at_ms);
+  total_wait_ms += wait_ms;
+  waits++;
+  if (wait_ms > result.max_wait_ms) result.max_wait_ms = wait_ms;
+  sim_wait_buckets[min(wait_ms / 1000, (uint32_t)LOT_SIM_WAIT_BUCKETS - 1)]++;
+
+  uint32_t busy_ms = config.scan_ms;
+  if (v.wants_exit) {
+    v.outcome = SIM_OUTCOME_EXITED;
+    occupancy--;
+    busy_ms += config.gate_cycle_ms;
+  } else if (occupancy >= config.capacity) {
+    v.outcome = SIM_OUTCOME_REJECTED;  // Same check as the firmware, before any 2FA request
+    result.full_rejections++;
+  } else if (simPercent(config.two_fa_percent)) {
+    result.two_fa_requests++;
+    uint32_t answer_ms = simExponential(config.mean_approval_ms);
+    if (answer_ms >= config.two_fa_timeout_ms) {
+      v.outcome = SIM_OUTCOME_REJECTED;
+      result.two_fa_timeouts++;
+      busy_ms += config.two_fa_timeout_ms;
+    } else if (!simPercent(config.approve_percent)) {
+      v.outcome = SIM_OUTCOME_REJECTED;
+      result.two_fa_denied++;
+      busy_ms += answer_ms;
+    } else {
+      v.outcome = SIM_OUTCOME_ADMITTED;
+      busy_ms += answer_ms + config.gate_cycle_ms;
+    }
+  } else {
+    v.outcome = SIM_OUTCOME_ADMITTED;
+    busy_ms += config.gate_cycle_ms;
+  }
+  // No other entry can pass until this vehicle is through, so the space can be taken now
+  if (v.outcome == SIM_OUTCOME_ADMITTED) {
+    occupancy++;
+    if (occupancy > result.max_occupancy) result.max_occupancy = occupancy;
+  }
+  simPushEvent(now_ms + busy_ms, vehicle, SIM_EVENT_GATE_DONE);
+}
+
+
+// --- Function Implementations ---
+
+void runLotSimulation(const LotSimConfig& config, LotSimResult& result_out) {
+  memset(&result_out, 0, sizeof(result_out));
+  memset(sim_vehicles, 0, sizeof(sim_vehicles));
+  memset(sim_wait_buckets, 0, sizeof(sim_wait_buckets));
+  sim_heap_count = 0;
+  memset(sim_queue_head, 0, sizeof(sim_queue_head));
+  memset(sim_queue_count, 0, sizeof(sim_queue_count));
+  memset(sim_gate_busy, 0, sizeof(sim_gate_busy));
+  sim_scans = 0;
+  sim_scan_batches = 0;
+  sim_batch_pending = 0;
+  sim_rng_state = config.seed != 0 ? config.seed : 1;  // xorshift never leaves 0
+  if (config.arrivals_per_hour == 0 || config.duration_s == 0) return;
+
+  const uint64_t end_ms = (uint64_t)config.duration_s * 1000;
+  const uint32_t mean_interarrival_ms = 3600000UL / config.arrivals_per_hour;
+  const uint8_t exit_lane = config.lanes > 1 ? 1 : 0;
+  uint32_t occupancy = 0;
+  uint64_t total_wait_ms = 0;
+  uint32_t waits = 0;
+
+  simPushEvent(simExponential(mean_interarrival_ms), 0, SIM_EVENT_ARRIVAL);
+  while (sim_heap_count > 0 && sim_heap[0].at_ms <= end_ms) {
+    SimEvent event = simPopEvent();
+    switch (event.type) {
+      case SIM_EVENT_ARRIVAL: {
+        result_out.arrivals++;
+        int free_vehicle = -1;
+        for (int i = 0; i < LOT_SIM_MAX_VEHICLES && free_vehicle < 0; i++) {
+          if (!sim_vehicles[i].in_use) free_vehicle = i;
+        }
+        if (free_vehicle < 0) {
+          result_out.overflow_drops++;
+        } else {
+          sim_vehicles[free_vehicle].in_use = true;
+          sim_vehicles[free_vehicle].wants_exit = false;
+          simEnqueue((uint16_t)free_vehicle, 0, event.at_ms, result_out);
+        }
+        simPushEvent(event.at_ms + simExponential(mean_interarrival_ms), 0, SIM_EVENT_ARRIVAL);
+        break;
+      }
+
+      case SIM_EVENT_LEAVE_SPOT:
+        sim_vehicles[event.vehicle].wants_exit = true;
+        simEnqueue(event.vehicle, exit_lane, event.at_ms, result_out);
+        break;
+
+      case SIM_EVENT_GATE_DONE: {
+        SimVehicle& v = sim_vehicles[event.vehicle];
+        sim_gate_busy[v.lane] = false;
+        if (v.outcome == SIM_OUTCOME_ADMITTED) {
+          result_out.entries++;
+          simPushEvent(event.at_ms + simExponential(config.mean_stay_min * 60000UL), event.vehicle,
+                       SIM_EVENT_LEAVE_SPOT);
+        } else {
+          if (v.outcome == SIM_OUTCOME_EXITED) result_out.exits++;
+          v.in_use = false;
+        }
+        break;
+      }
+    }
+    for (uint8_t lane = 0; lane <= exit_lane; lane++) {
+      if (!sim_gate_busy[lane] && sim_queue_count[lane] > 0) {
+        simStartService(config, lane, event.at_ms, occupancy, result_out, total_wait_ms, waits);
+      }
+    }
+  }
+
+  if (sim_batch_pending > 0) sim_scan_batches++;  // Goes out on its age limit
+  result_out.scans_per_hour = (uint32_t)((uint64_t)sim_scans * 3600 / config.duration_s);
+  result_out.scan_batches_per_hour = (uint32_t)((uint64_t)sim_scan_batches * 3600 / config.duration_s);
+  result_out.entries_per_hour = (uint32_t)((uint64_t)result_out.entries * 3600 / config.duration_s);
+  result_out.vehicles_per_hour = (uint32_t)((uint64_t)(result_out.entries + result_out.exits) * 3600 / config.duration_s);
+  if (waits > 0) {
+    result_out.mean_wait_ms = (uint32_t)(total_wait_ms / waits);
+    uint32_t rank = (uint32_t)(((uint64_t)waits * 95 + 99) / 100);
+    uint32_t seen = 0;
+    for (int i = 0; i < LOT_SIM_WAIT_BUCKETS; i++) {
+      seen += sim_wait_buckets[i];
+      if (seen >= rank) {
+        result_out.p95_wait_ms = min((uint32_t)(i + 1) * 1000, result_out.max_wait_ms);
+        break;
+      }
+    }
+  }
+}
+
+void printLotSimulation(const LotSimConfig& config, const LotSimResult& result) {
+  Serial.println("--- Parking Lot Simulation ---");
+  Serial.printf("Config: %u s, %u arrivals/h, stay %u min, %u spaces, %u lane(s), seed %u\n", config.duration_s,
+                config.arrivals_per_hour, config.mean_stay_min, config.capacity, config.lanes > 1 ? 2 : 1,
+                config.seed);
+  Serial.printf("        2FA %u%% (approve %u%%, mean answer %u ms, timeout %u ms), scan %u ms, gate %u ms\n",
+                config.two_fa_percent, config.approve_percent, config.mean_approval_ms, config.two_fa_timeout_ms,
+                config.scan_ms, config.gate_cycle_ms);
+  Serial.printf("Arrivals: %u, entries: %u, exits: %u, rejected full: %u, untracked: %u\n", result.arrivals,
+                result.entries, result.exits, result.full_rejections, result.overflow_drops);
+  Serial.printf("2FA: %u requests, %u denied, %u timed out\n", result.two_fa_requests, result.two_fa_denied,
+                result.two_fa_timeouts);
+  Serial.printf("Throughput: %u entries/h, %u vehicles/h through the gate\n", result.entries_per_hour,
+                result.vehicles_per_hour);
+  Serial.printf("Gate wait: mean %u ms, p95 %u ms, max %u ms, longest queue %u\n", result.mean_wait_ms,
+                result.p95_wait_ms, result.max_wait_ms, result.max_queue_length);
+  Serial.printf("Peak occupancy: %u/%u\n", result.max_occupancy, config.capacity);
+  Serial.printf("Scan telemetry: %u msg/h one per touch, %u msg/h batched (%u events or %u ms), %u/h saved\n",
+                result.scans_per_hour, result.scan_batches_per_hour, config.scan_batch_events,
+                config.scan_batch_max_age_ms, result.scans_per_hour - result.scan_batches_per_hour);
+  Serial.println("------------------------------");
+}
@@ -1,25 +1,59 @@
 #include "mqtt_manager.h"
 #include "ibutton_manager.h"  // To use printIButtonID if needed for debug
+#include "json_reader.h"
+#include "json_writer.h"
+#include "payload_codec.h"
+#include "outbound_queue.h"
+#include "boot_timeline.h"
+#include "access_metrics.h"
+#include "scan_telemetry.h"
+#include "registry_transfer.h"
+#include "scan_queue.h"
 
 // --- Module Variables ---
 WiFiClient espWiFiClient;
 PubSubClient mqttClient(espWiFiClient);
 MQTTConfig mqtt_config;
-String full_client_id;
+char full_client_id[48];
 char char_buffer[256];  // General purpose buffer for payloads, topics
+char scan_batch_buffer[1280];  // Fits SCAN_TELEMETRY_BATCH_MAX events in JSON
+char registry_chunk_buffer[REGISTRY_CHUNK_PAYLOAD_MAX];
+const size_t MQTT_TOPIC_BUFFER_SIZE = 128;
+const uint16_t MQTT_PACKET_BUFFER_SIZE = 1408;  // Largest publish: a full scan batch plus topic and header
+const int OUTBOUND_FLUSH_BATCH = 4;  // Queued messages sent per loop pass, so a backlog cannot stall the gate
+const int REGISTRY_EXPORT_CHUNKS_PER_LOOP = 4;  // Export chunks sent per loop pass, like the outbox flush
+const unsigned long METRICS_PUBLISH_INTERVAL_MS = 60000;
+unsigned long last_metrics_publish_ms = 0;
+
+// Retained status, published on change and as a heartbeat (see reportStatus())
+uint32_t status_occupancy = 0;
+uint32_t status_total_spaces = 0;
+bool status_known = false;        // reportStatus() called at least once
+bool status_dirty = false;        // Changed since the last publish, or new broker connection
+unsigned long last_status_publish_ms = 0;
+char status_ip[16] = "0.0.0.0";   // Cached when WiFi gets an address
 
 // Pairing state
 bool pairing_mode_active = false;
-String current_pairing_session_id_str = "";
+char current_pairing_session_id[PAIRING_SESSION_ID_MAX_LEN + 1] = "";
 unsigned long pairing_timeout_start_ms = 0;
 const unsigned long PAIRING_TIMEOUT_DURATION_MS = 60000;  // 60 seconds
 
-// 2FA state
-bool waiting_for_2fa_response = false;
-String two_fa_ibutton_id_str = "";  // Store iButton ID as string for 2FA
-unsigned long two_fa_timeout_start_ms = 0;
-const unsigned long TWO_FA_TIMEOUT_DURATION_MS = 30000;  // 30 seconds
-bool two_fa_granted = false;
+// 2FA state: one slot per outstanding request, each with its own timer
+struct TwoFASession {
+  bool in_use;
+  TwoFAStatus status;
+  byte ibutton_id[IBUTTON_ID_LEN];
+  char ibutton_id_str[IBUTTON_HEX_LEN + 1];  // Hex form, for matching responses
+  uint32_t request_id;                          // Correlation ID sent in auth/2fa_request
+  unsigned long started_ms;
+  uint32_t touch_us;     // micros() of the scan that opened the session (0 if unknown)
+  uint32_t sent_us;      // micros() when the request was published
+  uint32_t resolved_us;  // micros() when the response or the timeout resolved it
+  uint8_t lane;          // Lane whose gate opens on a grant
+};
+TwoFASession two_fa_sessions[MAX_2FA_SESSIONS];
+uint32_t next_2fa_request_id = 0;  // Seeded randomly so stale responses from before a reboot do not match
 
 // For deletion
 bool delete_ibutton_mode_active = false;
@@ -27,116 +61,254 @@ unsigned long delete_ibutton_timeout_start_ms = 0;
 const unsigned long DELETE_IBUTTON_TIMEOUT_DURATION_MS = 60000;
 
 
-// Forward declaration for callback
+// Connection state (see updateConnection())
+enum ConnectionState : uint8_t {
+  CONN_WIFI_BACKOFF,     // Waiting before the next WiFi attempt
+  CONN_WIFI_CONNECTING,  // WiFi.begin() issued, waiting for an IP
+  CONN_MQTT_BACKOFF,     // WiFi up, waiting before the next broker attempt
+  CONN_ONLINE            // Broker connected
+};
+bool mqtt_manager_started = false;  // setupMQTTManager() may run after the first loop passes
+ConnectionState connection_state = CONN_WIFI_BACKOFF;
+unsigned long connection_state_since_ms = 0;
+unsigned long next_connect_attempt_ms = 0;
+uint8_t wifi_attempt = 0;  // Consecutive failures, drives the backoff
+uint8_t mqtt_attempt = 0;
+volatile bool wifi_got_ip_event = false;  // Set from the WiFi event task
+volatile bool wifi_lost_event = false;
+char wifi_ssid[33] = "";
+char wifi_password[65] = "";
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 15000;
+const unsigned long CONNECT_BACKOFF_BASE_MS = 1000;
+const unsigned long CONNECT_BACKOFF_MAX_MS = 60000;
+const uint16_t MQTT_SOCKET_TIMEOUT_S = 3;   // Waiting for the broker's CONNACK (and later reads)
+const uint32_t MQTT_CONNECT_TIMEOUT_S = 1;  // TCP connect to the broker; the WiFiClient default is 3 s
+IPAddress broker_ip;
+bool broker_ip_resolved = false;  // Cleared when WiFi drops, so the name is looked up again
+
+// Command topic prefix ("<base_topic_prefix>cmd/"), built once in setupMQTTManager()
+char cmd_topic_prefix[96];
+size_t cmd_topic_prefix_len = 0;
+
+
+// Forward declarations
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-
-void setupWiFi(const char* ssid, const char* password) {
-  delay(10);
-  Serial.println();
-  Serial.print("Connecting to WiFi: ");
-  Serial.println(ssid);
-  WiFi.begin(ssid, password);
-  int retries = 0;
-  while (WiFi.status() != WL_CONNECTED && retries < 30) {  // Retry for ~15 seconds
-    delay(500);
-    Serial.print(".");
-    retries++;
-  }
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("\nFailed to connect to WiFi. Please check credentials or signal.");
-    // ESP.restart(); // Or handle error differently
-  }
-}
+void flushOutboundQueue(int max_messages);
+size_t buildOfflineStatus(char* buf, size_t size);
+void publishStatusIfDue();
+void publishRegistryExportChunks();
+void publishRegistryImportStatus(uint32_t transfer_id, uint32_t seq, RegistryImportStatus status);
 
 void reconnectMQTT() {
   if (!mqttClient.connected()) {
+    // One DNS lookup per WiFi connection instead of one per attempt (PubSubClient resolves
+    // a name on every connect)
+    if (!broker_ip_resolved) {
+      if (!WiFi.hostByName(mqtt_config.broker_host, broker_ip)) {
+        Serial.printf("MQTT broker '%s' did not resolve.\n", mqtt_config.broker_host);
+        return;
+      }
+      broker_ip_resolved = true;
+      mqttClient.setServer(broker_ip, mqtt_config.broker_port);
+      Serial.printf("MQTT broker '%s' resolved to %s.\n", mqtt_config.broker_host, broker_ip.toString().c_str());
+    }
     Serial.print("Attempting MQTT connection...");
     // Create a unique client ID
     uint64_t chipid = ESP.getEfuseMac();
     uint16_t unique_part = (uint16_t)(chipid >> 32);  // Higher part of MAC
-    full_client_id = String(mqtt_config.client_id_prefix) + String(unique_part, HEX);
+    snprintf(full_client_id, sizeof(full_client_id), "%s%x", mqtt_config.client_id_prefix, unique_part);
 
     Serial.print("Client ID: ");
     Serial.println(full_client_id);
 
-    // Attempt to connect
-    if (mqttClient.connect(full_client_id.c_str())) {
+    // Attempt to connect. If the link dies the broker publishes the will, so the
+    // retained status flips to offline without the device's help.
+    char will_topic[MQTT_TOPIC_BUFFER_SIZE];
+    char will_payload[24];
+    snprintf(will_topic, sizeof(will_topic), "%sstatus", mqtt_config.base_topic_prefix);
+    buildOfflineStatus(will_payload, sizeof(will_payload));
+    if (mqttClient.connect(full_client_id, will_topic, 1, true, will_payload)) {
       Serial.println("MQTT connected!");
-      // Subscribe to command topics
-      String cmd_topic_base = String(mqtt_config.base_topic_prefix) + "cmd/";
-      mqttClient.subscribe((cmd_topic_base + "initiate_pairing").c_str());
-      Serial.println("Subscribed to: " + cmd_topic_base + "initiate_pairing");
-      mqttClient.subscribe((cmd_topic_base + "cancel_pairing").c_str());
-      Serial.println("Subscribed to: " + cmd_topic_base + "cancel_pairing");
-      mqttClient.subscribe((cmd_topic_base + "auth/2fa_response").c_str());
-      Serial.println("Subscribed to: " + cmd_topic_base + "auth/2fa_response");
-      // For deletion
-      mqttClient.subscribe((cmd_topic_base + "ibutton/initiate_delete_mode").c_str());
-      Serial.println("Subscribed to: " + cmd_topic_base + "ibutton/initiate_delete_mode");
-      mqttClient.subscribe((cmd_topic_base + "ibutton/cancel_delete_mode").c_str());
-      Serial.println("Subscribed to: " + cmd_topic_base + "ibutton/cancel_delete_mode");
-
+      status_dirty = true;  // New session: replace the will with the current status
+      // One wildcard subscription; mqttCallback dispatches on the topic suffix
+      snprintf(char_buffer, sizeof(char_buffer), "%s#", cmd_topic_prefix);
+      mqttClient.subscribe(char_buffer);
+      Serial.print("Subscribed to: ");
+      Serial.println(char_buffer);
+      flushOutboundQueue(OUTBOUND_FLUSH_BATCH);  // Start delivering what was queued while offline
     } else {
       Serial.print("MQTT connect failed, rc=");
-      Serial.print(mqttClient.state());
-      Serial.println(" try again in 5 seconds");
-      // Wait 5 seconds before retrying
+      Serial.println(mqttClient.state());
     }
   }
 }
 
-void setupMQTTManager(const MQTTConfig& config, const char* wifi_ssid, const char* wifi_password) {
-  mqtt_config = config;  // Store config
-
-  setupWiFi(wifi_ssid, wifi_password);
+// --- Connection State Machine ---
+// WiFi and MQTT are (re)connected from loopMQTTManager() without blocking the loop.
+// WiFi events only set flags (they run on the WiFi event task); all transitions happen here.
 
-  if (WiFi.status() == WL_CONNECTED) {
-    mqttClient.setServer(mqtt_config.broker_host, mqtt_config.broker_port);
-    mqttClient.setCallback(mqttCallback);
-    mqttClient.setBufferSize(512);  // Increase if payloads are larger
-    reconnectMQTT();                // Initial connection attempt
-  } else {
-    Serial.println("MQTT setup skipped due to WiFi connection failure.");
+void onWiFiEvent(arduino_event_id_t event) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    wifi_got_ip_event = true;
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP) {
+    wifi_lost_event = true;
   }
 }
 
-void loopMQTTManager() {
-  if (WiFi.status() != WL_CONNECTED) {
-    // Attempt to reconnect WiFi if lost? Or let main handle restart.
-    // For now, just don't loop MQTT if WiFi is down.
-    // Serial.println("WiFi disconnected. MQTT loop paused.");
-    // setupWiFi(stored_ssid, stored_password) // Need to store ssid/pass for this
+// Exponential backoff with jitter: a random delay in [half, full] of base * 2^attempt, capped.
+// Counts the attempt, so consecutive failures wait longer.
+unsigned long nextBackoffMs(uint8_t& attempt) {
+  unsigned long delay_ms = CONNECT_BACKOFF_BASE_MS << attempt;
+  if (delay_ms > CONNECT_BACKOFF_MAX_MS) delay_ms = CONNECT_BACKOFF_MAX_MS;
+  if (attempt < 16) attempt++;
+  return delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+}
+
+void startWiFiAttempt() {
+  Serial.print("Connecting to WiFi: ");
+  Serial.println(wifi_ssid);
+  wifi_got_ip_event = false;
+  wifi_lost_event = false;
+  WiFi.begin(wifi_ssid, wifi_password);
+  connection_state = CONN_WIFI_CONNECTING;
+  connection_state_since_ms = millis();
+}
+
+void scheduleWiFiRetry(const char* reason) {
+  unsigned long wait_ms = nextBackoffMs(wifi_attempt);
+  Serial.printf("WiFi %s. Retrying in %lu ms.\n", reason, wait_ms);
+  if (mqttClient.connected()) mqttClient.disconnect();
+  WiFi.disconnect();
+  broker_ip_resolved = false;
+  connection_state = CONN_WIFI_BACKOFF;
+  connection_state_since_ms = millis();
+  next_connect_attempt_ms = millis() + wait_ms;
+}
+
+void scheduleMQTTRetry(unsigned long wait_ms) {
+  connection_state = CONN_MQTT_BACKOFF;
+  connection_state_since_ms = millis();
+  next_connect_attempt_ms = millis() + wait_ms;
+}
+
+void updateConnection() {
+  unsigned long now = millis();
+
+  // A lost link sends every connected state back to WiFi backoff
+  if (wifi_lost_event && connection_state != CONN_WIFI_BACKOFF) {
+    wifi_lost_event = false;
+    scheduleWiFiRetry(connection_state == CONN_WIFI_CONNECTING ? "connect failed" : "connection lost");
     return;
   }
 
-  if (!mqttClient.connected()) {
-    static unsigned long last_mqtt_reconnect_attempt = 0;
-    if (millis() - last_mqtt_reconnect_attempt > 5000) {  // Try reconnecting every 5s
-      last_mqtt_reconnect_attempt = millis();
-      reconnectMQTT();
+  switch (connection_state) {
+    case CONN_WIFI_BACKOFF:
+      if ((long)(now - next_connect_attempt_ms) >= 0) startWiFiAttempt();
+      break;
+
+    case CONN_WIFI_CONNECTING:
+      if (wifi_got_ip_event || WiFi.status() == WL_CONNECTED) {
+        wifi_got_ip_event = false;
+        wifi_attempt = 0;
+        Serial.print("WiFi connected! IP address: ");
+        Serial.println(WiFi.localIP());
+        uint32_t ip = (uint32_t)WiFi.localIP();  // First octet in the low byte
+        snprintf(status_ip, sizeof(status_ip), "%u.%u.%u.%u", (unsigned)(ip & 0xFF), (unsigned)((ip >> 8) & 0xFF),
+                 (unsigned)((ip >> 16) & 0xFF), (unsigned)(ip >> 24));
+        mqtt_attempt = 0;
+        scheduleMQTTRetry(0);  // Connect to the broker on the next pass
+      } else if (now - connection_state_since_ms >= WIFI_CONNECT_TIMEOUT_MS) {
+        scheduleWiFiRetry("connect timed out");
+      }
+      break;
+
+    case CONN_MQTT_BACKOFF:
+      if ((long)(now - next_connect_attempt_ms) >= 0) {
+        reconnectMQTT();
+        if (mqttClient.connected()) {
+          mqtt_attempt = 0;
+          connection_state = CONN_ONLINE;
+          connection_state_since_ms = now;
+        } else {
+          unsigned long wait_ms = nextBackoffMs(mqtt_attempt);
+          Serial.printf("MQTT retry in %lu ms.\n", wait_ms);
+          scheduleMQTTRetry(wait_ms);
+        }
+      }
+      break;
+
+    case CONN_ONLINE:
+      if (!mqttClient.connected()) {
+        Serial.printf("MQTT connection lost, rc=%d.\n", mqttClient.state());
+        scheduleMQTTRetry(nextBackoffMs(mqtt_attempt));
+      }
+      break;
+  }
+}
+
+void setupMQTTManager(const MQTTConfig& config, const char* ssid, const char* password) {
+  mqtt_config = config;  // Store config
+  setupOutboundQueue();   // Restores messages queued before a software reset
+  snprintf(cmd_topic_prefix, sizeof(cmd_topic_prefix), "%scmd/", mqtt_config.base_topic_prefix);
+  cmd_topic_prefix_len = strlen(cmd_topic_prefix);
+
+  strncpy(wifi_ssid, ssid, sizeof(wifi_ssid) - 1);
+  strncpy(wifi_password, password, sizeof(wifi_password) - 1);
+
+  // The server address is set once the broker name resolves (see reconnectMQTT())
+  mqttClient.setCallback(mqttCallback);
+  mqttClient.setBufferSize(MQTT_PACKET_BUFFER_SIZE);
+  // Together these bound how long an unreachable broker can stall connect()
+  espWiFiClient.setTimeout(MQTT_CONNECT_TIMEOUT_S);
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+
+  // The connection is brought up in the background by loopMQTTManager()
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);  // Reconnection is handled by the state machine, with backoff
+  WiFi.onEvent(onWiFiEvent);
+  startWiFiAttempt();
+  mqtt_manager_started = true;
+}
+
+void loopMQTTManager() {
+  if (!mqtt_manager_started) return;
+  updateConnection();
+
+  if (connection_state == CONN_ONLINE) {
+    mqttClient.loop();  // Process MQTT messages (may call mqttCallback and resolve 2FA sessions)
+    flushOutboundQueue(OUTBOUND_FLUSH_BATCH);
+    publishStatusIfDue();
+    publishScanBatch();
+    publishRegistryExportChunks();
+    if (millis() - last_metrics_publish_ms >= METRICS_PUBLISH_INTERVAL_MS) {
+      last_metrics_publish_ms = millis();
+      publishAccessMetrics();
     }
-  } else {
-    mqttClient.loop();  // Process MQTT messages (may call mqttCallback and set two_fa_granted)
   }
 
   // Handle pairing timeout
   if (pairing_mode_active && (millis() - pairing_timeout_start_ms > PAIRING_TIMEOUT_DURATION_MS)) {
     Serial.println("Pairing mode timed out.");
-    publishPairingFailure(current_pairing_session_id_str.c_str(), "timeout");
+    publishPairingFailure(current_pairing_session_id, "timeout");
     clearPairingMode();
   }
 
-  // Handle 2FA timeout
-  // Check if we are waiting AND the timer has expired
-  if (waiting_for_2fa_response && (millis() - two_fa_timeout_start_ms >= TWO_FA_TIMEOUT_DURATION_MS)) {
-    Serial.println("2FA response timed out.");  // <<-- ESTO ES LO QUE VES
-    two_fa_granted = false;                     // Explicitly mark as not granted on timeout
-    clear2FA_WaitingState();                    // <<-- ESTO LIMPIA EL ESTADO
-    // El .ino detectará que isWaitingFor2FA() es false y two_fa_granted es false.
+  // Discard a registry import the app stopped sending
+  if (checkRegistryImportTimeout(millis())) {
+    RegistryImportStats import_stats;
+    getRegistryImportStats(import_stats);
+    publishRegistryImportStatus(import_stats.transfer_id, import_stats.next_seq, REGISTRY_IMPORT_TIMED_OUT);
+  }
+
+  // Handle 2FA timeouts, each session on its own timer
+  for (int i = 0; i < MAX_2FA_SESSIONS; i++) {
+    TwoFASession& session = two_fa_sessions[i];
+    if (session.in_use && session.status == TWO_FA_PENDING
+        && (millis() - session.started_ms >= TWO_FA_TIMEOUT_DURATION_MS)) {
+      Serial.printf("2FA: Request %u for %s timed out.\n", session.request_id, session.ibutton_id_str);
+      session.status = TWO_FA_TIMED_OUT;  // El .ino lo recoge con takeResolved2FA()
+      session.resolved_us = micros();
+    }
   }
 
   // Handle Delete iButton Mode Timeout ---
@@ -148,299 +320,633 @@ void loopMQTTManager() {
   }
 }
 
-bool publishMQTTMessage(const char* sub_topic, const char* payload, bool retained) {
+// Logs a payload: JSON as text, CBOR as its size
+void printPayload(const byte* payload, size_t length) {
+  if (payloadDetectFormat(payload, length) == PAYLOAD_FORMAT_CBOR) {
+    Serial.printf("<%u bytes CBOR>\n", (unsigned)length);
+  } else {
+    Serial.write(payload, length);
+    Serial.println();
+  }
+}
+
+// Sends one message right now; false if not connected or the client rejected it
+bool sendMQTTMessage(const char* sub_topic, const byte* payload, size_t length, bool retained) {
   if (!mqttClient.connected()) {
-    Serial.println("MQTT not connected. Cannot publish.");
     return false;
   }
-  String full_topic = String(mqtt_config.base_topic_prefix) + sub_topic;
-  Serial.printf("Publishing to %s: %s\n", full_topic.c_str(), payload);
-  return mqttClient.publish(full_topic.c_str(), payload, retained);
+  char full_topic[MQTT_TOPIC_BUFFER_SIZE];
+  snprintf(full_topic, sizeof(full_topic), "%s%s", mqtt_config.base_topic_prefix, sub_topic);
+  Serial.print("Publishing to ");  // print() rather than printf(): long lines make printf allocate
+  Serial.print(full_topic);
+  Serial.print(": ");
+  printPayload(payload, length);
+  return mqttClient.publish(full_topic, payload, length, retained);
+}
+
+// Sends up to max_messages queued messages, oldest first
+void flushOutboundQueue(int max_messages) {
+  const OutboundMessage* message;
+  int sent = 0;
+  while (sent < max_messages && (message = outboundQueuePeek()) != nullptr) {
+    if (!sendMQTTMessage(message->sub_topic, (const byte*)message->payload, message->payload_len,
+                         message->retained)) {
+      break;  // Keep it queued; retried on the next pass
+    }
+    outboundQueuePop();
+    sent++;
+  }
+  if (sent > 0 && getOutboundQueueDepth() == 0) {
+    Serial.println("Outbound queue flushed.");
+  }
+}
+
+bool publishMQTTMessage(const char* sub_topic, const char* payload, bool retained, PublishDelivery delivery) {
+  return publishMQTTPayload(sub_topic, (const byte*)payload, strlen(payload), retained, delivery);
+}
+
+bool publishMQTTPayload(const char* sub_topic, const byte* payload, size_t length, bool retained,
+                        PublishDelivery delivery) {
+  if (delivery == DELIVERY_NOW_OR_DROP) {
+    if (!mqttClient.connected()) {
+      Serial.println("MQTT not connected. Cannot publish.");
+      return false;
+    }
+    return sendMQTTMessage(sub_topic, payload, length, retained);
+  }
+
+  // Send directly only when nothing older is waiting, so the app sees events in order
+  if (getOutboundQueueDepth() == 0 && sendMQTTMessage(sub_topic, payload, length, retained)) {
+    return true;
+  }
+  if (!outboundQueuePush(sub_topic, payload, length, retained,
+                         delivery == DELIVERY_QUEUED_HIGH ? OUTBOUND_PRIORITY_HIGH : OUTBOUND_PRIORITY_NORMAL,
+                         delivery == DELIVERY_LATEST_ONLY)) {
+    return false;
+  }
+  Serial.print("MQTT unavailable. Queued message for ");
+  Serial.println(sub_topic);
+  return true;
+}
+
+// Table-driven hex encoding of an iButton ID, no allocation
+void ibuttonBytesToHex(const byte* id_bytes, char* hex_out) {
+  static const char hex_digits[] = "0123456789ABCDEF";
+  for (int i = 0; i < IBUTTON_ID_LEN; i++) {
+    hex_out[i * 2] = hex_digits[id_bytes[i] >> 4];
+    hex_out[i * 2 + 1] = hex_digits[id_bytes[i] & 0x0F];
+  }
+  hex_out[IBUTTON_HEX_LEN] = '\0';
+}
+
+// Parses IBUTTON_HEX_LEN hex digits (either case) into an iButton ID
+bool ibuttonHexToBytes(const char* hex, byte* id_out) {
+  if (strlen(hex) != IBUTTON_HEX_LEN) return false;
+  for (int i = 0; i < IBUTTON_HEX_LEN; i++) {
+    char ch = hex[i];
+    int digit;
+    if (ch >= '0' && ch <= '9') digit = ch - '0';
+    else if (ch >= 'a' && ch <= 'f') digit = ch - 'a' + 10;
+    else if (ch >= 'A' && ch <= 'F') digit = ch - 'A' + 10;
+    else return false;
+    if (i % 2 == 0) id_out[i / 2] = digit << 4;
+    else id_out[i / 2] |= digit;
+  }
+  return true;
 }
 
 // Helper to convert byte array iButton ID to hex string
 String ibuttonBytesToHexString(const byte* id_bytes) {
-  String hex_str = "";
-  for (int i = 0; i < IBUTTON_ID_LEN; i++) {
-    char hex_pair[3];
-    sprintf(hex_pair, "%02X", id_bytes[i]);
-    hex_str += hex_pair;
+  char hex_str[IBUTTON_HEX_LEN + 1];
+  ibuttonBytesToHex(id_bytes, hex_str);
+  return String(hex_str);
+}
+
+// --- Payload Encoding ---
+// App-facing payloads are JSON by default, or CBOR with the same keys when
+// binary_payloads is set; iButton IDs are then raw 8-byte strings instead of hex.
+// Diagnostics (boot, metrics) stay JSON for dashboards.
+
+void payloadBeginApp(PayloadWriter& w, char* buf = char_buffer, size_t size = sizeof(char_buffer)) {
+  payloadBegin(w, mqtt_config.binary_payloads ? PAYLOAD_FORMAT_CBOR : PAYLOAD_FORMAT_JSON, buf, size);
+}
+
+// Closes the payload in char_buffer and publishes it
+bool payloadPublish(PayloadWriter& w, const char* sub_topic, bool retained = false,
+                    PublishDelivery delivery = DELIVERY_QUEUED) {
+  if (!payloadEnd(w)) {
+    Serial.print("MQTT: Payload too large for ");
+    Serial.println(sub_topic);
+    return false;
   }
-  return hex_str;
+  return publishMQTTPayload(sub_topic, (const byte*)char_buffer, payloadLength(w), retained, delivery);
 }
 
-void mqttCallback(char* topic, byte* payload_bytes, unsigned int length) {
-  Serial.print("Message arrived [");
-  Serial.print(topic);
-  Serial.print("] ");
-  String payload_str;
-  for (int i = 0; i < length; i++) {
-    payload_str += (char)payload_bytes[i];
-  }
-  Serial.println(payload_str);
-
-  String topic_str(topic);
-  String cmd_topic_base = String(mqtt_config.base_topic_prefix) + "cmd/";
-
-  // --- Handle initiate_pairing command ---
-  if (topic_str.equals(cmd_topic_base + "initiate_pairing")) {
-    Serial.print("DEBUG: Payload for initiate_pairing: '");  // Debug print
-    Serial.print(payload_str);
-    Serial.println("'");
-
-    // Basic JSON parsing - Look for "pairing_session_id":" or "pairing_session_id": "
-    const char* key_psid_no_space = "\"pairing_session_id\":\"";
-    const char* key_psid_with_space = "\"pairing_session_id\": \"";
-    int id_start_pos = payload_str.indexOf(key_psid_with_space);  // Try with space first
-    int key_len = strlen(key_psid_with_space);
-
-    if (id_start_pos == -1) {  // If not found with space, try without space
-      id_start_pos = payload_str.indexOf(key_psid_no_space);
-      key_len = strlen(key_psid_no_space);
-    }
 
-    String received_session_id = "";  // Buffer for the parsed ID
+// --- Command Handlers ---
+// One handler per command topic suffix, called with the raw payload buffer
+// (JSON or CBOR, whatever binary_payloads says; told apart per message).
+
+void handleInitiatePairing(const byte* payload_bytes, unsigned int length) {
+  char received_session_id[PAIRING_SESSION_ID_MAX_LEN + 1];
+  JsonField fields[] = {
+    { "pairing_session_id", JSON_FIELD_STRING, received_session_id, sizeof(received_session_id), false },
+  };
+  payloadReadObject(payload_bytes, length, fields, 1);
+
+  // Check if parsing was successful and the extracted ID is not empty
+  if (fields[0].found && received_session_id[0] != '\0') {
+    strcpy(current_pairing_session_id, received_session_id);  // Store the received ID
+    pairing_mode_active = true;
+    pairing_timeout_start_ms = millis();
+    Serial.print("Pairing mode activated. Session ID: ");
+    Serial.println(current_pairing_session_id);
+    publishPairingReady(current_pairing_session_id);
+  } else {
+    Serial.println("Invalid or empty pairing_session_id in payload.");
+  }
+}
 
-    if (id_start_pos > -1) {  // If the key was found (with or without space)
-      int val_start = id_start_pos + key_len;
-      int val_end = payload_str.indexOf("\"", val_start);  // Find the ending quote
-      if (val_end > -1) {
-        received_session_id = payload_str.substring(val_start, val_end);
-      } else {
-        Serial.println("DEBUG: Failed to find end quote for 'pairing_session_id' value.");
-      }
+void handleCancelPairing(const byte* payload_bytes, unsigned int length) {
+  char session_to_cancel[PAIRING_SESSION_ID_MAX_LEN + 1];
+  JsonField fields[] = {
+    { "pairing_session_id", JSON_FIELD_STRING, session_to_cancel, sizeof(session_to_cancel), false },
+  };
+  payloadReadObject(payload_bytes, length, fields, 1);
+
+  // Check if parsing was successful and the extracted ID is not empty
+  if (fields[0].found && session_to_cancel[0] != '\0') {
+    if (pairing_mode_active && strcmp(session_to_cancel, current_pairing_session_id) == 0) {
+      Serial.println("Pairing cancelled by remote command.");
+      publishPairingFailure(current_pairing_session_id, "cancelled_by_app");
+      clearPairingMode();  // This also clears current_pairing_session_id
     } else {
-      Serial.println("DEBUG: Failed to find 'pairing_session_id' key.");
+      Serial.print("Pairing cancellation request for non-active or mismatched session: ");
+      Serial.println(session_to_cancel);
     }
+  } else {
+    Serial.println("Invalid or empty pairing_session_id in cancel payload.");
+  }
+}
 
-    // Check if parsing was successful and the extracted ID is not empty
-    if (!received_session_id.isEmpty()) {
-      current_pairing_session_id_str = received_session_id;  // Store the received ID
-      pairing_mode_active = true;
-      pairing_timeout_start_ms = millis();
-      Serial.print("Pairing mode activated. Session ID: ");
-      Serial.println(current_pairing_session_id_str);
-      publishPairingReady(current_pairing_session_id_str.c_str());
-    } else {
-      Serial.println("Invalid or empty pairing_session_id in payload.");
-    }
+void handle2FAResponse(const byte* payload_bytes, unsigned int length) {
+  char received_ib_id[IBUTTON_HEX_LEN + 1];
+  bool allow_entry_val = false;
+  uint32_t received_request_id = 0;  // Opcional: clientes antiguos no lo envían
+  JsonField fields[] = {
+    { "ibutton_id", JSON_FIELD_STRING, received_ib_id, sizeof(received_ib_id), false },
+    { "allow_entry", JSON_FIELD_BOOL, &allow_entry_val, 0, false },
+    { "request_id", JSON_FIELD_UINT, &received_request_id, 0, false },
+  };
+  payloadReadObject(payload_bytes, length, fields, 3);
+  bool has_ib_id = fields[0].found;
+  bool parsed_allow_entry = fields[1].found;
+  bool has_request_id = fields[2].found;
+
+  if (!has_ib_id) {
+    Serial.println("DEBUG: 'ibutton_id' could not be parsed from 2FA response.");
+  }
+  if (!parsed_allow_entry) {
+    Serial.println("DEBUG: 'allow_entry' could not be parsed from 2FA response. Ignored.");
   }
-  // --- Handle cancel_pairing command ---
-  else if (topic_str.equals(cmd_topic_base + "cancel_pairing")) {
-    Serial.print("DEBUG: Payload for cancel_pairing: '");  // Debug print
-    Serial.print(payload_str);
-    Serial.println("'");
-
-    // Basic JSON parsing - Look for "pairing_session_id":" or "pairing_session_id": "
-    const char* key_psid_no_space = "\"pairing_session_id\":\"";
-    const char* key_psid_with_space = "\"pairing_session_id\": \"";
-    int id_start_pos = payload_str.indexOf(key_psid_with_space);  // Try with space first
-    int key_len = strlen(key_psid_with_space);
-
-    if (id_start_pos == -1) {  // If not found with space, try without space
-      id_start_pos = payload_str.indexOf(key_psid_no_space);
-      key_len = strlen(key_psid_no_space);
+
+  // Match the pending session by iButton ID, and by request_id when the app sends it
+  TwoFASession* session = nullptr;
+  for (int i = 0; i < MAX_2FA_SESSIONS && has_ib_id; i++) {
+    TwoFASession& candidate = two_fa_sessions[i];
+    if (candidate.in_use && candidate.status == TWO_FA_PENDING
+        && strcasecmp(received_ib_id, candidate.ibutton_id_str) == 0
+        && (!has_request_id || received_request_id == candidate.request_id)) {
+      session = &candidate;
+      break;
     }
+  }
 
-    String session_to_cancel = "";  // Buffer for the parsed ID
+  if (session == nullptr) {
+    Serial.println("2FA: Response does not match any pending request. Ignored.");
+  } else if (parsed_allow_entry) {  // Solo actuar si parseamos 'allow_entry'
+    session->status = allow_entry_val ? TWO_FA_GRANTED : TWO_FA_DENIED;
+    session->resolved_us = micros();
+    accessMetricRecord(ACCESS_STAGE_2FA_ROUNDTRIP, session->resolved_us - session->sent_us);
+    Serial.printf("2FA: Request %u for %s %s by remote.\n", session->request_id, session->ibutton_id_str,
+                  allow_entry_val ? "GRANTED" : "DENIED");
+    // El .ino recoge el resultado con takeResolved2FA(), que libera la sesión.
+  }
+}
 
-    if (id_start_pos > -1) {  // If the key was found
-      int val_start = id_start_pos + key_len;
-      int val_end = payload_str.indexOf("\"", val_start);  // Find the ending quote
-      if (val_end > -1) {
-        session_to_cancel = payload_str.substring(val_start, val_end);
-      } else {
-        Serial.println("DEBUG: Failed to find end quote for 'pairing_session_id' value.");
-      }
-    } else {
-      Serial.println("DEBUG: Failed to find 'pairing_session_id' key.");
-    }
+void handleInitiateDeleteMode(const byte* payload_bytes, unsigned int length) {
+  // Solo activar si no hay otra operación MQTT en curso
+  if (!delete_ibutton_mode_active && !isPairingModeActive() && !isWaitingFor2FA()) {
+    Serial.println("MQTT: Delete iButton mode activated by remote command.");
+    delete_ibutton_mode_active = true;
+    delete_ibutton_timeout_start_ms = millis();
+    publishDeleteReady();  // Opcional: notificar a la app que estamos listos
+  } else {
+    Serial.println("MQTT: Cannot activate delete iButton mode, another operation is active or already in delete mode.");
+    // Opcional: Enviar un mensaje de error a la app si se intenta activar mientras otra cosa está activa
+    // publishGenericError("delete_mode_activation_failed", "another_operation_active");
+  }
+}
 
+void handleCancelDeleteMode(const byte* payload_bytes, unsigned int length) {
+  if (delete_ibutton_mode_active) {
+    Serial.println("MQTT: Delete iButton mode cancelled by remote command.");
+    clearDeleteIButtonMode(); // Esta función ya resetea el flag y el timer
+  } else {
+    Serial.println("MQTT: Received cancel_delete_mode, but delete mode was not active.");
+  }
+}
 
-    // Check if parsing was successful and the extracted ID is not empty
-    if (!session_to_cancel.isEmpty()) {
-      if (pairing_mode_active && session_to_cancel.equals(current_pairing_session_id_str)) {
-        Serial.println("Pairing cancelled by remote command.");
-        publishPairingFailure(current_pairing_session_id_str.c_str(), "cancelled_by_app");
-        clearPairingMode();  // This also clears current_pairing_session_id_str
-      } else {
-        Serial.print("Pairing cancellation request for non-active or mismatched session: ");
-        Serial.println(session_to_cancel);
-      }
-    } else {
-      Serial.println("Invalid or empty pairing_session_id in cancel payload.");
-    }
+// Echoes the ID as received (hex text in both formats), since it may not be a valid ID
+void publishTwoFAPolicyResult(const char* ibutton_id_str, const char* status) {
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddString(w, "ibutton_id", ibutton_id_str);
+  payloadAddString(w, "status", status);
+  payloadPublish(w, "ibutton/2fa_policy_result", false, DELIVERY_QUEUED_HIGH);
+}
+
+// Payload: {"ibutton_id":"HEX","policy":"always|never|window","grant_minutes":N}
+void handleSet2FAPolicy(const byte* payload_bytes, unsigned int length) {
+  char received_ib_id[IBUTTON_HEX_LEN + 1];
+  char policy_str[8];
+  uint32_t grant_minutes = 0;
+  JsonField fields[] = {
+    { "ibutton_id", JSON_FIELD_STRING, received_ib_id, sizeof(received_ib_id), false },
+    { "policy", JSON_FIELD_STRING, policy_str, sizeof(policy_str), false },
+    { "grant_minutes", JSON_FIELD_UINT, &grant_minutes, 0, false },
+  };
+  payloadReadObject(payload_bytes, length, fields, 3);
+
+  byte ibutton_id[IBUTTON_ID_LEN];
+  if (!fields[0].found || !ibuttonHexToBytes(received_ib_id, ibutton_id)) {
+    Serial.println("2FA policy: Invalid or missing 'ibutton_id'.");
+    publishTwoFAPolicyResult(fields[0].found ? received_ib_id : "", "invalid");
+    return;
   }
-  // --- Handle 2FA response ---
-  else if (topic_str.equals(cmd_topic_base + "auth/2fa_response")) {
-    if (waiting_for_2fa_response) {
-      String received_ib_id = "";
-      bool allow_entry_val = false;     // Para almacenar el valor booleano
-      bool parsed_allow_entry = false;  // Flag para saber si se parseó allow_entry
-
-      // --- Parse "ibutton_id" ---
-      const char* key_ib_id_no_space = "\"ibutton_id\":\"";
-      const char* key_ib_id_with_space = "\"ibutton_id\": \"";
-      int id_start_pos = payload_str.indexOf(key_ib_id_with_space);  // Intenta con espacio primero
-      int key_len = strlen(key_ib_id_with_space);
-
-      if (id_start_pos == -1) {  // Si no se encontró con espacio, intenta sin espacio
-        id_start_pos = payload_str.indexOf(key_ib_id_no_space);
-        key_len = strlen(key_ib_id_no_space);
-      }
 
-      if (id_start_pos > -1) {
-        int val_start = id_start_pos + key_len;
-        int val_end = payload_str.indexOf("\"", val_start);
-        if (val_end > -1) {
-          received_ib_id = payload_str.substring(val_start, val_end);
-        } else {
-          Serial.println("DEBUG: Failed to find end quote for 'ibutton_id' value.");
-        }
-      } else {
-        Serial.println("DEBUG: Failed to find 'ibutton_id' key.");
-      }
+  TwoFAPolicy policy;
+  if (!fields[1].found) {
+    policy_str[0] = '\0';
+  }
+  if (strcmp(policy_str, "always") == 0) policy = TWO_FA_POLICY_ALWAYS;
+  else if (strcmp(policy_str, "never") == 0) policy = TWO_FA_POLICY_NEVER;
+  else if (strcmp(policy_str, "window") == 0) policy = TWO_FA_POLICY_GRANT_WINDOW;
+  else {
+    Serial.println("2FA policy: Unknown 'policy'. Expected always, never or window.");
+    publishTwoFAPolicyResult(received_ib_id, "invalid");
+    return;
+  }
+  if (policy == TWO_FA_POLICY_GRANT_WINDOW && (grant_minutes == 0 || grant_minutes > TWO_FA_MAX_GRANT_MINUTES)) {
+    Serial.println("2FA policy: 'grant_minutes' missing or out of range.");
+    publishTwoFAPolicyResult(received_ib_id, "invalid");
+    return;
+  }
 
+  IButtonRecord record;
+  if (!getIButtonRecord(ibutton_id, record)) {
+    publishTwoFAPolicyResult(received_ib_id, "not_found");
+    return;
+  }
+  bool stored = setIButtonTwoFAPolicy(ibutton_id, policy, (uint16_t)grant_minutes);
+  publishTwoFAPolicyResult(received_ib_id, stored ? "ok" : "store_failed");
+}
 
-      // --- Parse "allow_entry" ---
-      if (payload_str.indexOf("\"allow_entry\":true") > -1 || payload_str.indexOf("\"allow_entry\": true") > -1) {
-        allow_entry_val = true;
-        parsed_allow_entry = true;
-      } else if (payload_str.indexOf("\"allow_entry\":false") > -1 || payload_str.indexOf("\"allow_entry\": false") > -1) {
-        allow_entry_val = false;
-        parsed_allow_entry = true;
-      }
+// Payload: {"transfer_id":N,"from_seq":K,"from_slot":S}. The registry is streamed on
+// registry/export_chunk from loopMQTTManager(). To resume an export whose later chunks were
+// lost, from_seq is the first chunk missing and from_slot the next_slot of the chunk before it.
+void handleRegistryExport(const byte* payload_bytes, unsigned int length) {
+  uint32_t transfer_id = 0;
+  uint32_t from_seq = 0;
+  uint32_t from_slot = 0;
+  JsonField fields[] = {
+    { "transfer_id", JSON_FIELD_UINT, &transfer_id, 0, false },
+    { "from_seq", JSON_FIELD_UINT, &from_seq, 0, false },
+    { "from_slot", JSON_FIELD_UINT, &from_slot, 0, false },
+  };
+  payloadReadObject(payload_bytes, length, fields, 3);
+  if (!fields[0].found) {
+    Serial.println("Registry export: Missing 'transfer_id'. Ignored.");
+    return;
+  }
+  if (from_seq > 0 && !fields[2].found) {
+    Serial.println("Registry export: Resume without 'from_slot'. Ignored.");
+    return;
+  }
+  beginRegistryExport(transfer_id, from_seq, from_slot);
+}
 
-      if (received_ib_id.isEmpty()) {
-        Serial.println("DEBUG: 'ibutton_id' could not be parsed from 2FA response.");
-      }
-      if (!parsed_allow_entry) {
-        Serial.println("DEBUG: 'allow_entry' could not be parsed from 2FA response. Defaulting to DENY.");
-        allow_entry_val = false;  // Default seguro
-      }
+// Payload: one chunk (see registry_transfer.h). Every chunk is answered on
+// registry/import_status with the chunk the device expects next.
+void handleRegistryImport(const byte* payload_bytes, unsigned int length) {
+  RegistryChunk chunk;
+  RegistryChunkDecode decoded = decodeRegistryChunk(payload_bytes, length, chunk);
+  RegistryImportStatus status;
+  if (decoded == REGISTRY_CHUNK_MALFORMED) status = REGISTRY_IMPORT_MALFORMED;
+  else if (decoded == REGISTRY_CHUNK_BAD_CRC) status = REGISTRY_IMPORT_BAD_CRC;
+  else status = applyRegistryImportChunk(chunk);
+  if (status != REGISTRY_IMPORT_ACCEPTED) {
+    Serial.printf("Registry import: Chunk %u of %u: %s.\n", chunk.seq, chunk.transfer_id,
+                  getRegistryImportStatusName(status));
+  }
+  publishRegistryImportStatus(chunk.transfer_id, chunk.seq, status);
+}
 
-      if (!received_ib_id.isEmpty() && received_ib_id.equalsIgnoreCase(two_fa_ibutton_id_str)) {
-        if (parsed_allow_entry) {  // Solo actuar si parseamos 'allow_entry'
-          if (allow_entry_val) {
-            two_fa_granted = true;  // Flag para que el .ino actúe
-            Serial.println("2FA: Entry GRANTED by remote.");
-          } else {
-            two_fa_granted = false;  // Flag para que el .ino actúe
-            Serial.println("2FA: Entry DENIED by remote.");
-          }
-          // NO LLAMAR clear2FA_WaitingState() ni modificar waiting_for_2fa_response AQUI.
-          // El .ino procesará el resultado (two_fa_granted) y luego limpiará el estado.
-        } else {
-          // No se pudo parsear 'allow_entry', se denegó por defecto en el .ino
-          // two_fa_granted ya es false.
-          Serial.println("2FA: 'allow_entry' field missing or invalid in remote response.");
-        }
-      } else {
-        // Mismatch de iButton ID
-        Serial.println("2FA: Received response for mismatched iButton ID. Ignored.");
-        // No hacemos nada con el estado de 2FA pendiente si el ID no coincide.
-        // El timeout original sigue corriendo para la solicitud correcta.
-      }
-    } else {
-      Serial.println("Received 2FA response, but not waiting for one. Ignored.");
-    }
+// Dispatch table keyed on the topic suffix after "<base_topic_prefix>cmd/".
+// Kept sorted by suffix (strcmp order) for the binary search in mqttCallback.
+struct CommandRoute {
+  const char* suffix;
+  void (*handler)(const byte* payload_bytes, unsigned int length);
+};
+const CommandRoute command_routes[] = {
+  { "auth/2fa_response", handle2FAResponse },
+  { "cancel_pairing", handleCancelPairing },
+  { "ibutton/cancel_delete_mode", handleCancelDeleteMode },
+  { "ibutton/initiate_delete_mode", handleInitiateDeleteMode },
+  { "ibutton/set_2fa_policy", handleSet2FAPolicy },
+  { "initiate_pairing", handleInitiatePairing },
+  { "registry/export", handleRegistryExport },
+  { "registry/import", handleRegistryImport },
+};
+const int COMMAND_ROUTE_COUNT = sizeof(command_routes) / sizeof(command_routes[0]);
+
+const CommandRoute* findCommandRoute(const char* suffix) {
+  int low = 0;
+  int high = COMMAND_ROUTE_COUNT - 1;
+  while (low <= high) {
+    int mid = (low + high) / 2;
+    int cmp = strcmp(suffix, command_routes[mid].suffix);
+    if (cmp == 0) return &command_routes[mid];
+    if (cmp < 0) high = mid - 1;
+    else low = mid + 1;
   }
-  // --- Handle initiate_delete_mode command ---
-  else if (topic_str.equals(cmd_topic_base + "ibutton/initiate_delete_mode")) {
-    // Solo activar si no hay otra operación MQTT en curso
-    if (!delete_ibutton_mode_active && !isPairingModeActive() && !isWaitingFor2FA()) {
-      Serial.println("MQTT: Delete iButton mode activated by remote command.");
-      delete_ibutton_mode_active = true;
-      delete_ibutton_timeout_start_ms = millis();
-      publishDeleteReady();  // Opcional: notificar a la app que estamos listos
-    } else {
-      Serial.println("MQTT: Cannot activate delete iButton mode, another operation is active or already in delete mode.");
-      // Opcional: Enviar un mensaje de error a la app si se intenta activar mientras otra cosa está activa
-      // publishGenericError("delete_mode_activation_failed", "another_operation_active");
-    }
+  return nullptr;
+}
+
+void mqttCallback(char* topic, byte* payload_bytes, unsigned int length) {
+  Serial.print("Message arrived [");
+  Serial.print(topic);
+  Serial.print("] ");
+  printPayload(payload_bytes, length);  // Payload is not NUL-terminated; parsed in place by the handlers
+
+  // Everything arrives through the single cmd/# subscription
+  if (strncmp(topic, cmd_topic_prefix, cmd_topic_prefix_len) != 0) {
+    Serial.println("MQTT: Message outside the command topic. Ignored.");
+    return;
   }
-  // --- Handle cancel_delete_mode command ---
-    else if (topic_str.equals(cmd_topic_base + "ibutton/cancel_delete_mode")) {
-        if (delete_ibutton_mode_active) {
-            Serial.println("MQTT: Delete iButton mode cancelled by remote command.");
-            clearDeleteIButtonMode(); // Esta función ya resetea el flag y el timer
-        } else {
-            Serial.println("MQTT: Received cancel_delete_mode, but delete mode was not active.");
-        }
-    }
+  const CommandRoute* route = findCommandRoute(topic + cmd_topic_prefix_len);
+  if (route == nullptr) {
+    Serial.println("MQTT: Unknown command topic. Ignored.");
+    return;
+  }
+  route->handler(payload_bytes, length);
 }
 
 // --- Specific Publishing Functions ---
-void publishStatus(bool online, uint32_t occupancy, uint32_t total_spaces) {
-  snprintf(char_buffer, sizeof(char_buffer), "{\"online\":%s, \"occupancy\":%u, \"total_spaces\":%u, \"ip\":\"%s\"}",
-           online ? "true" : "false", occupancy, total_spaces, WiFi.localIP().toString().c_str());
-  publishMQTTMessage("status", char_buffer, true);
+// Payloads are encoded into char_buffer with PayloadWriter (or JsonWriter for diagnostics);
+// nothing here touches the heap.
+void reportStatus(uint32_t occupancy, uint32_t total_spaces) {
+  if (status_known && occupancy == status_occupancy && total_spaces == status_total_spaces) return;
+  status_occupancy = occupancy;
+  status_total_spaces = total_spaces;
+  status_known = true;
+  status_dirty = true;
 }
 
-void publishIButtonScanned(const byte* ibutton_id, bool is_registered, uint32_t associated_id) {
-  String ib_id_str = ibuttonBytesToHexString(ibutton_id);
-  if (is_registered) {
-    snprintf(char_buffer, sizeof(char_buffer), "{\"ibutton_id\":\"%s\", \"is_registered\":true, \"associated_id\":%u}",
-             ib_id_str.c_str(), associated_id);
-  } else {
-    snprintf(char_buffer, sizeof(char_buffer), "{\"ibutton_id\":\"%s\", \"is_registered\":false}",
-             ib_id_str.c_str());
+// Publishes the retained status if it changed or the heartbeat is due; online only, so
+// it is never queued (the next connection publishes it anyway)
+void publishStatusIfDue() {
+  if (!status_known) return;
+  if (!status_dirty && millis() - last_status_publish_ms < STATUS_HEARTBEAT_MS) return;
+
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddBool(w, "online", true);
+  payloadAddUInt(w, "occupancy", status_occupancy);
+  payloadAddUInt(w, "total_spaces", status_total_spaces);
+  payloadAddString(w, "ip", status_ip);
+  OutboundQueueStats queue_stats;
+  getOutboundQueueStats(queue_stats);
+  payloadAddUInt(w, "outbox_depth", queue_stats.depth);
+  payloadAddUInt(w, "outbox_evicted", queue_stats.evicted);
+  payloadAddUInt(w, "outbox_dropped", queue_stats.dropped);
+  payloadAddUInt(w, "scan_dropped", getScanQueueDropCount());  // Touches lost between reader and loop()
+  last_status_publish_ms = millis();  // Also paces retries if the publish fails
+  if (payloadPublish(w, "status", true, DELIVERY_NOW_OR_DROP)) {
+    status_dirty = false;
+  }
+}
+
+// The Last Will: {"online":false}, in the configured format. NUL-terminated, which
+// PubSubClient needs; the CBOR form contains no zero bytes.
+size_t buildOfflineStatus(char* buf, size_t size) {
+  PayloadWriter w;
+  payloadBegin(w, mqtt_config.binary_payloads ? PAYLOAD_FORMAT_CBOR : PAYLOAD_FORMAT_JSON, buf, size - 1);
+  payloadAddBool(w, "online", false);
+  payloadEnd(w);
+  size_t length = payloadLength(w);
+  buf[length] = '\0';
+  return length;
+}
+
+bool publishScanBatch() {
+  int count = scanTelemetryBatchDue(millis());
+  if (count == 0 || !mqttClient.connected()) return false;
+
+  ScanTelemetryStats stats;
+  getScanTelemetryStats(stats);
+  unsigned long now = millis();
+  PayloadWriter w;
+  payloadBeginApp(w, scan_batch_buffer, sizeof(scan_batch_buffer));
+  payloadAddUInt(w, "dropped", stats.dropped);
+  payloadBeginArray(w, "events", count);
+  for (int i = 0; i < count; i++) {
+    const ScanTelemetryEvent* event = scanTelemetryPeek(i);
+    payloadBeginElement(w);
+    payloadAddID(w, "ibutton_id", event->ibutton_id, IBUTTON_ID_LEN);
+    payloadAddBool(w, "is_registered", event->is_registered);
+    if (event->is_registered) {
+      payloadAddUInt(w, "associated_id", event->associated_id);
+    }
+    payloadAddUInt(w, "lane", event->lane);
+    payloadAddString(w, "outcome", getScanOutcomeName(event->outcome));
+    payloadAddUInt(w, "age_ms", now - event->scanned_ms);
+    payloadEndElement(w);
+  }
+  payloadEndArray(w);
+  if (!payloadEnd(w)) {  // Cannot happen with SCAN_TELEMETRY_BATCH_MAX events; drop rather than retry forever
+    Serial.println("MQTT: Scan batch too large. Dropped.");
+    scanTelemetryConsume(count);
+    return false;
+  }
+  if (!publishMQTTPayload("ibutton/scan_batch", (const byte*)scan_batch_buffer, payloadLength(w), false,
+                          DELIVERY_NOW_OR_DROP)) {
+    return false;  // Events stay buffered for the next pass
+  }
+  scanTelemetryConsume(count);
+  return true;
+}
+
+// Sends up to REGISTRY_EXPORT_CHUNKS_PER_LOOP chunks of the export in progress; a chunk
+// that cannot be sent is retried on the next pass
+void publishRegistryExportChunks() {
+  RegistryChunk chunk;
+  for (int i = 0; i < REGISTRY_EXPORT_CHUNKS_PER_LOOP && peekRegistryExportChunk(chunk); i++) {
+    PayloadWriter w;
+    payloadBeginApp(w, registry_chunk_buffer, sizeof(registry_chunk_buffer));
+    encodeRegistryChunk(w, chunk);
+    if (!payloadEnd(w)) {  // Cannot happen with REGISTRY_CHUNK_RECORDS records; skip rather than stall
+      Serial.println("MQTT: Registry export chunk too large. Skipped.");
+      consumeRegistryExportChunk();
+      continue;
+    }
+    if (!publishMQTTPayload("registry/export_chunk", (const byte*)registry_chunk_buffer, payloadLength(w), false,
+                            DELIVERY_NOW_OR_DROP)) {
+      return;
+    }
+    consumeRegistryExportChunk();
+  }
+}
+
+// Progress counters refer to the open (or last) import; a reply to another transfer asks for chunk 0
+void publishRegistryImportStatus(uint32_t transfer_id, uint32_t seq, RegistryImportStatus status) {
+  RegistryImportStats stats;
+  getRegistryImportStats(stats);
+  if (stats.transfer_id != transfer_id || status == REGISTRY_IMPORT_NO_SESSION) {
+    memset(&stats, 0, sizeof(stats));
   }
-  publishMQTTMessage("ibutton/scanned", char_buffer);
+  bool final_reply = status == REGISTRY_IMPORT_COMMITTED || status == REGISTRY_IMPORT_FULL
+                     || status == REGISTRY_IMPORT_FAILED || status == REGISTRY_IMPORT_TIMED_OUT;
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddUInt(w, "transfer_id", transfer_id);
+  payloadAddUInt(w, "seq", seq);
+  payloadAddString(w, "status", getRegistryImportStatusName(status));
+  payloadAddUInt(w, "next_seq", stats.next_seq);
+  payloadAddUInt(w, "imported", stats.staged);
+  payloadAddUInt(w, "skipped", stats.skipped);
+  payloadPublish(w, "registry/import_status", false, final_reply ? DELIVERY_QUEUED_HIGH : DELIVERY_NOW_OR_DROP);
 }
 
 void publishPairingReady(const char* pairing_session_id) {
-  snprintf(char_buffer, sizeof(char_buffer), "{\"pairing_session_id\":\"%s\"}", pairing_session_id);
-  publishMQTTMessage("pairing/ready_for_ibutton", char_buffer);
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddString(w, "pairing_session_id", pairing_session_id);
+  payloadPublish(w, "pairing/ready_for_ibutton", false, DELIVERY_NOW_OR_DROP);
 }
 
 void publishPairingSuccess(const char* pairing_session_id, const byte* ibutton_id, uint32_t associated_id) {
-  String ib_id_str = ibuttonBytesToHexString(ibutton_id);
-  snprintf(char_buffer, sizeof(char_buffer), "{\"pairing_session_id\":\"%s\", \"ibutton_id\":\"%s\", \"associated_id\":%u}",
-           pairing_session_id, ib_id_str.c_str(), associated_id);
-  publishMQTTMessage("pairing/success", char_buffer);
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddString(w, "pairing_session_id", pairing_session_id);
+  payloadAddID(w, "ibutton_id", ibutton_id, IBUTTON_ID_LEN);
+  payloadAddUInt(w, "associated_id", associated_id);
+  payloadPublish(w, "pairing/success", false, DELIVERY_QUEUED_HIGH);
 }
 
 void publishPairingFailure(const char* pairing_session_id, const char* reason) {
-  snprintf(char_buffer, sizeof(char_buffer), "{\"pairing_session_id\":\"%s\", \"reason\":\"%s\"}",
-           pairing_session_id, reason);
-  publishMQTTMessage("pairing/failure", char_buffer);
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddString(w, "pairing_session_id", pairing_session_id);
+  payloadAddString(w, "reason", reason);
+  payloadPublish(w, "pairing/failure", false, DELIVERY_QUEUED_HIGH);
 }
 
-void publish2FARequest(const byte* ibutton_id, uint32_t associated_id, const char* device_id_esp32) {
-  String ib_id_str = ibuttonBytesToHexString(ibutton_id);
-  two_fa_ibutton_id_str = ib_id_str;  // Store for matching response
-  waiting_for_2fa_response = true;
-  two_fa_granted = false;              // Reset grant status
-  two_fa_timeout_start_ms = millis();  // <<-- AQUI EMPIEZA EL TEMPORIZADOR
+bool publish2FARequest(const byte* ibutton_id, uint32_t associated_id, const char* device_id_esp32, uint32_t touch_us,
+                       uint8_t lane) {
+  TwoFASession* session = nullptr;
+  for (int i = 0; i < MAX_2FA_SESSIONS && session == nullptr; i++) {
+    if (!two_fa_sessions[i].in_use) session = &two_fa_sessions[i];
+  }
+  if (session == nullptr) {
+    Serial.println("2FA: Session table full. Request not sent.");
+    return false;
+  }
 
-  Serial.printf("2FA: Request sent. Timer started at %lu ms for %u ms timeout.\n", two_fa_timeout_start_ms, TWO_FA_TIMEOUT_DURATION_MS);  // DEBUG TIMER
+  if (next_2fa_request_id == 0) next_2fa_request_id = esp_random() | 1;
+  session->in_use = true;
+  session->status = TWO_FA_PENDING;
+  memcpy(session->ibutton_id, ibutton_id, IBUTTON_ID_LEN);
+  ibuttonBytesToHex(ibutton_id, session->ibutton_id_str);
+  session->request_id = next_2fa_request_id++;
+  session->started_ms = millis();  // Starts this session's timeout
+  session->touch_us = touch_us;
+  session->lane = lane;
+  session->sent_us = micros();
+
+  Serial.printf("2FA: Request %u sent, %d pending.\n", session->request_id, getPending2FACount());
+
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddUInt(w, "request_id", session->request_id);
+  payloadAddID(w, "ibutton_id", session->ibutton_id, IBUTTON_ID_LEN);
+  payloadAddUInt(w, "associated_id", associated_id);
+  payloadAddString(w, "device_id", device_id_esp32);
+  payloadAddUInt(w, "lane", lane);
+  if (!payloadPublish(w, "auth/2fa_request", false, DELIVERY_NOW_OR_DROP)) {
+    session->in_use = false;  // Nobody will answer a request that never left
+    return false;
+  }
+  return true;
+}
 
-  snprintf(char_buffer, sizeof(char_buffer), "{\"ibutton_id\":\"%s\", \"associated_id\":%u, \"device_id\":\"%s\"}",
-           ib_id_str.c_str(), associated_id, device_id_esp32);
-  publishMQTTMessage("auth/2fa_request", char_buffer);
+void publishBootReport() {
+  JsonWriter w;
+  jsonBeginObject(w, char_buffer, sizeof(char_buffer));
+  jsonAddUInt(w, "scan_ready_ms", getBootScanReadyMs());
+  for (int i = 0; i < getBootStageCount(); i++) {
+    jsonAddUInt(w, getBootStageName(i), getBootStageMs(i));
+  }
+  jsonEndObject(w);
+  publishMQTTMessage("boot", char_buffer, true, DELIVERY_LATEST_ONLY);
+}
+
+// One message per stage that has samples, on metrics/<stage>; dropped while offline
+void publishAccessMetrics() {
+  char sub_topic[32];
+  for (int i = 0; i < ACCESS_STAGE_COUNT; i++) {
+    AccessStageStats stats;
+    getAccessStageStats((AccessStage)i, stats);
+    if (stats.count == 0) continue;
+    JsonWriter w;
+    jsonBeginObject(w, char_buffer, sizeof(char_buffer));
+    jsonAddUInt(w, "count", stats.count);
+    jsonAddUInt(w, "p50_us", stats.p50_us);
+    jsonAddUInt(w, "p95_us", stats.p95_us);
+    jsonAddUInt(w, "p99_us", stats.p99_us);
+    jsonAddUInt(w, "max_us", stats.max_us);
+    jsonEndObject(w);
+    snprintf(sub_topic, sizeof(sub_topic), "metrics/%s", getAccessStageName((AccessStage)i));
+    publishMQTTMessage(sub_topic, char_buffer, false, DELIVERY_NOW_OR_DROP);
+  }
 }
 
 // --- Deletion publish implementations ---
 void publishDeleteReady() {
   // Payload simple, o incluso vacío si el tópico es suficiente
-  publishMQTTMessage("ibutton/delete_ready", "{\"status\":\"ready_for_delete\"}");
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddString(w, "status", "ready_for_delete");
+  payloadPublish(w, "ibutton/delete_ready", false, DELIVERY_NOW_OR_DROP);
 }
 
 void publishDeleteSuccess(const byte* ibutton_id) {
-  String ib_id_str = ibuttonBytesToHexString(ibutton_id);
-  snprintf(char_buffer, sizeof(char_buffer), "{\"ibutton_id\":\"%s\", \"status\":\"deleted\"}", ib_id_str.c_str());
-  publishMQTTMessage("ibutton/delete_success", char_buffer);
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddID(w, "ibutton_id", ibutton_id, IBUTTON_ID_LEN);
+  payloadAddString(w, "status", "deleted");
+  payloadPublish(w, "ibutton/delete_success", false, DELIVERY_QUEUED_HIGH);
 }
 
 void publishDeleteFailure(const char* reason, const byte* ibutton_id_attempted) {
+  PayloadWriter w;
+  payloadBeginApp(w);
+  payloadAddString(w, "reason", reason);
   if (ibutton_id_attempted != nullptr) {
-    String ib_id_str = ibuttonBytesToHexString(ibutton_id_attempted);
-    snprintf(char_buffer, sizeof(char_buffer), "{\"reason\":\"%s\", \"ibutton_id_attempted\":\"%s\", \"status\":\"delete_failed\"}", reason, ib_id_str.c_str());
-  } else {
-    snprintf(char_buffer, sizeof(char_buffer), "{\"reason\":\"%s\", \"status\":\"delete_failed\"}", reason);
+    payloadAddID(w, "ibutton_id_attempted", ibutton_id_attempted, IBUTTON_ID_LEN);
   }
-  publishMQTTMessage("ibutton/delete_failure", char_buffer);
+  payloadAddString(w, "status", "delete_failed");
+  payloadPublish(w, "ibutton/delete_failure", false, DELIVERY_QUEUED_HIGH);
 }
 
 
@@ -454,41 +960,53 @@ bool isPairingModeActive() {
 }
 
 const char* getCurrentPairingSessionId() {
-  return current_pairing_session_id_str.c_str();
+  return current_pairing_session_id;
 }
 
 void clearPairingMode() {
   pairing_mode_active = false;
-  current_pairing_session_id_str = "";
+  current_pairing_session_id[0] = '\0';
   pairing_timeout_start_ms = 0;
 }
 
 
 bool isWaitingFor2FA() {
-  return waiting_for_2fa_response;
-}
-
-// This is a bit clunky, main loop will convert it back to bytes if needed for comparison.
-// Or modify to store byte array. For now, string for simplicity in matching response.
-const char* get2FA_iButtonId_Str() {
-  return two_fa_ibutton_id_str.c_str();
+  return getPending2FACount() > 0;
 }
 
-void clear2FA_WaitingState() {
-  Serial.println("2FA: Clearing waiting state.");  // DEBUG CLEAR
-  waiting_for_2fa_response = false;
-  two_fa_ibutton_id_str = "";   // Limpiar ID almacenado
-  two_fa_timeout_start_ms = 0;  // <<-- RESETEAR EL TEMPORIZADOR
-  // two_fa_granted is NOT cleared here, main loop reads it then resets it.
+int getPending2FACount() {
+  int pending = 0;
+  for (int i = 0; i < MAX_2FA_SESSIONS; i++) {
+    if (two_fa_sessions[i].in_use && two_fa_sessions[i].status == TWO_FA_PENDING) pending++;
+  }
+  return pending;
 }
 
-bool get2FA_GrantStatus() {
-  return two_fa_granted;
+bool is2FAPending(const byte* ibutton_id) {
+  for (int i = 0; i < MAX_2FA_SESSIONS; i++) {
+    const TwoFASession& session = two_fa_sessions[i];
+    if (session.in_use && session.status == TWO_FA_PENDING
+        && memcmp(session.ibutton_id, ibutton_id, IBUTTON_ID_LEN) == 0) {
+      return true;
+    }
+  }
+  return false;
 }
 
-void reset2FA_GrantStatus() {
-  Serial.println("2FA: Resetting grant status flag.");  // DEBUG RESET
-  two_fa_granted = false;
+bool takeResolved2FA(byte* ibutton_id_out, TwoFAStatus& status_out, uint32_t* touch_us_out, uint8_t* lane_out) {
+  for (int i = 0; i < MAX_2FA_SESSIONS; i++) {
+    TwoFASession& session = two_fa_sessions[i];
+    if (session.in_use && session.status != TWO_FA_PENDING) {
+      memcpy(ibutton_id_out, session.ibutton_id, IBUTTON_ID_LEN);
+      status_out = session.status;
+      accessMetricSince(ACCESS_STAGE_2FA_PICKUP, session.resolved_us);
+      if (touch_us_out != nullptr) *touch_us_out = session.touch_us;
+      if (lane_out != nullptr) *lane_out = session.lane;
+      session.in_use = false;  // Free the slot for the next request
+      return true;
+    }
+  }
+  return false;
 }
 
 bool isDeleteIButtonModeActive() {
@@ -11,15 +11,32 @@ struct MQTTConfig {
     uint16_t broker_port;
     const char* client_id_prefix; // e.g., "juanliz-sparking-" (ESP32 will append unique part)
     const char* base_topic_prefix; // e.g., "juanliz-sparking-esp32/"
+    bool binary_payloads;          // CBOR instead of JSON on the app-facing topics (status, scans, 2FA, pairing, deletion)
     // Add user/password if your broker requires them
     // const char* mqtt_user;
     // const char* mqtt_password;
 };
 
+// Outcome of a 2FA session, as seen by the main .ino
+enum TwoFAStatus {
+    TWO_FA_PENDING,
+    TWO_FA_GRANTED,
+    TWO_FA_DENIED,
+    TWO_FA_TIMED_OUT
+};
+
+#define MAX_2FA_SESSIONS 8  // Outstanding 2FA requests that can wait for the app at once
+#define TWO_FA_TIMEOUT_DURATION_MS 30000UL  // A session resolves as timed out after this long
+#define PAIRING_SESSION_ID_MAX_LEN 63  // Longer pairing_session_id values from the app are rejected
+#define STATUS_HEARTBEAT_MS 300000UL   // Retained status re-sent this often even when nothing changed
+
 // Public Function Declarations
 /**
- * @brief Initializes WiFi and MQTT client.
- * Connects to WiFi and then to the MQTT broker.
+ * @brief Initializes WiFi and MQTT client and starts connecting in the background.
+ * Returns immediately; loopMQTTManager() brings WiFi and then the broker up, and
+ * reconnects with exponential backoff after outages. Every broker connection registers
+ * a retained Last Will on the status topic, {"online":false}, so the app learns that the
+ * device is gone once the broker's keepalive expires.
  * @param config MQTTConfig struct with broker details, topics, etc.
  * @param wifi_ssid SSID of the WiFi network.
  * @param wifi_password Password for the WiFi network.
@@ -27,30 +44,102 @@ struct MQTTConfig {
 void setupMQTTManager(const MQTTConfig& config, const char* wifi_ssid, const char* wifi_password);
 
 /**
- * @brief Keeps the MQTT connection alive and processes incoming messages.
+ * @brief Advances the WiFi/MQTT connection state machine, processes incoming messages
+ * and flushes queued ones and due scan telemetry batches. Never waits for the network, except
+ * in a broker connect attempt: up to 1 s for the TCP connect plus 3 s for the broker's reply,
+ * and the DNS lookup of the broker, done once per WiFi connection.
  * Should be called regularly in the main loop().
  */
 void loopMQTTManager();
 
+// How publishMQTTMessage() handles a message the broker cannot take right now
+enum PublishDelivery : uint8_t {
+    DELIVERY_QUEUED,       // Queued while offline and flushed on reconnect
+    DELIVERY_QUEUED_HIGH,  // Queued, and kept over normal messages when the queue is full
+    DELIVERY_LATEST_ONLY,  // Queued, replacing any queued message for the same sub-topic
+    DELIVERY_NOW_OR_DROP   // Only meaningful right now (interactive prompts); never queued
+};
+
 /**
  * @brief Publishes a message to a given MQTT topic.
+ * Messages that cannot be sent (broker unreachable, or older messages still queued)
+ * go to the outbound queue and are flushed in order, a few per loop pass, once the
+ * connection is back.
  * @param sub_topic The part of the topic after the base_topic_prefix.
  * @param payload The message payload string.
  * @param retained Whether the message should be retained by the broker.
- * @return true if publish was successful (queued), false otherwise.
+ * @param delivery What to do if the message cannot be sent right away.
+ * @return true if the message was published or queued, false if it was dropped.
  */
-bool publishMQTTMessage(const char* sub_topic, const char* payload, bool retained = false);
+bool publishMQTTMessage(const char* sub_topic, const char* payload, bool retained = false,
+                        PublishDelivery delivery = DELIVERY_QUEUED);
 
-// --- Helper function for converting iButton ID to String ---
-String ibuttonBytesToHexString(const byte* id_bytes);
+/**
+ * @brief Same as publishMQTTMessage() for a payload given by length, which may be binary (CBOR).
+ */
+bool publishMQTTPayload(const char* sub_topic, const byte* payload, size_t length, bool retained = false,
+                        PublishDelivery delivery = DELIVERY_QUEUED);
+
+// --- Helper functions for converting iButton ID to hex text ---
+#define IBUTTON_HEX_LEN 16  // IBUTTON_ID_LEN bytes as uppercase hex, without the NUL
+
+/**
+ * @brief Writes an iButton ID as uppercase hex into a caller buffer, without allocating.
+ * @param id_bytes iButton ID (IBUTTON_ID_LEN bytes).
+ * @param hex_out Destination, at least IBUTTON_HEX_LEN + 1 bytes. Always NUL-terminated.
+ */
+void ibuttonBytesToHex(const byte* id_bytes, char* hex_out);
+String ibuttonBytesToHexString(const byte* id_bytes); // Convenience for Serial debug output
 
 // --- Specific publishing functions for convenience ---
-void publishStatus(bool online, uint32_t occupancy, uint32_t total_spaces);
-void publishIButtonScanned(const byte* ibutton_id, bool is_registered, uint32_t associated_id);
+/**
+ * @brief Reports the values of the retained status message. Only compares, so it can be
+ * called on every loop pass; loopMQTTManager() publishes the status when occupancy or
+ * capacity changed, on every new broker connection, and every STATUS_HEARTBEAT_MS.
+ */
+void reportStatus(uint32_t occupancy, uint32_t total_spaces);
 void publishPairingReady(const char* pairing_session_id);
 void publishPairingSuccess(const char* pairing_session_id, const byte* ibutton_id, uint32_t associated_id);
 void publishPairingFailure(const char* pairing_session_id, const char* reason);
-void publish2FARequest(const byte* ibutton_id, uint32_t associated_id, const char* device_id_esp32);
+/**
+ * @brief Opens a 2FA session for an iButton and publishes auth/2fa_request.
+ * Each session has its own timeout and a "request_id" correlation ID in the payload,
+ * so several drivers can wait for their phone at the same time and responses may
+ * arrive in any order.
+ * @param touch_us micros() of the scan that triggered the request, kept for the access
+ *        latency trace and handed back by takeResolved2FA(). 0 if unknown.
+ * @param lane Lane where the iButton was scanned; sent in the request and handed back
+ *        by takeResolved2FA() so the grant opens that lane's gate.
+ * @return true if the session was opened and the request published; false if the
+ *         session table is full or the publish failed.
+ */
+bool publish2FARequest(const byte* ibutton_id, uint32_t associated_id, const char* device_id_esp32,
+                       uint32_t touch_us = 0, uint8_t lane = 0);
+
+/**
+ * @brief Publishes the scan events waiting in scan_telemetry as one ibutton/scan_batch
+ * message, if a batch is due (see ScanTelemetryConfig). Each event carries ibutton_id,
+ * is_registered, associated_id (when registered), lane, outcome and age_ms (time since
+ * the scan); "dropped" counts events lost to a full buffer since boot.
+ * Sent only while online and never queued: unsent events stay in the telemetry buffer,
+ * so batches never hold up 2FA or pairing messages in the outbound queue.
+ * Called by loopMQTTManager(); one batch per call.
+ * @return true if a batch was published.
+ */
+bool publishScanBatch();
+
+/**
+ * @brief Publishes the boot timeline (stage timestamps and time-to-first-scan, in ms
+ * since power-up) as a retained "boot" message. Queued until the broker is reachable.
+ */
+void publishBootReport();
+
+/**
+ * @brief Publishes the access latency histograms (count, p50/p95/p99 and max in
+ * microseconds) on metrics/<stage>, one message per stage with samples.
+ * Called every minute by loopMQTTManager() while online; dropped while offline.
+ */
+void publishAccessMetrics();
 
 // For button deletion
 void publishDeleteReady();
@@ -63,11 +152,20 @@ bool isPairingModeActive();
 const char* getCurrentPairingSessionId();
 void clearPairingMode(); // To be called by main .ino after processing iButton for pairing
 
-bool isWaitingFor2FA();
-const char* get2FA_iButtonId_Str(); // Gets iButton ID (string) waiting for 2FA
-void clear2FA_WaitingState(); // Clears the 2FA waiting state
-bool get2FA_GrantStatus(); // Gets true if 2FA was granted, false if denied or timed out
-void reset2FA_GrantStatus(); // Resets grant status for next 2FA
+bool isWaitingFor2FA(); // True while at least one 2FA session is pending
+int getPending2FACount();
+bool is2FAPending(const byte* ibutton_id); // True if this iButton already has a pending session
+/**
+ * @brief Takes one resolved 2FA session (granted, denied or timed out) and frees its slot.
+ * Call repeatedly from the main loop until it returns false.
+ * @param[out] ibutton_id_out Buffer for the iButton ID (IBUTTON_ID_LEN bytes).
+ * @param[out] status_out Outcome of the session.
+ * @param[out] touch_us_out Optional; the touch_us given to publish2FARequest(). Can be nullptr.
+ * @param[out] lane_out Optional; the lane given to publish2FARequest(). Can be nullptr.
+ * @return true if a resolved session was returned.
+ */
+bool takeResolved2FA(byte* ibutton_id_out, TwoFAStatus& status_out, uint32_t* touch_us_out = nullptr,
+                     uint8_t* lane_out = nullptr);
 
 //For deletion
 bool isDeleteIButtonModeActive();
@@ -0,0 +1,162 @@
+#include "outbound_queue.h"
+#include <stddef.h>  // Required for offsetof
+
+const uint32_t OUTBOUND_QUEUE_MAGIC = 0x3351554F;  // "OUQ3" in memory byte order (v3: evicted)
+
+// Whole queue in one block so it can live in RTC memory and be validated with one CRC
+struct OutboundQueueState {
+  uint32_t magic;
+  uint16_t head;   // Slot of the oldest message
+  uint16_t count;
+  uint32_t high_water;
+  uint32_t enqueued;
+  uint32_t coalesced;
+  uint32_t evicted;
+  uint32_t dropped;
+  uint32_t flushed;
+  OutboundMessage slots[OUTBOUND_QUEUE_CAPACITY];
+  uint32_t crc;
+};
+
+
+// --- Module Variables ---
+#if OUTBOUND_QUEUE_PERSIST
+RTC_NOINIT_ATTR OutboundQueueState outbound_state;  // Not cleared by software, watchdog or brownout resets
+#else
+OutboundQueueState outbound_state;
+#endif
+
+
+// --- Helpers ---
+uint32_t outboundCrc32(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+void sealOutboundState() {
+  outbound_state.crc = outboundCrc32(&outbound_state, offsetof(OutboundQueueState, crc));
+}
+
+OutboundMessage& outboundSlot(int position) {  // position 0 is the oldest message
+  return outbound_state.slots[(outbound_state.head + position) % OUTBOUND_QUEUE_CAPACITY];
+}
+
+// Removes the message at a position, shifting the newer ones down to keep FIFO order
+void removeOutboundAt(int position) {
+  for (int i = position; i < outbound_state.count - 1; i++) {
+    outboundSlot(i) = outboundSlot(i + 1);
+  }
+  outbound_state.count--;
+}
+
+
+// --- Function Implementations ---
+
+void setupOutboundQueue() {
+  bool restored = OUTBOUND_QUEUE_PERSIST
+                  && outbound_state.magic == OUTBOUND_QUEUE_MAGIC
+                  && outbound_state.crc == outboundCrc32(&outbound_state, offsetof(OutboundQueueState, crc))
+                  && outbound_state.head < OUTBOUND_QUEUE_CAPACITY
+                  && outbound_state.count <= OUTBOUND_QUEUE_CAPACITY;
+  if (restored) {
+    Serial.printf("Outbound queue: restored %u message(s) from before the reset.\n", outbound_state.count);
+    return;
+  }
+  memset(&outbound_state, 0, sizeof(outbound_state));
+  outbound_state.magic = OUTBOUND_QUEUE_MAGIC;
+  sealOutboundState();
+}
+
+// Copies a payload by length and NUL-terminates it, so JSON payloads stay printable
+void setOutboundPayload(OutboundMessage& message, const byte* payload, size_t payload_len) {
+  memcpy(message.payload, payload, payload_len);
+  message.payload[payload_len] = '\0';
+  message.payload_len = payload_len;
+}
+
+bool outboundQueuePush(const char* sub_topic, const byte* payload, size_t payload_len, bool retained,
+                       OutboundPriority priority, bool coalesce) {
+  if (strlen(sub_topic) > OUTBOUND_TOPIC_MAX_LEN || payload_len > OUTBOUND_PAYLOAD_MAX_LEN) {
+    Serial.printf("Outbound queue: message for %s too large to queue. Dropped.\n", sub_topic);
+    outbound_state.dropped++;
+    sealOutboundState();
+    return false;
+  }
+
+  // Replace a queued message for the same sub-topic (e.g. status) instead of adding one
+  if (coalesce) {
+    for (int i = 0; i < outbound_state.count; i++) {
+      OutboundMessage& queued = outboundSlot(i);
+      if (queued.coalesce && strcmp(queued.sub_topic, sub_topic) == 0) {
+        setOutboundPayload(queued, payload, payload_len);
+        queued.retained = retained;
+        queued.priority = max(queued.priority, (uint8_t)priority);
+        outbound_state.coalesced++;
+        sealOutboundState();
+        return true;
+      }
+    }
+  }
+
+  if (outbound_state.count == OUTBOUND_QUEUE_CAPACITY) {
+    // Oldest message of the lowest priority queued
+    int victim = 0;
+    for (int i = 1; i < outbound_state.count; i++) {
+      if (outboundSlot(i).priority < outboundSlot(victim).priority) victim = i;
+    }
+    if (outboundSlot(victim).priority > priority) {
+      Serial.printf("Outbound queue full. Message for %s dropped.\n", sub_topic);
+      outbound_state.dropped++;
+      sealOutboundState();
+      return false;
+    }
+    Serial.printf("Outbound queue full. Oldest message for %s evicted.\n", outboundSlot(victim).sub_topic);
+    outbound_state.evicted++;
+    removeOutboundAt(victim);
+  }
+
+  OutboundMessage& slot = outboundSlot(outbound_state.count);
+  strcpy(slot.sub_topic, sub_topic);
+  setOutboundPayload(slot, payload, payload_len);
+  slot.priority = priority;
+  slot.retained = retained;
+  slot.coalesce = coalesce;
+  outbound_state.count++;
+  outbound_state.enqueued++;
+  if (outbound_state.count > outbound_state.high_water) outbound_state.high_water = outbound_state.count;
+  sealOutboundState();
+  return true;
+}
+
+const OutboundMessage* outboundQueuePeek() {
+  return outbound_state.count > 0 ? &outboundSlot(0) : nullptr;
+}
+
+void outboundQueuePop() {
+  if (outbound_state.count == 0) return;
+  outbound_state.head = (outbound_state.head + 1) % OUTBOUND_QUEUE_CAPACITY;
+  outbound_state.count--;
+  outbound_state.flushed++;
+  sealOutboundState();
+}
+
+int getOutboundQueueDepth() {
+  return outbound_state.count;
+}
+
+void getOutboundQueueStats(OutboundQueueStats& stats_out) {
+  stats_out.depth = outbound_state.count;
+  stats_out.high_water = outbound_state.high_water;
+  stats_out.enqueued = outbound_state.enqueued;
+  stats_out.coalesced = outbound_state.coalesced;
+  stats_out.evicted = outbound_state.evicted;
+  stats_out.dropped = outbound_state.dropped;
+  stats_out.flushed = outbound_state.flushed;
+}
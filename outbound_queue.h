@@ -0,0 +1,84 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <Arduino.h>
+
+// --- Constants ---
+// A bounded, priority-evicting buffer for broker outages, not a delivery guarantee. The
+// whole queue (~3.8 KB) lives in the 8 KB of RTC slow memory, which caps it at 16 messages.
+// During a long outage the newest messages and the high-priority ones survive: once full,
+// each new message evicts the oldest one of the lowest priority (counted as evicted).
+#define OUTBOUND_QUEUE_CAPACITY 16      // Messages held while the broker is unreachable
+#define OUTBOUND_TOPIC_MAX_LEN 39       // Sub-topic after base_topic_prefix
+#define OUTBOUND_PAYLOAD_MAX_LEN 191
+#define OUTBOUND_QUEUE_PERSIST 1        // Keep the queue in RTC memory across software resets
+
+// How a queued message is treated when the queue is full or a newer one arrives
+enum OutboundPriority : uint8_t {
+  OUTBOUND_PRIORITY_NORMAL = 0,  // Evicted first when the queue is full
+  OUTBOUND_PRIORITY_HIGH = 1     // Results the app must not miss (pairing, deletion)
+};
+
+struct OutboundMessage {
+  char sub_topic[OUTBOUND_TOPIC_MAX_LEN + 1];
+  char payload[OUTBOUND_PAYLOAD_MAX_LEN + 1];  // JSON text or binary (CBOR); NUL-terminated after payload_len
+  uint8_t payload_len;
+  uint8_t priority;  // OutboundPriority
+  bool retained;
+  bool coalesce;     // A newer message for the same sub-topic replaces this one
+};
+
+// Counters since the queue was created
+struct OutboundQueueStats {
+  int depth;
+  int high_water;
+  uint32_t enqueued;
+  uint32_t coalesced;
+  uint32_t evicted;  // Queued messages pushed out by newer ones while full
+  uint32_t dropped;  // New messages refused: too large, or the queue full of higher priority ones
+  uint32_t flushed;
+};
+
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Restores messages queued before a software reset (when OUTBOUND_QUEUE_PERSIST
+ * is set and the RTC copy is intact), otherwise starts empty.
+ * Must be called once in setup, before the first publish.
+ */
+void setupOutboundQueue();
+
+/**
+ * @brief Queues a message for later delivery.
+ * The payload may be binary; it is copied by length.
+ * If coalesce is set and a coalescing message for the same sub-topic is queued, its
+ * payload is replaced in place. When the queue is full the oldest message of the lowest
+ * queued priority is evicted, if that priority does not outrank the new message; otherwise
+ * the new one is dropped.
+ * @return true if the message was queued.
+ */
+bool outboundQueuePush(const char* sub_topic, const byte* payload, size_t payload_len, bool retained,
+                       OutboundPriority priority, bool coalesce);
+
+/**
+ * @brief Returns the oldest queued message without removing it, or nullptr if empty.
+ */
+const OutboundMessage* outboundQueuePeek();
+
+/**
+ * @brief Removes the oldest queued message after it was delivered.
+ */
+void outboundQueuePop();
+
+/**
+ * @brief Number of messages currently queued.
+ */
+int getOutboundQueueDepth();
+
+/**
+ * @brief Copies the queue counters.
+ */
+void getOutboundQueueStats(OutboundQueueStats& stats_out);
+
+#endif // OUTBOUND_QUEUE_H
@@ -0,0 +1,189 @@
+#include "payload_benchmark.h"
+#include "payload_codec.h"
+#include "scan_telemetry.h"
+
+// --- Sample Payloads ---
+// Same members and typical values as the publishers in mqtt_manager
+const byte bench_ibutton_id[8] = { 0x01, 0x5A, 0x3C, 0x11, 0x00, 0x00, 0x00, 0x9E };
+const char bench_session_id[] = "a1f0c2d4-7e55-4b1a-9c3e-2f6d8b0e4a17";
+
+void benchEncodeStatus(PayloadWriter& w) {
+  payloadAddBool(w, "online", true);
+  payloadAddUInt(w, "occupancy", 2);
+  payloadAddUInt(w, "total_spaces", 3);
+  payloadAddString(w, "ip", "192.168.100.23");
+  payloadAddUInt(w, "outbox_depth", 0);
+  payloadAddUInt(w, "outbox_evicted", 0);
+  payloadAddUInt(w, "outbox_dropped", 0);
+  payloadAddUInt(w, "scan_dropped", 0);
+}
+
+// A full batch, mixing outcomes
+void benchEncodeScanBatch(PayloadWriter& w) {
+  payloadAddUInt(w, "dropped", 0);
+  payloadBeginArray(w, "events", SCAN_TELEMETRY_BATCH_MAX);
+  for (int i = 0; i < SCAN_TELEMETRY_BATCH_MAX; i++) {
+    bool is_registered = i % 4 != 3;
+    payloadBeginElement(w);
+    payloadAddID(w, "ibutton_id", bench_ibutton_id, sizeof(bench_ibutton_id));
+    payloadAddBool(w, "is_registered", is_registered);
+    if (is_registered) {
+      payloadAddUInt(w, "associated_id", 1042 + i);
+    }
+    payloadAddUInt(w, "lane", 0);
+    payloadAddString(w, "outcome",
+                     getScanOutcomeName(is_registered ? SCAN_OUTCOME_ENTRY : SCAN_OUTCOME_UNREGISTERED));
+    payloadAddUInt(w, "age_ms", 30000 - i * 3500);
+    payloadEndElement(w);
+  }
+  payloadEndArray(w);
+}
+
+void benchEncode2FARequest(PayloadWriter& w) {
+  payloadAddUInt(w, "request_id", 2891734561UL);
+  payloadAddID(w, "ibutton_id", bench_ibutton_id, sizeof(bench_ibutton_id));
+  payloadAddUInt(w, "associated_id", 1042);
+  payloadAddString(w, "device_id", "ESP32_Parking_01");
+  payloadAddUInt(w, "lane", 0);
+}
+
+void benchEncode2FAResponse(PayloadWriter& w) {
+  payloadAddID(w, "ibutton_id", bench_ibutton_id, sizeof(bench_ibutton_id));
+  payloadAddBool(w, "allow_entry", true);
+  payloadAddUInt(w, "request_id", 2891734561UL);
+}
+
+void benchEncodePairingSuccess(PayloadWriter& w) {
+  payloadAddString(w, "pairing_session_id", bench_session_id);
+  payloadAddID(w, "ibutton_id", bench_ibutton_id, sizeof(bench_ibutton_id));
+  payloadAddUInt(w, "associated_id", 1042);
+}
+
+void benchEncodeDeleteSuccess(PayloadWriter& w) {
+  payloadAddID(w, "ibutton_id", bench_ibutton_id, sizeof(bench_ibutton_id));
+  payloadAddString(w, "status", "deleted");
+}
+
+// Keys read back when timing the decode, as a command handler would
+struct BenchKey {
+  const char* key;
+  JsonFieldType type;
+};
+
+const BenchKey status_keys[] = {
+  { "online", JSON_FIELD_BOOL }, { "occupancy", JSON_FIELD_UINT }, { "total_spaces", JSON_FIELD_UINT },
+  { "ip", JSON_FIELD_STRING }, { "outbox_depth", JSON_FIELD_UINT }, { "outbox_evicted", JSON_FIELD_UINT },
+  { "outbox_dropped", JSON_FIELD_UINT }, { "scan_dropped", JSON_FIELD_UINT },
+};
+const BenchKey scan_batch_keys[] = {
+  { "dropped", JSON_FIELD_UINT },  // The events array is walked and skipped
+};
+const BenchKey request_keys[] = {
+  { "request_id", JSON_FIELD_UINT }, { "ibutton_id", JSON_FIELD_STRING }, { "associated_id", JSON_FIELD_UINT },
+  { "device_id", JSON_FIELD_STRING }, { "lane", JSON_FIELD_UINT },
+};
+const BenchKey response_keys[] = {
+  { "ibutton_id", JSON_FIELD_STRING }, { "allow_entry", JSON_FIELD_BOOL }, { "request_id", JSON_FIELD_UINT },
+};
+const BenchKey pairing_keys[] = {
+  { "pairing_session_id", JSON_FIELD_STRING }, { "ibutton_id", JSON_FIELD_STRING },
+  { "associated_id", JSON_FIELD_UINT },
+};
+const BenchKey delete_keys[] = {
+  { "ibutton_id", JSON_FIELD_STRING }, { "status", JSON_FIELD_STRING },
+};
+
+struct PayloadBenchCase {
+  const char* message;  // Topic suffix
+  void (*encode)(PayloadWriter& w);
+  const BenchKey* keys;
+  int key_count;
+};
+
+#define BENCH_CASE(topic, encoder, keys) { topic, encoder, keys, sizeof(keys) / sizeof(keys[0]) }
+const PayloadBenchCase payload_bench_cases[] = {
+  BENCH_CASE("status", benchEncodeStatus, status_keys),
+  BENCH_CASE("ibutton/scan_batch", benchEncodeScanBatch, scan_batch_keys),
+  BENCH_CASE("auth/2fa_request", benchEncode2FARequest, request_keys),
+  BENCH_CASE("cmd/auth/2fa_response", benchEncode2FAResponse, response_keys),
+  BENCH_CASE("pairing/success", benchEncodePairingSuccess, pairing_keys),
+  BENCH_CASE("ibutton/delete_success", benchEncodeDeleteSuccess, delete_keys),
+};
+#undef BENCH_CASE
+
+const int BENCH_MAX_KEYS = 6;
+const size_t BENCH_STRING_LEN = 40;  // Fits the pairing session ID
+
+
+// --- Helpers ---
+bool benchEncode(const PayloadBenchCase& bench_case, PayloadFormat format, char* buf, size_t size, size_t& length_out) {
+  PayloadWriter w;
+  payloadBegin(w, format, buf, size);
+  bench_case.encode(w);
+  bool ok = payloadEnd(w);
+  length_out = payloadLength(w);
+  return ok;
+}
+
+// Reads every key of the case back; false if any is missing
+bool benchDecode(const PayloadBenchCase& bench_case, const byte* payload, size_t length) {
+  static char strings[BENCH_MAX_KEYS][BENCH_STRING_LEN];
+  static uint32_t uints[BENCH_MAX_KEYS];
+  static bool bools[BENCH_MAX_KEYS];
+  JsonField fields[BENCH_MAX_KEYS];
+  for (int i = 0; i < bench_case.key_count; i++) {
+    fields[i].key = bench_case.keys[i].key;
+    fields[i].type = bench_case.keys[i].type;
+    fields[i].out_size = 0;
+    switch (fields[i].type) {
+      case JSON_FIELD_STRING:
+        fields[i].out = strings[i];
+        fields[i].out_size = BENCH_STRING_LEN;
+        break;
+      case JSON_FIELD_BOOL: fields[i].out = &bools[i]; break;
+      case JSON_FIELD_UINT: fields[i].out = &uints[i]; break;
+    }
+  }
+  if (!payloadReadObject(payload, length, fields, bench_case.key_count)) return false;
+  for (int i = 0; i < bench_case.key_count; i++) {
+    if (!fields[i].found) return false;
+  }
+  return true;
+}
+
+
+// --- Function Implementations ---
+
+void runPayloadBenchmark() {
+  static char buf[1280];  // Same size as the MQTT manager's scan batch buffer
+  const PayloadFormat formats[] = { PAYLOAD_FORMAT_JSON, PAYLOAD_FORMAT_CBOR };
+
+  Serial.println("payload_bench,message,format,bytes,encode_ns,decode_ns");
+  for (const PayloadBenchCase& bench_case : payload_bench_cases) {
+    for (PayloadFormat format : formats) {
+      const char* format_name = format == PAYLOAD_FORMAT_CBOR ? "cbor" : "json";
+      size_t length = 0;
+      if (!benchEncode(bench_case, format, buf, sizeof(buf), length)
+          || !benchDecode(bench_case, (const byte*)buf, length)) {
+        Serial.printf("payload_bench: %s did not round-trip in %s. Skipped.\n", bench_case.message, format_name);
+        continue;
+      }
+
+      uint32_t start_us = micros();
+      for (int i = 0; i < PAYLOAD_BENCH_ITERATIONS; i++) {
+        benchEncode(bench_case, format, buf, sizeof(buf), length);
+      }
+      uint32_t encode_us = micros() - start_us;
+
+      start_us = micros();
+      for (int i = 0; i < PAYLOAD_BENCH_ITERATIONS; i++) {
+        benchDecode(bench_case, (const byte*)buf, length);
+      }
+      uint32_t decode_us = micros() - start_us;
+
+      Serial.printf("payload_bench,%s,%s,%u,%u,%u\n", bench_case.message, format_name, (unsigned)length,
+                    (uint32_t)((uint64_t)encode_us * 1000 / PAYLOAD_BENCH_ITERATIONS),
+                    (uint32_t)((uint64_t)decode_us * 1000 / PAYLOAD_BENCH_ITERATIONS));
+    }
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef PAYLOAD_BENCHMARK_H
+#define PAYLOAD_BENCHMARK_H
+
+#include <Arduino.h>
+
+// --- Constants ---
+#define PAYLOAD_BENCH_ITERATIONS 1000  // Timed encodes and decodes per message and format
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Encodes and decodes sample MQTT payloads (status, scan batch, 2FA request and
+ * response, pairing and deletion results) in JSON and in CBOR, and prints one CSV row
+ * per message and format, prefixed with "payload_bench," so the rows can be grepped:
+ *   payload_bench,message,format,bytes,encode_ns,decode_ns
+ * bytes is the payload size on the wire; times are means per operation. Uses its own
+ * buffer and publishes nothing.
+ */
+void runPayloadBenchmark();
+
+#endif // PAYLOAD_BENCHMARK_H
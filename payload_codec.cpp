@@ -0,0 +1,73 @@
+#include "payload_codec.h"
+#include "cbor_reader.h"
+
+// --- Function Implementations ---
+
+void payloadBegin(PayloadWriter& w, PayloadFormat format, char* buf, size_t size) {
+  w.format = format;
+  if (format == PAYLOAD_FORMAT_CBOR) cborBeginMap(w.cbor, (byte*)buf, size);
+  else jsonBeginObject(w.json, buf, size);
+}
+
+void payloadAddString(PayloadWriter& w, const char* key, const char* value) {
+  if (w.format == PAYLOAD_FORMAT_CBOR) cborAddString(w.cbor, key, value);
+  else jsonAddString(w.json, key, value);
+}
+
+void payloadAddUInt(PayloadWriter& w, const char* key, uint32_t value) {
+  if (w.format == PAYLOAD_FORMAT_CBOR) cborAddUInt(w.cbor, key, value);
+  else jsonAddUInt(w.json, key, value);
+}
+
+void payloadAddBool(PayloadWriter& w, const char* key, bool value) {
+  if (w.format == PAYLOAD_FORMAT_CBOR) cborAddBool(w.cbor, key, value);
+  else jsonAddBool(w.json, key, value);
+}
+
+void payloadAddID(PayloadWriter& w, const char* key, const byte* id, size_t length) {
+  if (length > PAYLOAD_MAX_ID_LEN) length = PAYLOAD_MAX_ID_LEN;
+  payloadAddBytes(w, key, id, length);
+}
+
+void payloadAddBytes(PayloadWriter& w, const char* key, const byte* data, size_t length) {
+  if (w.format == PAYLOAD_FORMAT_CBOR) cborAddBytes(w.cbor, key, data, length);
+  else jsonAddHex(w.json, key, data, length);
+}
+
+void payloadBeginArray(PayloadWriter& w, const char* key, uint32_t items) {
+  if (w.format == PAYLOAD_FORMAT_CBOR) cborBeginArray(w.cbor, key, items);
+  else jsonBeginArray(w.json, key);
+}
+
+void payloadBeginElement(PayloadWriter& w) {
+  if (w.format == PAYLOAD_FORMAT_CBOR) cborBeginElement(w.cbor);
+  else jsonBeginElement(w.json);
+}
+
+void payloadEndElement(PayloadWriter& w) {
+  if (w.format == PAYLOAD_FORMAT_CBOR) cborEndElement(w.cbor);
+  else jsonEndElement(w.json);
+}
+
+void payloadEndArray(PayloadWriter& w) {
+  if (w.format == PAYLOAD_FORMAT_JSON) jsonEndArray(w.json);  // CBOR arrays are closed by their length
+}
+
+bool payloadEnd(PayloadWriter& w) {
+  return w.format == PAYLOAD_FORMAT_CBOR ? cborEndMap(w.cbor) : jsonEndObject(w.json);
+}
+
+size_t payloadLength(const PayloadWriter& w) {
+  return w.format == PAYLOAD_FORMAT_CBOR ? w.cbor.len : w.json.len;
+}
+
+bool payloadReadObject(const byte* payload, unsigned int length, JsonField* fields, int field_count) {
+  if (payloadDetectFormat(payload, length) == PAYLOAD_FORMAT_CBOR) {
+    return cborReadMap(payload, length, fields, field_count);
+  }
+  return jsonReadObject(payload, length, fields, field_count);
+}
+
+PayloadFormat payloadDetectFormat(const byte* payload, unsigned int length) {
+  return cborLooksLikeMap(payload, length) ? PAYLOAD_FORMAT_CBOR : PAYLOAD_FORMAT_JSON;
+}
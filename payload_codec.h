@@ -0,0 +1,82 @@
+#ifndef PAYLOAD_CODEC_H
+#define PAYLOAD_CODEC_H
+
+#include <Arduino.h>
+#include "json_reader.h"
+#include "json_writer.h"
+#include "cbor_writer.h"
+
+// --- Constants ---
+#define PAYLOAD_MAX_ID_LEN 8  // Longest binary ID payloadAddID() accepts (an iButton ROM ID)
+
+// Wire format of a flat payload object. Both carry the same keys.
+enum PayloadFormat : uint8_t {
+  PAYLOAD_FORMAT_JSON,
+  PAYLOAD_FORMAT_CBOR
+};
+
+// Writes one object as JSON or CBOR into a caller-provided buffer, so a publisher is
+// written once for both formats. Members are flat, except for arrays of flat objects.
+// Never allocates.
+struct PayloadWriter {
+  PayloadFormat format;
+  JsonWriter json;
+  CborWriter cbor;
+};
+
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Starts an object in buf in the given format.
+ */
+void payloadBegin(PayloadWriter& w, PayloadFormat format, char* buf, size_t size);
+
+void payloadAddString(PayloadWriter& w, const char* key, const char* value);
+void payloadAddUInt(PayloadWriter& w, const char* key, uint32_t value);
+void payloadAddBool(PayloadWriter& w, const char* key, bool value);
+
+/**
+ * @brief Adds a binary ID: uppercase hex text in JSON, a byte string in CBOR.
+ * @param length At most PAYLOAD_MAX_ID_LEN bytes.
+ */
+void payloadAddID(PayloadWriter& w, const char* key, const byte* id, size_t length);
+
+/**
+ * @brief Adds binary data of any length: uppercase hex text in JSON, a byte string in CBOR.
+ * Reads back as hex text in both formats (see payloadReadObject()).
+ */
+void payloadAddBytes(PayloadWriter& w, const char* key, const byte* data, size_t length);
+
+/**
+ * @brief Starts an array of items flat objects; exactly items elements must follow,
+ * each between payloadBeginElement() and payloadEndElement(), then payloadEndArray().
+ */
+void payloadBeginArray(PayloadWriter& w, const char* key, uint32_t items);
+void payloadBeginElement(PayloadWriter& w);
+void payloadEndElement(PayloadWriter& w);
+void payloadEndArray(PayloadWriter& w);
+
+/**
+ * @brief Closes the object.
+ * @return true if the whole object fit in the buffer.
+ */
+bool payloadEnd(PayloadWriter& w);
+
+/**
+ * @brief Encoded length in bytes (JSON without its NUL terminator).
+ */
+size_t payloadLength(const PayloadWriter& w);
+
+/**
+ * @brief Extracts fields from a JSON object or a CBOR map, told apart by the first byte.
+ * See jsonReadObject() and cborReadMap(); an ID sent as a CBOR byte string reads as hex.
+ */
+bool payloadReadObject(const byte* payload, unsigned int length, JsonField* fields, int field_count);
+
+/**
+ * @brief Format of a received payload, from its first byte.
+ */
+PayloadFormat payloadDetectFormat(const byte* payload, unsigned int length);
+
+#endif // PAYLOAD_CODEC_H
@@ -0,0 +1,441 @@
+#include "record_store.h"
+#include <esp_partition.h>
+#include <stddef.h>  // Required for offsetof
+
+
+// --- Flash Layout ---
+// Bank header, written last when a bank is compacted so a torn compaction leaves
+// the previous bank in charge.
+struct StoreBankHeader {
+  uint32_t magic;
+  uint32_t generation;  // Incremented on every compaction; the highest valid bank wins
+  uint32_t max_records;  // Slot count of the snapshot that follows
+  uint16_t record_size;
+  uint16_t layout_version;  // IBUTTON_RECORD_LAYOUT_VERSION of the snapshot and its journal
+  uint32_t counters[STORE_COUNTER_COUNT];
+  uint32_t reserved2;
+  uint32_t crc;
+};
+
+enum JournalEntryType : uint8_t {
+  JOURNAL_ENTRY_RECORD = 0x01,
+  JOURNAL_ENTRY_COUNTER = 0x02
+};
+
+// The last entry of a batch carries JOURNAL_FLAG_COMMIT and the batch size in the low bits.
+// Entries of a batch whose commit entry never made it to flash are discarded on replay.
+const uint8_t JOURNAL_FLAG_COMMIT = 0x80;
+const uint8_t JOURNAL_BATCH_SIZE_MASK = 0x7F;
+
+// One fixed-size change record. Entries from an older generation are left over from
+// the previous use of the bank and mark the end of the journal.
+struct JournalEntry {
+  uint8_t type;
+  uint8_t flags;  // JOURNAL_FLAG_COMMIT | batch size on the last entry of a batch, 0 otherwise
+  uint16_t slot;  // Record slot or StoreCounter id
+  uint32_t generation;
+  union {
+    IButtonRecord record;
+    uint32_t value;
+  } data;
+  uint32_t crc;
+};
+static_assert(RECORD_STORE_SECTOR_SIZE % sizeof(JournalEntry) == 0, "Journal entries must not straddle sectors");
+static_assert(STORE_MAX_BATCH <= JOURNAL_BATCH_SIZE_MASK, "Batch size must fit in the entry flags");
+
+
+// --- Module Variables ---
+const esp_partition_t* store_partition = nullptr;
+uint32_t bank_size = 0;             // Bytes per bank (multiple of the sector size)
+int active_bank = -1;               // -1 until a bank has been loaded or created
+uint32_t active_generation = 0;
+uint32_t journal_start = 0;         // Offset of the first journal entry within a bank
+uint32_t journal_write_pos = 0;     // Offset of the next journal entry within the active bank
+int store_max_records = 0;
+IButtonRecord* store_records = nullptr;  // RAM image of all slots
+uint32_t store_counters[STORE_COUNTER_COUNT];
+bool store_created = false;
+uint32_t store_erase_count = 0;     // Sector erases since boot
+uint32_t store_entries_written = 0; // Journal entries appended since boot
+uint32_t store_commit_count = 0;    // Batches committed since boot
+
+// Open batch: changes are applied to RAM at once and written to flash on commit.
+// undo_entries hold the previous values so a failed commit can be rolled back.
+bool batch_active = false;
+int staged_count = 0;
+JournalEntry staged_entries[STORE_MAX_BATCH];
+JournalEntry undo_entries[STORE_MAX_BATCH];
+
+
+// --- Helpers ---
+uint32_t storeCrc32(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t roundUp(uint32_t value, uint32_t multiple) {
+  return ((value + multiple - 1) / multiple) * multiple;
+}
+
+uint32_t bankOffset(int bank) {
+  return (uint32_t)bank * bank_size;
+}
+
+uint32_t computeJournalStart(uint32_t max_records) {
+  return roundUp(sizeof(StoreBankHeader) + max_records * sizeof(IButtonRecord), sizeof(JournalEntry));
+}
+
+bool eraseSectors(uint32_t offset, uint32_t length) {
+  if (esp_partition_erase_range(store_partition, offset, length) != ESP_OK) {
+    Serial.printf("Error: Flash erase failed at 0x%X.\n", offset);
+    return false;
+  }
+  store_erase_count += length / RECORD_STORE_SECTOR_SIZE;
+  return true;
+}
+
+bool isErased(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t i = 0; i < len; i++) {
+    if (p[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+bool readBankHeader(int bank, StoreBankHeader& header) {
+  if (esp_partition_read(store_partition, bankOffset(bank), &header, sizeof(header)) != ESP_OK) {
+    return false;
+  }
+  return header.magic == RECORD_STORE_MAGIC
+         && header.crc == storeCrc32(&header, offsetof(StoreBankHeader, crc));
+}
+
+void applyJournalEntry(const JournalEntry& entry) {
+  if (entry.type == JOURNAL_ENTRY_RECORD && entry.slot < store_max_records) {
+    store_records[entry.slot] = entry.data.record;
+  } else if (entry.type == JOURNAL_ENTRY_COUNTER && entry.slot < STORE_COUNTER_COUNT) {
+    store_counters[entry.slot] = entry.data.value;
+  }
+}
+
+// Loads the snapshot of a bank into RAM and replays its journal.
+bool loadBank(int bank, const StoreBankHeader& header) {
+  if (header.record_size != sizeof(IButtonRecord)) {
+    Serial.println("Warning: Record store bank has an incompatible record layout.");
+    return false;
+  }
+
+  memset(store_records, 0, store_max_records * sizeof(IButtonRecord));
+  uint32_t snapshot_records = min(header.max_records, (uint32_t)store_max_records);
+  if (esp_partition_read(store_partition, bankOffset(bank) + sizeof(StoreBankHeader),
+                         store_records, snapshot_records * sizeof(IButtonRecord)) != ESP_OK) {
+    return false;
+  }
+  memcpy(store_counters, header.counters, sizeof(store_counters));
+
+  // Replay the journal up to the first erased or stale entry. Entries are held back until
+  // the commit entry of their batch is seen; torn entries invalidate the pending batch.
+  uint32_t pos = computeJournalStart(header.max_records);
+  uint32_t replayed = 0;
+  uint32_t discarded = 0;
+  JournalEntry pending[STORE_MAX_BATCH];
+  int pending_count = 0;
+  JournalEntry entry;
+  memset(&entry, 0xFF, sizeof(entry));
+  while (pos + sizeof(JournalEntry) <= bank_size) {
+    if (esp_partition_read(store_partition, bankOffset(bank) + pos, &entry, sizeof(entry)) != ESP_OK) break;
+    if (isErased(&entry, sizeof(entry))) break;
+    pos += sizeof(JournalEntry);
+    if (entry.crc != storeCrc32(&entry, offsetof(JournalEntry, crc))) {
+      discarded += pending_count + 1;
+      pending_count = 0;
+      continue;
+    }
+    if (entry.generation != header.generation) {  // Left over from the previous cycle
+      pos -= sizeof(JournalEntry);
+      break;
+    }
+    if (!(entry.flags & JOURNAL_FLAG_COMMIT)) {
+      if (pending_count == STORE_MAX_BATCH) {  // Oldest entry belongs to an abandoned batch
+        memmove(&pending[0], &pending[1], (STORE_MAX_BATCH - 1) * sizeof(JournalEntry));
+        pending_count--;
+        discarded++;
+      }
+      pending[pending_count++] = entry;
+      continue;
+    }
+    int batch_size = entry.flags & JOURNAL_BATCH_SIZE_MASK;
+    if (batch_size - 1 > pending_count) {  // Part of this batch is missing
+      discarded += pending_count + 1;
+      pending_count = 0;
+      continue;
+    }
+    discarded += pending_count - (batch_size - 1);
+    for (int i = pending_count - (batch_size - 1); i < pending_count; i++) {
+      applyJournalEntry(pending[i]);
+    }
+    applyJournalEntry(entry);
+    pending_count = 0;
+    replayed++;
+  }
+  discarded += pending_count;  // Batch interrupted before its commit entry
+
+  // Records written by older firmware (snapshot and journal alike) are upgraded in RAM;
+  // beginRecordStore() then compacts so the bank on flash carries the current layout
+  if (header.layout_version < IBUTTON_RECORD_LAYOUT_VERSION) {
+    for (int i = 0; i < store_max_records; i++) {
+      upgradeIButtonRecord(store_records[i], header.layout_version);
+    }
+  }
+
+  // Never append on top of leftover data inside a sector
+  if (pos % RECORD_STORE_SECTOR_SIZE != 0 && pos + sizeof(JournalEntry) <= bank_size && !isErased(&entry, sizeof(entry))) {
+    pos = roundUp(pos, RECORD_STORE_SECTOR_SIZE);
+  }
+
+  active_bank = bank;
+  active_generation = header.generation;
+  journal_write_pos = pos;
+  Serial.printf("Record store: bank %d (gen %u) loaded, %u batches replayed, %u uncommitted entries discarded.\n",
+                bank, header.generation, replayed, discarded);
+  return true;
+}
+
+// Restores the RAM image from the undo entries of the current batch, newest first.
+void storeAbortBatchChanges() {
+  for (int i = staged_count - 1; i >= 0; i--) {
+    applyJournalEntry(undo_entries[i]);
+  }
+  staged_count = 0;
+}
+
+// Appends one entry to the active journal. The caller makes sure it fits in the bank.
+bool appendJournalEntry(JournalEntry& entry) {
+  uint32_t addr = bankOffset(active_bank) + journal_write_pos;
+  if (journal_write_pos % RECORD_STORE_SECTOR_SIZE == 0) {
+    if (!eraseSectors(addr, RECORD_STORE_SECTOR_SIZE)) return false;
+  }
+
+  entry.generation = active_generation;
+  entry.crc = storeCrc32(&entry, offsetof(JournalEntry, crc));
+  // The position is consumed even on failure, a partial write may have landed there
+  journal_write_pos += sizeof(JournalEntry);
+  if (esp_partition_write(store_partition, addr, &entry, sizeof(entry)) != ESP_OK) {
+    Serial.println("Error: Journal append failed.");
+    return false;
+  }
+  store_entries_written++;
+  return true;
+}
+
+
+// --- Function Implementations ---
+
+bool beginRecordStore(int max_records) {
+  store_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                             RECORD_STORE_PARTITION_LABEL);
+  if (store_partition == nullptr) {
+    Serial.println("Error: Partition '" RECORD_STORE_PARTITION_LABEL "' not found. Check partitions.csv.");
+    return false;
+  }
+
+  store_max_records = max_records;
+  bank_size = (store_partition->size / 2) / RECORD_STORE_SECTOR_SIZE * RECORD_STORE_SECTOR_SIZE;
+  journal_start = computeJournalStart(max_records);
+  if (journal_start + RECORD_STORE_SECTOR_SIZE > bank_size) {
+    Serial.printf("Error: Partition too small for %d records (bank size %u bytes).\n", max_records, bank_size);
+    return false;
+  }
+
+  free(store_records);
+  store_records = (IButtonRecord*)calloc(max_records, sizeof(IButtonRecord));
+  if (store_records == nullptr) {
+    Serial.println("Error: Not enough RAM for the record store image.");
+    return false;
+  }
+
+  // Pick the newest valid bank, falling back to the other one if it cannot be loaded
+  StoreBankHeader headers[2];
+  bool valid[2] = { readBankHeader(0, headers[0]), readBankHeader(1, headers[1]) };
+  int first = (valid[1] && (!valid[0] || headers[1].generation > headers[0].generation)) ? 1 : 0;
+  int order[2] = { first, 1 - first };
+  active_bank = -1;
+  for (int i = 0; i < 2 && active_bank < 0; i++) {
+    if (valid[order[i]]) loadBank(order[i], headers[order[i]]);
+  }
+
+  store_created = (active_bank < 0);
+  if (store_created) {
+    Serial.println("No valid record store found. Creating an empty one...");
+    memset(store_records, 0, max_records * sizeof(IButtonRecord));
+    store_counters[STORE_COUNTER_OCCUPANCY] = 0;
+    store_counters[STORE_COUNTER_NEXT_ASSOCIATED_ID] = INVALID_ASSOCIATED_ID + 1;
+    active_generation = 0;
+    return compactRecordStore();
+  }
+
+  if ((int)headers[active_bank].max_records != max_records) {
+    Serial.println("Record capacity changed. Compacting into the new layout...");
+    return compactRecordStore();
+  }
+  if (headers[active_bank].layout_version != IBUTTON_RECORD_LAYOUT_VERSION) {
+    Serial.printf("Record layout upgraded from version %u. Compacting...\n", headers[active_bank].layout_version);
+    return compactRecordStore();
+  }
+  return true;
+}
+
+bool recordStoreWasCreated() {
+  return store_created;
+}
+
+void storeGetRecord(int slot, IButtonRecord& record_out) {
+  record_out = store_records[slot];
+}
+
+// Applies a change to the RAM image and stages it in the open batch, opening a
+// single-change batch when none is active.
+bool stageChange(const JournalEntry& entry) {
+  bool auto_commit = !batch_active;
+  if (auto_commit) storeBeginBatch();
+  if (staged_count == STORE_MAX_BATCH) {
+    Serial.println("Error: Record store batch is full.");
+    return false;
+  }
+
+  JournalEntry& undo = undo_entries[staged_count];
+  undo = entry;
+  if (entry.type == JOURNAL_ENTRY_RECORD) {
+    undo.data.record = store_records[entry.slot];
+  } else {
+    undo.data.value = store_counters[entry.slot];
+  }
+  staged_entries[staged_count++] = entry;
+  applyJournalEntry(entry);
+
+  return auto_commit ? storeCommitBatch() : true;
+}
+
+bool storePutRecord(int slot, const IButtonRecord& record) {
+  if (slot < 0 || slot >= store_max_records) return false;
+  JournalEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.type = JOURNAL_ENTRY_RECORD;
+  entry.slot = (uint16_t)slot;
+  entry.data.record = record;
+  return stageChange(entry);
+}
+
+void storePutRecordUnlogged(int slot, const IButtonRecord& record) {
+  if (slot < 0 || slot >= store_max_records) return;
+  store_records[slot] = record;
+}
+
+uint32_t storeGetCounter(StoreCounter counter) {
+  return store_counters[counter];
+}
+
+bool storePutCounter(StoreCounter counter, uint32_t value) {
+  JournalEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.type = JOURNAL_ENTRY_COUNTER;
+  entry.slot = counter;
+  entry.data.value = value;
+  return stageChange(entry);
+}
+
+void storeBeginBatch() {
+  if (batch_active) {
+    Serial.println("Warning: Record store batch already open, joining it.");
+    return;
+  }
+  batch_active = true;
+  staged_count = 0;
+}
+
+bool storeBatchActive() {
+  return batch_active;
+}
+
+bool storeCommitBatch() {
+  if (!batch_active) return false;
+  batch_active = false;
+  if (staged_count == 0) return true;
+
+  bool ok = (active_bank >= 0);
+  if (ok && journal_write_pos + staged_count * sizeof(JournalEntry) > bank_size) {
+    // The RAM image already holds the batch, so the new snapshot commits it atomically
+    ok = compactRecordStore();
+  } else {
+    for (int i = 0; ok && i < staged_count; i++) {
+      staged_entries[i].flags = (i == staged_count - 1) ? (JOURNAL_FLAG_COMMIT | staged_count) : 0;
+      ok = appendJournalEntry(staged_entries[i]);
+    }
+  }
+
+  if (!ok) {
+    Serial.println("Error: Record store commit failed. Rolling back batch.");
+    storeAbortBatchChanges();
+    return false;
+  }
+  staged_count = 0;
+  store_commit_count++;
+  return true;
+}
+
+void storeAbortBatch() {
+  if (!batch_active) return;
+  batch_active = false;
+  storeAbortBatchChanges();
+}
+
+bool compactRecordStore() {
+  int target = (active_bank == 0) ? 1 : 0;
+  uint32_t base = bankOffset(target);
+
+  // Only the snapshot sectors are erased now; journal sectors are erased on first append
+  if (!eraseSectors(base, roundUp(journal_start, RECORD_STORE_SECTOR_SIZE))) return false;
+  if (esp_partition_write(store_partition, base + sizeof(StoreBankHeader), store_records,
+                          store_max_records * sizeof(IButtonRecord)) != ESP_OK) {
+    Serial.println("Error: Failed to write record store snapshot.");
+    return false;
+  }
+
+  StoreBankHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = RECORD_STORE_MAGIC;
+  header.generation = active_generation + 1;
+  header.max_records = store_max_records;
+  header.record_size = sizeof(IButtonRecord);
+  header.layout_version = IBUTTON_RECORD_LAYOUT_VERSION;
+  memcpy(header.counters, store_counters, sizeof(store_counters));
+  header.crc = storeCrc32(&header, offsetof(StoreBankHeader, crc));
+  if (esp_partition_write(store_partition, base, &header, sizeof(header)) != ESP_OK) {
+    Serial.println("Error: Failed to write record store header.");
+    return false;
+  }
+
+  active_bank = target;
+  active_generation = header.generation;
+  journal_write_pos = journal_start;
+  Serial.printf("Record store compacted into bank %d (gen %u).\n", target, active_generation);
+  return true;
+}
+
+void printRecordStoreStats() {
+  if (active_bank < 0) {
+    Serial.println("Record store not mounted.");
+    return;
+  }
+  uint32_t capacity = (bank_size - journal_start) / sizeof(JournalEntry);
+  uint32_t used = (journal_write_pos - journal_start) / sizeof(JournalEntry);
+  Serial.printf("Record store: bank %d, gen %u, journal %u/%u entries. Since boot: %u commits, %u appends, %u sector erases.\n",
+                active_bank, active_generation, used, capacity, store_commit_count, store_entries_written, store_erase_count);
+}
@@ -0,0 +1,113 @@
+#ifndef RECORD_STORE_H
+#define RECORD_STORE_H
+
+#include <Arduino.h>
+#include "ibutton_manager.h"  // For IButtonRecord
+
+// --- Constants ---
+#define RECORD_STORE_PARTITION_LABEL "ibjournal"  // Data partition declared in partitions.csv
+const uint32_t RECORD_STORE_MAGIC = 0x4A424931;   // "1IBJ" in flash byte order
+const uint32_t RECORD_STORE_SECTOR_SIZE = 4096;   // Flash erase granularity
+const int STORE_MAX_BATCH = 8;                    // Maximum changes per committed batch
+
+// Counters persisted next to the records
+enum StoreCounter : uint8_t {
+  STORE_COUNTER_OCCUPANCY = 0,
+  STORE_COUNTER_NEXT_ASSOCIATED_ID = 1,
+  STORE_COUNTER_COUNT
+};
+
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Mounts the journal-backed record store.
+ * The flash partition is split in two banks. Each bank holds a snapshot of all records
+ * followed by an append-only journal of fixed-size change entries. On boot the newest
+ * bank is loaded and its journal replayed into RAM. When a journal fills up, the RAM
+ * image is compacted into the other bank. Journal sectors are erased lazily, one at a
+ * time, as appends reach them.
+ * @param max_records Number of record slots to manage.
+ * @return true if the store is ready, false if the partition is missing or too small.
+ */
+bool beginRecordStore(int max_records);
+
+/**
+ * @brief Tells whether beginRecordStore() had to create an empty store
+ * (no valid bank was found). Used to trigger migration from the legacy EEPROM layout.
+ */
+bool recordStoreWasCreated();
+
+/**
+ * @brief Copies a record slot from the RAM image.
+ * @param slot Slot index (0 to max_records - 1).
+ * @param[out] record_out Destination record.
+ */
+void storeGetRecord(int slot, IButtonRecord& record_out);
+
+/**
+ * @brief Applies a record change to the RAM image and appends it to the journal.
+ * Inside a batch the change is only staged until storeCommitBatch().
+ * The RAM image is restored if the flash write fails.
+ * @return true if the entry was written (or staged).
+ */
+bool storePutRecord(int slot, const IButtonRecord& record);
+
+/**
+ * @brief Changes a slot in the RAM image only, without a journal entry. The change
+ * reaches flash with the next compactRecordStore(), as part of the snapshot, and is
+ * forgotten by a reboot before that. Lets a bulk import land thousands of records with
+ * one compaction instead of one journal batch each.
+ * The slot must not be part of an open batch.
+ */
+void storePutRecordUnlogged(int slot, const IButtonRecord& record);
+
+/**
+ * @brief Reads a persisted counter from the RAM image.
+ */
+uint32_t storeGetCounter(StoreCounter counter);
+
+/**
+ * @brief Applies a counter change to the RAM image and appends it to the journal.
+ * Inside a batch the change is only staged until storeCommitBatch().
+ * @return true if the entry was written (or staged).
+ */
+bool storePutCounter(StoreCounter counter, uint32_t value);
+
+/**
+ * @brief Opens a batch. Following puts are visible in RAM right away but are written
+ * to flash together by storeCommitBatch(), with a single commit entry. After a crash
+ * a batch is replayed completely or not at all.
+ * At most STORE_MAX_BATCH changes fit in one batch.
+ */
+void storeBeginBatch();
+
+/**
+ * @brief Tells whether a batch is open.
+ */
+bool storeBatchActive();
+
+/**
+ * @brief Writes the staged changes of the open batch to flash.
+ * @return true on success. On failure the RAM image is rolled back.
+ */
+bool storeCommitBatch();
+
+/**
+ * @brief Discards the open batch and rolls the RAM image back.
+ */
+void storeAbortBatch();
+
+/**
+ * @brief Writes a fresh snapshot of the RAM image into the other bank and switches to it.
+ * Called automatically when the journal is full.
+ * @return true if the new bank was written and activated.
+ */
+bool compactRecordStore();
+
+/**
+ * @brief Prints journal usage and flash erase statistics to the Serial monitor.
+ */
+void printRecordStoreStats();
+
+#endif // RECORD_STORE_H
@@ -0,0 +1,202 @@
+#include "registry_benchmark.h"
+#include "ibutton_manager.h"
+#include "record_store.h"
+#include "registry_transfer.h"
+
+// --- Helpers ---
+struct BenchRow {
+  const char* op;
+  uint32_t iterations;
+  uint64_t total_us;
+  uint32_t min_us;
+  uint32_t max_us;
+};
+
+void benchAdd(BenchRow& row, uint32_t elapsed_us) {
+  if (row.iterations == 0 || elapsed_us < row.min_us) row.min_us = elapsed_us;
+  if (elapsed_us > row.max_us) row.max_us = elapsed_us;
+  row.total_us += elapsed_us;
+  row.iterations++;
+}
+
+// A DS1990A-looking ID that is almost certainly not registered
+void benchRandomID(byte* id_out) {
+  uint32_t a = esp_random();
+  uint32_t b = esp_random();
+  memcpy(id_out, &a, 4);
+  memcpy(id_out + 4, &b, 4);
+  id_out[0] = 0x01;
+}
+
+// Next registered slot at or after start (wrapping), or -1 if the registry is empty
+int benchNextRegisteredSlot(int start, IButtonRecord& record_out) {
+  int capacity = getIButtonCapacity();
+  for (int n = 0; n < capacity; n++) {
+    int slot = (start + n) % capacity;
+    storeGetRecord(slot, record_out);
+    if (record_out.is_valid) return slot;
+  }
+  return -1;
+}
+
+
+// --- Function Implementations ---
+
+void runRegistryBenchmark() {
+  int capacity = getIButtonCapacity();
+  if (capacity <= 0 || storeBatchActive()) {
+    Serial.println("Registry benchmark: registry not ready or a transaction is open.");
+    return;
+  }
+
+  // Fragmentation: free slots below the highest used one
+  IButtonRecord record;
+  int highest_used = -1;
+  int holes = 0;
+  for (int i = 0; i < capacity; i++) {
+    storeGetRecord(i, record);
+    if (record.is_valid) highest_used = i;
+  }
+  for (int i = 0; i < highest_used; i++) {
+    storeGetRecord(i, record);
+    if (!record.is_valid) holes++;
+  }
+  int registered = getRegisteredIButtonCount();
+
+  BenchRow rows[] = {
+    { "lookup_hit", 0, 0, 0, 0 },
+    { "lookup_miss", 0, 0, 0, 0 },
+    { "register", 0, 0, 0, 0 },
+    { "delete", 0, 0, 0, 0 },
+    { "index_rebuild", 0, 0, 0, 0 },
+    { "list", 0, 0, 0, 0 },
+  };
+  BenchRow& lookup_hit = rows[0];
+  BenchRow& lookup_miss = rows[1];
+  BenchRow& register_row = rows[2];
+  BenchRow& delete_row = rows[3];
+  BenchRow& rebuild_row = rows[4];
+  BenchRow& list_row = rows[5];
+
+  IButtonRecord found;
+  byte id[IBUTTON_ID_LEN];
+  uint32_t start_us;
+
+  // Lookups, cycling over every registered iButton
+  int slot = -1;
+  for (int i = 0; i < REGISTRY_BENCH_LOOKUPS && registered > 0; i++) {
+    slot = benchNextRegisteredSlot(slot + 1, record);
+    start_us = micros();
+    getIButtonRecord(record.ibutton_id, found);
+    benchAdd(lookup_hit, micros() - start_us);
+  }
+  for (int i = 0; i < REGISTRY_BENCH_LOOKUPS; i++) {
+    benchRandomID(id);
+    start_us = micros();
+    getIButtonRecord(id, found);
+    benchAdd(lookup_miss, micros() - start_us);
+  }
+
+  // Writes are staged in a transaction and rolled back; the abort rebuilds the index
+  for (int i = 0; i < REGISTRY_BENCH_WRITES && registered < capacity; i++) {
+    benchRandomID(id);
+    beginRegistryTransaction();
+    start_us = micros();
+    registerIButton(id);
+    benchAdd(register_row, micros() - start_us);
+    abortRegistryTransaction();
+  }
+  slot = -1;
+  for (int i = 0; i < REGISTRY_BENCH_WRITES && registered > 0; i++) {
+    slot = benchNextRegisteredSlot(slot + 1, record);
+    beginRegistryTransaction();
+    start_us = micros();
+    deleteIButton(record.ibutton_id);
+    benchAdd(delete_row, micros() - start_us);
+    abortRegistryTransaction();
+  }
+  for (int i = 0; i < REGISTRY_BENCH_WRITES; i++) {
+    beginRegistryTransaction();
+    start_us = micros();
+    abortRegistryTransaction();  // Nothing staged: the cost is the index rebuild
+    benchAdd(rebuild_row, micros() - start_us);
+  }
+
+  // Dominated by the Serial output, timed once
+  start_us = micros();
+  printAllRegisteredIButtons();
+  benchAdd(list_row, micros() - start_us);
+
+  Serial.println("registry_bench,capacity,registered,holes,op,iterations,mean_us,min_us,max_us");
+  for (const BenchRow& row : rows) {
+    if (row.iterations == 0) continue;
+    Serial.printf("registry_bench,%d,%d,%d,%s,%u,%u,%u,%u\n", capacity, registered, holes, row.op,
+                  row.iterations, (uint32_t)(row.total_us / row.iterations), row.min_us, row.max_us);
+  }
+}
+
+// Record n of the synthetic registry, with every 2FA policy represented
+void benchTransferRecord(uint32_t n, IButtonRecord& record_out) {
+  memset(&record_out, 0, sizeof(record_out));
+  record_out.is_valid = true;
+  record_out.ibutton_id[0] = 0x01;
+  memcpy(&record_out.ibutton_id[1], &n, sizeof(n));
+  record_out.associated_id = 1000 + n;
+  record_out.two_fa_policy = n % 3;
+  if (record_out.two_fa_policy == TWO_FA_POLICY_GRANT_WINDOW) record_out.two_fa_grant_minutes = 1 + n % 600;
+}
+
+void runRegistryTransferBenchmark() {
+  static char wire[REGISTRY_CHUNK_PAYLOAD_MAX];     // Payload as published
+  static byte inbound[REGISTRY_CHUNK_PAYLOAD_MAX];  // Copy handed to the receiver, like PubSubClient's buffer
+  static RegistryChunk chunk;
+  static RegistryChunk decoded;
+  const PayloadFormat formats[] = { PAYLOAD_FORMAT_JSON, PAYLOAD_FORMAT_CBOR };
+
+  Serial.println("registry_transfer_bench,format,records,chunks,bytes,encode_us,decode_us,errors");
+  for (PayloadFormat format : formats) {
+    uint32_t chunks = 0;
+    uint32_t bytes = 0;
+    uint32_t errors = 0;
+    uint32_t encode_us = 0;
+    uint32_t decode_us = 0;
+    IButtonRecord record;
+    IButtonRecord received;
+    for (uint32_t first = 0; first < REGISTRY_TRANSFER_BENCH_RECORDS; first += REGISTRY_CHUNK_RECORDS) {
+      uint32_t start_us = micros();
+      chunk.transfer_id = 1;
+      chunk.seq = chunks++;
+      chunk.count = min((uint32_t)REGISTRY_CHUNK_RECORDS, REGISTRY_TRANSFER_BENCH_RECORDS - first);
+      chunk.last = first + chunk.count >= REGISTRY_TRANSFER_BENCH_RECORDS;
+      for (int i = 0; i < chunk.count; i++) {
+        benchTransferRecord(first + i, record);
+        packRegistryRecord(record, &chunk.data[i * REGISTRY_RECORD_WIRE_LEN]);
+      }
+      PayloadWriter w;
+      payloadBegin(w, format, wire, sizeof(wire));
+      encodeRegistryChunk(w, chunk);
+      bool encoded = payloadEnd(w);
+      size_t length = payloadLength(w);
+      encode_us += micros() - start_us;
+      if (!encoded) {
+        errors++;
+        continue;
+      }
+      memcpy(inbound, wire, length);
+      bytes += length;
+
+      start_us = micros();
+      bool ok = decodeRegistryChunk(inbound, length, decoded) == REGISTRY_CHUNK_OK;
+      decode_us += micros() - start_us;
+      ok = ok && decoded.seq == chunk.seq && decoded.last == chunk.last && decoded.count == chunk.count;
+      for (int i = 0; ok && i < decoded.count; i++) {
+        benchTransferRecord(first + i, record);
+        unpackRegistryRecord(&decoded.data[i * REGISTRY_RECORD_WIRE_LEN], received);
+        ok = memcmp(&received, &record, sizeof(record)) == 0;
+      }
+      if (!ok) errors++;
+    }
+    Serial.printf("registry_transfer_bench,%s,%u,%u,%u,%u,%u,%u\n", format == PAYLOAD_FORMAT_CBOR ? "cbor" : "json",
+                  (unsigned)REGISTRY_TRANSFER_BENCH_RECORDS, chunks, bytes, encode_us, decode_us, errors);
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef REGISTRY_BENCHMARK_H
+#define REGISTRY_BENCHMARK_H
+
+#include <Arduino.h>
+
+// --- Constants ---
+#define REGISTRY_BENCH_LOOKUPS 1000  // Timed lookups per hit/miss row
+#define REGISTRY_BENCH_WRITES 10     // Timed register/delete/rebuild runs (each one rolled back)
+#define REGISTRY_TRANSFER_BENCH_RECORDS 10000  // Synthetic records round-tripped by the transfer benchmark
+
+// --- Public Function Declarations ---
+
+/**
+ * @brief Times the registry operations on the live registry and prints one CSV row per
+ * operation, prefixed with "registry_bench," so the rows can be grepped from a log:
+ *   registry_bench,capacity,registered,holes,op,iterations,mean_us,min_us,max_us
+ * Register and delete run inside a registry transaction that is aborted, so nothing
+ * reaches flash and the registry is left as it was (only the cached 2FA approvals of the
+ * iButtons used for the delete runs are dropped). "holes" counts free slots below the
+ * highest used slot (fragmentation left by deletions).
+ * Must be called from the main loop with no registry transaction open.
+ */
+void runRegistryBenchmark();
+
+/**
+ * @brief Round-trips REGISTRY_TRANSFER_BENCH_RECORDS synthetic records through the bulk
+ * transfer chunks, in JSON and in CBOR: each chunk is encoded as for registry/export_chunk,
+ * copied as the broker would deliver it, decoded as cmd/registry/import does, and checked
+ * against what was sent. Prints one CSV row per format:
+ *   registry_transfer_bench,format,records,chunks,bytes,encode_us,decode_us,errors
+ * bytes is the total payload size; times are totals for the whole transfer. Does not
+ * touch the registry or the network.
+ */
+void runRegistryTransferBenchmark();
+
+#endif // REGISTRY_BENCHMARK_H
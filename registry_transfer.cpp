@@ -0,0 +1,213 @@
+#include "registry_transfer.h"
+
+// --- Module Variables ---
+// Export cursor
+bool export_active = false;
+uint32_t export_transfer_id = 0;
+uint32_t export_seq = 0;
+int export_slot = 0;          // First slot of the next chunk
+int export_chunk_end = 0;     // Where the chunk after the peeked one starts
+bool export_chunk_last = false;
+
+// Import session (the staged records themselves live in ibutton_manager)
+RegistryImportStats import_stats;
+unsigned long import_last_chunk_ms = 0;
+
+const char* const registry_import_status_names[] = {
+  "ok", "committed", "out_of_order", "malformed", "bad_crc", "no_session", "full", "failed", "timeout"
+};
+
+
+// --- Helpers ---
+// CRC-32 as in zlib, so the app can check chunks with its standard library
+uint32_t registryCrc32(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+int hexDigitValue(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+
+// --- Function Implementations ---
+
+void packRegistryRecord(const IButtonRecord& record, byte* out) {
+  memcpy(out, record.ibutton_id, IBUTTON_ID_LEN);
+  for (int i = 0; i < 4; i++) {
+    out[IBUTTON_ID_LEN + i] = (byte)(record.associated_id >> (8 * i));
+  }
+  out[12] = record.two_fa_policy;
+  out[13] = (byte)record.two_fa_grant_minutes;
+  out[14] = (byte)(record.two_fa_grant_minutes >> 8);
+}
+
+void unpackRegistryRecord(const byte* in, IButtonRecord& record_out) {
+  memset(&record_out, 0, sizeof(record_out));
+  record_out.is_valid = true;
+  memcpy(record_out.ibutton_id, in, IBUTTON_ID_LEN);
+  for (int i = 0; i < 4; i++) {
+    record_out.associated_id |= (uint32_t)in[IBUTTON_ID_LEN + i] << (8 * i);
+  }
+  record_out.two_fa_policy = in[12];
+  record_out.two_fa_grant_minutes = in[13] | (in[14] << 8);
+}
+
+void encodeRegistryChunk(PayloadWriter& w, const RegistryChunk& chunk) {
+  size_t data_len = chunk.count * REGISTRY_RECORD_WIRE_LEN;
+  payloadAddUInt(w, "transfer_id", chunk.transfer_id);
+  payloadAddUInt(w, "seq", chunk.seq);
+  payloadAddBool(w, "last", chunk.last);
+  payloadAddUInt(w, "count", chunk.count);
+  payloadAddUInt(w, "next_slot", chunk.next_slot);
+  payloadAddUInt(w, "crc", registryCrc32(chunk.data, data_len));
+  payloadAddBytes(w, "records", chunk.data, data_len);
+}
+
+RegistryChunkDecode decodeRegistryChunk(const byte* payload, unsigned int length, RegistryChunk& chunk_out) {
+  char records_hex[REGISTRY_CHUNK_DATA_LEN * 2 + 1];
+  uint32_t count = 0;
+  uint32_t crc = 0;
+  memset(&chunk_out, 0, sizeof(chunk_out));
+  JsonField fields[] = {
+    { "transfer_id", JSON_FIELD_UINT, &chunk_out.transfer_id, 0, false },
+    { "seq", JSON_FIELD_UINT, &chunk_out.seq, 0, false },
+    { "last", JSON_FIELD_BOOL, &chunk_out.last, 0, false },
+    { "count", JSON_FIELD_UINT, &count, 0, false },
+    { "crc", JSON_FIELD_UINT, &crc, 0, false },
+    { "records", JSON_FIELD_STRING, records_hex, sizeof(records_hex), false },
+    { "next_slot", JSON_FIELD_UINT, &chunk_out.next_slot, 0, false },  // Optional, last
+  };
+  const int field_count = sizeof(fields) / sizeof(fields[0]);
+  if (!payloadReadObject(payload, length, fields, field_count)) return REGISTRY_CHUNK_MALFORMED;
+  for (int i = 0; i < field_count - 1; i++) {
+    if (!fields[i].found) return REGISTRY_CHUNK_MALFORMED;
+  }
+
+  size_t data_len = count * REGISTRY_RECORD_WIRE_LEN;
+  if (count > REGISTRY_CHUNK_RECORDS || strlen(records_hex) != data_len * 2) return REGISTRY_CHUNK_MALFORMED;
+  for (size_t i = 0; i < data_len * 2; i++) {
+    int digit = hexDigitValue(records_hex[i]);
+    if (digit < 0) return REGISTRY_CHUNK_MALFORMED;
+    if (i % 2 == 0) chunk_out.data[i / 2] = digit << 4;
+    else chunk_out.data[i / 2] |= digit;
+  }
+  chunk_out.count = (uint8_t)count;
+  return registryCrc32(chunk_out.data, data_len) == crc ? REGISTRY_CHUNK_OK : REGISTRY_CHUNK_BAD_CRC;
+}
+
+void beginRegistryExport(uint32_t transfer_id, uint32_t from_seq, uint32_t from_slot) {
+  export_active = true;
+  export_transfer_id = transfer_id;
+  export_seq = from_seq;
+  // Chunks already delivered end before from_slot; no need to count records to find it
+  export_slot = (int)min<uint32_t>(from_slot, (uint32_t)getIButtonCapacity());
+  Serial.printf("Registry export %u started at chunk %u, slot %d.\n", transfer_id, from_seq, export_slot);
+}
+
+bool isRegistryExportActive() {
+  return export_active;
+}
+
+bool peekRegistryExportChunk(RegistryChunk& chunk_out) {
+  if (!export_active) return false;
+  chunk_out.transfer_id = export_transfer_id;
+  chunk_out.seq = export_seq;
+  chunk_out.count = 0;
+
+  int capacity = getIButtonCapacity();
+  int slot = export_slot;
+  IButtonRecord record;
+  for (; slot < capacity && chunk_out.count < REGISTRY_CHUNK_RECORDS; slot++) {
+    if (getIButtonRecordBySlot(slot, record)) {
+      packRegistryRecord(record, &chunk_out.data[chunk_out.count * REGISTRY_RECORD_WIRE_LEN]);
+      chunk_out.count++;
+    }
+  }
+  // Last unless another registered record follows; the next chunk starts at it
+  while (slot < capacity && !getIButtonRecordBySlot(slot, record)) slot++;
+  export_chunk_end = slot;
+  export_chunk_last = slot >= capacity;
+  chunk_out.last = export_chunk_last;
+  chunk_out.next_slot = (uint32_t)slot;
+  return true;
+}
+
+void consumeRegistryExportChunk() {
+  if (!export_active) return;
+  if (export_chunk_last) {
+    export_active = false;
+    Serial.printf("Registry export %u finished after %u chunks.\n", export_transfer_id, export_seq + 1);
+    return;
+  }
+  export_slot = export_chunk_end;
+  export_seq++;
+}
+
+RegistryImportStatus applyRegistryImportChunk(const RegistryChunk& chunk) {
+  if (chunk.seq == 0) {
+    if (isIButtonImportActive()) {
+      Serial.printf("Registry import %u replaced by %u.\n", import_stats.transfer_id, chunk.transfer_id);
+      abortIButtonImport();
+    }
+    memset(&import_stats, 0, sizeof(import_stats));
+    import_stats.transfer_id = chunk.transfer_id;
+    if (!beginIButtonImport()) return REGISTRY_IMPORT_FAILED;
+  } else if (!isIButtonImportActive() || chunk.transfer_id != import_stats.transfer_id) {
+    return REGISTRY_IMPORT_NO_SESSION;
+  }
+  if (chunk.seq != import_stats.next_seq) return REGISTRY_IMPORT_OUT_OF_ORDER;  // Also a repeated chunk
+  import_last_chunk_ms = millis();
+
+  IButtonRecord record;
+  for (int i = 0; i < chunk.count; i++) {
+    unpackRegistryRecord(&chunk.data[i * REGISTRY_RECORD_WIRE_LEN], record);
+    switch (stageIButtonImport(record)) {
+      case IBUTTON_IMPORT_STAGED:
+        import_stats.staged++;
+        break;
+      case IBUTTON_IMPORT_FULL:
+        abortIButtonImport();
+        return REGISTRY_IMPORT_FULL;
+      default:
+        import_stats.skipped++;
+        break;
+    }
+  }
+  import_stats.next_seq++;
+  if (!chunk.last) return REGISTRY_IMPORT_ACCEPTED;
+
+  int imported = 0;
+  int duplicates = 0;
+  int conflicts = 0;
+  if (!commitIButtonImport(imported, duplicates, conflicts)) return REGISTRY_IMPORT_FAILED;
+  import_stats.staged = imported;
+  import_stats.skipped += duplicates + conflicts;
+  return REGISTRY_IMPORT_COMMITTED;
+}
+
+bool checkRegistryImportTimeout(unsigned long now_ms) {
+  if (!isIButtonImportActive() || now_ms - import_last_chunk_ms < REGISTRY_IMPORT_IDLE_TIMEOUT_MS) return false;
+  Serial.printf("Registry import %u timed out waiting for chunk %u.\n", import_stats.transfer_id,
+                import_stats.next_seq);
+  abortIButtonImport();
+  return true;
+}
+
+void getRegistryImportStats(RegistryImportStats& stats_out) {
+  stats_out = import_stats;
+}
+
+const char* getRegistryImportStatusName(RegistryImportStatus status) {
+  return status <= REGISTRY_IMPORT_TIMED_OUT ? registry_import_status_names[status] : "unknown";
+}
@@ -0,0 +1,127 @@
+#ifndef REGISTRY_TRANSFER_H
+#define REGISTRY_TRANSFER_H
+
+#include <Arduino.h>
+#include "ibutton_manager.h"
+#include "payload_codec.h"
+
+// --- Constants ---
+// A chunk carries up to REGISTRY_CHUNK_RECORDS packed records in its "records" member:
+//   ibutton_id (8 bytes), associated_id (4, little-endian), two_fa_policy (1),
+//   two_fa_grant_minutes (2, little-endian)
+// and "crc", the CRC-32 (as in zlib) of those bytes. Export chunks also carry "next_slot",
+// the registry slot the next chunk starts at, which an interrupted export resumes from.
+// Ten records keep a JSON chunk, with its topic, under a 512-byte MQTT packet.
+#define REGISTRY_RECORD_WIRE_LEN 15
+#define REGISTRY_CHUNK_RECORDS 10
+#define REGISTRY_CHUNK_DATA_LEN (REGISTRY_CHUNK_RECORDS * REGISTRY_RECORD_WIRE_LEN)
+#define REGISTRY_CHUNK_PAYLOAD_MAX 420          // Largest encoded chunk (JSON, full chunk)
+#define REGISTRY_IMPORT_IDLE_TIMEOUT_MS 30000UL  // An import with no chunk for this long is discarded
+
+// One chunk of an export or import, as on the wire
+struct RegistryChunk {
+  uint32_t transfer_id;  // Chosen by the app, echoed in every chunk and reply
+  uint32_t seq;          // 0, 1, 2, ... within the transfer
+  bool last;             // No chunk follows
+  uint8_t count;         // Records in data
+  uint32_t next_slot;    // Export resume cursor; 0 when an import chunk leaves it out
+  byte data[REGISTRY_CHUNK_DATA_LEN];
+};
+
+enum RegistryChunkDecode : uint8_t {
+  REGISTRY_CHUNK_OK,
+  REGISTRY_CHUNK_MALFORMED,  // Missing member, bad hex or count
+  REGISTRY_CHUNK_BAD_CRC
+};
+
+// Reply to an import chunk
+enum RegistryImportStatus : uint8_t {
+  REGISTRY_IMPORT_ACCEPTED,      // Staged; send chunk next_seq
+  REGISTRY_IMPORT_COMMITTED,     // Last chunk staged and the whole import committed
+  REGISTRY_IMPORT_OUT_OF_ORDER,  // Ignored; the import stays open, resend from next_seq
+  REGISTRY_IMPORT_MALFORMED,     // Chunk unreadable (see RegistryChunkDecode); resend it
+  REGISTRY_IMPORT_BAD_CRC,       // Records do not match crc; resend the chunk
+  REGISTRY_IMPORT_NO_SESSION,    // No open import with this transfer_id (start with seq 0)
+  REGISTRY_IMPORT_FULL,          // Registry full; import discarded
+  REGISTRY_IMPORT_FAILED,        // Could not open or commit; import discarded
+  REGISTRY_IMPORT_TIMED_OUT      // No chunk for REGISTRY_IMPORT_IDLE_TIMEOUT_MS; import discarded
+};
+
+// Progress of the current (or last) import
+struct RegistryImportStats {
+  uint32_t transfer_id;
+  uint32_t next_seq;  // Chunk expected next
+  uint32_t staged;    // Records staged so far (registered, once committed)
+  uint32_t skipped;   // Already registered, invalid, or with an associated ID in use
+};
+
+
+// --- Public Function Declarations ---
+// Bulk registry export and import in sequence-numbered chunks. This module holds the wire
+// format and the transfer state; mqtt_manager receives the commands and publishes the
+// chunks and replies. Main loop only.
+
+/**
+ * @brief Converts a record to and from its REGISTRY_RECORD_WIRE_LEN bytes in a chunk.
+ * Unpacked records are valid and outside.
+ */
+void packRegistryRecord(const IButtonRecord& record, byte* out);
+void unpackRegistryRecord(const byte* in, IButtonRecord& record_out);
+
+/**
+ * @brief Adds the members of a chunk (transfer_id, seq, last, count, next_slot, crc,
+ * records) to an open payload.
+ */
+void encodeRegistryChunk(PayloadWriter& w, const RegistryChunk& chunk);
+
+/**
+ * @brief Reads a chunk from a JSON or CBOR payload and checks its count and CRC.
+ * next_slot is optional.
+ */
+RegistryChunkDecode decodeRegistryChunk(const byte* payload, unsigned int length, RegistryChunk& chunk_out);
+
+/**
+ * @brief Starts streaming the registry, restarting any export in progress.
+ * @param from_seq Sequence number of the first chunk sent.
+ * @param from_slot Slot the first chunk starts at: 0 for a new export, or the next_slot of
+ * the last chunk received, to resume an export whose later chunks were lost.
+ */
+void beginRegistryExport(uint32_t transfer_id, uint32_t from_seq, uint32_t from_slot);
+
+bool isRegistryExportActive();
+
+/**
+ * @brief Fills the next export chunk without consuming it, walking the live registry from
+ * where the last chunk ended. Registrations and deletions during an export may or may not
+ * show up in it.
+ * @return false if no export is active.
+ */
+bool peekRegistryExportChunk(RegistryChunk& chunk_out);
+
+/**
+ * @brief Moves past the chunk returned by peekRegistryExportChunk() once it was published.
+ * The export ends after its last chunk.
+ */
+void consumeRegistryExportChunk();
+
+/**
+ * @brief Applies one import chunk. Chunk 0 opens the import (discarding an open one); the
+ * records of every chunk are staged with stageIButtonImport(), and the last chunk commits
+ * them all at once with commitIButtonImport().
+ */
+RegistryImportStatus applyRegistryImportChunk(const RegistryChunk& chunk);
+
+/**
+ * @brief Discards an import that has been idle for REGISTRY_IMPORT_IDLE_TIMEOUT_MS.
+ * @return true if it did, so the caller can tell the app.
+ */
+bool checkRegistryImportTimeout(unsigned long now_ms);
+
+void getRegistryImportStats(RegistryImportStats& stats_out);
+
+/**
+ * @brief Short name of an import status as sent in the reply ("ok", "committed", ...).
+ */
+const char* getRegistryImportStatusName(RegistryImportStatus status);
+
+#endif // REGISTRY_TRANSFER_H
@@ -0,0 +1,68 @@
+#include "scan_cooldown.h"
+
+// --- Module Variables ---
+struct CooldownEntry {
+  uint64_t key;               // ROM ID as one integer, so a lookup is a single compare per slot
+  unsigned long started_ms;   // Also the LRU age
+  unsigned long duration_ms;  // 0 marks a free slot
+  uint32_t associated_id;     // Of the record that started the cooldown
+};
+CooldownEntry cooldown_entries[SCAN_COOLDOWN_SLOTS];
+
+
+// --- Helpers ---
+uint64_t cooldownKey(const byte* ibutton_id) {
+  uint64_t key = 0;
+  memcpy(&key, ibutton_id, IBUTTON_ID_LEN);
+  return key;
+}
+
+// Returns the live entry of key, or nullptr. Expired entries are freed on the way.
+CooldownEntry* findCooldownEntry(uint64_t key, unsigned long now) {
+  CooldownEntry* match = nullptr;
+  for (int i = 0; i < SCAN_COOLDOWN_SLOTS; i++) {
+    CooldownEntry& entry = cooldown_entries[i];
+    if (entry.duration_ms == 0) continue;
+    if (now - entry.started_ms >= entry.duration_ms) {
+      entry.duration_ms = 0;
+    } else if (entry.key == key) {
+      match = &entry;
+    }
+  }
+  return match;
+}
+
+
+// --- Function Implementations ---
+
+void scanCooldownStart(const byte* ibutton_id, unsigned long duration_ms, uint32_t associated_id) {
+  if (duration_ms == 0) return;
+  unsigned long now = millis();
+  uint64_t key = cooldownKey(ibutton_id);
+  CooldownEntry* entry = findCooldownEntry(key, now);
+  for (int i = 0; entry == nullptr && i < SCAN_COOLDOWN_SLOTS; i++) {
+    if (cooldown_entries[i].duration_ms == 0) entry = &cooldown_entries[i];
+  }
+  if (entry == nullptr) {
+    // Full: evict the least recently started entry
+    entry = &cooldown_entries[0];
+    for (int i = 1; i < SCAN_COOLDOWN_SLOTS; i++) {
+      if (now - cooldown_entries[i].started_ms > now - entry->started_ms) entry = &cooldown_entries[i];
+    }
+  }
+  entry->key = key;
+  entry->started_ms = now;
+  entry->duration_ms = duration_ms;
+  entry->associated_id = associated_id;
+}
+
+bool scanCooldownActive(const byte* ibutton_id, uint32_t* associated_id_out) {
+  CooldownEntry* entry = findCooldownEntry(cooldownKey(ibutton_id), millis());
+  if (entry == nullptr) return false;
+  if (associated_id_out != nullptr) *associated_id_out = entry->associated_id;
+  return true;
+}
+
+void scanCooldownClear() {
+  memset(cooldown_entries, 0, sizeof(cooldown_entries));
+}
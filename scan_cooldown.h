@@ -0,0 +1,37 @@
+#ifndef SCAN_COOLDOWN_H
+#define SCAN_COOLDOWN_H
+
+#include <Arduino.h>
+#include "ibutton_manager.h"  // For IBUTTON_ID_LEN
+
+// --- Constants ---
+#define SCAN_COOLDOWN_SLOTS 8  // iButtons in cooldown at once; the least recently used one is evicted
+
+// --- Public Function Declarations ---
+// Fixed-size table of recently processed iButtons, checked first in the scan pipeline so
+// a repeat read is dropped before any registry lookup or MQTT publish. Several drivers
+// alternating at the reader each keep their own cooldown. Main loop only.
+
+/**
+ * @brief Starts (or restarts) the cooldown of an iButton.
+ * @param ibutton_id The physical ID of the iButton (IBUTTON_ID_LEN bytes).
+ * @param duration_ms Time during which further reads of this iButton are rejected.
+ * @param associated_id Associated ID of the iButton's record, handed back by
+ *        scanCooldownActive() so a rejected read is reported without a registry lookup.
+ */
+void scanCooldownStart(const byte* ibutton_id, unsigned long duration_ms, uint32_t associated_id);
+
+/**
+ * @brief Tells whether an iButton is still in cooldown. Constant time (SCAN_COOLDOWN_SLOTS
+ * compares); expired entries are freed on the way.
+ * @param[out] associated_id_out Optional pointer for the associated ID given to
+ *        scanCooldownStart(). Can be nullptr.
+ */
+bool scanCooldownActive(const byte* ibutton_id, uint32_t* associated_id_out = nullptr);
+
+/**
+ * @brief Ends the cooldown of every iButton.
+ */
+void scanCooldownClear();
+
+#endif // SCAN_COOLDOWN_H
@@ -0,0 +1,39 @@
+#include "scan_queue.h"
+#include <atomic>
+
+static_assert((SCAN_QUEUE_CAPACITY & (SCAN_QUEUE_CAPACITY - 1)) == 0, "SCAN_QUEUE_CAPACITY must be a power of two");
+
+// --- Module Variables ---
+ScanEvent scan_queue_slots[SCAN_QUEUE_CAPACITY];
+// Free-running indices; head is written only by the consumer, tail only by the producer
+std::atomic<uint32_t> scan_queue_head(0);
+std::atomic<uint32_t> scan_queue_tail(0);
+std::atomic<uint32_t> scan_queue_drops(0);
+
+
+// --- Function Implementations ---
+
+bool scanQueuePush(const ScanEvent& event) {
+  uint32_t tail = scan_queue_tail.load(std::memory_order_relaxed);
+  if (tail - scan_queue_head.load(std::memory_order_acquire) >= SCAN_QUEUE_CAPACITY) {
+    scan_queue_drops.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  scan_queue_slots[tail & (SCAN_QUEUE_CAPACITY - 1)] = event;
+  scan_queue_tail.store(tail + 1, std::memory_order_release);  // Publish the slot
+  return true;
+}
+
+bool scanQueuePop(ScanEvent& event_out) {
+  uint32_t head = scan_queue_head.load(std::memory_order_relaxed);
+  if (head == scan_queue_tail.load(std::memory_order_acquire)) {
+    return false;  // Empty
+  }
+  event_out = scan_queue_slots[head & (SCAN_QUEUE_CAPACITY - 1)];
+  scan_queue_head.store(head + 1, std::memory_order_release);  // Hand the slot back
+  return true;
+}
+
+uint32_t getScanQueueDropCount() {
+  return scan_queue_drops.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,41 @@
+#ifndef SCAN_QUEUE_H
+#define SCAN_QUEUE_H
+
+#include <Arduino.h>
+#include "ibutton_manager.h"  // For IBUTTON_ID_LEN
+
+// --- Constants ---
+#define SCAN_QUEUE_CAPACITY 8  // Must be a power of two
+
+// One validated touch on the reader
+struct ScanEvent {
+  byte ibutton_id[IBUTTON_ID_LEN];
+  unsigned long timestamp_ms;  // millis() when the iButton was read
+  uint32_t timestamp_us;       // micros() of the same read, start of the access latency trace
+  uint8_t lane;                // Reader that was touched
+};
+
+
+// --- Public Function Declarations ---
+// Lock-free single-producer/single-consumer ring. Only the reader task may push and
+// only the main loop may pop; no locks or critical sections are needed.
+
+/**
+ * @brief Pushes a scan event (producer side).
+ * @return false if the queue was full and the event was dropped.
+ */
+bool scanQueuePush(const ScanEvent& event);
+
+/**
+ * @brief Pops the oldest scan event (consumer side).
+ * @param[out] event_out Destination for the event.
+ * @return true if an event was available.
+ */
+bool scanQueuePop(ScanEvent& event_out);
+
+/**
+ * @brief Number of events dropped because the queue was full. Reported in the status.
+ */
+uint32_t getScanQueueDropCount();
+
+#endif // SCAN_QUEUE_H
@@ -0,0 +1,74 @@
+#include "scan_telemetry.h"
+
+// --- Module Variables ---
+ScanTelemetryConfig telemetry_config = { SCAN_TELEMETRY_BATCH_MAX, 30000 };
+ScanTelemetryEvent telemetry_events[SCAN_TELEMETRY_CAPACITY];  // Ring, oldest at telemetry_head
+int telemetry_head = 0;
+int telemetry_count = 0;
+ScanTelemetryStats telemetry_stats;
+
+const char* const scan_outcome_names[SCAN_OUTCOME_COUNT] = {
+  "entry", "exit", "full", "already_inside", "unregistered", "2fa_requested", "2fa_pending",
+  "2fa_failed", "cooldown", "registered", "register_failed", "deleted", "delete_failed", "2fa_entry",
+  "2fa_denied", "2fa_timeout"
+};
+
+
+// --- Function Implementations ---
+
+void setupScanTelemetry(const ScanTelemetryConfig& config) {
+  telemetry_config = config;
+  telemetry_config.batch_events = constrain(config.batch_events, 1, SCAN_TELEMETRY_BATCH_MAX);
+  telemetry_head = 0;
+  telemetry_count = 0;
+  memset(&telemetry_stats, 0, sizeof(telemetry_stats));
+}
+
+void scanTelemetryRecord(const byte* ibutton_id, bool is_registered, uint32_t associated_id, uint8_t lane,
+                         ScanOutcome outcome) {
+  if (telemetry_count == SCAN_TELEMETRY_CAPACITY) {
+    telemetry_head = (telemetry_head + 1) % SCAN_TELEMETRY_CAPACITY;
+    telemetry_count--;
+    telemetry_stats.dropped++;
+  }
+  ScanTelemetryEvent& event = telemetry_events[(telemetry_head + telemetry_count) % SCAN_TELEMETRY_CAPACITY];
+  memcpy(event.ibutton_id, ibutton_id, IBUTTON_ID_LEN);
+  event.associated_id = is_registered ? associated_id : 0;
+  event.scanned_ms = millis();
+  event.is_registered = is_registered;
+  event.lane = lane;
+  event.outcome = outcome;
+  telemetry_count++;
+  telemetry_stats.recorded++;
+}
+
+int scanTelemetryBatchDue(unsigned long now_ms) {
+  if (telemetry_count == 0) return 0;
+  bool full_batch = telemetry_count >= telemetry_config.batch_events;
+  bool too_old = now_ms - telemetry_events[telemetry_head].scanned_ms >= telemetry_config.batch_max_age_ms;
+  if (!full_batch && !too_old) return 0;
+  return min(telemetry_count, SCAN_TELEMETRY_BATCH_MAX);
+}
+
+const ScanTelemetryEvent* scanTelemetryPeek(int index) {
+  if (index < 0 || index >= telemetry_count) return nullptr;
+  return &telemetry_events[(telemetry_head + index) % SCAN_TELEMETRY_CAPACITY];
+}
+
+void scanTelemetryConsume(int count) {
+  count = constrain(count, 0, telemetry_count);
+  if (count == 0) return;
+  telemetry_head = (telemetry_head + count) % SCAN_TELEMETRY_CAPACITY;
+  telemetry_count -= count;
+  telemetry_stats.published += count;
+  telemetry_stats.batches++;
+}
+
+void getScanTelemetryStats(ScanTelemetryStats& stats_out) {
+  stats_out = telemetry_stats;
+  stats_out.depth = telemetry_count;
+}
+
+const char* getScanOutcomeName(ScanOutcome outcome) {
+  return outcome < SCAN_OUTCOME_COUNT ? scan_outcome_names[outcome] : "unknown";
+}
@@ -0,0 +1,97 @@
+#ifndef SCAN_TELEMETRY_H
+#define SCAN_TELEMETRY_H
+
+#include <Arduino.h>
+#include "ibutton_manager.h"  // For IBUTTON_ID_LEN
+
+// --- Constants ---
+#define SCAN_TELEMETRY_CAPACITY 32   // Events held until published; the oldest is dropped when full
+#define SCAN_TELEMETRY_BATCH_MAX 8   // Most events in one batch message
+
+// What the controller did with a scan
+enum ScanOutcome : uint8_t {
+  SCAN_OUTCOME_ENTRY,            // Gate opened to enter
+  SCAN_OUTCOME_EXIT,             // Gate opened to leave
+  SCAN_OUTCOME_FULL,             // Entry denied, lot full
+  SCAN_OUTCOME_ALREADY_INSIDE,   // Entry denied on an entry lane, already marked inside
+  SCAN_OUTCOME_UNREGISTERED,     // Unknown iButton
+  SCAN_OUTCOME_2FA_REQUESTED,    // App approval requested
+  SCAN_OUTCOME_2FA_PENDING,      // Approval already in flight for this iButton
+  SCAN_OUTCOME_2FA_FAILED,       // Approval could not be requested
+  SCAN_OUTCOME_COOLDOWN,         // Repeat read ignored
+  SCAN_OUTCOME_REGISTERED,       // Added from the serial console
+  SCAN_OUTCOME_REGISTER_FAILED,
+  SCAN_OUTCOME_DELETED,          // Removed from the serial console
+  SCAN_OUTCOME_DELETE_FAILED,
+  // Resolution of a request sent earlier (SCAN_OUTCOME_2FA_REQUESTED), on the lane it came from
+  SCAN_OUTCOME_2FA_ENTRY,        // Approved, gate opened to enter
+  SCAN_OUTCOME_2FA_DENIED,       // Rejected in the app
+  SCAN_OUTCOME_2FA_TIMEOUT,      // No answer within the 2FA timeout
+  SCAN_OUTCOME_COUNT
+};
+
+struct ScanTelemetryEvent {
+  byte ibutton_id[IBUTTON_ID_LEN];
+  uint32_t associated_id;    // 0 when not registered
+  unsigned long scanned_ms;  // millis() of the scan
+  bool is_registered;
+  uint8_t lane;
+  ScanOutcome outcome;
+};
+
+// When a batch is due
+struct ScanTelemetryConfig {
+  uint8_t batch_events;       // Publish once this many events wait (1 to SCAN_TELEMETRY_BATCH_MAX)
+  uint32_t batch_max_age_ms;  // ... or once the oldest one has waited this long
+};
+
+// Counters since boot
+struct ScanTelemetryStats {
+  int depth;          // Events waiting
+  uint32_t recorded;
+  uint32_t published;
+  uint32_t batches;
+  uint32_t dropped;   // Lost to a full buffer (long broker outage)
+};
+
+
+// --- Public Function Declarations ---
+// Scan events are collected here and published in batches by mqtt_manager, instead of
+// one message per touch. While the broker is unreachable the buffer keeps the newest
+// SCAN_TELEMETRY_CAPACITY events. Main loop only.
+
+/**
+ * @brief Sets the flush policy and empties the buffer. Call once in setup.
+ */
+void setupScanTelemetry(const ScanTelemetryConfig& config);
+
+/**
+ * @brief Adds one scan to the buffer, dropping the oldest event if it is full.
+ */
+void scanTelemetryRecord(const byte* ibutton_id, bool is_registered, uint32_t associated_id, uint8_t lane,
+                         ScanOutcome outcome);
+
+/**
+ * @brief Number of events to publish now: up to SCAN_TELEMETRY_BATCH_MAX once either
+ * threshold of the policy is reached, otherwise 0.
+ */
+int scanTelemetryBatchDue(unsigned long now_ms);
+
+/**
+ * @brief Waiting event by age, 0 being the oldest; nullptr past the end.
+ */
+const ScanTelemetryEvent* scanTelemetryPeek(int index);
+
+/**
+ * @brief Removes the count oldest events after they were published as one batch.
+ */
+void scanTelemetryConsume(int count);
+
+void getScanTelemetryStats(ScanTelemetryStats& stats_out);
+
+/**
+ * @brief Short name of an outcome as sent in the batch ("entry", "cooldown", ...).
+ */
+const char* getScanOutcomeName(ScanOutcome outcome);
+
+#endif // SCAN_TELEMETRY_H
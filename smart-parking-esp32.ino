@@ -1,16 +1,31 @@
 #include <Arduino.h>
-#include <ESP32Servo.h>
+#include "actuator_manager.h"
 #include "ibutton_manager.h"
+#include "scan_queue.h"
+#include "scan_cooldown.h"
+#include "scan_telemetry.h"
 #include "mqtt_manager.h"
 #include "lcd_manager.h"
+#include "boot_timeline.h"
+#include "access_metrics.h"
+#include "lot_simulator.h"
+#include "registry_benchmark.h"
+#include "payload_benchmark.h"
 
 // --- User Configuration ---
 // iButton
 #define IBUTTON_DATA_PIN 33         // GPIO pin for the OneWire data line
 #define MAX_REGISTERED_IBUTTONS 10  // Maximum number of iButtons to store
+static_assert(MAX_REGISTERED_IBUTTONS <= MAX_MANAGED_IBUTTONS, "Every registry slot is kept in RAM; see ibutton_manager.h");
 //#define TOTAL_PARKING_SPACES 3      // Total capacity
 const uint32_t TOTAL_PARKING_SPACES = 3;
 #define IBUTTON_COOLDOWN_MS 10000  // Seconds cooldown for same iButton
+#define SCAN_HOLDOFF_MS 1500       // Reader ignored after a processed scan (avoids immediate re-reads)
+
+// Scan telemetry: every touch and its outcome, published in batches on ibutton/scan_batch
+#define SCAN_BATCH_EVENTS 8          // Publish once this many scans are waiting...
+#define SCAN_BATCH_MAX_AGE_MS 30000  // ...or once the oldest one has waited this long
+ScanTelemetryConfig scan_telemetry_settings = { SCAN_BATCH_EVENTS, SCAN_BATCH_MAX_AGE_MS };
 
 // Servo
 #define SERVO_PIN 27             // GPIO pin for the Servo motor
@@ -25,6 +40,33 @@ const uint32_t TOTAL_PARKING_SPACES = 3;
 #define REJECT_PAUSE_MS 100          // Pause between rejection beeps
 #define REJECT_BEEP_COUNT 3          // Number of rejection beeps
 
+// Lanes: each one has its own reader, gate and buzzer, all sharing the registry and the
+// occupancy count. With one lane it handles both directions (guessed from is_inside);
+// with two, lane 0 is the entry lane and lane 1 the exit lane.
+#define PARKING_LANES 1              // 1 or 2 (at most IBUTTON_MAX_READERS and ACTUATOR_MAX_LANES)
+#define EXIT_IBUTTON_DATA_PIN 32     // Lane 1 reader
+#define EXIT_SERVO_PIN 25            // Lane 1 gate
+#define EXIT_BUZZER_PIN BUZZER_PIN   // Lanes may share the buzzer
+
+enum LaneRole {
+  LANE_ROLE_BOTH,
+  LANE_ROLE_ENTRY,
+  LANE_ROLE_EXIT
+};
+
+struct LaneConfig {
+  uint8_t reader_pin;
+  ActuatorConfig actuators;
+  LaneRole role;  // Used when PARKING_LANES > 1
+};
+
+LaneConfig lane_settings[PARKING_LANES] = {
+  { IBUTTON_DATA_PIN, { SERVO_PIN, SERVO_OPEN_ANGLE, SERVO_CLOSE_ANGLE, BUZZER_PIN }, LANE_ROLE_ENTRY },
+#if PARKING_LANES > 1
+  { EXIT_IBUTTON_DATA_PIN, { EXIT_SERVO_PIN, SERVO_OPEN_ANGLE, SERVO_CLOSE_ANGLE, EXIT_BUZZER_PIN }, LANE_ROLE_EXIT },
+#endif
+};
+
 // --- WiFi Configuration ---
 const char *WIFI_SSID = "ssid";
 const char *WIFI_PASSWORD = "password";
@@ -34,19 +76,45 @@ MQTTConfig mqtt_settings = {
   "broker.emqx.io",          // Broker host
   1883,                      // Broker port
   "juanliz-sparking-",       // Client ID prefix (ESP MAC part will be added)
-  "juanliz-sparking-esp32/"  // Base topic prefix
+  "juanliz-sparking-esp32/",  // Base topic prefix
+  false                       // Payloads: false = JSON, true = CBOR (para enlaces con datos medidos)
 };
 const char *ESP32_DEVICE_ID = "ESP32_Parking_01";  // Unique ID for this device
 
-// --- Global Objects ---
-Servo gateServo;
+// --- Load Simulation ('s' command) ---
+// A day of traffic against this lot's capacity, gate timing and 2FA timeout
+LotSimConfig lot_sim_settings = {
+  24UL * 3600,                 // Simulated seconds
+  30,                          // Arrivals per hour
+  120,                         // Mean stay (minutes)
+  TOTAL_PARKING_SPACES,
+  80,                          // % of entries needing 2FA
+  95,                          // % of 2FA requests approved
+  8000,                        // Mean time to answer on the phone (ms)
+  TWO_FA_TIMEOUT_DURATION_MS,
+  1500,                        // Scan (ms)
+  GATE_OPEN_DELAY_MS + 2000,   // Gate cycle: hold plus opening and closing (ms)
+  PARKING_LANES,
+  SCAN_BATCH_EVENTS,
+  SCAN_BATCH_MAX_AGE_MS,
+  12345                        // Seed
+};
 
+// --- Global Objects ---
 byte current_ibutton_id[IBUTTON_ID_LEN];              // Buffer for the currently read iButton ID
+uint32_t current_touch_us = 0;                        // micros() of that read, start of its latency trace
 uint32_t last_associated_id = INVALID_ASSOCIATED_ID;  // Store associated ID of authenticated iButton
 
+uint8_t current_lane = 0;                             // Lane where current_ibutton_id was read
+
 uint32_t current_occupancy = 0;                // RAM variable for current count
-byte last_scanned_id[IBUTTON_ID_LEN] = { 0 };  // Track last scanned ID for cooldown
-unsigned long last_scan_timestamp = 0;         // Track last scan time for cooldown
+
+// Per-lane state
+struct LaneState {
+  bool scan_holdoff_active;  // Set after a processed scan, see SCAN_HOLDOFF_MS
+  unsigned long scan_holdoff_start_ms;
+};
+LaneState lane_states[PARKING_LANES];
 
 // --- States for Serial Control ---
 enum ControlState {
@@ -57,72 +125,112 @@ enum ControlState {
 ControlState currentState = IDLE;
 
 // --- Helper Functions ---
-void openGate() {
-  Serial.println("Opening gate...");
+// Gate and buzzer sequences run in actuator_manager and are advanced from loop(),
+// so none of these helpers block.
+LaneRole laneRole(uint8_t lane) {
+  return PARKING_LANES == 1 ? LANE_ROLE_BOTH : lane_settings[lane].role;
+}
+
+void openGate(uint8_t lane) {
+  Serial.printf("Opening gate of lane %u...\n", lane);
   lcdPrintTemporary("Abriendo...", "", 1000);  // Mensaje temporal en LCD
-  // Single beep for success
-  digitalWrite(BUZZER_PIN, HIGH);
-  delay(BEEP_DURATION_MS);
-  digitalWrite(BUZZER_PIN, LOW);
+  buzzerPlay(1, BEEP_DURATION_MS, 0, lane);    // Single beep for success
+  gateOpenFor(GATE_OPEN_DELAY_MS, lane);       // Closes by itself after the delay
+}
 
-  gateServo.write(SERVO_OPEN_ANGLE);
+void intermitentBeep(uint8_t lane) {
+  // Intermittent beep for rejection
+  buzzerPlay(REJECT_BEEP_COUNT, REJECT_BEEP_DURATION_MS, REJECT_PAUSE_MS, lane);
 }
 
-void closeGate() {
-  Serial.println("Closing gate...");
-  gateServo.write(SERVO_CLOSE_ANGLE);
+// Starts the post-scan hold-off of current_lane (used to be a blocking delay(1500))
+void startScanHoldoff() {
+  lane_states[current_lane].scan_holdoff_active = true;
+  lane_states[current_lane].scan_holdoff_start_ms = millis();
 }
 
-void intermitentBeep() {
-  // Intermittent beep for rejection
-  for (int i = 0; i < REJECT_BEEP_COUNT; i++) {
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(REJECT_BEEP_DURATION_MS);
-    digitalWrite(BUZZER_PIN, LOW);
-    // Don't pause after the last beep
-    if (i < REJECT_BEEP_COUNT - 1) {
-      delay(REJECT_PAUSE_MS);
+// Takes the next touch from the reader task, skipping touches on lanes whose post-scan
+// hold-off is still running. Sets current_lane and current_touch_us.
+bool readIButtonIfReady(byte* id_buffer) {
+  uint8_t lane;
+  while (popScannedIButton(id_buffer, nullptr, &current_touch_us, &lane)) {
+    if (lane >= PARKING_LANES) continue;
+    LaneState& state = lane_states[lane];
+    if (state.scan_holdoff_active) {
+      if (millis() - state.scan_holdoff_start_ms < SCAN_HOLDOFF_MS) {
+        continue;  // Touches during the hold-off are ignored, as before
+      }
+      state.scan_holdoff_active = false;
     }
+    current_lane = lane;
+    accessMetricSince(ACCESS_STAGE_QUEUE, current_touch_us);
+    return true;
   }
+  return false;
 }
 
 
-void processEntry(IButtonRecord &record, int record_idx) {
-  unsigned long entry_time = millis();  // For cooldown
+// Adds a scan to the telemetry batch
+void recordScan(const byte* ibutton_id, uint8_t lane, bool is_registered, uint32_t associated_id,
+                ScanOutcome outcome) {
+  scanTelemetryRecord(ibutton_id, is_registered, associated_id, lane, outcome);
+}
+
+// Same, for the scan in current_ibutton_id
+void recordScan(bool is_registered, uint32_t associated_id, ScanOutcome outcome) {
+  recordScan(current_ibutton_id, current_lane, is_registered, associated_id, outcome);
+}
+
+
+// touch_us: micros() of the scan that started this access (0 if unknown), for the latency trace
+// lane: lane whose gate opens
+// Returns false if the lot was full and the gate stayed closed
+bool processEntry(IButtonRecord &record, int record_idx, uint32_t touch_us, uint8_t lane) {
+  uint32_t gate_start_us = micros();
   if (current_occupancy < TOTAL_PARKING_SPACES) {
     Serial.println("Space available. Opening gate for entry.");
-    openGate();
+    openGate(lane);
+    accessMetricSince(ACCESS_STAGE_TOTAL, touch_us);
     current_occupancy++;
     record.is_inside = true;
-    if (updateIButtonRecord(record_idx, record) && writeOccupancyCount(current_occupancy)) {
+    // Record flag and counter reach flash in one commit, so they always agree
+    beginRegistryTransaction();
+    if (updateIButtonRecord(record_idx, record) && writeOccupancyCount(current_occupancy)
+        && commitRegistryTransaction()) {
       Serial.println("Entry successful. Record and count updated.");
-      if (isMQTTConnected()) {  // NUEVO: Publicar estado actualizado
-        publishStatus(true, current_occupancy, TOTAL_PARKING_SPACES);
+      if (isMQTTConnected()) {  // El estado MQTT lo publica loopMQTTManager() si cambió
         lcdPrintTemporary("Acceso Concedido", "Bienvenido!", 2000);
       }
     } else {
+      abortRegistryTransaction();  // No-op if the failed commit already rolled back
       Serial.println("Error: Failed to update record/occupancy for entry. Reverting RAM.");
-      lcdPrintTemporary("Error Guardado", "Intente de nuevo", 2000);
+      lcdPrintTemporary("Error Guardado", "Intente de nuevo", 2000, "", "", LCD_PRIORITY_HIGH);
       current_occupancy--;       // Revert RAM
       record.is_inside = false;  // Revert RAM
-                                 // Note: EEPROM might be inconsistent if one write failed.
     }
-    delay(GATE_OPEN_DELAY_MS);
-    closeGate();
-    memcpy(last_scanned_id, record.ibutton_id, IBUTTON_ID_LEN);  // Use record's ID
-    last_scan_timestamp = entry_time;                            // Use the time of entry attempt
-  } else {
-    Serial.println("Parking FULL. Entry denied.");
-    lcdPrintTemporary("Parking LLENO", "Acceso Denegado", 3000);
-    intermitentBeep();
+    scanCooldownStart(record.ibutton_id, IBUTTON_COOLDOWN_MS, record.associated_id);
+    accessMetricSince(ACCESS_STAGE_GATE, gate_start_us);
+    return true;
   }
+  Serial.println("Parking FULL. Entry denied.");
+  lcdPrintTemporary("Parking LLENO", "Acceso Denegado", 3000);
+  intermitentBeep(lane);
+  return false;
 }
 
 
-void processExit(IButtonRecord &record, int record_idx) {
-  unsigned long exit_time = millis();  // For cooldown
+void processExit(IButtonRecord &record, int record_idx, uint32_t touch_us, uint8_t lane) {
+  uint32_t gate_start_us = micros();
   Serial.println("Attempting EXIT. Opening gate.");
-  openGate();
+  openGate(lane);
+  accessMetricSince(ACCESS_STAGE_TOTAL, touch_us);
+
+  if (!record.is_inside) {
+    // Only on a dedicated exit lane: never trap a car, but the count was not raised for it
+    Serial.println("Warning: iButton was not marked inside (missed entry?). Occupancy unchanged.");
+    scanCooldownStart(record.ibutton_id, IBUTTON_COOLDOWN_MS, record.associated_id);
+    return;
+  }
 
   if (current_occupancy > 0) {
     current_occupancy--;
@@ -131,26 +239,22 @@ void processExit(IButtonRecord &record, int record_idx) {
   }
   record.is_inside = false;
 
-  if (updateIButtonRecord(record_idx, record)) {
-    if (writeOccupancyCount(current_occupancy)) {
-      Serial.println("Exit successful. Record and count updated.");
-      if (isMQTTConnected()) {  // NUEVO: Publicar estado actualizado
-        publishStatus(true, current_occupancy, TOTAL_PARKING_SPACES);
-        lcdPrintTemporary("Salida Exitosa", "Hasta Luego!", 2000);
-      }
-    } else {
-      Serial.println("Error: Failed to update occupancy count after record update for exit. Record updated.");
-      // RAM count was already decremented.
+  // Record flag and counter reach flash in one commit, so they always agree
+  beginRegistryTransaction();
+  if (updateIButtonRecord(record_idx, record) && writeOccupancyCount(current_occupancy)
+      && commitRegistryTransaction()) {
+    Serial.println("Exit successful. Record and count updated.");
+    if (isMQTTConnected()) {  // El estado MQTT lo publica loopMQTTManager() si cambió
+      lcdPrintTemporary("Salida Exitosa", "Hasta Luego!", 2000);
     }
   } else {
-    Serial.println("Error: Failed to update iButton record for exit. Reverting RAM occupancy.");
-    if (current_occupancy < TOTAL_PARKING_SPACES) current_occupancy++;  // Revert RAM count if possible
-                                                                        // record.is_inside remains false in RAM, but EEPROM is not updated.
+    abortRegistryTransaction();  // No-op if the failed commit already rolled back
+    Serial.println("Error: Failed to update record/occupancy for exit. Reverting RAM occupancy.");
+    current_occupancy = readOccupancyCount();  // Store was rolled back to the previous count
+    record.is_inside = true;
   }
-  delay(GATE_OPEN_DELAY_MS);
-  closeGate();
-  memcpy(last_scanned_id, record.ibutton_id, IBUTTON_ID_LEN);  // Use record's ID
-  last_scan_timestamp = exit_time;                             // Use the time of exit attempt
+  scanCooldownStart(record.ibutton_id, IBUTTON_COOLDOWN_MS, record.associated_id);
+  accessMetricSince(ACCESS_STAGE_GATE, gate_start_us);
 }
 
 void handleSerialCommands() {
@@ -176,6 +280,40 @@ void handleSerialCommands() {
         printAllRegisteredIButtons();  // Call the function from the manager
         break;
 
+      case 'm':  // Access latency histograms and requests dropped by the full queues
+        printAccessMetrics();
+        Serial.printf("Dropped: %u scans (reader queue), %u LCD requests (renderer queue)\n",
+                      getScanQueueDropCount(), getLCDDropCount());
+        break;
+
+      case 'z':  // Start a new latency window, e.g. before a test session
+        resetAccessMetrics();
+        Serial.println("\nAccess latency histograms cleared.");
+        break;
+
+      case 's': {  // Parking lot load simulation (virtual clock, does not touch the registry)
+        // Same traffic with one shared lane and with separate entry and exit lanes
+        LotSimConfig sim_config = lot_sim_settings;
+        LotSimResult sim_result;
+        for (uint8_t lanes = 1; lanes <= 2; lanes++) {
+          sim_config.lanes = lanes;
+          unsigned long sim_start_ms = millis();
+          runLotSimulation(sim_config, sim_result);
+          printLotSimulation(sim_config, sim_result);
+          Serial.printf("Simulation ran in %lu ms.\n", millis() - sim_start_ms);
+        }
+        break;
+      }
+
+      case 'b':  // Registry benchmark, CSV rows on Serial (changes are rolled back)
+        runRegistryBenchmark();
+        runRegistryTransferBenchmark();  // Export/import chunks de 10k registros, sin red
+        break;
+
+      case 'p':  // MQTT payload benchmark, JSON vs CBOR, CSV rows on Serial
+        runPayloadBenchmark();
+        break;
+
       case 'c':  // Cancel current operation
         Serial.println("\nCurrent operation cancelled. Returning to Idle mode.");
         currentState = IDLE;
@@ -183,53 +321,38 @@ void handleSerialCommands() {
 
       default:
         Serial.println("\nUnknown command.");
-        Serial.println("Available commands: 'r' (register), 'd' (delete), 'l' (list), 'c' (cancel).");
+        Serial.println("Available commands: 'r' (register), 'd' (delete), 'l' (list), 'm' (metrics), 'z' (reset metrics), 's' (simulate), 'b' (registry benchmark), 'p' (payload benchmark), 'c' (cancel).");
         break;
     }
     // Prompt for next action if idle
     if (currentState == IDLE) {
-      Serial.print("\nSystem Idle. Present iButton or enter command (r,d,l,c): ");
+      Serial.print("\nSystem Idle. Present iButton or enter command (r,d,l,m,z,s,b,p,c): ");
     }
   }
 }
 
 // --- Setup ---
+// Boot is staged so the gate can read cards as early as possible: the registry and the
+// reader come up in setup(); the network and the LCD follow as deferred stages run from
+// the first passes of loop(). Each stage is timestamped (see boot_timeline).
+enum BootStage {
+  BOOT_STAGE_NETWORK,
+  BOOT_STAGE_LCD,
+  BOOT_STAGE_DONE
+};
+BootStage boot_stage = BOOT_STAGE_NETWORK;
+
 void setup() {
-  // NUEVO: Iniciar Serial con timeout
-  Serial.begin(115200);
-  unsigned long serial_timeout_start = millis();
-  while (!Serial && (millis() - serial_timeout_start < 2000)) {  // Espera hasta 2 segundos
-    // Puedes dejar este bucle vacío o parpadear un LED si tienes uno para indicar espera
-    delay(10);
-  }
-  delay(1500);
+  Serial.begin(115200);  // UART: no need to wait for a host to attach
   Serial.println("\n--- ESP32 Smart Parking System ---");
 
   // Initialize the iButton Manager, passing configuration
-  setupIButtonManager(IBUTTON_DATA_PIN, MAX_REGISTERED_IBUTTONS);
-
-  // Initialize Servo
-  gateServo.attach(SERVO_PIN);
-  closeGate();  // Ensure gate starts closed
-
-  // Initialize Buzzer pin
-  pinMode(BUZZER_PIN, OUTPUT);
-  digitalWrite(BUZZER_PIN, LOW);  // Ensure buzzer is off initially
-
-  // NUEVO: Inicializar LCD Manager
-  if (setupLCDManager()) {  // Usa pines por defecto 21, 22
-    Serial.println("LCD Manager Initialized.");
-    lcdDisplayWelcome();  // Mostrar mensaje de bienvenida inicial
-    delay(2000);          // Mostrar bienvenida por un momento
-  } else {
-    Serial.println("LCD Manager Initialization FAILED.");
-    // Puedes decidir qué hacer si la LCD falla, por ahora el programa continúa
+  setupIButtonManager(lane_settings[0].reader_pin, MAX_REGISTERED_IBUTTONS);
+  setupScanTelemetry(scan_telemetry_settings);
+  for (uint8_t lane = 1; lane < PARKING_LANES; lane++) {
+    addIButtonReader(lane_settings[lane].reader_pin);
   }
 
-
-  // Initialize WiFi
-  setupMQTTManager(mqtt_settings, WIFI_SSID, WIFI_PASSWORD);
-
   // Read initial occupancy count
   current_occupancy = readOccupancyCount();
   // Optional: Add validation against TOTAL_PARKING_SPACES here
@@ -240,101 +363,114 @@ void setup() {
     current_occupancy = 0;
     writeOccupancyCount(current_occupancy);  // Save the reset value
   }
+  bootMark("registry");
+
+  // Initialize Servo and Buzzer (gate starts closed, buzzer off)
+  setupActuatorManager(lane_settings[0].actuators);
+  for (uint8_t lane = 1; lane < PARKING_LANES; lane++) {
+    addActuatorLane(lane_settings[lane].actuators);
+  }
+  bootMark("actuators");
+
+  // Card detection runs on its own task from here on
+  if (!startIButtonReaderTask()) {
+    Serial.println("FATAL: iButton reader task could not be started!");
+  }
+  bootMarkScanReady();
 
   Serial.printf("System ready. Total Spaces: %d, Current Occupancy: %u\n", TOTAL_PARKING_SPACES, current_occupancy);
-  printAllRegisteredIButtons();
-  Serial.print("\nPresent iButton or enter command (r,d,l,c): ");
-  lcdDisplayOccupancy(current_occupancy, TOTAL_PARKING_SPACES);
+  Serial.print("\nPresent iButton or enter command (r,d,l,m,s,b,p,c): ");
+}
+
+// Runs one deferred boot stage per call; called from loop() until boot is done
+void runDeferredBootStage() {
+  switch (boot_stage) {
+    case BOOT_STAGE_NETWORK:
+      // Non-blocking: WiFi and MQTT connect in the background from loopMQTTManager()
+      setupMQTTManager(mqtt_settings, WIFI_SSID, WIFI_PASSWORD);
+      bootMark("network");
+      boot_stage = BOOT_STAGE_LCD;
+      break;
+
+    case BOOT_STAGE_LCD:
+      if (setupLCDManager()) {  // Usa pines por defecto 21, 22
+        Serial.println("LCD Manager Initialized.");
+        lcdDisplayOccupancy(current_occupancy, TOTAL_PARKING_SPACES);
+        lcdPrintTemporary(" Smart Parking ", "  Bienvenido!  ", 2000, "", "", LCD_PRIORITY_LOW);  // Cualquier aviso la reemplaza
+      } else {
+        Serial.println("LCD Manager Initialization FAILED.");
+        // Puedes decidir qué hacer si la LCD falla, por ahora el programa continúa
+      }
+      bootMark("lcd");
+      boot_stage = BOOT_STAGE_DONE;
+      printBootTimeline();
+      publishBootReport();  // Queued until the broker is reachable
+      break;
+
+    case BOOT_STAGE_DONE:
+      break;
+  }
 }
 
 // --- Main Loop ---
 void loop() {
+  if (boot_stage != BOOT_STAGE_DONE) {
+    runDeferredBootStage();
+  }
   // 1. Handle commands from Serial Monitor
   handleSerialCommands();
+  loopActuatorManager();  // Advance gate and buzzer sequences
   // 2. Handle MQTT connection and messages
+  reportStatus(current_occupancy, TOTAL_PARKING_SPACES);  // Solo compara; se publica si cambió
   loopMQTTManager();  // Procesa MQTT. Puede:
-                      // - Llamar callback -> setear two_fa_granted (si respuesta llega)
-                      // - Expirar timeout -> setear two_fa_granted=false y clear2FA_WaitingState() (si tiempo pasa)
+                      // - Llamar callback -> resolver una sesión 2FA (si respuesta llega)
+                      // - Expirar timeout -> marcar la sesión como TIMED OUT (si tiempo pasa)
 
   loopLCDManager(current_occupancy, TOTAL_PARKING_SPACES);
 
-  static bool mqtt_just_connected = false;
-  static bool last_mqtt_connected_state = false;
-
-  if (isMQTTConnected() && !last_mqtt_connected_state) {
-    mqtt_just_connected = true;  // Marcamos que acabamos de conectar
-  }
-  last_mqtt_connected_state = isMQTTConnected();
-
-  if (mqtt_just_connected) {
-    Serial.println("MQTT just connected (or reconnected). Publishing status...");
-    publishStatus(true, current_occupancy, TOTAL_PARKING_SPACES);
-    mqtt_just_connected = false;  // Resetear el flag
-  }
-
   // --- PROACTIVE CHECK for 2FA Result ---
-  static bool was_waiting_before = false;  // Static variable to track previous waiting state
-
-  if (isWaitingFor2FA()) {
-    // Aún estamos esperando. ¿Llegó una respuesta CONCEDIDA?
-    if (get2FA_GrantStatus()) {  // Si get2FA_GrantStatus() es true, el callback la puso así.
-      Serial.println("PROACTIVE CHECK: 2FA Granted via callback. Proceeding with entry.");
-      byte ibutton_id_for_2fa_entry[IBUTTON_ID_LEN];
-      String stored_ib_str = get2FA_iButtonId_Str();
-      bool conversion_ok = false;
-
-      if (stored_ib_str.length() == IBUTTON_ID_LEN * 2) {
-        for (int i = 0; i < IBUTTON_ID_LEN; i++) {
-          char hex_pair[3] = { stored_ib_str.charAt(i * 2), stored_ib_str.charAt(i * 2 + 1), '\0' };
-          ibutton_id_for_2fa_entry[i] = strtol(hex_pair, nullptr, 16);
-        }
-        conversion_ok = true;
-      }
-
-      if (conversion_ok) {
-        IButtonRecord record_for_entry;
-        int record_idx_for_entry;
-        if (getIButtonRecord(ibutton_id_for_2fa_entry, record_for_entry, &record_idx_for_entry)) {
-          if (!record_for_entry.is_inside) {
-            Serial.println("Proactive 2FA Grant: Executing entry.");
-            processEntry(record_for_entry, record_idx_for_entry);  // Use helper
-          } else {
-            Serial.println("Proactive 2FA Grant: iButton already inside?");
-          }
+  // Each pending request resolves on its own (grant, denial or timeout); handle all that did.
+  byte resolved_2fa_id[IBUTTON_ID_LEN];
+  TwoFAStatus resolved_2fa_status;
+  uint32_t resolved_touch_us;
+  uint8_t resolved_lane;
+  while (takeResolved2FA(resolved_2fa_id, resolved_2fa_status, &resolved_touch_us, &resolved_lane)) {
+    String resolved_id_str = ibuttonBytesToHexString(resolved_2fa_id);
+    IButtonRecord resolved_record;
+    int resolved_record_idx;
+    bool resolved_is_registered = getIButtonRecord(resolved_2fa_id, resolved_record, &resolved_record_idx);
+    uint32_t resolved_associated_id = resolved_is_registered ? resolved_record.associated_id : INVALID_ASSOCIATED_ID;
+    if (resolved_2fa_status == TWO_FA_GRANTED) {
+      Serial.println("PROACTIVE CHECK: 2FA Granted for " + resolved_id_str + ". Proceeding with entry.");
+      if (resolved_is_registered) {
+        cacheTwoFAGrant(resolved_record);  // Only has an effect with the grant window policy
+        if (!resolved_record.is_inside) {
+          Serial.println("Proactive 2FA Grant: Executing entry.");
+          bool entered = processEntry(resolved_record, resolved_record_idx, resolved_touch_us, resolved_lane);
+          recordScan(resolved_2fa_id, resolved_lane, true, resolved_associated_id,
+                     entered ? SCAN_OUTCOME_2FA_ENTRY : SCAN_OUTCOME_FULL);
         } else {
-          Serial.println("Proactive 2FA Grant: Could not find record for granted ID!");
+          Serial.println("Proactive 2FA Grant: iButton already inside?");
+          recordScan(resolved_2fa_id, resolved_lane, true, resolved_associated_id, SCAN_OUTCOME_ALREADY_INSIDE);
         }
-      } else {
-        Serial.println("Proactive 2FA Grant: Error converting stored ID.");
+      } else {  // Deleted while the request was pending
+        Serial.println("Proactive 2FA Grant: Could not find record for granted ID!");
+        recordScan(resolved_2fa_id, resolved_lane, false, INVALID_ASSOCIATED_ID, SCAN_OUTCOME_UNREGISTERED);
       }
-
-      clear2FA_WaitingState();
-      reset2FA_GrantStatus();
-      currentState = IDLE;
-    }
-    // If still waiting and not granted, do nothing here, let timeout or next scan handle.
-    was_waiting_before = true;  // Update static state: we are currently waiting
-  } else {
-    // This could be due to:
-    // 1. Timeout in loopMQTTManager() (set isWaitingFor2FA=false, two_fa_granted=false).
-    // 2. Granted logic above executed (set isWaitingFor2FA=false, two_fa_granted=false).
-    // 3. 2FA was never initiated.
-
-    if (was_waiting_before) {  // Transition: Was waiting in a previous iteration, now not.
-                               // And we didn't enter the get2FA_GrantStatus() block above.
-                               // So, this means the 2FA process ended due to DENIAL or TIMEOUT.
-      Serial.println("PROACTIVE CHECK: 2FA process finished (DENIED or TIMEOUT). Entry aborted.");
-      // intermitentBeep();
-      reset2FA_GrantStatus();  // Ensure grant flag is false (timeout already does this)
-      currentState = IDLE;
+    } else {
+      bool denied = resolved_2fa_status == TWO_FA_DENIED;
+      Serial.printf("PROACTIVE CHECK: 2FA for %s %s. Entry aborted.\n", resolved_id_str.c_str(),
+                    denied ? "DENIED" : "TIMED OUT");
+      recordScan(resolved_2fa_id, resolved_lane, resolved_is_registered, resolved_associated_id,
+                 denied ? SCAN_OUTCOME_2FA_DENIED : SCAN_OUTCOME_2FA_TIMEOUT);
     }
-    was_waiting_before = false;  // Update static state: we are not currently waiting
+    currentState = IDLE;
   }
   // --- End PROACTIVE CHECK ---
 
   // --- Handle MQTT-driven pairing first if active ---
   if (isPairingModeActive()) {
-    if (readIButton(current_ibutton_id)) {  // iButton presented during pairing
+    if (readIButtonIfReady(current_ibutton_id)) {  // iButton presented during pairing
       Serial.print("\niButton detected during MQTT Pairing Mode for session: ");
       Serial.println(getCurrentPairingSessionId());
       printIButtonID(current_ibutton_id);
@@ -363,7 +499,7 @@ void loop() {
       clearPairingMode();   // Important: clear pairing mode in MQTT manager
       currentState = IDLE;  // Ensure local state machine is also IDLE
 
-      delay(1500);
+      startScanHoldoff();
     }
     // No iButton yet, or pairing timed out (handled in mqtt_manager.loopMQTTManager)
     delay(50);  // Small delay when in pairing mode waiting for iButton
@@ -373,7 +509,7 @@ void loop() {
 
   // --- NUEVO: Handle MQTT-driven iButton Deletion ---
   if (isDeleteIButtonModeActive()) {
-    if (readIButton(current_ibutton_id)) {
+    if (readIButtonIfReady(current_ibutton_id)) {
       Serial.print("\niButton detected during MQTT Delete Mode: ");
       printIButtonID(current_ibutton_id);
       Serial.println();
@@ -390,7 +526,7 @@ void loop() {
       }
       clearDeleteIButtonMode();  // Salir del modo borrado después del intento
       currentState = IDLE;       // Asegurar estado IDLE local
-      delay(1500);               // Delay para evitar re-lectura inmediata
+      startScanHoldoff();        // Evitar re-lectura inmediata sin bloquear el loop
                                  // No necesitamos un 'return' aquí, el resto del loop se saltará o el cooldown actuará
     }
     // Si no se lee un iButton, el timeout en loopMQTTManager() eventualmente lo manejará.
@@ -401,31 +537,29 @@ void loop() {
   }
   // --- END Handle MQTT-driven iButton Deletion ---
 
-  // if (readIButton(current_ibutton_id)) {
-  if (readIButton(current_ibutton_id) && !isDeleteIButtonModeActive() && !isPairingModeActive()) {
-    unsigned long now = millis();
-    bool cooldown_active = false;
-
-    // Publish every scan event (before cooldown or other logic)
-    // We need to know if it's registered to send complete info
-    IButtonRecord temp_scan_record;
-    bool scanned_is_registered = getIButtonRecord(current_ibutton_id, temp_scan_record);
-    publishIButtonScanned(current_ibutton_id, scanned_is_registered, scanned_is_registered ? temp_scan_record.associated_id : 0);
-
+  // Mode checks come first so a touch meant for another mode is not consumed here
+  if (!isDeleteIButtonModeActive() && !isPairingModeActive() && readIButtonIfReady(current_ibutton_id)) {
     // --- Cooldown Check ---
-    // If the same button is scanned within the cooldown period
-    // after a successful entrance or exit, ignore the scan.
-    // This prevents double scans from being processed for occupancy counter
-    if (memcmp(current_ibutton_id, last_scanned_id, IBUTTON_ID_LEN) == 0) {  // Same iButton?
-      if (now - last_scan_timestamp < IBUTTON_COOLDOWN_MS) {
-        cooldown_active = true;
-        Serial.print("\nCooldown active for iButton: ");
-        printIButtonID(current_ibutton_id);
-        Serial.println(". Scan ignored.");
-      }
+    // An iButton that just went in or out is ignored for IBUTTON_COOLDOWN_MS, before any
+    // registry lookup or MQTT publish. Every recent iButton has its own entry, so drivers
+    // alternating at the reader cannot double-count occupancy.
+    uint32_t cooldown_associated_id = INVALID_ASSOCIATED_ID;
+    bool cooldown_active = scanCooldownActive(current_ibutton_id, &cooldown_associated_id);
+    if (cooldown_active) {
+      Serial.print("\nCooldown active for iButton: ");
+      printIButtonID(current_ibutton_id);
+      Serial.println(". Scan ignored.");
+      // Only iButtons that just went in or out are in cooldown; the entry carries their ID
+      recordScan(true, cooldown_associated_id, SCAN_OUTCOME_COOLDOWN);
     }
 
     if (!cooldown_active) {
+      // Every scan goes to the telemetry batch with its outcome, once it is known, and with
+      // the record as it is after the action (a registration has an ID, a deletion none)
+      bool scanned_is_registered = false;
+      uint32_t scanned_associated_id = INVALID_ASSOCIATED_ID;
+      ScanOutcome scan_outcome = SCAN_OUTCOME_UNREGISTERED;
+
       Serial.print("\niButton detected: ");
       printIButtonID(current_ibutton_id);
       Serial.println();
@@ -433,30 +567,39 @@ void loop() {
       switch (currentState) {
         case WAITING_FOR_IBUTTON_TO_REGISTER:
           if (registerIButton(current_ibutton_id)) {
+            scan_outcome = SCAN_OUTCOME_REGISTERED;
             Serial.println("iButton registered successfully.");
             lcdPrintTemporary("iButton Reg.", "Exitoso!", 2000);
             printAllRegisteredIButtons();  // Show updated list
           } else {
+            scan_outcome = SCAN_OUTCOME_REGISTER_FAILED;
             Serial.println("Failed to register iButton (maybe already exists, EEPROM full, or ID generation issue?).");
             lcdPrintTemporary("Fallo Registro", "Ya existe?", 2000);
           }
           currentState = IDLE;  // Return to idle state
-          Serial.print("\nSystem Idle. Present iButton or enter command (r,d,l,c): ");
+          {
+            IButtonRecord registered_record;
+            scanned_is_registered = getIButtonRecord(current_ibutton_id, registered_record);
+            if (scanned_is_registered) scanned_associated_id = registered_record.associated_id;
+          }
+          Serial.print("\nSystem Idle. Present iButton or enter command (r,d,l,m,s,b,p,c): ");
           break;
 
         case WAITING_FOR_IBUTTON_TO_DELETE:
           if (deleteIButton(current_ibutton_id)) {
+            scan_outcome = SCAN_OUTCOME_DELETED;
             Serial.println("iButton deleted successfully.");
             lcdPrintTemporary("iButton Borrado", "Exitoso!", 2000);
             current_occupancy = readOccupancyCount();
             printAllRegisteredIButtons();
           } else {
+            scan_outcome = SCAN_OUTCOME_DELETE_FAILED;
             Serial.println("Failed to delete iButton (was not found).");
             lcdPrintTemporary("Fallo Borrado", "No encontrado?", 2000);
           }
-          currentState = IDLE;
+          currentState = IDLE;  // Either way the iButton is no longer registered
           Serial.printf(
-            "\nSystem Idle. Occupancy: %u/%d. Present iButton or enter command (r,d,l,c): ",
+            "\nSystem Idle. Occupancy: %u/%d. Present iButton or enter command (r,d,l,m,s,b,p,c): ",
             current_occupancy,
             TOTAL_PARKING_SPACES);
           break;
@@ -465,42 +608,63 @@ void loop() {
         default:
           IButtonRecord current_record;
           int record_idx;
+          uint32_t lookup_start_us = micros();
+          bool found = getIButtonRecord(current_ibutton_id, current_record, &record_idx);
+          accessMetricSince(ACCESS_STAGE_LOOKUP, lookup_start_us);
 
-          if (getIButtonRecord(current_ibutton_id, current_record, &record_idx)) {
+          if (found) {
             last_associated_id = current_record.associated_id;
+            scanned_is_registered = true;
+            scanned_associated_id = current_record.associated_id;
 
             Serial.print("iButton AUTHENTICATED. AssocID: ");
             Serial.print(last_associated_id);
             Serial.printf(". Currently Inside: %s\n", current_record.is_inside ? "YES" : "NO");
 
-            bool is_2fa_globally_required = true;  // TODO: Make this configurable
-
-            if (!current_record.is_inside) {  // Attempting ENTRY
-              if (current_occupancy >= TOTAL_PARKING_SPACES) {
+            bool is_2fa_required = isTwoFARequired(current_record);  // Política del iButton y caché de aprobaciones
+            // A shared lane guesses the direction from is_inside; dedicated lanes know it
+            LaneRole role = laneRole(current_lane);
+            bool wants_entry = role == LANE_ROLE_ENTRY || (role == LANE_ROLE_BOTH && !current_record.is_inside);
+
+            if (wants_entry) {  // Attempting ENTRY
+              if (current_record.is_inside) {  // Only on a dedicated entry lane
+                scan_outcome = SCAN_OUTCOME_ALREADY_INSIDE;
+                Serial.println("Entry lane: iButton already marked inside (missed exit?). Entry denied.");
+                lcdPrintTemporary("Ya esta dentro", "Acceso Denegado", 3000);
+                intermitentBeep(current_lane);
+              } else if (current_occupancy >= TOTAL_PARKING_SPACES) {
+                scan_outcome = SCAN_OUTCOME_FULL;
                 Serial.println("Parking FULL. Entry denied BEFORE 2FA or direct entry.");
                 lcdPrintTemporary("Parking LLENO", "Acceso Denegado", 3000);
-                intermitentBeep();
+                intermitentBeep(current_lane);
               } else {
-                if (is_2fa_globally_required) {  // 2FA is required for entry
-                  if (!isWaitingFor2FA()) {      // And no 2FA request is pending for ANY iButton
-                    Serial.println("Attempting ENTRY, 2FA required. Sending request...");
-                    lcdPrint("Esperando 2FA", "App Movil...");
-                    publish2FARequest(current_ibutton_id, current_record.associated_id, ESP32_DEVICE_ID);
-                    // publish2FARequest sets isWaitingFor2FA()=true and starts timer
+                if (is_2fa_required) {  // 2FA is required for entry
+                  if (is2FAPending(current_ibutton_id)) {  // This iButton already has a request in flight
+                    scan_outcome = SCAN_OUTCOME_2FA_PENDING;
+                    Serial.println("Attempting ENTRY, 2FA already requested for this iButton. Still waiting.");
+                    lcdPrintTemporary("Esperando 2FA", "App Movil...", 2000);
+                  } else if (publish2FARequest(current_ibutton_id, current_record.associated_id, ESP32_DEVICE_ID,
+                                               current_touch_us, current_lane)) {
+                    // Other drivers can keep scanning while this request is pending
+                    scan_outcome = SCAN_OUTCOME_2FA_REQUESTED;
+                    Serial.println("Attempting ENTRY, 2FA required. Request sent.");
+                    lcdPrintTemporary("Esperando 2FA", "App Movil...", 3000);
                     Serial.println("Awaiting 2FA confirmation. Gate remains closed. Scan again or wait for proactive check.");
-                    // Do not proceed with action here, wait for proactive check or next scan
-                  } else {  // Attempting entry, 2FA required, BUT another 2FA is already pending
-                    Serial.println("Attempting ENTRY, 2FA required, but another 2FA request is already pending. Please wait.");
-                    intermitentBeep();  // Indicate busy or waiting for other 2FA
+                  } else {  // Session table full or publish failed
+                    scan_outcome = SCAN_OUTCOME_2FA_FAILED;
+                    Serial.println("Attempting ENTRY, 2FA required, but the request could not be sent. Please retry.");
+                    intermitentBeep(current_lane);
                   }
                 } else {  // 2FA is NOT required for entry
-                  Serial.println("Attempting DIRECT ENTRY (2FA not globally required).");
-                  processEntry(current_record, record_idx);  // Call helper function for direct entry
+                  Serial.println("Attempting DIRECT ENTRY (2FA not required by policy or recently granted).");
+                  bool entered = processEntry(current_record, record_idx, current_touch_us, current_lane);  // Call helper function for direct entry
+                  scan_outcome = entered ? SCAN_OUTCOME_ENTRY : SCAN_OUTCOME_FULL;
                 }
               }
-            } else {  // Attempting EXIT (assuming scan means exit if inside)
+            } else {  // Attempting EXIT (inside on a shared lane, or any scan on the exit lane)
               Serial.println("Attempting EXIT.");
-              processExit(current_record, record_idx);  // Call helper function for exit
+              processExit(current_record, record_idx, current_touch_us, current_lane);  // Call helper function for exit
+              scan_outcome = SCAN_OUTCOME_EXIT;
             }
             // No 'proceed_with_action' flag needed here anymore as logic is handled by states/helpers
 
@@ -508,16 +672,17 @@ void loop() {
             Serial.println("iButton NOT REGISTERED.");
             lcdPrintTemporary("iButton DESCON.", "Acceso Denegado", 3000);
             last_associated_id = INVALID_ASSOCIATED_ID;
-            intermitentBeep();
+            intermitentBeep(current_lane);
           }
           Serial.printf(
-            "\nSystem Idle. Occupancy: %u/%d. Present iButton or enter command (r,d,l,c): ",
+            "\nSystem Idle. Occupancy: %u/%d. Present iButton or enter command (r,d,l,m,s,b,p,c): ",
             current_occupancy,
             TOTAL_PARKING_SPACES);
           break;
       }
 
-      delay(1500);  // Keep this delay after any non-cooldown iButton processing
+      recordScan(scanned_is_registered, scanned_associated_id, scan_outcome);
+      startScanHoldoff();  // Ignore the reader briefly after any non-cooldown iButton processing
 
     }  // End if (!cooldown_active)
 